@@ -27,6 +27,7 @@
 #define GPARTED_BLOCKSPECIAL_H
 
 #include <glibmm/ustring.h>
+#include <vector>
 
 namespace GParted
 {
@@ -54,6 +55,43 @@ public:
 bool operator==( const BlockSpecial & lhs, const BlockSpecial & rhs );
 bool operator<( const BlockSpecial & lhs, const BlockSpecial & rhs );
 
+// Index of the positions of BlockSpecial objects in a vector of cache entries, so that
+// entries can be looked up without a linear search.  Finds the first object comparing
+// equal using operator==(), so block special files are matched by major, minor device
+// numbers and other files by name.  Implemented as hash tables with chained buckets as
+// the C++98 library has no unordered containers.
+class BlockSpecialIndex
+{
+public:
+	BlockSpecialIndex();
+
+	void clear();
+	void push_back( const BlockSpecial & bs );
+	unsigned int size() const  { return m_size; };
+	bool find( const BlockSpecial & bs, unsigned int & position ) const;
+
+private:
+	struct Entry
+	{
+		BlockSpecial bs;
+		unsigned int position;
+	};
+	typedef std::vector<std::vector<Entry> > Buckets;
+
+	static size_t hash_numbers( unsigned long major, unsigned long minor );
+	static size_t hash_name( const Glib::ustring & name );
+	static const Entry * find_entry( const Buckets & buckets, size_t hash, const BlockSpecial & bs,
+	                                 bool by_number );
+	static void insert( Buckets & buckets, unsigned int & count, size_t hash, const BlockSpecial & bs,
+	                    unsigned int position, bool by_number );
+
+	Buckets m_by_number;
+	Buckets m_by_name;
+	unsigned int m_number_count;  // Entries in m_by_number
+	unsigned int m_name_count;    // Entries in m_by_name
+	unsigned int m_size;
+};
+
 }//GParted
 
 #endif /* GPARTED_BLOCKSPECIAL_H */
@@ -21,12 +21,44 @@
 #include "Utils.h"
 
 #include <glibmm/ustring.h>
+#include <glibmm/thread.h>
+#include <glibmm/timer.h>
 #include <parted/parted.h>
+#include <vector>
 
 namespace GParted {
 
+class CopyTuner;
+class MoveJournal;
+
+enum CopyMethod
+{
+	COPY_METHOD_LIBPARTED = 0,  // Buffered I/O through libparted
+	COPY_METHOD_DIRECT    = 1,  // O_DIRECT I/O bypassing the page cache
+	COPY_METHOD_IO_URING  = 2   // Asynchronous O_DIRECT I/O with many blocks in flight
+};
+
 class CopyBlocks
 {
+	// One buffer in the ring passed from the reader thread to the writer thread.
+	struct Block
+	{
+		char *     buf;
+		bool       huge_page;  // Buffer is mmap()ed huge pages rather than malloc()ed
+		Byte_Value offset;     // Byte offset of the block from the start of the copy
+		Byte_Value length;     // Length of the block in bytes
+		bool       zero;       // Block read contains only zeros
+		Byte_Value skipped;    // Bytes of unused blocks passed over just before this block
+	};
+
+	// How the destination can be zeroed without writing blocks of zeros.
+	enum ZeroOffload
+	{
+		ZERO_OFFLOAD_NONE       = 0,
+		ZERO_OFFLOAD_BLKZEROOUT = 1,  // Block device write zeroes
+		ZERO_OFFLOAD_PUNCH_HOLE = 2   // Deallocate the range of an image file
+	};
+
 	const Glib::ustring & src_device;
 	const Glib::ustring & dst_device;
 	Byte_Value length;
@@ -34,21 +66,72 @@ class CopyBlocks
 	OperationDetail &operationdetail;
 	Byte_Value & total_done;
 	Byte_Value total_length;
-	char *buf;
 	Byte_Value done;
 	PedDevice *lp_device_src;
 	PedDevice *lp_device_dst;
 	Sector offset_src;
 	Sector offset_dst;
+	bool backwards;
 	bool success;
 	Glib::ustring error_message;
 	void copy_thread();
+	void read_thread();
 	bool cancel;
 	bool cancel_safe;
 	void set_cancel( bool force );
-	void copy_block();
+	void set_failed( const Glib::ustring & message );
+	bool next_block( Byte_Value & position, Byte_Value & offset, Byte_Value & len,
+	                 Byte_Value & skipped ) const;
+	bool block_in_use( Byte_Value offset, Byte_Value len ) const;
+	bool read_block( const Block & block );
+	bool write_block( const Block & block );
+	bool open_devices();
+	void close_devices();
+	bool open_direct( const Glib::ustring & path, int flags, int & fd, bool & direct );
+	bool zero_range( Byte_Value byte_offset, Byte_Value byte_count );
+	bool note_written( Byte_Value byte_offset, Byte_Value byte_count );
+	bool sync_written( bool final );
+	bool io_uring_copy();
+	Byte_Value limit_blocksize( Byte_Value size ) const;
+	Byte_Value copy_position( const Block & block ) const;
+	bool needs_checkpoint( const Block & block ) const;
+	bool checkpoint( Byte_Value position );
+	bool alloc_ring();
+	void free_ring();
+
+	CopyMethod method;
+	const std::vector<Extent> * used_extents;  // Sorted ranges in use, or NULL for all
+	CopyTuner * tuner;            // Adjusts blocksize and queue_depth, or NULL for fixed
+	unsigned int queue_depth;     // Maximum blocks in flight when copying using io_uring
+	MoveJournal * journal;        // Records checkpoints of a move, or NULL when not journalled
+	Byte_Value journal_distance;  // Distance moved, which writes can run ahead of a checkpoint
+	Byte_Value checkpointed;      // Copy position of the last checkpoint
+	Glib::Timer checkpoint_timer; // Time since the last checkpoint
+	int fd_src;
+	int fd_dst;
+	bool direct_src;              // Whether fd_src and fd_dst were opened with O_DIRECT
+	bool direct_dst;
+	Byte_Value alignment;         // Buffer alignment required for O_DIRECT
+	bool detect_zeros;            // Whether to check blocks read for only zeros
+	ZeroOffload zero_offload;
+	Byte_Value unsynced_start;    // Byte range of the destination written since the
+	Byte_Value unsynced_end;      // last incremental flush
+
+	std::vector<Block> ring;
+	unsigned int ring_blocks;     // Number of buffers to allocate in the ring
+	Byte_Value buffer_size;
+	unsigned int blocks_read;     // Number of blocks filled by the reader thread
+	unsigned int blocks_written;  // Number of blocks emptied by the writer thread
+	bool reader_finished;
+	bool windowed;                // Read the whole ring before writing it when copying
+	bool draining;                // within one rotating disk.  Ring being written.
+	Byte_Value skipped_end;       // Bytes of unused blocks passed over after the last block
+	Glib::Mutex ring_mutex;       // Protects the above counts, success and error_message
+	Glib::Cond ring_cond;
+	Glib::Mutex io_mutex;         // Serialises libparted I/O when copying within one device
 
 public:
+	static bool io_uring_supported();
 	bool set_progress_info();
 	CopyBlocks( const Glib::ustring & in_src_device,
 	            const Glib::ustring & in_dst_device,
@@ -59,7 +142,11 @@ public:
 	            OperationDetail & in_operationdetail,
 	            Byte_Value & in_total_done,
 	            Byte_Value in_total_length,
-	            bool cancel_safe );
+	            bool cancel_safe,
+	            CopyMethod in_method = COPY_METHOD_LIBPARTED,
+	            const std::vector<Extent> * in_used_extents = NULL,
+	            CopyTuner * in_tuner = NULL,
+	            MoveJournal * in_journal = NULL );
 	bool copy();
 };
 
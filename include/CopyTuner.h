@@ -0,0 +1,92 @@
+/* Copyright (C) 2018 Mike Fleetwood
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* CopyTuner
+ *
+ * Online tuning of the block size, and for io_uring copies the queue depth, used by
+ * CopyBlocks.  Throughput is measured over successive windows and the settings hill
+ * climbed towards the fastest.  The best settings are remembered in a profile per
+ * device so that later copies start from them.
+ */
+
+#ifndef GPARTED_COPYTUNER_H
+#define GPARTED_COPYTUNER_H
+
+#include "Utils.h"
+
+#include <glibmm/ustring.h>
+#include <glibmm/timer.h>
+
+namespace GParted
+{
+
+class CopyTuner
+{
+public:
+	CopyTuner( const Glib::ustring & profile_key );
+
+	Byte_Value get_blocksize() const;
+	Byte_Value get_max_blocksize() const;
+	Byte_Value get_best_blocksize() const;
+	unsigned int get_queue_depth() const;
+	void set_max_queue_depth( unsigned int depth );
+	bool add_sample( Byte_Value bytes );
+	bool loaded_profile() const  { return profile_loaded; };
+	bool measured() const        { return throughput_measured; };
+	bool save_profile( Glib::ustring & error ) const;
+
+private:
+	enum Move
+	{
+		MOVE_BLOCKSIZE_UP   = 0,
+		MOVE_BLOCKSIZE_DOWN = 1,
+		MOVE_DEPTH_UP       = 2,
+		MOVE_DEPTH_DOWN     = 3,
+		NUM_MOVES           = 4
+	};
+
+	bool evaluate( double rate );
+	bool apply_move( Move change );
+	void load_profile();
+	static Glib::ustring get_profile_filename();
+
+	Glib::ustring profile_key;   // Empty when the device can't be identified
+	bool profile_loaded;
+
+	unsigned int blocksize_index;  // Current block size is MIN_BLOCKSIZE << blocksize_index
+	unsigned int queue_depth;
+	unsigned int max_queue_depth;  // 1 when the queue depth isn't tuned
+	bool tune_queue_depth;         // Only io_uring copies have a queue depth
+	unsigned int profile_queue_depth;  // From the profile, or 0 when none
+
+	unsigned int best_blocksize_index;
+	unsigned int best_queue_depth;
+	double best_rate;              // Bytes per second with the best settings
+	bool throughput_measured;      // At least one window has been evaluated
+
+	Move move;                     // Next change to try
+	unsigned int failed_moves;     // Consecutive changes which didn't improve throughput
+	unsigned int settle_windows;   // Windows to stay with the best settings before trying again
+	bool warming_up;               // Discard the first window after changing settings
+
+	Glib::Timer timer;
+	Byte_Value window_bytes;
+};
+
+}//GParted
+
+#endif /* GPARTED_COPYTUNER_H */
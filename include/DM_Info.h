@@ -0,0 +1,77 @@
+/* Copyright (C) 2018 Mike Fleetwood
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* DM_Info
+ *
+ * Cache of the active Linux kernel Device-mapper mappings and their tables, read
+ * directly from the kernel using the ioctls on /dev/mapper/control, as used by the
+ * dmsetup command.  Loaded once per refresh rather than running dmsetup or udevadm for
+ * each query.
+ */
+
+#ifndef GPARTED_DM_INFO_H
+#define GPARTED_DM_INFO_H
+
+#include "BlockSpecial.h"
+#include "Utils.h"
+
+#include <glibmm/ustring.h>
+#include <vector>
+
+namespace GParted
+{
+
+struct DM_Target
+{
+	Sector        start;        // In 512 byte sectors, within the mapping
+	Sector        length;       // In 512 byte sectors
+	Glib::ustring target_type;  // E.g. "linear", "crypt", "mirror"
+	Glib::ustring params;       // As printed by dmsetup table, without the key of crypt targets
+};
+
+struct DM_Mapping
+{
+	Glib::ustring          name;
+	Glib::ustring          uuid;
+	BlockSpecial           dev;  // Major, minor numbers of the mapped device
+	std::vector<DM_Target> targets;
+};
+
+class DM_Info
+{
+public:
+	static void clear_cache();
+	static bool is_available();
+	static std::vector<DM_Mapping> get_mappings();
+	static Glib::ustring get_name( const Glib::ustring & path );
+
+private:
+	static void initialise_if_required();
+	static bool load_cache();
+	static bool dm_ioctl( int fd, unsigned long request, const Glib::ustring & name, unsigned int flags,
+	                      std::vector<char> & buf );
+	static bool load_table( int fd, DM_Mapping & mapping );
+	static bool parse_table( const std::vector<char> & buf, DM_Mapping & mapping );
+
+	static bool cache_initialised;
+	static bool dm_ioctls_work;
+	static std::vector<DM_Mapping> dm_mapping_cache;
+};
+
+}//GParted
+
+#endif /* GPARTED_DM_INFO_H */
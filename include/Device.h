@@ -50,6 +50,7 @@ public:
 	Sector cylsize ;
 	Glib::ustring model;
 	Glib::ustring serial_number;
+	Glib::ustring wwid;          // World wide name, or empty when none
  	Glib::ustring disktype;
 	int sector_size ;
 	int max_prims ;
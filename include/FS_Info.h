@@ -45,11 +45,14 @@ public:
 	static Glib::ustring get_uuid( const Glib::ustring & path );
 	static Glib::ustring get_path_by_uuid( const Glib::ustring & uuid );
 	static Glib::ustring get_path_by_label( const Glib::ustring & label );
+	static std::vector<Glib::ustring> get_paths_by_fs_type( const Glib::ustring & fstype );
+	static bool can_identify_fs_types();
 
 private:
 	static void initialize_if_required();
 	static void set_commands_found();
 	static const FS_Entry & get_cache_entry_by_path( const Glib::ustring & path );
+	static bool find_cache_index( const BlockSpecial & bs, unsigned int & index );
 	static void load_fs_info_cache();
 	static void load_fs_info_cache_extra_for_path( const Glib::ustring & path );
 	static bool run_blkid_load_cache( const Glib::ustring & path = "" );
@@ -60,6 +63,7 @@ private:
 	static bool blkid_found ;
 	static bool need_blkid_vfat_cache_update_workaround;
 	static std::vector<FS_Entry> fs_info_cache;
+	static BlockSpecialIndex fs_info_index;
 };
 
 }//GParted
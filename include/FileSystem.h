@@ -113,6 +113,9 @@ public:
 	virtual FS_Limits get_filesystem_limits( const Partition & partition ) const  { return fs_limits; };
 	virtual bool is_busy( const Glib::ustring & path ) { return false ; } ;
 	virtual void set_used_sectors( Partition & partition ) {};
+	// Ranges of the file system in use, sorted and in bytes from the start of the
+	// partition, so that copies and moves can pass over free space.
+	virtual bool get_used_extents( const Partition & partition, std::vector<Extent> & extents ) { return false; };
 	virtual void read_label( Partition & partition ) {};
 	virtual bool write_label( const Partition & partition, OperationDetail & operationdetail ) { return false; };
 	virtual void read_uuid( Partition & partition ) {};
@@ -146,17 +149,14 @@ protected:
 	void set_status( OperationDetail & operationdetail, bool success );
 	void execute_command_eof();
 	Glib::ustring mk_temp_dir( const Glib::ustring & infix, OperationDetail & operationdetail ) ;
+	const Glib::ustring & get_command_output() const  { return output; };
+	const Glib::ustring & get_command_error() const   { return error; };
 	void rm_temp_dir( const Glib::ustring dir_name, OperationDetail & operationdetail ) ;
 
 	FS_Limits fs_limits;  // File system minimum and maximum size limits.  In derived
 	                      // classes either assign fixed values in get_filesystem_support()
 	                      // or implement get_filesystem_limits() for dynamic values.
 
-	//those are used in several places..
-	Glib::ustring output, error ;
-	Sector T, N, S ;  //File system [T]otal num of blocks, [N]um of free (or used) blocks, block [S]ize
-	int exit_status ;
-
 private:
 	int execute_command_internal( const Glib::ustring & command, OperationDetail & operationdetail,
 	                              ExecFlags flags,
@@ -165,6 +165,10 @@ private:
 	void store_exit_status( GPid pid, int status );
 	bool running;
 	int pipecount;
+	// Output and exit status of the last command run by execute_command().  Only
+	// operations run commands that way, probing uses Utils::execute_command().
+	Glib::ustring output, error;
+	int exit_status;
 };
 
 } //GParted
@@ -20,15 +20,19 @@
 
 #include "BlockSpecial.h"
 #include "FileSystem.h"
+#include "MoveJournal.h"
 #include "Operation.h"
 #include "Partition.h"
 #include "PartitionLUKS.h"
 #include "PartitionVector.h"
 #include "Utils.h"
 
+#include <glibmm/thread.h>
 #include <parted/parted.h>
+#include <map>
 #include <vector>
 #include <fstream>
+#include <time.h>
 
 namespace GParted
 {
@@ -51,6 +55,7 @@ public:
 	bool snap_to_mebibyte( const Device & device, Partition & partition, Glib::ustring & error ) ;
 	bool snap_to_alignment( const Device & device, Partition & partition, Glib::ustring & error ) ;
 	bool apply_operation_to_disk( Operation * operation );
+	bool find_interrupted_move( MoveJournal & journal ) const;
 
 	bool set_disklabel( const Device & device, const Glib::ustring & disklabel );
 	bool new_disklabel( const Glib::ustring & device_path, const Glib::ustring & disklabel,
@@ -77,12 +82,21 @@ public:
 	                                bool inside_extended );
 
 private:
+	struct PartitionProbe
+	{
+		Partition * partition;
+		std::vector<Glib::ustring> busy_paths;  // Paths checked to determine if busy
+	};
+
 	//detectionstuff..
 	void set_thread_status_message( Glib::ustring msg ) ;
 	static Glib::ustring get_partition_path( PedPartition * lp_partition );
+	void probe_device( unsigned int index, std::vector<Device> * devices );
 	void set_device_from_disk( Device & device, const Glib::ustring & device_path );
 	void set_device_serial_number( Device & device );
+	void set_device_serial_number_hdparm( Device & device );
 	void set_device_partitions( Device & device, PedDevice* lp_device, PedDisk* lp_disk ) ;
+	void probe_partition( unsigned int index, std::vector<PartitionProbe> * probes, PedDisk * lp_disk );
 	void set_device_one_partition( Device & device, PedDevice * lp_device, FSType fstype,
 	                               std::vector<Glib::ustring> & messages );
 	void set_luks_partition( PartitionLUKS & partition );
@@ -127,7 +141,12 @@ private:
 	           OperationDetail & operationdetail );
 	bool move_filesystem( const Partition & partition_old,
 			      const Partition & partition_new,
-			      OperationDetail & operationdetail ) ;
+			      OperationDetail & operationdetail,
+			      MoveJournal & journal,
+			      bool & journalled );
+	bool resume_move( const Partition & partition_all_space,
+	                  const Partition & partition_new,
+	                  OperationDetail & operationdetail );
 #ifdef HAVE_LIBPARTED_FS_RESIZE
 	bool resize_move_filesystem_using_libparted( const Partition & partition_old,
 				      		     const Partition & partition_new,
@@ -174,15 +193,21 @@ private:
 	bool copy_filesystem( const Partition & partition_src,
 	                      Partition & partition_dst,
 	                      OperationDetail & operationdetail );
+	bool get_used_extents( const Partition & partition, std::vector<Extent> & extents );
 	bool copy_filesystem_internal( const Partition & partition_src,
 	                               const Partition & partition_dst,
 	                               OperationDetail & operationdetail,
-	                               bool cancel_safe );
+	                               bool cancel_safe,
+	                               const std::vector<Extent> * used_extents = NULL );
 	bool copy_filesystem_internal( const Partition & partition_src,
 	                               const Partition & partition_dst,
 	                               OperationDetail & operationdetail,
 	                               Byte_Value & total_done,
-	                               bool cancel_safe );
+	                               bool cancel_safe,
+	                               const std::vector<Extent> * used_extents = NULL,
+	                               MoveJournal * journal = NULL );
+	Glib::ustring get_copy_profile_key( const Glib::ustring & src_device,
+	                                    const Glib::ustring & dst_device ) const;
 	bool copy_blocks( const Glib::ustring & src_device,
 	                  const Glib::ustring & dst_device,
 	                  Sector src_start,
@@ -192,7 +217,9 @@ private:
 	                  Byte_Value src_length,
 	                  OperationDetail & operationdetail,
 	                  Byte_Value & total_done,
-	                  bool cancel_safe );
+	                  bool cancel_safe,
+	                  const std::vector<Extent> * used_extents,
+	                  MoveJournal * journal = NULL );
 	void rollback_move_filesystem( const Partition & partition_src,
 	                               const Partition & partition_dst,
 	                               OperationDetail & operationdetail,
@@ -226,7 +253,8 @@ private:
 	static void destroy_device_and_disk( PedDevice*& lp_device, PedDisk*& lp_disk );
 	static bool commit( PedDisk* lp_disk );
 	static bool commit_to_os( PedDisk* lp_disk, std::time_t timeout );
-	static void settle_device( std::time_t timeout );
+	static void settle_device( const Glib::ustring & device_path, const struct timespec & since,
+	                           std::time_t timeout );
 	static bool useable_device( PedDevice * lp_device );
 	static PedPartition* get_lp_partition( const PedDisk* lp_disk, const Partition & partition );
 
@@ -236,8 +264,10 @@ private:
 	static std::map< FSType, FileSystem * > FILESYSTEM_MAP;
 	std::vector<PedPartitionFlag> flags;
 	std::vector<Glib::ustring> device_paths ;
+	std::map<Glib::ustring, Glib::ustring> device_identities;  // Device path to model and serial number or wwid
 	bool probe_devices ;
 	Glib::ustring thread_status_message;  //Used to pass data to show_pulsebar method
+	Glib::Mutex thread_status_mutex;      // Protects thread_status_message
 	Glib::RefPtr<Glib::IOChannel> iocInput, iocOutput; // Used to send data to gpart command
 };
 
@@ -46,14 +46,17 @@ class LUKS_Info
 {
 public:
 	static void clear_cache();
-	static const LUKS_Mapping & get_cache_entry( const Glib::ustring & path );
+	static LUKS_Mapping get_cache_entry( const Glib::ustring & path );
 
 private:
 	static void initialise_if_required();
 	static void load_cache();
+	static void add_mapping( const Glib::ustring & name, Sector length,
+	                         const Glib::ustring & devpath, Sector offset );
 	static const LUKS_Mapping & get_cache_entry_internal( const Glib::ustring & path );
 
 	static std::vector<LUKS_Mapping> luks_mapping_cache;
+	static BlockSpecialIndex luks_mapping_index;
 	static bool cache_initialised;
 };
 
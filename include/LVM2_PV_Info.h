@@ -29,6 +29,7 @@
 #include "Utils.h"
 
 #include <glibmm/ustring.h>
+#include <map>
 #include <vector>
 
 namespace GParted
@@ -42,19 +43,28 @@ struct LVM2_PV
 	Glib::ustring vg_name;
 };
 
-struct LVM2_VG
+struct LVM2_LV
 {
-	Glib::ustring vg_name;
-	Glib::ustring vg_attr;
 	Glib::ustring lv_name;
 	Glib::ustring lv_attr;
 };
 
+struct LVM2_VG
+{
+	Glib::ustring        vg_name;
+	Glib::ustring        vg_attr;
+	std::vector<LVM2_LV> lvs;
+};
+
+// Fields of one row of an lvm report, by field name
+typedef std::map<Glib::ustring, Glib::ustring> LVM2_Report_Row;
+
 class LVM2_PV_Info
 {
 public:
 	static bool is_lvm2_pv_supported();
 	static void clear_cache();
+	static void request_vgscan();
 	static Glib::ustring get_vg_name( const Glib::ustring & path );
 	static Byte_Value get_size_bytes( const Glib::ustring & path );
 	static Byte_Value get_free_bytes( const Glib::ustring & path );
@@ -67,6 +77,9 @@ private:
 	static void initialize_if_required();
 	static void set_command_found();
 	static void load_lvm2_pv_info_cache();
+	static bool load_from_fullreport();
+	static bool load_from_pvs();
+	static void add_report_row( const Glib::ustring & report, const LVM2_Report_Row & row );
 	static const LVM2_PV & get_pv_cache_entry_by_name( const Glib::ustring & pvname );
 	static const LVM2_VG & get_vg_cache_entry_by_name( const Glib::ustring & vgname );
 	static Byte_Value lvm2_pv_size_to_num( const Glib::ustring str ) ;
@@ -75,6 +88,9 @@ private:
 	static bool lvm_found ;
 	static std::vector<LVM2_PV> lvm2_pv_cache;
 	static std::vector<LVM2_VG> lvm2_vg_cache;
+	static BlockSpecialIndex lvm2_pv_index;                      // PV name to lvm2_pv_cache index
+	static std::map<Glib::ustring, unsigned int> lvm2_vg_index;  // VG name to lvm2_vg_cache index
+	static bool vgscan_requested;
 	static std::vector<Glib::ustring> error_messages ;
 };
 
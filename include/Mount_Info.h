@@ -17,8 +17,9 @@
 
 /* Mount_Info
  *
- * Cache of mounted file systems from /proc/mounts and cache of
- * configured mount points from /etc/fstab.
+ * Cache of mounted file systems from /proc/self/mountinfo and swap
+ * devices from /proc/swaps, and cache of configured mount points from
+ * /etc/fstab.  Each file is only read again after it has changed.
  */
 
 #ifndef GPARTED_MOUNT_INFO_H
@@ -28,6 +29,8 @@
 
 #include <glibmm/ustring.h>
 #include <map>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace GParted
@@ -37,8 +40,10 @@ class Mount_Info
 {
 public:
 	typedef std::map<BlockSpecial, std::vector<Glib::ustring> > MountMapping;
+	typedef std::vector<std::pair<Glib::ustring, Glib::ustring> > MountEntries;  // Node, mount point
 
 	static void load_cache();
+	static void clear_cache();
 	static bool is_dev_mounted( const Glib::ustring & path );
 	static bool is_dev_mounted( const BlockSpecial & bs );
 	static std::vector<Glib::ustring> get_all_mountpoints();
@@ -46,14 +51,20 @@ public:
 	static const std::vector<Glib::ustring> & get_fstab_mountpoints( const Glib::ustring & path );
 
 private:
-	static void read_mountpoints_from_file( const Glib::ustring & filename, MountMapping & map );
+	static bool watched_file_changed( int & fd, const char * filename );
+	static bool fstab_changed();
+	static bool read_from_start( int & fd, std::string & contents );
+	static void read_mountpoints_from_mountinfo( const std::string & contents, MountMapping & map,
+	                                             MountEntries & entries );
+	static void read_mount_entries( const Glib::ustring & filename, MountEntries & entries );
+	static void add_mount_entries( const MountEntries & entries, MountMapping & map );
+	static void add_named_entries( const MountEntries & entries, MountMapping & map );
 	static void add_node_and_mountpoint( MountMapping & map,
 	                                     Glib::ustring & node,
 	                                     Glib::ustring & mountpoint );
-	static void read_mountpoints_from_file_swaps( const Glib::ustring & filename,
-	                                              MountMapping & map );
-	static bool have_rootfs_dev( MountMapping & map );
-	static void read_mountpoints_from_mount_command( MountMapping & map );
+	static void read_mountpoints_from_swaps( const std::string & contents, MountEntries & entries );
+	static bool have_rootfs_dev( const MountEntries & entries );
+	static void read_mountpoints_from_mount_command( MountEntries & entries );
 	static const std::vector<Glib::ustring> & find( const MountMapping & map, const Glib::ustring & path );
 };
 
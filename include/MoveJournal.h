@@ -0,0 +1,67 @@
+/* Copyright (C) 2018 Mike Fleetwood
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* MoveJournal
+ *
+ * On disk record of the progress of moving a file system within a device, where the
+ * source and destination overlap.  CopyBlocks records checkpoints once the data moved so
+ * far has been flushed to the device, so that after a crash the move can be resumed
+ * forwards from the last checkpoint rather than being lost.
+ */
+
+#ifndef GPARTED_MOVEJOURNAL_H
+#define GPARTED_MOVEJOURNAL_H
+
+#include "Utils.h"
+
+#include <glibmm/ustring.h>
+
+namespace GParted
+{
+
+class MoveJournal
+{
+public:
+	MoveJournal();
+
+	bool start();
+	bool checkpoint( Byte_Value copied );
+	void remove();
+	static bool load( MoveJournal & journal );
+
+	Byte_Value get_byte_length() const;
+	bool moving_left() const;
+
+	Glib::ustring device_path;
+	Glib::ustring device_identity;  // Model and serial number, empty when not known
+	FSType        filesystem;
+	Byte_Value    sector_size;
+	Sector        old_start;        // Partition boundaries before and after the move
+	Sector        old_end;
+	Sector        new_start;
+	Sector        new_end;
+	Byte_Value    done;             // Bytes moved and flushed, counted in copy order
+	Byte_Value    resumed;          // Bytes already moved when the current copy started
+
+private:
+	bool save() const;
+	static Glib::ustring get_filename();
+};
+
+}//GParted
+
+#endif /* GPARTED_MOVEJOURNAL_H */
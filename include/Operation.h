@@ -35,7 +35,8 @@ enum OperationType {
 	OPERATION_COPY             = 5,
 	OPERATION_LABEL_FILESYSTEM = 6,
 	OPERATION_CHANGE_UUID      = 7,
-	OPERATION_NAME_PARTITION   = 8
+	OPERATION_NAME_PARTITION   = 8,
+	OPERATION_RESUME_MOVE      = 9
 };
 
 class Operation
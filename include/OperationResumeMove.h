@@ -0,0 +1,46 @@
+/* Copyright (C) 2018 Mike Fleetwood
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GPARTED_OPERATIONRESUMEMOVE_H
+#define GPARTED_OPERATIONRESUMEMOVE_H
+
+#include "OperationResizeMove.h"
+#include "Partition.h"
+
+namespace GParted
+{
+
+// Resume a move of a file system interrupted by a crash.  Visually the same as shrinking
+// the partition, which was left encompassing both the old and new locations, to the new
+// location.
+class OperationResumeMove : public OperationResizeMove
+{
+public:
+	OperationResumeMove( const Device & device,
+	                     const Partition & partition_all_space,
+	                     const Partition & partition_new );
+
+private:
+	OperationResumeMove( const OperationResumeMove & src );              // Not implemented copy constructor
+	OperationResumeMove & operator=( const OperationResumeMove & rhs );  // Not implemented copy assignment operator
+
+	void create_description();
+	bool merge_operations( const Operation & candidate );
+};
+
+} //GParted
+
+#endif /* GPARTED_OPERATIONRESUMEMOVE_H */
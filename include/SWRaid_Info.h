@@ -17,14 +17,16 @@
 
 /* SWRaid_Info
  *
- * Cache of information about Linux Software RAID arrays so that the
- * mdadm command only needs to be executed once per refresh.
+ * Cache of information about Linux Software RAID arrays, loaded once per
+ * refresh from /proc/mdstat, sysfs and the md superblocks of the members.
+ * The mdadm command is only run to find members when blkid isn't available.
  */
 
 #ifndef GPARTED_SWRAID_INFO_H
 #define GPARTED_SWRAID_INFO_H
 
 #include "BlockSpecial.h"
+#include "TextTokenizer.h"
 
 #include <glibmm/ustring.h>
 #include <vector>
@@ -55,12 +57,18 @@ private:
 	static void initialise_if_required();
 	static void set_command_found();
 	static void load_swraid_info_cache();
+	static void load_members_from_mdadm();
+	static std::vector<Glib::ustring> get_array_members( const Glib::ustring & md_dir );
+	static bool read_member_superblock( const Glib::ustring & member_path,
+	                                    Glib::ustring & uuid, Glib::ustring & label );
+	static bool is_mdadm_uuid( const StringView & str );
+	static Glib::ustring format_uuid( const Glib::ustring & hex );
 	static SWRaid_Member & get_cache_entry_by_member( const Glib::ustring & member_path );
-	static Glib::ustring mdadm_to_canonical_uuid( const Glib::ustring & mdadm_uuid );
 
-	static bool cache_initialised;
 	static bool mdadm_found;
+	static bool cache_initialised;
 	static std::vector<SWRaid_Member> swraid_info_cache;
+	static BlockSpecialIndex swraid_info_index;
 };
 
 }//GParted
@@ -0,0 +1,116 @@
+/* Copyright (C) 2018 Mike Fleetwood
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* SuperblockReader
+ *
+ * Reads a block of a file system, usually the superblock, and decodes fields from it so
+ * that the size, free space, label and UUID can be read without running the file
+ * system's tools.  Each file system describes where its superblock and fields are in a
+ * SuperblockLayout table.  All field reads are bounds checked against the bytes read.
+ */
+
+#ifndef GPARTED_SUPERBLOCKREADER_H
+#define GPARTED_SUPERBLOCKREADER_H
+
+#include "Utils.h"
+
+#include <glibmm/ustring.h>
+#include <vector>
+
+namespace GParted
+{
+
+enum SuperblockByteOrder
+{
+	SB_LITTLE_ENDIAN = 0,
+	SB_BIG_ENDIAN    = 1
+};
+
+enum SuperblockBlockSize
+{
+	SB_BLOCK_SIZE_BYTES     = 0,  // Block size in bytes
+	SB_BLOCK_SIZE_LOG2_KIB  = 1   // Block size is 1024 << value
+};
+
+// Offset and size in bytes of a field in the superblock.  A size of 0 means the file
+// system doesn't have the field.
+struct SuperblockField
+{
+	size_t offset;
+	size_t size;
+};
+
+struct SuperblockLayout
+{
+	Byte_Value          offset;           // Of the superblock from the start of the file system
+	size_t              size;             // Bytes to read
+	SuperblockByteOrder byte_order;
+	SuperblockField     magic;
+	const char *        magic_value;      // Compared with the bytes of the magic field
+	SuperblockField     block_count;
+	SuperblockField     free_blocks;
+	SuperblockField     block_size;
+	SuperblockBlockSize block_size_encoding;
+	SuperblockField     label;            // NUL padded
+	SuperblockField     uuid;             // 16 bytes
+};
+
+// Values decoded from a superblock.  Numbers are -1 and strings empty when the layout
+// doesn't have them.
+struct SuperblockInfo
+{
+	Sector        block_count;
+	Sector        free_blocks;
+	Byte_Value    block_size;
+	Glib::ustring label;
+	Glib::ustring uuid;         // Empty for the Nil UUID
+};
+
+class SuperblockReader
+{
+public:
+	SuperblockReader( SuperblockByteOrder byte_order );
+
+	bool read( const Glib::ustring & path, Byte_Value offset, size_t size );
+	bool decode( const SuperblockLayout & layout, SuperblockInfo & info ) const;
+	static bool read_superblock( const Glib::ustring & path, const SuperblockLayout & layout,
+	                             SuperblockInfo & info );
+
+	bool get_uint( size_t offset, size_t size, unsigned long long & value ) const;
+	bool get_uint( const SuperblockField & field, unsigned long long & value ) const;
+	bool get_string( const SuperblockField & field, Glib::ustring & value ) const;
+	bool get_uuid( const SuperblockField & field, Glib::ustring & uuid ) const;
+	bool matches( const SuperblockField & field, const char * value ) const;
+
+	// Decode integers of the given byte order from on disk structures read by hand.
+	static unsigned int       le16( const unsigned char * p );
+	static unsigned long      le32( const unsigned char * p );
+	static unsigned long long le64( const unsigned char * p );
+	static unsigned int       be16( const unsigned char * p );
+	static unsigned long      be32( const unsigned char * p );
+	static unsigned long long be64( const unsigned char * p );
+
+	static unsigned long crc32c( unsigned long crc, const unsigned char * buf, size_t len );
+
+private:
+	SuperblockByteOrder m_byte_order;
+	std::vector<unsigned char> m_buf;
+};
+
+}//GParted
+
+#endif /* GPARTED_SUPERBLOCKREADER_H */
@@ -0,0 +1,86 @@
+/* Copyright (C) 2018 Mike Fleetwood
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* StringView, TextTokenizer
+ *
+ * Byte oriented parsing of command output and /proc files without copying.  A StringView
+ * refers to a run of bytes within a string it doesn't own, so the string must outlive
+ * it.  A TextTokenizer splits text into lines or fields, returning each as a StringView.
+ * Unlike Glib::ustring all positions are byte offsets, so finding and splitting are
+ * linear in the length of the text.
+ */
+
+#ifndef GPARTED_TEXTTOKENIZER_H
+#define GPARTED_TEXTTOKENIZER_H
+
+#include <stddef.h>
+#include <string>
+
+namespace GParted
+{
+
+class StringView
+{
+public:
+	static const size_t npos = (size_t)-1;
+
+	StringView();
+	StringView( const char * data, size_t size );
+	StringView( const char * str );
+	StringView( const std::string & str );
+
+	const char * data() const  { return m_data; };
+	size_t size() const        { return m_size; };
+	bool empty() const         { return m_size == 0; };
+	char operator[]( size_t i ) const  { return m_data[i]; };
+
+	std::string str() const;
+	StringView substr( size_t pos, size_t n = npos ) const;
+	StringView trim( const char * chars = " \t\r\n" ) const;
+	size_t find( const StringView & sought, size_t pos = 0 ) const;
+	bool starts_with( const StringView & prefix ) const;
+	bool to_number( unsigned long long & value ) const;
+
+private:
+	const char * m_data;
+	size_t       m_size;
+};
+
+bool operator==( const StringView & lhs, const StringView & rhs );
+bool operator!=( const StringView & lhs, const StringView & rhs );
+
+class TextTokenizer
+{
+public:
+	TextTokenizer( const StringView & text, const char * delimiters, bool skip_empty );
+
+	bool next( StringView & token );
+	StringView rest() const;
+
+private:
+	bool is_delimiter( char c ) const;
+
+	StringView   m_text;
+	const char * m_delimiters;
+	bool         m_skip_empty;
+	size_t       m_pos;
+	bool         m_done;
+};
+
+}//GParted
+
+#endif /* GPARTED_TEXTTOKENIZER_H */
@@ -123,6 +123,16 @@ enum CUSTOM_TEXT
 	CTEXT_RESIZE_DISALLOWED_WARNING		// File system resizing currently disallowed reason
 } ;
 
+// A range of bytes, such as blocks in use by a file system relative to the start of its
+// partition.
+struct Extent
+{
+	Byte_Value offset;
+	Byte_Value length;
+
+	Extent( Byte_Value in_offset, Byte_Value in_length ) : offset( in_offset ), length( in_length ) {};
+};
+
 class Utils
 {
 public:
@@ -158,6 +168,9 @@ public:
 	static Glib::ustring regexp_label( const Glib::ustring & text
 	                                 , const Glib::ustring & pattern
 	                                 ) ;
+	static bool regexp_match( const Glib::ustring & text,
+	                          const Glib::ustring & pattern,
+	                          std::vector<Glib::ustring> & captures );
 	static Glib::ustring trim( const Glib::ustring & src, const Glib::ustring & c = " \t\r\n" ) ;
 	static Glib::ustring last_line( const Glib::ustring & src );
 	static Glib::ustring get_lang() ;
@@ -155,6 +155,8 @@ private:
 
 	static gboolean initial_device_refresh( gpointer data );
 	void menu_gparted_refresh_devices();
+	void menu_gparted_rescan_devices();
+	void offer_resume_interrupted_move();
 	void menu_gparted_features();
 	void menu_gparted_quit();
 	void menu_view_harddisk_info();
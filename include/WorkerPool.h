@@ -0,0 +1,67 @@
+/* Copyright (C) 2018 Mike Fleetwood
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* WorkerPool
+ *
+ * Runs numbered work items, 0 to count-1, on a small pool of threads and waits for them
+ * all to finish.  The calling thread takes items too, so with a single thread, or when
+ * no more threads can be created, the items are simply run in turn.
+ *
+ * The threads created by all pools together, including pools run from within the work
+ * of another, are limited by set_thread_limit().  A nested pool which finds the limit
+ * reached runs its items on the calling thread.
+ */
+
+#ifndef GPARTED_WORKERPOOL_H
+#define GPARTED_WORKERPOOL_H
+
+#include <glibmm/thread.h>
+#include <sigc++/slot.h>
+
+namespace GParted
+{
+
+class WorkerPool
+{
+public:
+	typedef sigc::slot<void, unsigned int> WorkSlot;
+
+	WorkerPool( unsigned int max_threads );
+
+	void run( unsigned int count, const WorkSlot & work );
+
+	static void set_thread_limit( unsigned int limit );
+
+private:
+	void worker();
+	static bool reserve_thread();
+	static void release_threads( unsigned int num );
+
+	unsigned int max_threads;
+	unsigned int count;
+	unsigned int next;   // Next work item to be taken
+	WorkSlot work;
+	Glib::Mutex mutex;   // Protects next
+
+	static Glib::Mutex limit_mutex;        // Protects thread_limit and threads_created
+	static unsigned int thread_limit;      // 0 for no limit
+	static unsigned int threads_created;   // By all pools, not yet joined
+};
+
+}//GParted
+
+#endif /* GPARTED_WORKERPOOL_H */
@@ -22,6 +22,11 @@
 #include "FileSystem.h"
 #include "BlockSpecial.h"
 #include "Partition.h"
+#include "Utils.h"
+
+#include <glibmm/ustring.h>
+#include <string>
+#include <vector>
 
 namespace GParted
 {
@@ -30,6 +35,18 @@ struct BTRFS_Device
 {
 	int                       devid;
 	std::vector<BlockSpecial> members;
+	// Read from the superblocks.  total_bytes is -1 when the device was found
+	// using the btrfs tools instead.
+	Byte_Value                total_bytes;         // Size of this device
+	Byte_Value                bytes_used;          // Chunks allocated on this device
+	Byte_Value                fs_bytes_used;       // File system wide used bytes
+	Byte_Value                members_bytes_used;  // Chunks allocated on all members
+	Glib::ustring             label;
+	bool                      label_valid;         // Label read and valid UTF-8
+	Glib::ustring             uuid;                // Empty for the Nil UUID
+
+	BTRFS_Device() : devid( -1 ), total_bytes( -1 ), bytes_used( -1 ), fs_bytes_used( -1 ),
+	                 members_bytes_used( -1 ), label_valid( false )  {};
 } ;
 
 class btrfs : public FileSystem
@@ -51,7 +68,26 @@ public:
 	static std::vector<Glib::ustring> get_members( const Glib::ustring & path ) ;
 
 private:
-	static const BTRFS_Device & get_cache_entry( const Glib::ustring & path ) ;
+	// Values read from a device's superblock
+	struct Superblock
+	{
+		std::string   fsid;           // Raw file system UUID, for grouping members
+		Sector        generation;
+		int           devid;
+		Byte_Value    num_devices;
+		Byte_Value    total_bytes;
+		Byte_Value    bytes_used;
+		Byte_Value    fs_bytes_used;
+		Glib::ustring label;
+		bool          label_valid;
+		Glib::ustring uuid;
+	};
+
+	static BTRFS_Device get_cache_entry( const Glib::ustring & path ) ;
+	static void load_cache_from_superblocks( const std::vector<Glib::ustring> & paths );
+	static bool read_superblock( const Glib::ustring & path, Superblock & sb );
+	static bool read_super_copy( int fd, unsigned int mirror, unsigned char * buf );
+	static bool super_checksum_ok( const unsigned char * buf );
 	static Byte_Value btrfs_size_to_num( Glib::ustring str, Byte_Value ptn_bytes, bool scale_up ) ;
 	static gdouble btrfs_size_max_delta( Glib::ustring str ) ;
 	static gdouble btrfs_size_to_gdouble( Glib::ustring str ) ;
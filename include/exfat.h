@@ -19,6 +19,10 @@
 #define GPARTED_EXFAT_H
 
 #include "FileSystem.h"
+#include "Partition.h"
+#include "Utils.h"
+
+#include <glibmm/ustring.h>
 
 namespace GParted
 {
@@ -27,6 +31,30 @@ class exfat : public FileSystem
 {
 public:
 	FS get_filesystem_support() ;
+	void set_used_sectors( Partition & partition ) ;
+
+private:
+	// File system geometry decoded from the main boot sector.  Offsets and lengths are
+	// in sectors.
+	struct BootSector
+	{
+		Byte_Value    volume_length;
+		Byte_Value    fat_offset;
+		Byte_Value    cluster_heap_offset;  // Start of cluster 2
+		unsigned long cluster_count;
+		unsigned long root_cluster;         // Root directory first cluster
+		unsigned int  sector_shift;         // log2 of bytes per sector
+		unsigned int  cluster_shift;        // log2 of sectors per cluster
+	};
+
+	static bool read_usage( const Glib::ustring & path, Byte_Value & T, Byte_Value & N, Byte_Value & S );
+	static bool read_boot_sector( int fd, BootSector & bs );
+	static Byte_Value cluster_size( const BootSector & bs );
+	static Byte_Value cluster_offset( const BootSector & bs, unsigned long cluster );
+	static bool next_cluster( int fd, const BootSector & bs, unsigned long & cluster );
+	static bool find_allocation_bitmap( int fd, const BootSector & bs, unsigned long & bitmap_cluster );
+	static bool count_used_clusters( int fd, const BootSector & bs, unsigned long bitmap_cluster,
+	                                 unsigned long & used_clusters );
 };
 
 } //GParted
@@ -53,6 +53,18 @@ public:
 	           OperationDetail & operationdetail );
 
 private:
+	// Values read from the superblock
+	struct Superblock
+	{
+		Sector        block_count;
+		Sector        free_blocks;
+		Byte_Value    block_size;
+		Glib::ustring label;
+		Glib::ustring uuid;         // Empty for the Nil UUID
+	};
+
+	static bool read_superblock( const Glib::ustring & path, Superblock & sb );
+
 	void resize_progress( OperationDetail *operationdetail );
 	void create_progress( OperationDetail *operationdetail );
 	void check_repair_progress( OperationDetail *operationdetail );
@@ -20,6 +20,10 @@
 
 #include "FileSystem.h"
 #include "Partition.h"
+#include "Utils.h"
+
+#include <stddef.h>
+#include <vector>
 
 namespace GParted
 {
@@ -28,7 +32,25 @@ class f2fs : public FileSystem
 {
 public:
 	FS get_filesystem_support() ;
+	void set_used_sectors( Partition & partition ) ;
 	bool create( const Partition & new_partition, OperationDetail & operationdetail ) ;
+
+private:
+	struct Superblock
+	{
+		unsigned long      log_blocks_per_seg;
+		unsigned long long block_count;
+		unsigned long long cp_blkaddr;   // First block of the checkpoint area
+	};
+
+	static bool read_superblock( int fd, Byte_Value block_offset, Superblock & sb );
+	static bool read_checkpoint( int fd, const Superblock & sb,
+	                             unsigned long long & user_blocks, unsigned long long & valid_blocks );
+	static bool read_checkpoint_pack( int fd, unsigned long long blkaddr, unsigned long long block_count,
+	                                  unsigned long long & version,
+	                                  unsigned long long & user_blocks, unsigned long long & valid_blocks );
+	static bool read_checkpoint_block( int fd, unsigned long long blkaddr, std::vector<unsigned char> & buf );
+	static unsigned long crc32( const unsigned char * p, size_t len );
 };
 
 } //GParted
@@ -30,11 +30,15 @@ class fat16 : public FileSystem
 	const enum FSType specific_type;
 	Glib::ustring create_cmd ;
 	Glib::ustring check_cmd ;
+	bool mdir_found;
+	bool mlabel_found;
 public:
-	fat16( enum FSType type ) : specific_type( type ), create_cmd( "" ), check_cmd( "" ) {};
+	fat16( enum FSType type ) : specific_type( type ), create_cmd( "" ), check_cmd( "" ),
+	                            mdir_found( false ), mlabel_found( false )  {};
 	const Glib::ustring get_custom_text( CUSTOM_TEXT ttype, int index = 0 ) const;
 	FS get_filesystem_support() ;
 	void set_used_sectors( Partition & partition ) ;
+	bool get_used_extents( const Partition & partition, std::vector<Extent> & extents );
 	void read_label( Partition & partition ) ;
 	bool write_label( const Partition & partition, OperationDetail & operationdetail ) ;
 	void read_uuid( Partition & partition ) ;
@@ -43,6 +47,33 @@ public:
 	bool check_repair( const Partition & partition, OperationDetail & operationdetail ) ;
 
 private:
+	// File system geometry decoded from the boot sector
+	struct BootSector
+	{
+		unsigned int  bytes_per_sector;
+		unsigned int  sectors_per_cluster;
+		unsigned int  reserved_sectors;
+		unsigned int  num_fats;
+		Byte_Value    fat_sectors;        // Size of one FAT
+		Byte_Value    total_sectors;
+		Byte_Value    first_data_sector;  // Start of cluster 2
+		unsigned long clusters;           // Number of data clusters
+		unsigned int  fat_bits;           // FAT entry size: 12, 16 or 32
+		unsigned int  root_entries;       // FAT12/16 root directory size
+		unsigned long root_cluster;       // FAT32 root directory first cluster
+		unsigned int  fsinfo_sector;      // FAT32 FSInfo sector, 0 when none
+		bool          have_serial;
+		unsigned long serial;
+	};
+
+	static bool read_usage( const Glib::ustring & path, Byte_Value & T, Byte_Value & N, Byte_Value & S );
+	static bool read_boot_sector( int fd, Byte_Value offset, BootSector & bs );
+	static unsigned long fat_entry( const unsigned char * fat, unsigned int fat_bits,
+	                                unsigned long index );
+	static bool read_fsinfo_free_clusters( int fd, const BootSector & bs, unsigned long & free_clusters );
+	static bool count_free_clusters( int fd, const BootSector & bs, unsigned long & free_clusters );
+	static bool read_volume_label( int fd, const BootSector & bs, Glib::ustring & label );
+
 	static const Glib::ustring Change_UUID_Warning [] ;
 	const Glib::ustring sanitize_label( const Glib::ustring & label ) const;
 };
@@ -21,6 +21,7 @@
 
 #include "FileSystem.h"
 #include "Partition.h"
+#include "Utils.h"
 
 namespace GParted
 {
@@ -29,8 +30,24 @@ class hfs : public FileSystem
 {
 public:
 	FS get_filesystem_support() ;
+	void set_used_sectors( Partition & partition ) ;
 	bool create( const Partition & new_partition, OperationDetail & operationdetail ) ;
 	bool check_repair( const Partition & partition, OperationDetail & operationdetail ) ;
+
+	// Fields of the HFS Master Directory Block
+	struct MasterDirectoryBlock
+	{
+		unsigned int  total_blocks;   // Allocation blocks
+		unsigned long block_size;     // Allocation block size in bytes
+		unsigned int  first_block;    // Start of allocation block 0 in 512 byte sectors
+		unsigned int  free_blocks;
+		bool          embedded;       // Wrapper for an embedded HFS+ volume
+		unsigned int  embed_start;    // Embedded volume start and length in allocation blocks
+		unsigned int  embed_count;
+	};
+
+	static bool read_mdb( int fd, Byte_Value offset, MasterDirectoryBlock & mdb );
+	static Byte_Value volume_size( const MasterDirectoryBlock & mdb );
 };
 
 } //GParted
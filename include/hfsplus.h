@@ -21,6 +21,9 @@
 
 #include "FileSystem.h"
 #include "Partition.h"
+#include "Utils.h"
+
+#include <glibmm/ustring.h>
 
 namespace GParted
 {
@@ -29,8 +32,12 @@ class hfsplus : public FileSystem
 {
 public:
 	FS get_filesystem_support() ;
+	void set_used_sectors( Partition & partition ) ;
 	bool create( const Partition & new_partition, OperationDetail & operationdetail ) ;
 	bool check_repair( const Partition & partition, OperationDetail & operationdetail ) ;
+
+private:
+	static bool read_usage( const Glib::ustring & path, Byte_Value & T, Byte_Value & N, Byte_Value & S );
 };
 
 } //GParted
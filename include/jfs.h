@@ -21,13 +21,17 @@
 
 #include "FileSystem.h"
 #include "Partition.h"
+#include "SuperblockReader.h"
 
 namespace GParted
 {
 
 class jfs : public FileSystem
 {
+	bool jfs_debugfs_found;
+	bool jfs_tune_found;
 public:
+	jfs() : jfs_debugfs_found( false ), jfs_tune_found( false )  {};
 	FS get_filesystem_support() ;
 	void set_used_sectors( Partition & partition ) ;
 	void read_label( Partition & partition ) ;
@@ -37,6 +41,11 @@ public:
 	bool create( const Partition & new_partition, OperationDetail & operationdetail ) ;
 	bool resize( const Partition & partition_new, OperationDetail & operationdetail, bool fill_partition );
 	bool check_repair( const Partition & partition, OperationDetail & operationdetail ) ;
+
+private:
+	static bool read_superblock( const Glib::ustring & path, SuperblockInfo & info );
+	static bool read_block_map( const Glib::ustring & path, Byte_Value block_size,
+	                            Sector & map_size, Sector & free_blocks );
 };
 
 } //GParted
@@ -21,13 +21,16 @@
 
 #include "FileSystem.h"
 #include "Partition.h"
+#include "SuperblockReader.h"
 
 namespace GParted
 {
 
 class linux_swap : public FileSystem
 {
+	bool swaplabel_found;
 public:
+	linux_swap() : swaplabel_found( false )  {};
 	virtual const Glib::ustring get_custom_text( CUSTOM_TEXT ttype, int index = 0 ) const;
 
 	FS get_filesystem_support() ;
@@ -45,6 +48,9 @@ public:
 	bool copy( const Partition & src_part,
 		   Partition & dest_part,
 		   OperationDetail & operationdetail ) ;
+
+private:
+	static bool read_swap_header( const Glib::ustring & path, SuperblockInfo & info );
 };
 
 } //GParted
@@ -20,13 +20,16 @@
 
 #include "FileSystem.h"
 #include "Partition.h"
+#include "SuperblockReader.h"
 
 namespace GParted
 {
 
 class nilfs2 : public FileSystem
 {
+	bool nilfs_tune_found;
 public:
+	nilfs2() : nilfs_tune_found( false )  {};
 	FS get_filesystem_support() ;
 	void set_used_sectors( Partition & partition ) ;
 	void read_label( Partition & partition ) ;
@@ -35,6 +38,9 @@ public:
 	bool write_uuid( const Partition & partition, OperationDetail & operationdetail ) ;
 	bool create( const Partition & new_partition, OperationDetail & operationdetail ) ;
 	bool resize( const Partition & partition_new, OperationDetail & operationdetail, bool fill_partition );
+
+private:
+	static bool read_superblock( const Glib::ustring & path, SuperblockInfo & info, Byte_Value & dev_size );
 };
 
 } //GParted
@@ -22,15 +22,21 @@
 #include "FileSystem.h"
 #include "Partition.h"
 
+#include <vector>
+
 namespace GParted
 {
 
 class ntfs : public FileSystem
 {
+	bool ntfsresize_found;
 public:
+	ntfs() : ntfsresize_found( false )  {};
 	const Glib::ustring get_custom_text( CUSTOM_TEXT ttype, int index = 0 ) const;
 	FS get_filesystem_support() ;
+	FS_Limits get_filesystem_limits( const Partition & partition ) const;
 	void set_used_sectors( Partition & partition ) ;
+	bool get_used_extents( const Partition & partition, std::vector<Extent> & extents );
 	void read_label( Partition & partition ) ;
 	bool write_label( const Partition & partition, OperationDetail & operationdetail ) ;
 	void read_uuid( Partition & partition ) ;
@@ -45,6 +51,37 @@ public:
 	static const Glib::ustring Change_UUID_Warning [] ;
 
 private:
+	// Cluster run of a non-resident attribute.  lcn is -1 for a sparse run.
+	struct Run
+	{
+		Sector lcn;
+		Sector length;
+	};
+
+	// File system geometry decoded from the boot sector and the location of the
+	// $Bitmap cluster allocation bitmap
+	struct Volume
+	{
+		Byte_Value          bytes_per_sector;
+		Byte_Value          cluster_size;
+		Sector              total_sectors;
+		Sector              clusters;
+		Sector              mft_lcn;
+		Byte_Value          mft_record_size;
+		std::vector<unsigned char> resident_bitmap;  // When $Bitmap is stored in its MFT record
+		std::vector<Run>    bitmap_runs;
+	};
+
+	static bool read_ntfsresize_info( const Glib::ustring & path, Byte_Value & volume_size,
+	                                  Byte_Value & min_size, Byte_Value & cluster_size,
+	                                  Glib::ustring & output, Glib::ustring & error );
+	static bool read_volume( int fd, Byte_Value offset, Volume & vol );
+	static bool apply_fixups( unsigned char * record, Byte_Value record_size );
+	static bool decode_runs( const unsigned char * p, const unsigned char * end, std::vector<Run> & runs );
+	static bool read_bitmap( int fd, Byte_Value offset, const Volume & vol,
+	                         Byte_Value pos, unsigned char * buf, Byte_Value count );
+	static bool count_used_clusters( int fd, Byte_Value offset, const Volume & vol, Sector & used_clusters );
+
 	void resize_progress( OperationDetail *operationdetail );
 	void clone_progress( OperationDetail *operationdetail );
 };
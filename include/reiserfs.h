@@ -21,13 +21,16 @@
 
 #include "FileSystem.h"
 #include "Partition.h"
+#include "SuperblockReader.h"
 
 namespace GParted
 {
 
 class reiserfs : public FileSystem
 {
+	bool debugreiserfs_found;
 public:
+	reiserfs() : debugreiserfs_found( false )  {};
 	FS get_filesystem_support() ;
 	void set_used_sectors( Partition & partition ) ;
 	void read_label( Partition & partition ) ;
@@ -37,6 +40,9 @@ public:
 	bool create( const Partition & new_partition, OperationDetail & operationdetail ) ;
 	bool resize( const Partition & partition_new, OperationDetail & operationdetail, bool fill_partition );
 	bool check_repair( const Partition & partition, OperationDetail & operationdetail ) ;
+
+private:
+	static bool read_superblock( const Glib::ustring & path, SuperblockInfo & info );
 };
 
 } //GParted
@@ -31,7 +31,10 @@ namespace GParted
 
 class xfs : public FileSystem
 {
+	bool xfs_db_found;
+	bool xfs_admin_found;
 public:
+	xfs() : xfs_db_found( false ), xfs_admin_found( false )  {};
 	FS get_filesystem_support() ;
 	void set_used_sectors( Partition & partition ) ;
 	void read_label( Partition & partition ) ;
@@ -46,6 +49,19 @@ public:
 	bool check_repair( const Partition & partition, OperationDetail & operationdetail ) ;
 
 private:
+	// Values read from the primary superblock
+	struct Superblock
+	{
+		Sector        block_count;
+		Sector        free_blocks;
+		Byte_Value    block_size;
+		Glib::ustring label;
+		Glib::ustring uuid;         // Empty for the Nil UUID
+	};
+
+	static bool read_superblock( const Glib::ustring & path, Superblock & sb );
+	static bool sum_ag_free_blocks( int fd, const unsigned char * sb_buf, Sector & free_blocks );
+
 	bool copy_progress( OperationDetail * operationdetail );
 
 	Byte_Value src_used;             // Used bytes in the source FS of an XFS copy operation
@@ -17,11 +17,15 @@
 #include "BlockSpecial.h"
 
 #include <glibmm/ustring.h>
+#include <glibmm/thread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
 #include <unistd.h>
+#include <algorithm>
 #include <map>
+#include <string>
+#include <vector>
 
 namespace GParted
 {
@@ -42,12 +46,17 @@ typedef std::map<Glib::ustring, MM_Number> MMNumberMapping;
 //     mm_number_cache["sysfs"]     = {0, 0}
 static MMNumberMapping mm_number_cache;
 
+// Protects mm_number_cache as BlockSpecial objects are constructed while devices are
+// probed concurrently.
+static Glib::Mutex mm_number_cache_mutex;
+
 BlockSpecial::BlockSpecial() : m_name( "" ), m_major( 0UL ), m_minor( 0UL )
 {
 }
 
 BlockSpecial::BlockSpecial( const Glib::ustring & name ) : m_name( name ), m_major( 0UL ), m_minor( 0UL )
 {
+	Glib::Mutex::Lock lock( mm_number_cache_mutex );
 	MMNumberMapping::const_iterator mm_num_iter = mm_number_cache.find( name );
 	if ( mm_num_iter != mm_number_cache.end() )
 	{
@@ -77,6 +86,7 @@ BlockSpecial::~BlockSpecial()
 
 void BlockSpecial::clear_cache()
 {
+	Glib::Mutex::Lock lock( mm_number_cache_mutex );
 	mm_number_cache.clear();
 }
 
@@ -86,6 +96,7 @@ void BlockSpecial::register_block_special( const Glib::ustring & name,
 	MM_Number pair;
 	pair.m_major = major;
 	pair.m_minor = minor;
+	Glib::Mutex::Lock lock( mm_number_cache_mutex );
 	// Add new, or update existing, cache entry for name to major, minor pair
 	mm_number_cache[name] = pair;
 }
@@ -110,4 +121,111 @@ bool operator<( const BlockSpecial & lhs, const BlockSpecial & rhs )
 		return lhs.m_major < rhs.m_major || ( lhs.m_major == rhs.m_major && lhs.m_minor < rhs.m_minor );
 }
 
+// Buckets are added as the index grows, keeping about one entry per bucket.  Always a
+// power of two.
+const size_t INDEX_MIN_BUCKETS = 64;
+
+BlockSpecialIndex::BlockSpecialIndex() : m_number_count( 0 ), m_name_count( 0 ), m_size( 0 )
+{
+}
+
+void BlockSpecialIndex::clear()
+{
+	m_by_number.clear();
+	m_by_name.clear();
+	m_number_count = 0;
+	m_name_count = 0;
+	m_size = 0;
+}
+
+// Add the object at the next position.  Later objects equal to earlier ones are never
+// found, the same as a linear search.
+void BlockSpecialIndex::push_back( const BlockSpecial & bs )
+{
+	if ( bs.m_major > 0UL || bs.m_minor > 0UL )
+		insert( m_by_number, m_number_count, hash_numbers( bs.m_major, bs.m_minor ), bs, m_size, true );
+	// Block special files are also indexed by name because operator==() compares a
+	// non-block special file to anything by name.
+	insert( m_by_name, m_name_count, hash_name( bs.m_name ), bs, m_size, false );
+	m_size ++;
+}
+
+bool BlockSpecialIndex::find( const BlockSpecial & bs, unsigned int & position ) const
+{
+	const Entry * entry;
+	if ( bs.m_major > 0UL || bs.m_minor > 0UL )
+		entry = find_entry( m_by_number, hash_numbers( bs.m_major, bs.m_minor ), bs, true );
+	else
+		entry = find_entry( m_by_name, hash_name( bs.m_name ), bs, false );
+	if ( entry == NULL )
+		return false;
+	position = entry->position;
+	return true;
+}
+
+size_t BlockSpecialIndex::hash_numbers( unsigned long major, unsigned long minor )
+{
+	// Minor numbers of the partitions of one disk are consecutive so use them as the
+	// low bits.
+	return (size_t)( major * 2654435761UL ) ^ (size_t)minor;
+}
+
+// FNV-1a hash of the bytes of the name
+size_t BlockSpecialIndex::hash_name( const Glib::ustring & name )
+{
+	const std::string & bytes = name.raw();
+	size_t hash = 2166136261U;
+	for ( size_t i = 0 ; i < bytes.size() ; i ++ )
+	{
+		hash ^= (unsigned char)bytes[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+const BlockSpecialIndex::Entry * BlockSpecialIndex::find_entry( const Buckets & buckets, size_t hash,
+                                                                const BlockSpecial & bs, bool by_number )
+{
+	if ( buckets.empty() )
+		return NULL;
+	const std::vector<Entry> & bucket = buckets[hash & ( buckets.size() - 1 )];
+	for ( unsigned int i = 0 ; i < bucket.size() ; i ++ )
+	{
+		if ( by_number ? bucket[i].bs.m_major == bs.m_major && bucket[i].bs.m_minor == bs.m_minor
+		               : bucket[i].bs.m_name == bs.m_name                                          )
+			return &bucket[i];
+	}
+	return NULL;
+}
+
+void BlockSpecialIndex::insert( Buckets & buckets, unsigned int & count, size_t hash, const BlockSpecial & bs,
+                                unsigned int position, bool by_number )
+{
+	if ( find_entry( buckets, hash, bs, by_number ) != NULL )
+		return;
+
+	if ( count >= buckets.size() )
+	{
+		// Grow and rehash, keeping the entries of each bucket in order.
+		Buckets new_buckets( std::max( INDEX_MIN_BUCKETS, buckets.size() * 2 ) );
+		for ( unsigned int i = 0 ; i < buckets.size() ; i ++ )
+		{
+			for ( unsigned int j = 0 ; j < buckets[i].size() ; j ++ )
+			{
+				const BlockSpecial & old = buckets[i][j].bs;
+				size_t old_hash = by_number ? hash_numbers( old.m_major, old.m_minor )
+				                            : hash_name( old.m_name );
+				new_buckets[old_hash & ( new_buckets.size() - 1 )].push_back( buckets[i][j] );
+			}
+		}
+		buckets.swap( new_buckets );
+	}
+
+	Entry entry;
+	entry.bs = bs;
+	entry.position = position;
+	buckets[hash & ( buckets.size() - 1 )].push_back( entry );
+	count ++;
+}
+
 } //GParted
@@ -17,15 +17,69 @@
  */
 
 #include "CopyBlocks.h"
+#include "BlockSpecial.h"
+#include "CopyTuner.h"
+#include "MoveJournal.h"
 #include "OperationDetail.h"
 #include "Utils.h"
 
 #include <glibmm/ustring.h>
+#include <glibmm/thread.h>
 #include <gtkmm/main.h>
+#include <algorithm>
 #include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef ENABLE_IO_URING_COPY
+#include <liburing.h>
+#endif
 
 namespace GParted {
 
+// Number of block buffers in the ring between the reader and writer threads.  Two is
+// enough to overlap one read with one write, more smooths out uneven device latency.
+const unsigned int COPY_RING_BLOCKS = 4;
+
+// Number of bytes written between incremental flushes of the destination when copying
+// using direct I/O.  Limits how much data can be waiting in the page cache, when falling
+// back to buffered I/O, or in the device's write cache for the final flush.
+const Byte_Value COPY_SYNC_INTERVAL = 256 * MEBIBYTE;
+
+// Size of a huge page, which buffers are allocated from when available.
+const Byte_Value HUGE_PAGE_SIZE = 2 * MEBIBYTE;
+
+// Number of blocks kept in flight when copying using io_uring.  Rotational disks only
+// need enough to keep the head busy, solid state devices take as many as their request
+// queue allows up to the maximum.  The default is used for image files.
+const unsigned int IO_URING_ROTATIONAL_DEPTH = 4;
+const unsigned int IO_URING_DEFAULT_DEPTH = 16;
+const unsigned int IO_URING_MAX_DEPTH = 64;
+
+// Upper limit on the memory used by the ring buffers when copying using io_uring.
+const Byte_Value IO_URING_MAX_MEMORY = 256 * MEBIBYTE;
+
+// Bytes moved and seconds taken after which a journalled move records a checkpoint even
+// though it isn't yet needed to keep the source data intact.  Limits how much is copied
+// again when resuming an interrupted move, without flushing the device too often.
+const Byte_Value JOURNAL_CHECKPOINT_INTERVAL = 1024 * MEBIBYTE;
+const double JOURNAL_CHECKPOINT_MIN_SECONDS = 10.0;
+
+// Memory used to read a whole window of blocks before writing them when copying within
+// one rotating disk.  Limited to a quarter of physical memory.
+const Byte_Value COPY_WINDOW_MEMORY = COPY_WINDOW_MIB * MEBIBYTE;
+
 void CopyBlocks::set_cancel( bool force )
 {
 	if ( force || cancel_safe )
@@ -41,7 +95,11 @@ CopyBlocks::CopyBlocks( const Glib::ustring & in_src_device,
                         OperationDetail & in_operationdetail,
                         Byte_Value & in_total_done,
                         Byte_Value in_total_length,
-                        bool in_cancel_safe) :
+                        bool in_cancel_safe,
+                        CopyMethod in_method,
+                        const std::vector<Extent> * in_used_extents,
+                        CopyTuner * in_tuner,
+                        MoveJournal * in_journal ) :
 	src_device( in_src_device ),
 	dst_device ( in_dst_device ),
 	length ( in_length ),
@@ -49,10 +107,37 @@ CopyBlocks::CopyBlocks( const Glib::ustring & in_src_device,
 	operationdetail ( in_operationdetail ),
 	total_done ( in_total_done ),
 	total_length ( in_total_length ),
+	done( 0 ),
 	offset_src ( src_start ),
 	offset_dst ( dst_start ),
+	backwards( false ),
+	success( false ),
 	cancel( false ),
-	cancel_safe ( in_cancel_safe )
+	cancel_safe ( in_cancel_safe ),
+	method( in_method ),
+	used_extents( in_used_extents ),
+	tuner( in_tuner ),
+	queue_depth( 0 ),
+	journal( in_journal ),
+	journal_distance( 0 ),
+	checkpointed( 0 ),
+	fd_src( -1 ),
+	fd_dst( -1 ),
+	direct_src( false ),
+	direct_dst( false ),
+	alignment( 0 ),
+	detect_zeros( false ),
+	zero_offload( ZERO_OFFLOAD_NONE ),
+	unsynced_start( 0 ),
+	unsynced_end( 0 ),
+	ring_blocks( COPY_RING_BLOCKS ),
+	buffer_size( 0 ),
+	blocks_read( 0 ),
+	blocks_written( 0 ),
+	reader_finished( false ),
+	windowed( false ),
+	draining( false ),
+	skipped_end( 0 )
 {
 	operationdetail.signal_cancel.connect(
 		sigc::mem_fun(*this, &CopyBlocks::set_cancel));
@@ -87,42 +172,829 @@ static gboolean _set_progress_info( gpointer data )
 	return cb->set_progress_info();
 }
 
-void CopyBlocks::copy_thread()
+// Record the first failure and wake up both the reader and writer threads so that they
+// stop.
+void CopyBlocks::set_failed( const Glib::ustring & message )
 {
-	if ( ped_device_open( lp_device_src ) &&
-	     (lp_device_src == lp_device_dst || ped_device_open( lp_device_dst ) ) )
+	ring_mutex.lock();
+	if ( success )
 	{
-		Byte_Value src_sector_size = lp_device_src ->sector_size;
-		Byte_Value dst_sector_size = lp_device_dst ->sector_size;
+		success = false;
+		error_message = message;
+	}
+	ring_cond.broadcast();
+	ring_mutex.unlock();
+}
 
-		//Handle situation where we need to perform the copy beginning
-		//  with the end of the partition and finishing with the start.
-		if ( offset_src < offset_dst )
+// Calculate the next block to copy, advancing position which tracks how far through
+// the copy the caller is.  Blocks are aligned to multiples of blocksize from the start
+// of the copy so only the first block of a backwards copy or the last block of a
+// forwards copy is partial.  Blocks not in use by the file system are passed over,
+// returning their total length in skipped.  Returns false when there are no more
+// blocks, with skipped covering any passed over at the end.
+bool CopyBlocks::next_block( Byte_Value & position, Byte_Value & offset, Byte_Value & len,
+                             Byte_Value & skipped ) const
+{
+	skipped = 0;
+	while ( true )
+	{
+		if ( backwards )
 		{
-			blocksize -= 2*blocksize;
-			done -= 2*done;
-			offset_src += length / src_sector_size;
-			/* Handle situation where src sector size is smaller than dst sector size and an additional partial dst sector is required. */
-			offset_dst += (length + (dst_sector_size - 1)) / dst_sector_size;
+			if ( position <= 0 )
+				return false;
+			len = position % blocksize;
+			if ( len == 0 )
+				len = blocksize;
+			offset = position - len;
+			position = offset;
 		}
-		success = true;
-	} else success = false;
+		else
+		{
+			if ( position >= length )
+				return false;
+			offset = position;
+			len = blocksize - position % blocksize;
+			if ( len > length - position )
+				len = length - position;
+			position = offset + len;
+		}
+		if ( block_in_use( offset, len ) )
+			return true;
+		skipped += len;
+	}
+}
+
+static bool extent_ends_before( const Extent & extent, Byte_Value offset )
+{
+	return extent.offset + extent.length <= offset;
+}
+
+// Whether any of a block is in use by the file system.  All blocks are when the used
+// extents aren't known.  Unused blocks can be passed over in any order as not writing a
+// block never overwrites source data, even when the source and destination overlap.
+bool CopyBlocks::block_in_use( Byte_Value offset, Byte_Value len ) const
+{
+	if ( ! used_extents )
+		return true;
+	std::vector<Extent>::const_iterator it = std::lower_bound( used_extents->begin(),
+	                                                           used_extents->end(),
+	                                                           offset, extent_ends_before );
+	return it != used_extents->end() && it->offset < offset + len;
+}
+
+// Limit the block size when journalling a move so that any one block can be written
+// without getting too far ahead of the last checkpoint.
+Byte_Value CopyBlocks::limit_blocksize( Byte_Value size ) const
+{
+	if ( journal_distance > 0 && size > journal_distance )
+		return journal_distance;
+	return size;
+}
+
+// Position of the start of a block in copy order, counting from the end of the copy
+// when copying backwards.
+Byte_Value CopyBlocks::copy_position( const Block & block ) const
+{
+	if ( backwards )
+		return length - block.offset - block.length;
+	return block.offset;
+}
+
+// Whether a checkpoint of a journalled move must be recorded before writing a block.
+// Moving by journal_distance, writing copy positions [start, end) overwrites the source
+// of positions [start - journal_distance, end - journal_distance).  Resuming from the
+// last checkpoint reads the source from there onwards, so writes must never end more
+// than journal_distance beyond the checkpoint.  Otherwise checkpoints are batched to at
+// most one per JOURNAL_CHECKPOINT_INTERVAL bytes and JOURNAL_CHECKPOINT_MIN_SECONDS.
+bool CopyBlocks::needs_checkpoint( const Block & block ) const
+{
+	Byte_Value end = copy_position( block ) + block.length;
+	if ( end > checkpointed + journal_distance )
+		return true;
+	return    end > checkpointed + JOURNAL_CHECKPOINT_INTERVAL
+	       && checkpoint_timer.elapsed() >= JOURNAL_CHECKPOINT_MIN_SECONDS;
+}
+
+// Flush everything written so far and record a checkpoint of the move at position, the
+// start of the next block to be written.  All blocks before it must have been written.
+// When the journal can't be written the move carries on without it, as it would have
+// without journalling, and it is removed so that an old checkpoint isn't resumed from.
+bool CopyBlocks::checkpoint( Byte_Value position )
+{
+	bool ok;
+	if ( method == COPY_METHOD_LIBPARTED )
+	{
+		if ( lp_device_src == lp_device_dst )
+			io_mutex.lock();
+		ok = ped_device_sync( lp_device_dst );
+		if ( lp_device_src == lp_device_dst )
+			io_mutex.unlock();
+	}
+	else
+		ok = sync_written( true );
+	if ( ! ok )
+		return false;
+
+	if ( ! journal->checkpoint( position ) )
+	{
+		journal->remove();
+		journal = NULL;
+		return true;
+	}
+	checkpointed = position;
+	checkpoint_timer.start();
+	return true;
+}
+
+// Read or write the whole of count bytes, retrying after interruptions and short
+// transfers.
+static bool pread_all( int fd, char * buf, Byte_Value count, Byte_Value offset )
+{
+	while ( count > 0 )
+	{
+		ssize_t n = pread( fd, buf, count, offset );
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n <= 0 )
+			return false;
+		buf += n;
+		count -= n;
+		offset += n;
+	}
+	return true;
+}
+
+static bool pwrite_all( int fd, const char * buf, Byte_Value count, Byte_Value offset )
+{
+	while ( count > 0 )
+	{
+		ssize_t n = pwrite( fd, buf, count, offset );
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n <= 0 )
+			return false;
+		buf += n;
+		count -= n;
+		offset += n;
+	}
+	return true;
+}
+
+// Whether a buffer contains only zero bytes.  Runs over every block read so checks 64
+// bytes at a time, using SSE2 when available.
+static bool is_zero_buffer( const char * buf, Byte_Value count )
+{
+	Byte_Value i = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	for ( ; i + 64 <= count ; i += 64 )
+	{
+		const __m128i * p = reinterpret_cast<const __m128i *>( buf + i );
+		__m128i v = _mm_or_si128( _mm_or_si128( _mm_loadu_si128( p ), _mm_loadu_si128( p + 1 ) ),
+		                          _mm_or_si128( _mm_loadu_si128( p + 2 ), _mm_loadu_si128( p + 3 ) ) );
+		if ( _mm_movemask_epi8( _mm_cmpeq_epi8( v, zero ) ) != 0xFFFF )
+			return false;
+	}
+#else
+	for ( ; i + 64 <= count ; i += 64 )
+	{
+		unsigned long words[64 / sizeof( unsigned long )];
+		memcpy( words, buf + i, sizeof( words ) );
+		unsigned long v = 0;
+		for ( unsigned int j = 0 ; j < sizeof( words ) / sizeof( words[0] ) ; j ++ )
+			v |= words[j];
+		if ( v )
+			return false;
+	}
+#endif
+	for ( ; i < count ; i ++ )
+		if ( buf[i] )
+			return false;
+	return true;
+}
+
+bool CopyBlocks::read_block( const Block & block )
+{
+	Byte_Value sector_size_src = lp_device_src->sector_size;
+	Sector sector = offset_src + block.offset / sector_size_src;
+	Sector num_sectors = ( block.length + ( sector_size_src - 1 ) ) / sector_size_src;
+
+	if ( method == COPY_METHOD_DIRECT )
+	{
+		Byte_Value byte_offset = sector * sector_size_src;
+		Byte_Value byte_count = num_sectors * sector_size_src;
+		if ( ! pread_all( fd_src, block.buf, byte_count, byte_offset ) )
+			return false;
+		// Using buffered I/O as a fall back.  Drop the source data from the page
+		// cache as it won't be read again.
+		if ( ! direct_src )
+			posix_fadvise( fd_src, byte_offset, byte_count, POSIX_FADV_DONTNEED );
+		return true;
+	}
+
+	// Libparted seeks then reads using the file descriptor in the PedDevice so
+	// serialise I/O when both threads share the same device.
+	if ( lp_device_src == lp_device_dst )
+		io_mutex.lock();
+	bool ok = ped_device_read( lp_device_src, block.buf, sector, num_sectors );
+	if ( lp_device_src == lp_device_dst )
+		io_mutex.unlock();
+	return ok;
+}
+
+bool CopyBlocks::write_block( const Block & block )
+{
+	Byte_Value sector_size_dst = lp_device_dst->sector_size;
+	Sector sector = offset_dst + block.offset / sector_size_dst;
+	//Handle case where src and dst sector sizes are different.
+	//    E.g.,  5 sectors x 512 bytes/sector = ??? 2048 byte sectors
+	Sector num_sectors = ( block.length + ( sector_size_dst - 1 ) ) / sector_size_dst;
+
+	if ( method == COPY_METHOD_DIRECT )
+	{
+		Byte_Value byte_offset = sector * sector_size_dst;
+		Byte_Value byte_count = num_sectors * sector_size_dst;
+		if ( ! ( block.zero && zero_range( byte_offset, byte_count ) ) &&
+		     ! pwrite_all( fd_dst, block.buf, byte_count, byte_offset )       )
+			return false;
+		return note_written( byte_offset, byte_count );
+	}
+
+	if ( lp_device_src == lp_device_dst )
+		io_mutex.lock();
+	bool ok = ped_device_write( lp_device_dst, block.buf, sector, num_sectors );
+	if ( lp_device_src == lp_device_dst )
+		io_mutex.unlock();
+	return ok;
+}
+
+// Zero a range of the destination without writing the zeros, which on SSDs and thinly
+// provisioned storage can unmap the range rather than write it.  Returns false when the
+// zeros need writing normally.  Discard (BLKDISCARD) isn't used as the kernel no longer
+// guarantees that discarded blocks read back as zeros.
+bool CopyBlocks::zero_range( Byte_Value byte_offset, Byte_Value byte_count )
+{
+	int ret = -1;
+#ifdef BLKZEROOUT
+	if ( zero_offload == ZERO_OFFLOAD_BLKZEROOUT )
+	{
+		uint64_t range[2] = { (uint64_t)byte_offset, (uint64_t)byte_count };
+		ret = ioctl( fd_dst, BLKZEROOUT, range );
+	}
+#endif
+#ifdef FALLOC_FL_PUNCH_HOLE
+	if ( zero_offload == ZERO_OFFLOAD_PUNCH_HOLE )
+		ret = fallocate( fd_dst, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+		                 byte_offset, byte_count );
+#endif
+	if ( ret != 0 )
+	{
+		// Not supported by the device or file system so don't try again, nor
+		// spend time checking blocks for zeros.
+		zero_offload = ZERO_OFFLOAD_NONE;
+		detect_zeros = false;
+		return false;
+	}
+	return true;
+}
+
+// Add a completed write to the range of the destination waiting to be flushed.
+bool CopyBlocks::note_written( Byte_Value byte_offset, Byte_Value byte_count )
+{
+	if ( unsynced_start == unsynced_end )
+	{
+		unsynced_start = byte_offset;
+		unsynced_end = byte_offset + byte_count;
+	}
+	else
+	{
+		unsynced_start = std::min( unsynced_start, byte_offset );
+		unsynced_end = std::max( unsynced_end, byte_offset + byte_count );
+	}
+	return sync_written( false );
+}
+
+// Incrementally flush the range of the destination written since the last flush, once
+// it reaches COPY_SYNC_INTERVAL bytes or when final.  This avoids a single very long
+// sync at the end of a large copy.
+bool CopyBlocks::sync_written( bool final )
+{
+	Byte_Value count = unsynced_end - unsynced_start;
+	if ( count == 0 || ( ! final && count < COPY_SYNC_INTERVAL ) )
+		return true;
+
+	if ( ! direct_dst )
+	{
+		// Using buffered I/O as a fall back.  Write out and wait for just this
+		// range and then drop it from the page cache.
+		if ( sync_file_range( fd_dst, unsynced_start, count,
+		                      SYNC_FILE_RANGE_WAIT_BEFORE |
+		                      SYNC_FILE_RANGE_WRITE       |
+		                      SYNC_FILE_RANGE_WAIT_AFTER    ) != 0 )
+			return false;
+		posix_fadvise( fd_dst, unsynced_start, count, POSIX_FADV_DONTNEED );
+	}
+	// Flush the device's write cache.
+	if ( fdatasync( fd_dst ) != 0 )
+		return false;
+
+	unsynced_start = unsynced_end = 0;
+	return true;
+}
+
+// Open a device for direct I/O, falling back to buffered I/O when O_DIRECT isn't
+// supported, such as for an image file on tmpfs.
+bool CopyBlocks::open_direct( const Glib::ustring & path, int flags, int & fd, bool & direct )
+{
+	direct = true;
+	fd = open( path.c_str(), flags | O_DIRECT );
+	if ( fd < 0 && errno == EINVAL )
+	{
+		direct = false;
+		fd = open( path.c_str(), flags );
+	}
+	if ( fd < 0 )
+	{
+		error_message = path + ": " + Glib::strerror( errno );
+		return false;
+	}
+	return true;
+}
+
+bool CopyBlocks::open_devices()
+{
+	if ( method != COPY_METHOD_LIBPARTED )
+	{
+		// Separate file descriptors are opened even when copying within one
+		// device as pread() and pwrite() can be used concurrently.
+		if (    ! open_direct( src_device, O_RDONLY, fd_src, direct_src )
+		     || ! open_direct( dst_device, O_WRONLY, fd_dst, direct_dst ) )
+			return false;
+
+		// Runs of zeros, such as in the free space of a new file system, are
+		// zeroed in the destination rather than written.  Only done with these
+		// file descriptors, so not when copying with libparted.
+		struct stat st;
+		if ( fstat( fd_dst, &st ) == 0 )
+		{
+			if ( S_ISBLK( st.st_mode ) )
+				zero_offload = ZERO_OFFLOAD_BLKZEROOUT;
+			else if ( S_ISREG( st.st_mode ) )
+				zero_offload = ZERO_OFFLOAD_PUNCH_HOLE;
+		}
+		detect_zeros = zero_offload != ZERO_OFFLOAD_NONE;
+		return true;
+	}
+
+	return ped_device_open( lp_device_src ) &&
+	       (lp_device_src == lp_device_dst || ped_device_open( lp_device_dst ) );
+}
+
+void CopyBlocks::close_devices()
+{
+	if ( method != COPY_METHOD_LIBPARTED )
+	{
+		if ( fd_src >= 0 )
+			close( fd_src );
+		if ( fd_dst >= 0 )
+			close( fd_dst );
+		fd_src = fd_dst = -1;
+	}
+	else
+	{
+		ped_device_close( lp_device_src );
+		if ( src_device != dst_device )
+			ped_device_close( lp_device_dst );
+	}
+
+	ped_device_destroy( lp_device_src );
+	if ( src_device != dst_device )
+		ped_device_destroy( lp_device_dst );
+}
+
+// Read a single number from a sysfs attribute file.  Returns -1 when it can't be read.
+static long read_sysfs_number( const Glib::ustring & filename )
+{
+	std::ifstream input( filename.c_str() );
+	long value;
+	if ( ! ( input >> value ) )
+		return -1;
+	return value;
+}
+
+// Sysfs directory of the device with the request queue used by path.  Returns an empty
+// string when path isn't a block device, such as for an image file.
+static Glib::ustring get_queue_sysfs_dir( const Glib::ustring & path )
+{
+	BlockSpecial bs( path );
+	if ( bs.m_major == 0 && bs.m_minor == 0 )
+		return "";
+
+	// A partition doesn't have a request queue of its own so use the queue of
+	// the whole disk device, which is the parent directory in sysfs.
+	Glib::ustring sysfs_dir = "/sys/dev/block/" + Utils::num_to_str( bs.m_major ) +
+	                          ":" + Utils::num_to_str( bs.m_minor );
+	if ( ! file_test( sysfs_dir + "/queue", Glib::FILE_TEST_IS_DIR ) )
+		sysfs_dir += "/..";
+	return sysfs_dir;
+}
+
+static bool is_rotational( const Glib::ustring & path )
+{
+	Glib::ustring sysfs_dir = get_queue_sysfs_dir( path );
+	return ! sysfs_dir.empty() && read_sysfs_number( sysfs_dir + "/queue/rotational" ) == 1;
+}
+
+// Choose how many blocks to keep in flight when copying using io_uring from the
+// attributes of the device's request queue.
+static unsigned int get_queue_depth( const Glib::ustring & path )
+{
+	Glib::ustring sysfs_dir = get_queue_sysfs_dir( path );
+	if ( sysfs_dir.empty() )
+		return IO_URING_DEFAULT_DEPTH;
 
-	ped_device_sync( lp_device_dst );
+	if ( read_sysfs_number( sysfs_dir + "/queue/rotational" ) == 1 )
+		return IO_URING_ROTATIONAL_DEPTH;
+	long nr_requests = read_sysfs_number( sysfs_dir + "/queue/nr_requests" );
+	if ( nr_requests <= 0 )
+		return IO_URING_DEFAULT_DEPTH;
+	return std::max( 2L, std::min( nr_requests, (long)IO_URING_MAX_DEPTH ) );
+}
+
+bool CopyBlocks::alloc_ring()
+{
+	// Round the buffers up to a whole number of the larger sector size so that
+	// reading or writing a final partial sector stays within the buffer.
+	Byte_Value sector_size = std::max( lp_device_src->sector_size, lp_device_dst->sector_size );
+	if ( method != COPY_METHOD_LIBPARTED )
+	{
+		// O_DIRECT requires buffers aligned to the logical block size.  Also
+		// align to the physical block size and the page size.
+		alignment = std::max( sector_size, (Byte_Value)sysconf( _SC_PAGESIZE ) );
+		alignment = std::max( alignment, (Byte_Value)lp_device_src->phys_sector_size );
+		alignment = std::max( alignment, (Byte_Value)lp_device_dst->phys_sector_size );
+		sector_size = alignment;
+	}
+	// When tuned the block size can grow during the copy so allocate buffers for the
+	// largest.  Not tuned when copying in windows, as the block size matters little
+	// when reading or writing a whole window sequentially.
+	if ( windowed )
+		tuner = NULL;
+	Byte_Value max_blocksize = blocksize;
+	if ( tuner )
+		max_blocksize = std::min( limit_blocksize( std::max( blocksize, tuner->get_max_blocksize() ) ),
+		                          length );
+	buffer_size = Utils::ceil_size( max_blocksize, sector_size );
+	if ( method == COPY_METHOD_IO_URING )
+	{
+		ring_blocks = std::min( get_queue_depth( src_device ), get_queue_depth( dst_device ) );
+		ring_blocks = std::min( ring_blocks,
+		                        (unsigned int)std::max( 2LL, IO_URING_MAX_MEMORY / buffer_size ) );
+	}
+	else if ( windowed )
+	{
+		Byte_Value memory = std::min( COPY_WINDOW_MEMORY,
+		                              (Byte_Value)sysconf( _SC_PHYS_PAGES ) * sysconf( _SC_PAGESIZE ) / 4 );
+		// No more buffers than needed to hold the whole copy
+		Byte_Value needed = ( length + blocksize - 1 ) / blocksize;
+		ring_blocks = std::max( (Byte_Value)COPY_RING_BLOCKS, std::min( memory / buffer_size, needed ) );
+	}
+	queue_depth = ring_blocks;
+	if ( tuner && method == COPY_METHOD_IO_URING )
+	{
+		tuner->set_max_queue_depth( ring_blocks );
+		queue_depth = tuner->get_queue_depth();
+	}
+	for ( unsigned int i = 0 ; i < ring_blocks ; i ++ )
+	{
+		Block block;
+		block.buf = NULL;
+		block.huge_page = false;
+		if ( method != COPY_METHOD_LIBPARTED )
+		{
+#ifdef MAP_HUGETLB
+			// Try huge pages first to reduce TLB misses and the cost of
+			// pinning the pages for each I/O.  Fails unless the administrator
+			// has reserved huge pages.
+			if ( buffer_size >= HUGE_PAGE_SIZE )
+			{
+				void * p = mmap( NULL, Utils::ceil_size( buffer_size, HUGE_PAGE_SIZE ),
+				                 PROT_READ | PROT_WRITE,
+				                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+				if ( p != MAP_FAILED )
+				{
+					block.buf = static_cast<char *>( p );
+					block.huge_page = true;
+				}
+			}
+#endif
+			void * p = NULL;
+			if ( ! block.buf && posix_memalign( &p, alignment, buffer_size ) == 0 )
+				block.buf = static_cast<char *>( p );
+		}
+		else
+			block.buf = static_cast<char *>( malloc( buffer_size ) );
+		if ( ! block.buf )
+		{
+			// Copy in smaller windows when memory is short
+			if ( windowed && ring.size() >= COPY_RING_BLOCKS )
+				break;
+			return false;
+		}
+		// Zero the buffer so any padding beyond a partial final sector is
+		// written as zeros rather than stale memory.
+		memset( block.buf, 0, buffer_size );
+		block.offset = 0;
+		block.length = 0;
+		block.zero = false;
+		block.skipped = 0;
+		ring.push_back( block );
+	}
+	return true;
+}
 
-	if ( success && done != 0 )
+void CopyBlocks::free_ring()
+{
+	for ( unsigned int i = 0 ; i < ring.size() ; i ++ )
+	{
+		if ( ring[i].huge_page )
+			munmap( ring[i].buf, Utils::ceil_size( buffer_size, HUGE_PAGE_SIZE ) );
+		else
+			free( ring[i].buf );
+	}
+	ring.clear();
+}
+
+// Reader thread.  Fills free buffers in the ring in copy order while the writer thread
+// empties filled ones.  The writer only ever writes blocks which have already been read
+// and both threads progress in the same direction, so a block is always read before the
+// write of any earlier block could overwrite it when the source and destination overlap.
+void CopyBlocks::read_thread()
+{
+	Byte_Value position = backwards ? length : 0;
+	Byte_Value offset;
+	Byte_Value len;
+	Byte_Value skipped;
+	while ( next_block( position, offset, len, skipped ) )
 	{
-		Byte_Value b = blocksize;
-		blocksize = done;
-		done = 0;
-		/* copy partial block first */
-		copy_block();
-		blocksize = b;
+		// Wait for a free buffer.  When copying in windows also wait for the
+		// writer to empty the whole ring.
+		ring_mutex.lock();
+		while ( success && ( blocks_read - blocks_written >= ring.size() || draining ) )
+			ring_cond.wait( ring_mutex );
+		bool ok = success;
+		ring_mutex.unlock();
+		if ( ! ok )
+			break;
+
+		if ( cancel )
+		{
+			set_failed( _("Operation Canceled") );
+			break;
+		}
+
+		Block & block = ring[blocks_read % ring.size()];
+		block.offset = offset;
+		block.length = len;
+		block.skipped = skipped;
+		if ( ! read_block( block ) )
+		{
+			set_failed( String::ucompose( _("Error while reading block at sector %1"),
+			                              offset_src + offset / lp_device_src->sector_size ) );
+			break;
+		}
+		block.zero = detect_zeros && is_zero_buffer( block.buf, block.length );
+
+		// Tune here as the reader is the only user of blocksize during the copy.
+		// With the ring full the reader runs at the writer's pace so this
+		// measures the throughput of the whole copy.
+		if ( tuner && tuner->add_sample( len ) )
+			blocksize = limit_blocksize( tuner->get_blocksize() );
+
+		ring_mutex.lock();
+		blocks_read ++;
+		ring_cond.broadcast();
+		ring_mutex.unlock();
 	}
+
+	ring_mutex.lock();
+	reader_finished = true;
+	skipped_end = skipped;
+	ring_cond.broadcast();
+	ring_mutex.unlock();
+}
+
+#ifdef ENABLE_IO_URING_COPY
+// State of one buffer in the ring when copying using io_uring.
+enum UringState
+{
+	URING_FREE,
+	URING_READING,
+	URING_READ,
+	URING_WRITING,
+	URING_WRITTEN
+};
+
+struct UringSlot
+{
+	UringState   state;
+	Byte_Value   byte_offset;  // Device byte range of the read or write in progress
+	Byte_Value   byte_count;
+	Byte_Value   transferred;  // Bytes transferred so far, continuing after short I/Os
+	struct iovec iov;
+};
+
+// Queue the rest of the read or write of a slot.  There is never more than one I/O in
+// flight per slot so the submission queue, sized to the ring, can't be full.
+static void queue_slot_io( struct io_uring * uring, UringSlot & slot, unsigned int index,
+                           int fd, char * buf )
+{
+	struct io_uring_sqe * sqe = io_uring_get_sqe( uring );
+	slot.iov.iov_base = buf + slot.transferred;
+	slot.iov.iov_len = slot.byte_count - slot.transferred;
+	if ( slot.state == URING_READING )
+		io_uring_prep_readv( sqe, fd, &slot.iov, 1, slot.byte_offset + slot.transferred );
+	else
+		io_uring_prep_writev( sqe, fd, &slot.iov, 1, slot.byte_offset + slot.transferred );
+	io_uring_sqe_set_data( sqe, (void *)(uintptr_t)index );
+}
+#endif
+
+// Copy using io_uring, keeping a read or write in flight for every buffer in the ring.
+// Blocks are read in copy order and a block is only written once it and all earlier
+// blocks have been read.  So, as with the reader and writer threads, no write can
+// overwrite source data which has yet to be read when the source and destination
+// overlap.  Returns false without copying anything when an io_uring can't be set up.
+bool CopyBlocks::io_uring_copy()
+{
+#ifdef ENABLE_IO_URING_COPY
+	struct io_uring uring;
+	if ( io_uring_queue_init( ring.size(), &uring, 0 ) != 0 )
+		return false;
+
+	unsigned int n = ring.size();
+	std::vector<UringSlot> slots( n );
+	for ( unsigned int i = 0 ; i < n ; i ++ )
+		slots[i].state = URING_FREE;
+
+	Byte_Value sector_size_src = lp_device_src->sector_size;
+	Byte_Value sector_size_dst = lp_device_dst->sector_size;
+	Byte_Value position = backwards ? length : 0;
+	bool more_blocks = true;
+	unsigned int next_read = 0;    // Block indexes in copy order.  Block i uses slot i % n.
+	unsigned int reads_done = 0;   // Blocks before this index have all been read
+	unsigned int next_write = 0;
+	unsigned int writes_done = 0;  // Blocks before this index have all been written
+	unsigned int in_flight = 0;
 	Glib::Timer timer_progress_timeout;
-	while( success && llabs( done ) < length )
+	while ( true )
 	{
-		copy_block();
+		if ( success && cancel )
+			set_failed( _("Operation Canceled") );
+
+		// After a failure stop queueing I/O but still wait for that already in
+		// flight to complete before the buffers can be freed.
+		while (    success && more_blocks && next_read - writes_done < queue_depth
+		        && slots[next_read % n].state == URING_FREE                      )
+		{
+			Block & block = ring[next_read % n];
+			if ( ! next_block( position, block.offset, block.length, block.skipped ) )
+			{
+				skipped_end = block.skipped;
+				block.skipped = 0;
+				more_blocks = false;
+				break;
+			}
+			UringSlot & slot = slots[next_read % n];
+			Sector sector = offset_src + block.offset / sector_size_src;
+			Sector num_sectors = ( block.length + ( sector_size_src - 1 ) ) / sector_size_src;
+			slot.state = URING_READING;
+			slot.byte_offset = sector * sector_size_src;
+			slot.byte_count = num_sectors * sector_size_src;
+			slot.transferred = 0;
+			queue_slot_io( &uring, slot, next_read % n, fd_src, block.buf );
+			next_read ++;
+			in_flight ++;
+		}
+		while ( success && next_write < reads_done )
+		{
+			Block & block = ring[next_write % n];
+			if ( journal && needs_checkpoint( block ) )
+			{
+				// Wait for all earlier writes to complete first
+				if ( writes_done < next_write )
+					break;
+				if ( ! checkpoint( copy_position( block ) ) )
+				{
+					set_failed( Glib::strerror( errno ) );
+					break;
+				}
+			}
+			UringSlot & slot = slots[next_write % n];
+			Sector sector = offset_dst + block.offset / sector_size_dst;
+			Sector num_sectors = ( block.length + ( sector_size_dst - 1 ) ) / sector_size_dst;
+			slot.byte_offset = sector * sector_size_dst;
+			slot.byte_count = num_sectors * sector_size_dst;
+			slot.transferred = 0;
+			if ( block.zero && zero_range( slot.byte_offset, slot.byte_count ) )
+			{
+				slot.state = URING_WRITTEN;
+				if ( ! note_written( slot.byte_offset, slot.byte_count ) )
+					set_failed( Glib::strerror( errno ) );
+			}
+			else
+			{
+				slot.state = URING_WRITING;
+				queue_slot_io( &uring, slot, next_write % n, fd_dst, block.buf );
+				in_flight ++;
+			}
+			next_write ++;
+		}
+
+		// Only count blocks as done once all earlier blocks have been written
+		// too.  Go round again to reuse the freed buffers.
+		bool freed = false;
+		while ( writes_done < next_write && slots[writes_done % n].state == URING_WRITTEN )
+		{
+			const Block & block = ring[writes_done % n];
+			done += block.skipped + block.length;
+			if ( tuner && tuner->add_sample( block.length ) )
+			{
+				blocksize = limit_blocksize( tuner->get_blocksize() );
+				queue_depth = tuner->get_queue_depth();
+			}
+			slots[writes_done % n].state = URING_FREE;
+			writes_done ++;
+			freed = true;
+		}
+		if ( freed )
+			continue;
+
+		if ( in_flight == 0 )
+			break;
+
+		int ret = io_uring_submit_and_wait( &uring, 1 );
+		if ( ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY )
+		{
+			set_failed( Glib::strerror( -ret ) );
+			break;
+		}
+
+		struct io_uring_cqe * cqe;
+		while ( io_uring_peek_cqe( &uring, &cqe ) == 0 )
+		{
+			unsigned int index = (uintptr_t)io_uring_cqe_get_data( cqe );
+			int res = cqe->res;
+			io_uring_cqe_seen( &uring, cqe );
+
+			Block & block = ring[index];
+			UringSlot & slot = slots[index];
+			bool reading = slot.state == URING_READING;
+			int fd = reading ? fd_src : fd_dst;
+			if ( res == -EINTR || res == -EAGAIN )
+			{
+				queue_slot_io( &uring, slot, index, fd, block.buf );
+				continue;
+			}
+			if ( res <= 0 )
+			{
+				if ( reading )
+					set_failed( String::ucompose( _("Error while reading block at sector %1"),
+					                              offset_src + block.offset / sector_size_src ) );
+				else
+					set_failed( String::ucompose( _("Error while writing block at sector %1"),
+					                              offset_dst + block.offset / sector_size_dst ) );
+				in_flight --;
+				continue;
+			}
+			slot.transferred += res;
+			if ( slot.transferred < slot.byte_count )
+			{
+				queue_slot_io( &uring, slot, index, fd, block.buf );
+				continue;
+			}
+			in_flight --;
+
+			if ( reading )
+			{
+				slot.state = URING_READ;
+				// Using buffered I/O as a fall back.  Drop the source data
+				// from the page cache as it won't be read again.
+				if ( ! direct_src )
+					posix_fadvise( fd_src, slot.byte_offset, slot.byte_count,
+					               POSIX_FADV_DONTNEED );
+				block.zero = detect_zeros && is_zero_buffer( block.buf, block.length );
+				while ( reads_done < next_read && slots[reads_done % n].state == URING_READ )
+					reads_done ++;
+			}
+			else
+			{
+				slot.state = URING_WRITTEN;
+				if ( success && ! note_written( slot.byte_offset, slot.byte_count ) )
+					set_failed( Glib::strerror( errno ) );
+			}
+		}
+
 		if ( timer_progress_timeout .elapsed() >= 0.5 )
 		{
 			g_idle_add( _set_progress_info, this );
@@ -130,21 +1002,133 @@ void CopyBlocks::copy_thread()
 		}
 	}
 
-	//close and destroy the devices..
-	ped_device_close( lp_device_src );
-	ped_device_destroy( lp_device_src );
+	io_uring_queue_exit( &uring );
+	return true;
+#else
+	return false;
+#endif
+}
 
-	if ( src_device != dst_device )
+// Copy thread.  Opens the devices, then either copies using io_uring or starts the reader
+// thread and acts as the writer.
+void CopyBlocks::copy_thread()
+{
+	if ( open_devices() )
 	{
-		ped_device_close( lp_device_dst );
-		ped_device_destroy( lp_device_dst );
+		//Handle situation where we need to perform the copy beginning
+		//  with the end of the partition and finishing with the start.
+		backwards = offset_src < offset_dst;
+		success = true;
+	} else success = false;
+
+	if ( method == COPY_METHOD_LIBPARTED )
+		ped_device_sync( lp_device_dst );
+
+	if ( success )
+	{
+		if ( method == COPY_METHOD_IO_URING && ! io_uring_copy() )
+			// Couldn't set up an io_uring, such as when the locked memory limit
+			// is too low, so fall back to the reader and writer threads.
+			method = COPY_METHOD_DIRECT;
+
+		if ( method != COPY_METHOD_IO_URING )
+		{
+			Glib::Thread *reader = Glib::Thread::create( sigc::mem_fun( *this, &CopyBlocks::read_thread ),
+			                                             true );
+			Glib::Timer timer_progress_timeout;
+			while ( true )
+			{
+				// Wait for a filled buffer.  When copying in windows wait for
+				// the reader to fill the whole ring, then write all of it.
+				ring_mutex.lock();
+				while (    success && ! reader_finished
+				        && (    blocks_written == blocks_read
+				             || ( windowed && ! draining && blocks_read - blocks_written < ring.size() ) ) )
+					ring_cond.wait( ring_mutex );
+				bool more = success && blocks_written < blocks_read;
+				if ( windowed )
+					draining = more;
+				ring_mutex.unlock();
+				if ( ! more )
+					break;
+
+				if ( cancel )
+				{
+					set_failed( _("Operation Canceled") );
+					break;
+				}
+
+				const Block & block = ring[blocks_written % ring.size()];
+				if ( journal && needs_checkpoint( block ) && ! checkpoint( copy_position( block ) ) )
+				{
+					set_failed( Glib::strerror( errno ) );
+					break;
+				}
+				if ( ! write_block( block ) )
+				{
+					set_failed( String::ucompose( _("Error while writing block at sector %1"),
+					                              offset_dst + block.offset / lp_device_dst->sector_size ) );
+					break;
+				}
+
+				ring_mutex.lock();
+				blocks_written ++;
+				done += block.skipped + block.length;
+				if ( blocks_written == blocks_read )
+					draining = false;
+				ring_cond.broadcast();
+				ring_mutex.unlock();
+
+				if ( timer_progress_timeout .elapsed() >= 0.5 )
+				{
+					g_idle_add( _set_progress_info, this );
+					timer_progress_timeout.reset();
+				}
+			}
+			reader->join();
+		}
+
+		// Count unused blocks passed over after the last block copied.
+		if ( success )
+			done += skipped_end;
+
+		if ( success && method != COPY_METHOD_LIBPARTED && ! sync_written( true ) )
+			set_failed( Glib::strerror( errno ) );
 	}
 
+	//close and destroy the devices..
+	close_devices();
+
 	//set progress bar current info on completion
 	g_idle_add( _set_progress_info, this );
 	g_idle_add( (GSourceFunc)mainquit, this );
 }
 
+#ifdef ENABLE_IO_URING_COPY
+// Result of io_uring_supported(), -1 until checked.  Copies may run concurrently.
+static int io_uring_supported_result = -1;
+static Glib::Mutex io_uring_supported_mutex;
+#endif
+
+// Whether io_uring can be used for copying.  It may not be in the running kernel or may
+// have been disabled by the administrator.  Checked once by setting up a small io_uring.
+bool CopyBlocks::io_uring_supported()
+{
+#ifdef ENABLE_IO_URING_COPY
+	Glib::Mutex::Lock lock( io_uring_supported_mutex );
+	if ( io_uring_supported_result < 0 )
+	{
+		struct io_uring uring;
+		io_uring_supported_result = io_uring_queue_init( 1, &uring, 0 ) == 0;
+		if ( io_uring_supported_result )
+			io_uring_queue_exit( &uring );
+	}
+	return io_uring_supported_result;
+#else
+	return false;
+#endif
+}
+
 bool CopyBlocks::copy()
 {
 	if ( blocksize > length )
@@ -152,14 +1136,27 @@ bool CopyBlocks::copy()
 
 	operationdetail.run_progressbar( (double)total_done, (double)total_length, PROGRESSBAR_TEXT_COPY_BYTES );
 
-	done = length % blocksize;
-
 	lp_device_src = ped_device_get( src_device.c_str() );
 	lp_device_dst = src_device != dst_device ? ped_device_get( dst_device.c_str() ) : lp_device_src;
+	// Reading and writing alternately within one rotating disk seeks between the
+	// source and destination for every block.  Instead read a large window of blocks
+	// and then write them all.  Uses the reader and writer threads as io_uring would
+	// interleave reads and writes in the same way.
+	if ( src_device == dst_device && is_rotational( src_device ) )
+	{
+		windowed = true;
+		if ( method == COPY_METHOD_IO_URING )
+			method = COPY_METHOD_DIRECT;
+	}
+	if ( journal )
+	{
+		journal_distance = llabs( offset_src * lp_device_src->sector_size -
+		                          offset_dst * lp_device_dst->sector_size   );
+		blocksize = limit_blocksize( blocksize );
+	}
 	//add an empty sub which we will constantly update in the loop
 	operationdetail.get_last_child().add_child( OperationDetail( "", STATUS_NONE ) );
-	buf = static_cast<char *>( malloc( llabs( blocksize ) ) );
-	if ( buf )
+	if ( alloc_ring() )
 	{
 		Glib::Thread::create( sigc::mem_fun( *this, &CopyBlocks::copy_thread ),
 				      false );
@@ -181,10 +1178,15 @@ bool CopyBlocks::copy()
 				operationdetail.get_last_child().get_last_child().add_child(
 					OperationDetail( error_message, STATUS_NONE, FONT_ITALIC ) );
 		}
-		free( buf ) ;
 	}
 	else
+	{
+		success = false;
 		error_message = Glib::strerror( errno );
+		operationdetail.get_last_child().get_last_child().add_child(
+			OperationDetail( error_message, STATUS_NONE, FONT_ITALIC ) );
+	}
+	free_ring();
 
 	if ( total_done == total_length || ! success )
 		operationdetail.stop_progressbar();
@@ -192,52 +1194,4 @@ bool CopyBlocks::copy()
 	return success;
 }
 
-void CopyBlocks::copy_block()
-{
-	Byte_Value sector_size_src = lp_device_src ->sector_size;
-	Byte_Value sector_size_dst = lp_device_dst ->sector_size;
-
-	//Handle case where src and dst sector sizes are different.
-	//    E.g.,  5 sectors x 512 bytes/sector = ??? 2048 byte sectors
-	Sector num_blocks_src = (llabs(blocksize) + (sector_size_src - 1) ) / sector_size_src;
-	Sector num_blocks_dst = (llabs(blocksize) + (sector_size_dst - 1) ) / sector_size_dst;
-
-	//Handle situation where we are performing copy operation beginning
-	//  with the end of the partition and finishing with the start.
-	if ( blocksize < 0 )
-	{
-		offset_src += (blocksize / sector_size_src);
-		offset_dst += (blocksize / sector_size_dst);
-	}
-
-	if ( cancel )
-	{
-		error_message = _("Operation Canceled");
-		success = false;
-		return;
-	}
-
-	if ( blocksize != 0 )
-	{
-		if ( ped_device_read( lp_device_src, buf, offset_src, num_blocks_src ) )
-		{
-			if ( ped_device_write( lp_device_dst, buf, offset_dst, num_blocks_dst ) )
-				success = true;
-			else {
-				error_message = String::ucompose( _("Error while writing block at sector %1"), offset_dst );
-				success = false;
-			}
-		}
-		else
-			error_message = String::ucompose( _("Error while reading block at sector %1"), offset_src ) ;
-	}
-	if ( blocksize > 0 )
-	{
-		offset_src += (blocksize / sector_size_src);
-		offset_dst += (blocksize / sector_size_dst);
-	}
-	if( success )
-		done += blocksize;
-}
-
 } // namespace GParted
@@ -0,0 +1,290 @@
+/* Copyright (C) 2018 Mike Fleetwood
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CopyTuner.h"
+#include "Utils.h"
+
+#include <glibmm/ustring.h>
+#include <glibmm/keyfile.h>
+#include <glibmm/miscutils.h>
+#include <glib.h>
+#include <algorithm>
+
+namespace GParted
+{
+
+// Block sizes tried are powers of two from MIN_BLOCKSIZE to MIN_BLOCKSIZE << (NUM_BLOCKSIZES-1),
+// that is 128 KiB to 16 MiB.  Without a profile copies start with 4 MiB blocks.
+const Byte_Value MIN_BLOCKSIZE = 128 * KIBIBYTE;
+const unsigned int NUM_BLOCKSIZES = 8;
+const unsigned int DEFAULT_BLOCKSIZE_INDEX = 5;
+
+// Throughput is measured over windows of at least this many seconds and blocks.
+const double TUNE_WINDOW_SECONDS = 1.0;
+const Byte_Value TUNE_WINDOW_BLOCKS = 4;
+
+// A change must improve throughput by this fraction to be kept, so that noise in the
+// measurements doesn't cause the settings to wander.
+const double TUNE_MIN_GAIN = 0.05;
+
+// Number of windows to stay with the best settings once no change improves on them,
+// before trying again in case the device's behaviour has changed.
+const unsigned int TUNE_SETTLE_WINDOWS = 30;
+
+CopyTuner::CopyTuner( const Glib::ustring & in_profile_key ) :
+	profile_key( in_profile_key ),
+	profile_loaded( false ),
+	blocksize_index( DEFAULT_BLOCKSIZE_INDEX ),
+	queue_depth( 1 ),
+	max_queue_depth( 1 ),
+	tune_queue_depth( false ),
+	profile_queue_depth( 0 ),
+	best_blocksize_index( DEFAULT_BLOCKSIZE_INDEX ),
+	best_queue_depth( 1 ),
+	best_rate( 0.0 ),
+	throughput_measured( false ),
+	move( MOVE_BLOCKSIZE_UP ),
+	failed_moves( 0 ),
+	settle_windows( 0 ),
+	warming_up( true ),
+	window_bytes( 0 )
+{
+	// Key file group names can't contain square brackets.
+	for ( unsigned int i = 0 ; i < profile_key.size() ; i ++ )
+		if ( profile_key[i] == '[' || profile_key[i] == ']' )
+			profile_key.replace( i, 1, "_" );
+
+	load_profile();
+}
+
+Byte_Value CopyTuner::get_blocksize() const
+{
+	return MIN_BLOCKSIZE << blocksize_index;
+}
+
+Byte_Value CopyTuner::get_max_blocksize() const
+{
+	return MIN_BLOCKSIZE << ( NUM_BLOCKSIZES - 1 );
+}
+
+Byte_Value CopyTuner::get_best_blocksize() const
+{
+	return MIN_BLOCKSIZE << best_blocksize_index;
+}
+
+unsigned int CopyTuner::get_queue_depth() const
+{
+	return queue_depth;
+}
+
+// Set the number of blocks the copy can keep in flight, so that the queue depth is tuned
+// too.  Only called for io_uring copies.  Without a profile queue depth the queue depth
+// starts at the maximum.
+void CopyTuner::set_max_queue_depth( unsigned int depth )
+{
+	tune_queue_depth = true;
+	max_queue_depth = std::max( depth, 1U );
+	queue_depth = max_queue_depth;
+	if ( profile_queue_depth > 0 )
+		queue_depth = std::min( profile_queue_depth, max_queue_depth );
+	best_queue_depth = queue_depth;
+}
+
+// Account for bytes copied.  Returns true when the block size or queue depth has been
+// changed.
+bool CopyTuner::add_sample( Byte_Value bytes )
+{
+	window_bytes += bytes;
+	double elapsed = timer.elapsed();
+	if ( elapsed < TUNE_WINDOW_SECONDS || window_bytes < TUNE_WINDOW_BLOCKS * get_blocksize() )
+		return false;
+
+	double rate = window_bytes / elapsed;
+	window_bytes = 0;
+	timer.reset();
+	if ( warming_up )
+	{
+		// The window included blocks in flight from before the last change.
+		warming_up = false;
+		return false;
+	}
+	if ( evaluate( rate ) )
+	{
+		warming_up = true;
+		return true;
+	}
+	return false;
+}
+
+// Hill climb one step.  Measurements of the best settings are alternated with
+// measurements of a candidate change so that the comparison follows any change in the
+// device's speed during the copy.
+bool CopyTuner::evaluate( double rate )
+{
+	throughput_measured = true;
+	if ( blocksize_index == best_blocksize_index && queue_depth == best_queue_depth )
+	{
+		best_rate = rate;
+		if ( settle_windows > 0 )
+		{
+			settle_windows --;
+			return false;
+		}
+	}
+	else if ( rate > best_rate * ( 1.0 + TUNE_MIN_GAIN ) )
+	{
+		// Keep the change and try going further the same way.
+		best_blocksize_index = blocksize_index;
+		best_queue_depth = queue_depth;
+		best_rate = rate;
+		failed_moves = 0;
+		if ( apply_move( move ) )
+			return true;
+		move = (Move)( ( move + 1 ) % NUM_MOVES );
+	}
+	else
+	{
+		// Revert to the best settings and try another change next time.
+		blocksize_index = best_blocksize_index;
+		queue_depth = best_queue_depth;
+		move = (Move)( ( move + 1 ) % NUM_MOVES );
+		if ( ++ failed_moves >= NUM_MOVES )
+		{
+			failed_moves = 0;
+			settle_windows = TUNE_SETTLE_WINDOWS;
+		}
+		return true;
+	}
+
+	for ( unsigned int i = 0 ; i < NUM_MOVES ; i ++ )
+	{
+		if ( apply_move( move ) )
+			return true;
+		move = (Move)( ( move + 1 ) % NUM_MOVES );
+	}
+	// Nothing can be changed
+	settle_windows = TUNE_SETTLE_WINDOWS;
+	return false;
+}
+
+bool CopyTuner::apply_move( Move change )
+{
+	switch ( change )
+	{
+		case MOVE_BLOCKSIZE_UP:
+			if ( blocksize_index + 1 >= NUM_BLOCKSIZES )
+				return false;
+			blocksize_index ++;
+			return true;
+		case MOVE_BLOCKSIZE_DOWN:
+			if ( blocksize_index == 0 )
+				return false;
+			blocksize_index --;
+			return true;
+		case MOVE_DEPTH_UP:
+			if ( queue_depth >= max_queue_depth )
+				return false;
+			queue_depth = std::min( queue_depth * 2, max_queue_depth );
+			return true;
+		case MOVE_DEPTH_DOWN:
+			if ( queue_depth <= 1 )
+				return false;
+			queue_depth /= 2;
+			return true;
+		default:
+			return false;
+	}
+}
+
+Glib::ustring CopyTuner::get_profile_filename()
+{
+	return Glib::build_filename( Glib::get_user_config_dir(), "gparted", "copy-profiles.ini" );
+}
+
+// Start from the best settings remembered for the device.  As these are expected to be
+// close to optimal stay with them for a while before trying changes.
+void CopyTuner::load_profile()
+{
+	if ( profile_key.empty() )
+		return;
+
+	try
+	{
+		Glib::KeyFile key_file;
+		key_file.load_from_file( get_profile_filename() );
+		if ( ! key_file.has_group( profile_key ) )
+			return;
+
+		Byte_Value blocksize = key_file.get_integer( profile_key, "block_size_kib" ) * KIBIBYTE;
+		for ( unsigned int i = 0 ; i < NUM_BLOCKSIZES ; i ++ )
+		{
+			if ( MIN_BLOCKSIZE << i == blocksize )
+			{
+				blocksize_index = best_blocksize_index = i;
+				settle_windows = TUNE_SETTLE_WINDOWS;
+				profile_loaded = true;
+				break;
+			}
+		}
+		// Only saved by io_uring copies
+		if ( profile_loaded && key_file.has_key( profile_key, "queue_depth" ) )
+		{
+			int depth = key_file.get_integer( profile_key, "queue_depth" );
+			if ( depth >= 1 )
+				profile_queue_depth = depth;
+		}
+	}
+	catch ( Glib::Exception & e )
+	{
+		// No profile saved yet or it can't be read.  Use the defaults.
+	}
+}
+
+// Remember the best settings for the device.  The file is replaced atomically so that a
+// crash or full disk can't leave it truncated and lose the other devices' profiles.
+// Returns false with the reason in error when the file can't be written.
+bool CopyTuner::save_profile( Glib::ustring & error ) const
+{
+	if ( profile_key.empty() )
+		return true;
+
+	Glib::ustring filename = get_profile_filename();
+	Glib::KeyFile key_file;
+	try
+	{
+		key_file.load_from_file( filename );
+	}
+	catch ( Glib::Exception & e )
+	{
+		// Start a new profile file.
+	}
+	key_file.set_integer( profile_key, "block_size_kib", ( MIN_BLOCKSIZE << best_blocksize_index ) / KIBIBYTE );
+	if ( tune_queue_depth )
+		key_file.set_integer( profile_key, "queue_depth", best_queue_depth );
+
+	g_mkdir_with_parents( Glib::path_get_dirname( filename ).c_str(), 0700 );
+	Glib::ustring data = key_file.to_data();
+	GError * gerror = NULL;
+	if ( ! g_file_set_contents( filename.c_str(), data.c_str(), data.bytes(), &gerror ) )
+	{
+		error = gerror->message;
+		g_error_free( gerror );
+		return false;
+	}
+	return true;
+}
+
+}//GParted
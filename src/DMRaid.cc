@@ -15,6 +15,7 @@
  */
 
 #include "DMRaid.h"
+#include "DM_Info.h"
 #include "Partition.h"
 
 #include <limits.h>
@@ -152,6 +153,8 @@ int DMRaid::execute_command( const Glib::ustring & command, OperationDetail & op
 	operationdetail .add_child( OperationDetail( command, STATUS_NONE, FONT_BOLD_ITALIC ) ) ;
 
 	int exit_status = Utils::execute_command( command, output, error );
+	// The command may have added or removed mappings
+	DM_Info::clear_cache();
 
 	if ( ! output .empty() )
 		operationdetail .get_last_child() .add_child( OperationDetail( output, STATUS_NONE, FONT_ITALIC ) ) ;
@@ -240,6 +243,11 @@ int DMRaid::get_partition_number( const Glib::ustring & partition_name )
 
 Glib::ustring DMRaid::get_udev_dm_name( const Glib::ustring & dev_path )
 {
+	//Look up the name of the Device-mapper device in the mappings read from the
+	//  kernel, rather than running a udev command for each query
+	if ( DM_Info::is_available() )
+		return DM_Info::get_name( dev_path );
+
 	//Retrieve DM_NAME of device using udev information
 	Glib::ustring output = "" ;
 	Glib::ustring error  = "" ;
@@ -348,6 +356,7 @@ bool DMRaid::create_dev_map_entries( const Glib::ustring & dev_path )
 	//  and the partition number.
 	if ( Utils::execute_command( "dmraid -ay -P \"\" -v", output, error, true ) )
 		exit_status = false;  // command failed
+	DM_Info::clear_cache();
 
 	return exit_status ;
 }
@@ -465,6 +474,7 @@ bool DMRaid::purge_dev_map_entries( const Glib::ustring & dev_path )
 		if ( Utils::execute_command( command, output, error, true ) )
 			exit_status = false ;	//command failed
 	}
+	DM_Info::clear_cache();
 
 	return exit_status ;
 }
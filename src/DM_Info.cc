@@ -0,0 +1,260 @@
+/* Copyright (C) 2018 Mike Fleetwood
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "DM_Info.h"
+#include "BlockSpecial.h"
+#include "Utils.h"
+
+#include <glibmm/ustring.h>
+#include <glibmm/thread.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <linux/dm-ioctl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace GParted
+{
+
+const char * const DM_CONTROL_PATH = "/dev/mapper/control";
+
+// Sizes of the buffer passed to the Device-mapper ioctls.  Doubled from the initial size
+// until the results fit.
+const size_t DM_IOCTL_INITIAL_SIZE = 16 * KIBIBYTE;
+const size_t DM_IOCTL_MAX_SIZE     = 16 * MEBIBYTE;
+
+// Cache of active Device-mapper mappings.
+// Example entry:
+//     {name="sdb6_crypt", uuid="CRYPT-LUKS1-...-sdb6_crypt", dev=BlockSpecial{"/dev/mapper/sdb6_crypt", 253, 0},
+//      targets=[{start=0, length=1044480, target_type="crypt", params="aes-xts-plain64 0000... 0 8:22 4096"}]}
+// The key of crypt targets is masked with zeros, as dmsetup table does by default.
+std::vector<DM_Mapping> DM_Info::dm_mapping_cache;
+
+bool DM_Info::cache_initialised = false;
+bool DM_Info::dm_ioctls_work = false;
+
+// Protects the above when devices are probed concurrently.
+static Glib::Mutex dm_mapping_cache_mutex;
+
+void DM_Info::clear_cache()
+{
+	Glib::Mutex::Lock lock( dm_mapping_cache_mutex );
+	dm_mapping_cache.clear();
+	cache_initialised = false;
+}
+
+// Report whether the mappings could be read from the kernel.  When not the callers fall
+// back to running the dmsetup and udevadm commands.
+bool DM_Info::is_available()
+{
+	Glib::Mutex::Lock lock( dm_mapping_cache_mutex );
+	initialise_if_required();
+	return dm_ioctls_work;
+}
+
+std::vector<DM_Mapping> DM_Info::get_mappings()
+{
+	Glib::Mutex::Lock lock( dm_mapping_cache_mutex );
+	initialise_if_required();
+	return dm_mapping_cache;
+}
+
+// Return the Device-mapper name of the device, or "" when it isn't an active mapping.
+Glib::ustring DM_Info::get_name( const Glib::ustring & path )
+{
+	Glib::Mutex::Lock lock( dm_mapping_cache_mutex );
+	initialise_if_required();
+	BlockSpecial bs = BlockSpecial( path );
+	for ( unsigned int i = 0 ; i < dm_mapping_cache.size() ; i ++ )
+	{
+		if ( dm_mapping_cache[i].dev == bs )
+			return dm_mapping_cache[i].name;
+	}
+	return "";
+}
+
+//Private methods
+
+// Overwrite the buffer so that no encryption keys are left in freed memory.
+static void wipe_buffer( std::vector<char> & buf )
+{
+	volatile char * p = buf.empty() ? NULL : &buf[0];
+	for ( size_t i = 0 ; i < buf.size() ; i ++ )
+		p[i] = 0;
+}
+
+// Copy the parameters of a crypt target with the key replaced by zeros of the same
+// length.  The key is the second field:
+//     cipher key iv_offset device_path offset [#opt_params opt_params]
+static Glib::ustring masked_crypt_params( const char * params, size_t len )
+{
+	std::string masked( params, len );
+	size_t key_start = masked.find( ' ' );
+	if ( key_start == std::string::npos )
+		return masked;
+	key_start ++;
+	size_t key_end = masked.find( ' ', key_start );
+	if ( key_end == std::string::npos )
+		key_end = masked.size();
+	masked.replace( key_start, key_end - key_start, key_end - key_start, '0' );
+	return masked;
+}
+
+void DM_Info::initialise_if_required()
+{
+	if ( ! cache_initialised )
+	{
+		dm_ioctls_work = load_cache();
+		cache_initialised = true;
+	}
+}
+
+// Load all the mappings and their tables.  Returns false when the Device-mapper ioctls
+// can't be used, such as when the dm-mod kernel module isn't loaded.
+bool DM_Info::load_cache()
+{
+	dm_mapping_cache.clear();
+
+	int fd = open( DM_CONTROL_PATH, O_RDWR );
+	if ( fd < 0 )
+		return false;
+
+	std::vector<char> buf;
+	if ( ! dm_ioctl( fd, DM_LIST_DEVICES, "", 0, buf ) )
+	{
+		close( fd );
+		return false;
+	}
+
+	// The results are a chain of struct dm_name_list entries, each with the offset
+	// to the next, ending with an offset of 0.  No devices is reported as a single
+	// entry with a dev of 0.
+	const struct dm_ioctl * dmi = reinterpret_cast<const struct dm_ioctl *>( &buf[0] );
+	size_t data_end = std::min( (size_t)dmi->data_size, buf.size() );
+	size_t offset = dmi->data_start;
+	std::vector<DM_Mapping> mappings;
+	while ( offset + sizeof( struct dm_name_list ) <= data_end )
+	{
+		const struct dm_name_list * entry = reinterpret_cast<const struct dm_name_list *>( &buf[offset] );
+		if ( entry->dev == 0 )
+			break;
+
+		size_t name_max = data_end - offset - offsetof( struct dm_name_list, name );
+		DM_Mapping mapping;
+		mapping.name = Glib::ustring( entry->name, strnlen( entry->name, name_max ) );
+		mapping.dev.m_name = DEV_MAPPER_PATH + mapping.name;
+		mapping.dev.m_major = major( entry->dev );
+		mapping.dev.m_minor = minor( entry->dev );
+		mappings.push_back( mapping );
+
+		if ( entry->next == 0 )
+			break;
+		offset += entry->next;
+	}
+
+	for ( unsigned int i = 0 ; i < mappings.size() ; i ++ )
+	{
+		// Skip mappings removed since being listed
+		if ( load_table( fd, mappings[i] ) )
+			dm_mapping_cache.push_back( mappings[i] );
+	}
+	close( fd );
+	return true;
+}
+
+// Run a Device-mapper ioctl on the named mapping, or all mappings when name is "".  On
+// success buf holds the struct dm_ioctl followed by the results.
+bool DM_Info::dm_ioctl( int fd, unsigned long request, const Glib::ustring & name, unsigned int flags,
+                        std::vector<char> & buf )
+{
+	if ( name.bytes() >= DM_NAME_LEN )
+		return false;
+
+	for ( size_t size = DM_IOCTL_INITIAL_SIZE ; size <= DM_IOCTL_MAX_SIZE ; size *= 2 )
+	{
+		if ( flags & DM_SECURE_DATA_FLAG )
+			wipe_buffer( buf );
+		buf.assign( size, 0 );
+		struct dm_ioctl * dmi = reinterpret_cast<struct dm_ioctl *>( &buf[0] );
+		dmi->version[0] = DM_VERSION_MAJOR;
+		dmi->version[1] = 0;
+		dmi->version[2] = 0;
+		dmi->data_size  = size;
+		dmi->data_start = sizeof( struct dm_ioctl );
+		dmi->flags      = flags;
+		strncpy( dmi->name, name.c_str(), DM_NAME_LEN - 1 );
+		if ( ioctl( fd, request, dmi ) < 0 )
+			return false;
+		if ( ! ( dmi->flags & DM_BUFFER_FULL_FLAG ) )
+			return true;
+	}
+	return false;
+}
+
+// Load the UUID and table of the mapping.  The table is the same as reported by
+// "dmsetup table", a chain of struct dm_target_spec, each followed by the parameters.
+// The table of a crypt target includes the encryption key, so the kernel is asked to
+// wipe its copies, the key is masked before storing and the buffer is wiped after use.
+bool DM_Info::load_table( int fd, DM_Mapping & mapping )
+{
+	std::vector<char> buf;
+	if ( ! dm_ioctl( fd, DM_TABLE_STATUS, mapping.name, DM_STATUS_TABLE_FLAG | DM_SECURE_DATA_FLAG, buf ) )
+	{
+		wipe_buffer( buf );
+		return false;
+	}
+	bool success = parse_table( buf, mapping );
+	wipe_buffer( buf );
+	return success;
+}
+
+bool DM_Info::parse_table( const std::vector<char> & buf, DM_Mapping & mapping )
+{
+	const struct dm_ioctl * dmi = reinterpret_cast<const struct dm_ioctl *>( &buf[0] );
+	mapping.uuid = Glib::ustring( dmi->uuid, strnlen( dmi->uuid, DM_UUID_LEN ) );
+
+	// Offsets to the next target are from the start of the results
+	size_t data_end = std::min( (size_t)dmi->data_size, buf.size() );
+	size_t offset = dmi->data_start;
+	for ( unsigned int i = 0 ; i < dmi->target_count ; i ++ )
+	{
+		if ( offset + sizeof( struct dm_target_spec ) > data_end )
+			return false;
+		const struct dm_target_spec * spec = reinterpret_cast<const struct dm_target_spec *>( &buf[offset] );
+		const char * params = reinterpret_cast<const char *>( spec + 1 );
+		size_t params_max = data_end - offset - sizeof( struct dm_target_spec );
+
+		DM_Target target;
+		target.start       = spec->sector_start;
+		target.length      = spec->length;
+		target.target_type = Glib::ustring( spec->target_type,
+		                                    strnlen( spec->target_type, DM_MAX_TYPE_NAME ) );
+		if ( target.target_type == "crypt" )
+			target.params = masked_crypt_params( params, strnlen( params, params_max ) );
+		else
+			target.params = Glib::ustring( params, strnlen( params, params_max ) );
+		mapping.targets.push_back( target );
+
+		offset = dmi->data_start + spec->next;
+	}
+	return true;
+}
+
+}//GParted
@@ -33,6 +33,7 @@ void Device::Reset()
 	heads = sectors = cylinders = 0 ;
 	model = "";
 	serial_number = "";
+	wwid = "";
 	disktype = "";
 	sector_size = max_prims = highest_busy = 0 ;
 	readonly = false ; 	
@@ -48,6 +49,7 @@ Device Device::get_copy_without_partitions() const
 	new_device.cylinders                 = this->cylinders;
 	new_device.cylsize                   = this->cylsize;
 	new_device.model                     = this->model;
+	new_device.wwid                      = this->wwid;
 	new_device.disktype                  = this->disktype;
 	new_device.sector_size               = this->sector_size;
 	new_device.max_prims                 = this->max_prims;
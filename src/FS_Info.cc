@@ -17,10 +17,16 @@
 #include "FS_Info.h"
 #include "BlockSpecial.h"
 #include "Proc_Partitions_Info.h"
+#include "TextTokenizer.h"
 #include "Utils.h"
 
 #include <glibmm/ustring.h>
+#include <glibmm/thread.h>
 #include <vector>
+#ifdef ENABLE_LIBBLKID
+#include <blkid/blkid.h>
+#include <string.h>
+#endif
 
 namespace GParted
 {
@@ -47,8 +53,120 @@ bool FS_Info::need_blkid_vfat_cache_update_workaround = true;
 //     ]
 std::vector<FS_Entry> FS_Info::fs_info_cache;
 
+// Index of the paths in fs_info_cache.  Entries are only ever appended to the cache, so
+// the index is brought up to date as required before each lookup.
+BlockSpecialIndex FS_Info::fs_info_index;
+
+// Protects the above when devices are probed concurrently.  Not held while running
+// blkid for a single path so that those runs can overlap.
+static Glib::Mutex fs_info_mutex;
+
+#ifdef ENABLE_LIBBLKID
+static void set_fs_entry_value( FS_Entry & fs_entry, const char * name, const char * value )
+{
+	if ( strcmp( name, "TYPE" ) == 0 )
+		fs_entry.type = value;
+	else if ( strcmp( name, "SEC_TYPE" ) == 0 )
+		fs_entry.sec_type = value;
+	else if ( strcmp( name, "UUID" ) == 0 )
+		fs_entry.uuid = value;
+	else if ( strcmp( name, "LABEL" ) == 0 )
+		fs_entry.label = value;
+}
+
+// Load entries for all block devices using libblkid in process, rather than running
+// blkid.  Labels are read in the same pass.  Libblkid's tag values aren't encoded like
+// blkid's output, so the labels are as stored (#786502).
+static bool libblkid_load_all( std::vector<FS_Entry> & cache )
+{
+	blkid_cache bcache;
+	// Probe the devices rather than trusting blkid's on disk cache, the same as
+	// "blkid -c /dev/null".
+	if ( blkid_get_cache( &bcache, "/dev/null" ) != 0 )
+		return false;
+	blkid_probe_all( bcache );
+
+	bool loaded_entries = false;
+	blkid_dev_iterate dev_iter = blkid_dev_iterate_begin( bcache );
+	blkid_dev dev;
+	while ( blkid_dev_next( dev_iter, &dev ) == 0 )
+	{
+		FS_Entry fs_entry = {BlockSpecial( blkid_dev_devname( dev ) ), "", "", "", false, ""};
+		blkid_tag_iterate tag_iter = blkid_tag_iterate_begin( dev );
+		const char * name;
+		const char * value;
+		while ( blkid_tag_next( tag_iter, &name, &value ) == 0 )
+			set_fs_entry_value( fs_entry, name, value );
+		blkid_tag_iterate_end( tag_iter );
+
+		fs_entry.have_label = ( fs_entry.type != "" );
+		cache.push_back( fs_entry );
+		loaded_entries = true;
+	}
+	blkid_dev_iterate_end( dev_iter );
+	blkid_put_cache( bcache );
+
+	return loaded_entries;
+}
+
+// Load the entry for one path, which may be a file system image file, using the libblkid
+// low-level probe API.
+static bool libblkid_load_path( std::vector<FS_Entry> & cache, const Glib::ustring & path )
+{
+	blkid_probe pr = blkid_new_probe_from_filename( path.c_str() );
+	if ( pr == NULL )
+		return false;
+	blkid_probe_enable_superblocks( pr, 1 );
+	blkid_probe_set_superblocks_flags( pr, BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID |
+	                                       BLKID_SUBLKS_TYPE  | BLKID_SUBLKS_SECTYPE );
+	// Also probe for a partition table, as blkid does, so that a whole disk device
+	// with a partition table isn't identified by a stale file system signature.
+	blkid_probe_enable_partitions( pr, 1 );
+
+	bool loaded_entry = false;
+	if ( blkid_do_safeprobe( pr ) == 0 )
+	{
+		FS_Entry fs_entry = {BlockSpecial( path ), "", "", "", false, ""};
+		int num_values = blkid_probe_numof_values( pr );
+		for ( int i = 0 ; i < num_values ; i ++ )
+		{
+			const char * name;
+			const char * value;
+			if ( blkid_probe_get_value( pr, i, &name, &value, NULL ) == 0 )
+				set_fs_entry_value( fs_entry, name, value );
+		}
+
+		fs_entry.have_label = ( fs_entry.type != "" );
+		cache.push_back( fs_entry );
+		loaded_entry = true;
+	}
+	blkid_free_probe( pr );
+
+	return loaded_entry;
+}
+#endif
+
+#ifndef ENABLE_LIBBLKID
+// Return the value of the tag in a line of blkid output, without the surrounding quotes.
+// Tag is the leading space, name, equals and opening quote, e.g. " TYPE=\"".  Returns an
+// empty view when the line doesn't contain the tag.
+static StringView blkid_tag_value( const StringView & line, const char * tag )
+{
+	StringView tag_view( tag );
+	size_t start = line.find( tag_view );
+	if ( start == StringView::npos )
+		return StringView();
+	start += tag_view.size();
+	size_t end = line.find( "\"", start );
+	if ( end == StringView::npos )
+		return StringView();
+	return line.substr( start, end - start );
+}
+#endif
+
 void FS_Info::load_cache()
 {
+	Glib::Mutex::Lock lock( fs_info_mutex );
 	set_commands_found();
 	load_fs_info_cache();
 	fs_info_cache_initialized = true;
@@ -56,6 +174,7 @@ void FS_Info::load_cache()
 
 void FS_Info::load_cache_for_paths( const std::vector<Glib::ustring> &device_paths )
 {
+	Glib::Mutex::Lock lock( fs_info_mutex );
 	initialize_if_required();
 	const BlockSpecial empty_bs = BlockSpecial();
 	for ( unsigned int i = 0 ; i < device_paths.size() ; i ++ )
@@ -72,15 +191,22 @@ void FS_Info::load_cache_for_paths( const std::vector<Glib::ustring> &device_pat
 // Retrieve the file system type for the path
 Glib::ustring FS_Info::get_fs_type( const Glib::ustring & path )
 {
-	initialize_if_required();
-	const FS_Entry & fs_entry = get_cache_entry_by_path( path );
-	Glib::ustring fs_type = fs_entry.type;
-	Glib::ustring fs_sec_type = fs_entry.sec_type;
+	Glib::ustring fs_type;
+	Glib::ustring fs_sec_type;
+	bool need_workaround;
+	{
+		Glib::Mutex::Lock lock( fs_info_mutex );
+		initialize_if_required();
+		const FS_Entry & fs_entry = get_cache_entry_by_path( path );
+		fs_type = fs_entry.type;
+		fs_sec_type = fs_entry.sec_type;
+		need_workaround = need_blkid_vfat_cache_update_workaround;
+	}
 
 	// If vfat, decide whether fat16 or fat32
 	if ( fs_type == "vfat" )
 	{
-		if ( need_blkid_vfat_cache_update_workaround )
+		if ( need_workaround )
 		{
 			// Blkid cache does not correctly add and remove SEC_TYPE when
 			// overwriting FAT16 and FAT32 file systems with each other, so
@@ -104,33 +230,49 @@ Glib::ustring FS_Info::get_fs_type( const Glib::ustring & path )
 // Retrieve the label and set found indicator for the path
 Glib::ustring FS_Info::get_label( const Glib::ustring & path, bool & found )
 {
-	initialize_if_required();
 	BlockSpecial bs = BlockSpecial( path );
-	for ( unsigned int i = 0 ; i < fs_info_cache.size() ; i ++ )
-		if ( bs == fs_info_cache[i].path )
+	FS_Entry fs_entry = {BlockSpecial(), "", "", "", false, ""};
+	{
+		Glib::Mutex::Lock lock( fs_info_mutex );
+		initialize_if_required();
+		unsigned int i;
+		if ( ! find_cache_index( bs, i ) )
 		{
-			if ( fs_info_cache[i].have_label || fs_info_cache[i].type == "" )
-			{
-				// Already have the label or this is a blank cache entry
-				// for a whole disk device containing a partition table,
-				// so no label (as created by
-				// load_fs_info_cache_extra_for_path()).
-				found = fs_info_cache[i].have_label;
-				return fs_info_cache[i].label;
-			}
-
-			// Run blkid to get the label for this one partition, update the
-			// cache and return the found label.
-			found = run_blkid_update_cache_one_label( fs_info_cache[i] );
+			found = false;
+			return "";
+		}
+
+		if ( fs_info_cache[i].have_label || fs_info_cache[i].type == "" )
+		{
+			// Already have the label or this is a blank cache entry for a
+			// whole disk device containing a partition table, so no label (as
+			// created by load_fs_info_cache_extra_for_path()).
+			found = fs_info_cache[i].have_label;
 			return fs_info_cache[i].label;
 		}
-	found = false;
-	return "";
+		fs_entry = fs_info_cache[i];
+	}
+
+	// Run blkid to get the label for this one partition, update the cache and return
+	// the found label.
+	found = run_blkid_update_cache_one_label( fs_entry );
+	if ( found )
+	{
+		Glib::Mutex::Lock lock( fs_info_mutex );
+		unsigned int i;
+		if ( find_cache_index( bs, i ) )
+		{
+			fs_info_cache[i].have_label = true;
+			fs_info_cache[i].label = fs_entry.label;
+		}
+	}
+	return fs_entry.label;
 }
 
 // Retrieve the uuid given for the path
 Glib::ustring FS_Info::get_uuid( const Glib::ustring & path )
 {
+	Glib::Mutex::Lock lock( fs_info_mutex );
 	initialize_if_required();
 	const FS_Entry & fs_entry = get_cache_entry_by_path( path );
 	return fs_entry.uuid;
@@ -139,6 +281,7 @@ Glib::ustring FS_Info::get_uuid( const Glib::ustring & path )
 // Retrieve the path given the uuid
 Glib::ustring FS_Info::get_path_by_uuid( const Glib::ustring & uuid )
 {
+	Glib::Mutex::Lock lock( fs_info_mutex );
 	initialize_if_required();
 	for ( unsigned int i = 0 ; i < fs_info_cache.size() ; i ++ )
 		if ( uuid == fs_info_cache[i].uuid )
@@ -150,6 +293,7 @@ Glib::ustring FS_Info::get_path_by_uuid( const Glib::ustring & uuid )
 // Retrieve the path given the label
 Glib::ustring FS_Info::get_path_by_label( const Glib::ustring & label )
 {
+	Glib::Mutex::Lock lock( fs_info_mutex );
 	initialize_if_required();
 	update_fs_info_cache_all_labels();
 	for ( unsigned int i = 0 ; i < fs_info_cache.size() ; i ++ )
@@ -159,6 +303,32 @@ Glib::ustring FS_Info::get_path_by_label( const Glib::ustring & label )
 	return "";
 }
 
+// Retrieve the paths of all block devices containing the given file system type
+std::vector<Glib::ustring> FS_Info::get_paths_by_fs_type( const Glib::ustring & fstype )
+{
+	Glib::Mutex::Lock lock( fs_info_mutex );
+	initialize_if_required();
+	std::vector<Glib::ustring> paths;
+	for ( unsigned int i = 0 ; i < fs_info_cache.size() ; i ++ )
+		if ( fstype == fs_info_cache[i].type )
+			paths.push_back( fs_info_cache[i].path.m_name );
+
+	return paths;
+}
+
+// Return whether file system types can be identified, in process with libblkid or by
+// running blkid.
+bool FS_Info::can_identify_fs_types()
+{
+#ifdef ENABLE_LIBBLKID
+	return true;
+#else
+	Glib::Mutex::Lock lock( fs_info_mutex );
+	initialize_if_required();
+	return blkid_found;
+#endif
+}
+
 // Private methods
 
 void FS_Info::initialize_if_required()
@@ -175,6 +345,11 @@ void FS_Info::set_commands_found()
 {
 	//Set status of commands found 
 	blkid_found = (! Glib::find_program_in_path( "blkid" ) .empty() ) ;
+#ifdef ENABLE_LIBBLKID
+	// Libblkid probes the devices directly, bypassing blkid's cache, so the workaround
+	// is never needed.
+	need_blkid_vfat_cache_update_workaround = false;
+#else
 	if ( blkid_found )
 	{
 		// Blkid from util-linux before 2.23 has a cache update bug which prevents
@@ -192,22 +367,31 @@ void FS_Info::set_commands_found()
 					  ( blkid_major_ver == 2 && blkid_minor_ver < 23 )    );
 		}
 	}
+#endif
 }
 
 const FS_Entry & FS_Info::get_cache_entry_by_path( const Glib::ustring & path )
 {
-	BlockSpecial bs = BlockSpecial( path );
-	for ( unsigned int i = 0 ; i < fs_info_cache.size() ; i ++ )
-		if ( bs == fs_info_cache[i].path )
-			return fs_info_cache[i];
+	unsigned int i;
+	if ( find_cache_index( BlockSpecial( path ), i ) )
+		return fs_info_cache[i];
 
 	static FS_Entry not_found = {BlockSpecial(), "", "", "", false, ""};
 	return not_found;
 }
 
+// Find the index of the first cache entry for the block special file.
+bool FS_Info::find_cache_index( const BlockSpecial & bs, unsigned int & index )
+{
+	for ( unsigned int i = fs_info_index.size() ; i < fs_info_cache.size() ; i ++ )
+		fs_info_index.push_back( fs_info_cache[i].path );
+	return fs_info_index.find( bs, index );
+}
+
 void FS_Info::load_fs_info_cache()
 {
 	fs_info_cache.clear();
+	fs_info_index.clear();
 	// Run "blkid" and load entries into the cache.
 	run_blkid_load_cache();
 
@@ -241,6 +425,11 @@ void FS_Info::load_fs_info_cache_extra_for_path( const Glib::ustring & path )
 
 bool FS_Info::run_blkid_load_cache( const Glib::ustring & path )
 {
+#ifdef ENABLE_LIBBLKID
+	if ( path.empty() )
+		return libblkid_load_all( fs_info_cache );
+	return libblkid_load_path( fs_info_cache, path );
+#else
 	// Parse blkid output line by line extracting mandatory field: path and optional
 	// fields: type, sec_type, uuid.  Label is not extracted here because of blkid's
 	// default non-reversible encoding of non printable ASCII bytes.
@@ -262,25 +451,26 @@ bool FS_Info::run_blkid_load_cache( const Glib::ustring & path )
 	if ( blkid_found                                          &&
 	     ! Utils::execute_command( cmd, output, error, true )    )
 	{
-		std::vector<Glib::ustring> lines;
-		Utils::split( output, lines, "\n" );
-		for ( unsigned int i = 0 ; i < lines.size() ; i ++ )
+		TextTokenizer lines( output.raw(), "\n", true );
+		StringView line;
+		while ( lines.next( line ) )
 		{
+			size_t path_end = line.find( ": " );
+			if ( path_end == 0 || path_end == StringView::npos )
+				continue;
+
 			FS_Entry fs_entry = {BlockSpecial(), "", "", "", false, ""};
-			Glib::ustring entry_path = Utils::regexp_label( lines[i], "^(.*): " );
-			if ( entry_path.length() > 0 )
-			{
-				fs_entry.path = BlockSpecial( entry_path );
-				fs_entry.type = Utils::regexp_label( lines[i], " TYPE=\"([^\"]*)\"" );
-				fs_entry.sec_type = Utils::regexp_label( lines[i], " SEC_TYPE=\"([^\"]*)\"" );
-				fs_entry.uuid = Utils::regexp_label( lines[i], " UUID=\"([^\"]*)\"" );
-				fs_info_cache.push_back( fs_entry );
-				loaded_entries = true;
-			}
+			fs_entry.path = BlockSpecial( line.substr( 0, path_end ).str() );
+			fs_entry.type = blkid_tag_value( line, " TYPE=\"" ).str();
+			fs_entry.sec_type = blkid_tag_value( line, " SEC_TYPE=\"" ).str();
+			fs_entry.uuid = blkid_tag_value( line, " UUID=\"" ).str();
+			fs_info_cache.push_back( fs_entry );
+			loaded_entries = true;
 		}
 	}
 
 	return loaded_entries;
+#endif
 }
 
 void FS_Info::update_fs_info_cache_all_labels()
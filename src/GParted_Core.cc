@@ -18,13 +18,16 @@
 #include "Win_GParted.h"
 #include "GParted_Core.h"
 #include "CopyBlocks.h"
+#include "CopyTuner.h"
 #include "BlockSpecial.h"
 #include "DMRaid.h"
+#include "DM_Info.h"
 #include "FileSystem.h"
 #include "FS_Info.h"
 #include "LVM2_PV_Info.h"
 #include "LUKS_Info.h"
 #include "Mount_Info.h"
+#include "MoveJournal.h"
 #include "Operation.h"
 #include "OperationCopy.h"
 #include "Partition.h"
@@ -33,6 +36,7 @@
 #include "Proc_Partitions_Info.h"
 #include "SWRaid_Info.h"
 #include "Utils.h"
+#include "WorkerPool.h"
 
 #include "btrfs.h"
 #include "exfat.h"
@@ -57,19 +61,64 @@
 #include <cerrno>
 #include <cstring>
 #include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <fstream>
+#include <scsi/sg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <glibmm/fileutils.h>
+#include <glibmm/timer.h>
 #include <gtkmm/messagedialog.h>
 #include <gtkmm/main.h>
 
 std::vector<Glib::ustring> libparted_messages ; //see ped_exception_handler()
 
+// Libparted isn't thread safe.  Held for all use of libparted, and libparted_messages,
+// while devices are probed concurrently.
+static Glib::RecMutex libparted_mutex;
+
 namespace GParted
 {
 
 const std::time_t SETTLE_DEVICE_PROBE_MAX_WAIT_SECONDS = 1;
 const std::time_t SETTLE_DEVICE_APPLY_MAX_WAIT_SECONDS = 10;
 
+// Targeted settling of a device polls its udev state at this interval until unchanged
+// for the quiet period.
+const unsigned int SETTLE_DEVICE_POLL_MS  = 20;
+const unsigned int SETTLE_DEVICE_QUIET_MS = 200;
+
+const char * const UDEV_DATA_DIR   = "/run/udev/data";
+const char * const UDEV_QUEUE_FLAG = "/run/udev/queue";  // Exists while udev has events queued
+
+// Granularity of tmpfs file timestamps, which come from the coarse kernel clock and so
+// can lag the time of day by up to one timer tick.
+const long UDEV_DB_MTIME_GRANULARITY_NS = 10 * 1000 * 1000;
+
+static struct timespec udev_events_start_time();
+
+// Moves of a file system by less than this aren't journalled.  Writes can't get further
+// ahead of the last checkpoint than the distance moved, and each checkpoint flushes the
+// device and rewrites the journal, so smaller moves would checkpoint too often.
+const Byte_Value MOVE_JOURNAL_MIN_DISTANCE = 64 * MEBIBYTE;
+
+// Devices, and the partitions within each device, are probed concurrently on up to this
+// many threads.  Probing is mostly spent waiting for the commands run and for the disks.
+// The partition pools run within the device pool, so PROBE_THREADS limits the threads
+// of them all together, and so the commands run at once.
+const unsigned int PROBE_THREADS = 8;
+const unsigned int PROBE_DEVICE_THREADS = 8;
+const unsigned int PROBE_PARTITION_THREADS = 4;
+
+// Time allowed for a device to answer the SCSI INQUIRY for its serial number.  Some USB
+// bridges never answer so don't wait long.
+const unsigned int INQUIRY_TIMEOUT_MS = 3000;
+
 static bool udevadm_found = false;
 static bool udevsettle_found = false;
 static bool hdparm_found = false;
@@ -93,6 +142,9 @@ GParted_Core::GParted_Core()
 	std::cout << "libparted : " << ped_get_version() << std::endl ;
 	std::cout << "======================" << std::endl ;
 
+	// The calling thread probes too, so it isn't counted in the limit.
+	WorkerPool::set_thread_limit( PROBE_THREADS - 1 );
+
 	find_supported_core();
 
 	//initialize file system list
@@ -162,12 +214,14 @@ void GParted_Core::set_devices_thread( std::vector<Device> * pdevices )
 	                                        // pre-populates BlockSpecial cache.
 	FS_Info::load_cache();                  // SHOULD BE THRID.  Caches file system details
 	                                        // from blkid output.
+	DM_Info::clear_cache();                 // Cache automatically loaded if and when needed
 	DMRaid dmraid( true ) ;    //Refresh cache of dmraid device information
 	LVM2_PV_Info::clear_cache();            // Cache automatically loaded if and when needed
 	btrfs::clear_cache();                   // Cache incrementally loaded if and when needed
 	SWRaid_Info::load_cache();
 	LUKS_Info::clear_cache();               // Cache automatically loaded if and when needed
 	Mount_Info::load_cache();
+	device_identities.clear();
 
 	//only probe if no devices were specified as arguments..
 	if ( probe_devices )
@@ -198,8 +252,9 @@ void GParted_Core::set_devices_thread( std::vector<Device> * pdevices )
 				for ( unsigned int k=0; k < dmraid_devices .size(); k++ ) {
 					set_thread_status_message( String::ucompose ( _("Scanning %1"), dmraid_devices[k] ) ) ;
 #ifndef USE_LIBPARTED_DMRAID
+					struct timespec since = udev_events_start_time();
 					dmraid .create_dev_map_entries( dmraid_devices[k] ) ;
-					settle_device( SETTLE_DEVICE_PROBE_MAX_WAIT_SECONDS );
+					settle_device( dmraid_devices[k], since, SETTLE_DEVICE_PROBE_MAX_WAIT_SECONDS );
 #endif
 					ped_device_get( dmraid_devices[k] .c_str() ) ;
 				}
@@ -247,8 +302,9 @@ void GParted_Core::set_devices_thread( std::vector<Device> * pdevices )
 			if ( dmraid .is_dmraid_supported() &&
 			     dmraid .is_dmraid_device( device_paths[t] ) )
 			{
+				struct timespec since = udev_events_start_time();
 				dmraid .create_dev_map_entries( dmraid .get_dmraid_name( device_paths [t] ) ) ;
-				settle_device( SETTLE_DEVICE_PROBE_MAX_WAIT_SECONDS );
+				settle_device( device_paths[t], since, SETTLE_DEVICE_PROBE_MAX_WAIT_SECONDS );
 			}
 #endif
 
@@ -266,13 +322,21 @@ void GParted_Core::set_devices_thread( std::vector<Device> * pdevices )
 	// about, can be identified.
 	FS_Info::load_cache_for_paths( device_paths );
 
-	for ( unsigned int t = 0 ; t < device_paths .size() ; t++ ) 
+	// Probe the devices concurrently, each into its own element of the vector so that
+	// devices stay in the order of device_paths.
+	devices.resize( device_paths.size() );
+	WorkerPool pool( PROBE_DEVICE_THREADS );
+	pool.run( device_paths.size(),
+	          sigc::bind( sigc::mem_fun( *this, &GParted_Core::probe_device ), pdevices ) );
+
+	for ( unsigned int t = 0 ; t < devices.size() ; t++ )
 	{
-		/*TO TRANSLATORS: looks like Searching /dev/sda partitions */ 
-		set_thread_status_message( String::ucompose ( _("Searching %1 partitions"), device_paths[ t ] ) ) ;
-		Device temp_device;
-		set_device_from_disk( temp_device, device_paths[t] );
-		devices.push_back( temp_device );
+		// Without a serial number identify the disk by its world wide name, if it
+		// has one.
+		if ( ! devices[t].serial_number.empty() && devices[t].serial_number != "none" )
+			device_identities[devices[t].get_path()] = devices[t].model + " " + devices[t].serial_number;
+		else if ( ! devices[t].wwid.empty() )
+			device_identities[devices[t].get_path()] = devices[t].model + " " + devices[t].wwid;
 	}
 
 	set_thread_status_message("") ;
@@ -291,11 +355,13 @@ void GParted_Core::guess_partition_table(const Device & device, Glib::ustring &b
 void GParted_Core::set_thread_status_message( Glib::ustring msg )
 {
 	//Remember to clear status message when finished with thread.
+	Glib::Mutex::Lock lock( thread_status_mutex );
 	thread_status_message = msg ;
 }
 
 Glib::ustring GParted_Core::get_thread_status_message( )
 {
+	Glib::Mutex::Lock lock( thread_status_mutex );
 	return thread_status_message ;
 }
 
@@ -675,11 +741,48 @@ bool GParted_Core::apply_operation_to_disk( Operation * operation )
 			          && change_filesystem_uuid( operation->get_partition_new().get_filesystem_partition(),
 			                                     operation->operation_detail );
 			break;
+
+		case OPERATION_RESUME_MOVE:
+			success = calibrate_partition( operation->get_partition_original(),
+			                               operation->operation_detail );
+			if ( ! success )
+				break;
+
+			operation->get_partition_new().set_path( operation->get_partition_original().get_path() );
+			success = resume_move( operation->get_partition_original(),
+			                       operation->get_partition_new(),
+			                       operation->operation_detail );
+			break;
 	}
 
 	return success;
 }
 
+// Find the journal of a file system move interrupted by a crash.  When the device was
+// identified when it was journalled but it now has a different name, such as after
+// disks were added or removed, the journal is updated with the current name.
+bool GParted_Core::find_interrupted_move( MoveJournal & journal ) const
+{
+	if ( ! MoveJournal::load( journal ) )
+		return false;
+	if ( journal.device_identity.empty() )
+		return true;
+
+	std::map<Glib::ustring, Glib::ustring>::const_iterator it = device_identities.find( journal.device_path );
+	if ( it != device_identities.end() && it->second == journal.device_identity )
+		return true;
+	for ( it = device_identities.begin() ; it != device_identities.end() ; ++ it )
+	{
+		if ( it->second == journal.device_identity )
+		{
+			journal.device_path = it->first;
+			return true;
+		}
+	}
+	// The device isn't attached
+	return false;
+}
+
 bool GParted_Core::set_disklabel( const Device & device, const Glib::ustring & disklabel )
 {
 	Glib::ustring device_path = device.get_path();
@@ -861,10 +964,19 @@ Glib::ustring GParted_Core::get_partition_path( PedPartition * lp_partition )
 	return partition_path ;
 }
 
+// Probe one device.  Run concurrently for the devices by set_devices_thread().
+void GParted_Core::probe_device( unsigned int index, std::vector<Device> * devices )
+{
+	/*TO TRANSLATORS: looks like Searching /dev/sda partitions */
+	set_thread_status_message( String::ucompose ( _("Searching %1 partitions"), device_paths[index] ) );
+	set_device_from_disk( (*devices)[index], device_paths[index] );
+}
+
 void GParted_Core::set_device_from_disk( Device & device, const Glib::ustring & device_path )
 {
 	PedDevice* lp_device = NULL;
 	PedDisk* lp_disk = NULL;
+	libparted_mutex.lock();
 	if ( get_device( device_path, lp_device, true ) )
 	{
 		device.Reset();
@@ -878,7 +990,11 @@ void GParted_Core::set_device_from_disk( Device & device, const Glib::ustring &
 		device.sectors     = lp_device->bios_geom.sectors;
 		device.cylinders   = lp_device->bios_geom.cylinders;
 		device.cylsize     = device.heads * device.sectors;
+
+		// Let other devices use libparted while hdparm is run
+		libparted_mutex.unlock();
 		set_device_serial_number( device );
+		libparted_mutex.lock();
 
 		// Make sure cylsize is at least 1 MiB
 		if ( device.cylsize < (MEBIBYTE / device.sector_size) )
@@ -977,9 +1093,187 @@ void GParted_Core::set_device_from_disk( Device & device, const Glib::ustring &
 
 		destroy_device_and_disk( lp_device, lp_disk);
 	}
+	libparted_mutex.unlock();
+}
+
+// Keep only the printable ASCII characters of a serial number, which is space padded and
+// sometimes NUL padded too.
+static Glib::ustring clean_serial_number( const char * buf, size_t len )
+{
+	std::string serial_number;
+	for ( size_t i = 0 ; i < len ; i ++ )
+	{
+		if ( buf[i] > ' ' && buf[i] < 127 )
+			serial_number += buf[i];
+		else if ( buf[i] == ' ' )
+			serial_number += ' ';
+	}
+	return Utils::trim( serial_number );
+}
+
+// Extract the serial number from a Unit Serial Number VPD page (0x80).  The page has a 4
+// byte header, with the length of the serial number in byte 3.
+static Glib::ustring parse_vpd_page_80( const unsigned char * page, size_t len )
+{
+	if ( len < 4 || page[1] != 0x80 )
+		return "";
+	size_t serial_len = std::min( (size_t)page[3], len - 4 );
+	return clean_serial_number( reinterpret_cast<const char *>( page + 4 ), serial_len );
+}
+
+static Glib::ustring read_sysfs_file( const Glib::ustring & filename )
+{
+	std::ifstream input( filename.c_str(), std::ios::in | std::ios::binary );
+	if ( ! input )
+		return "";
+	char buf[256];
+	input.read( buf, sizeof( buf ) );
+	return std::string( buf, input.gcount() );
+}
+
+// Return the device numbers of a block special file as "major:minor", as used to name
+// its sysfs and udev database entries, or an empty string when it isn't one.
+static Glib::ustring get_device_numbers( const Glib::ustring & path )
+{
+	BlockSpecial bs( path );
+	if ( bs.m_major == 0 && bs.m_minor == 0 )
+		return "";
+	return Utils::num_to_str( bs.m_major ) + ":" + Utils::num_to_str( bs.m_minor );
+}
+
+static Glib::ustring get_sysfs_dir( const Glib::ustring & path )
+{
+	Glib::ustring dev_numbers = get_device_numbers( path );
+	if ( dev_numbers.empty() )
+		return "";
+	return "/sys/dev/block/" + dev_numbers;
+}
+
+// Read the serial number of a disk from the attributes the kernel exports in sysfs.
+// NVMe and virtio disks have a serial attribute.  SCSI, SATA and USB disks have the
+// Unit Serial Number VPD page cached as vpd_pg80.  Returns an empty string when neither
+// is available.
+static Glib::ustring read_sysfs_serial_number( const Glib::ustring & path )
+{
+	Glib::ustring sysfs_dir = get_sysfs_dir( path );
+	if ( sysfs_dir.empty() )
+		return "";
+
+	Glib::ustring serial_number = Utils::trim( read_sysfs_file( sysfs_dir + "/device/serial" ) );
+	if ( serial_number.empty() )
+		serial_number = Utils::trim( read_sysfs_file( sysfs_dir + "/serial" ) );
+	if ( serial_number.empty() )
+	{
+		std::string page = read_sysfs_file( sysfs_dir + "/device/vpd_pg80" );
+		serial_number = parse_vpd_page_80( reinterpret_cast<const unsigned char *>( page.data() ),
+		                                   page.size() );
+	}
+	if ( ! serial_number.validate() )
+		return "";
+	return serial_number;
+}
+
+// Read the serial number udev recorded for the disk, from the ATA identify data or USB
+// device descriptor, as ID_SERIAL_SHORT in its database entry.
+static Glib::ustring read_udev_serial_number( const Glib::ustring & path )
+{
+	Glib::ustring dev_numbers = get_device_numbers( path );
+	if ( dev_numbers.empty() )
+		return "";
+	Glib::ustring db_file = Glib::ustring( UDEV_DATA_DIR ) + "/b" + dev_numbers;
+	std::ifstream input( db_file.c_str() );
+	std::string line;
+	while ( getline( input, line ) )
+	{
+		if ( line.compare( 0, 18, "E:ID_SERIAL_SHORT=" ) == 0 )
+		{
+			Glib::ustring serial_number = clean_serial_number( line.data() + 18, line.size() - 18 );
+			if ( ! serial_number.validate() )
+				return "";
+			return serial_number;
+		}
+	}
+	return "";
+}
+
+// Read the device identification the kernel chose for a SCSI disk.  This is a world
+// wide name, such as "naa.5000c500a1b2c3d4", or a vendor specific identifier, such as
+// "t10.ATA     ST1000DM003...", rather than a serial number so is kept separately and
+// only used to identify disks without a serial number.  The type prefix is kept to
+// show which it is.
+static Glib::ustring read_sysfs_wwid( const Glib::ustring & path )
+{
+	Glib::ustring sysfs_dir = get_sysfs_dir( path );
+	if ( sysfs_dir.empty() )
+		return "";
+
+	std::string wwid = read_sysfs_file( sysfs_dir + "/device/wwid" );
+	Glib::ustring identifier = clean_serial_number( wwid.data(), wwid.size() );
+	if ( ! identifier.validate() )
+		return "";
+	return identifier;
+}
+
+// Ask the device for its Unit Serial Number VPD page with a SCSI INQUIRY.  Used for
+// disks where the kernel doesn't cache the page in sysfs.  Returns an empty string when
+// the device doesn't support the SG_IO ioctl or doesn't answer.
+static Glib::ustring inquire_serial_number( const Glib::ustring & path )
+{
+	int fd = open( path.c_str(), O_RDONLY | O_NONBLOCK );
+	if ( fd < 0 )
+		return "";
+
+	// INQUIRY with EVPD set for page 0x80
+	unsigned char cdb[6] = { 0x12, 0x01, 0x80, 0x00, 0xFF, 0x00 };
+	unsigned char page[255];
+	unsigned char sense[32];
+	sg_io_hdr_t io_hdr;
+	memset( &io_hdr, 0, sizeof( io_hdr ) );
+	memset( page, 0, sizeof( page ) );
+	io_hdr.interface_id    = 'S';
+	io_hdr.cmd_len         = sizeof( cdb );
+	io_hdr.cmdp            = cdb;
+	io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+	io_hdr.dxferp          = page;
+	io_hdr.dxfer_len       = sizeof( page );
+	io_hdr.sbp             = sense;
+	io_hdr.mx_sb_len       = sizeof( sense );
+	io_hdr.timeout         = INQUIRY_TIMEOUT_MS;
+	int ret = ioctl( fd, SG_IO, &io_hdr );
+	close( fd );
+	if ( ret < 0 || ( io_hdr.info & SG_INFO_OK_MASK ) != SG_INFO_OK )
+		return "";
+
+	int len = sizeof( page ) - io_hdr.resid;
+	if ( len <= 0 )
+		return "";
+	Glib::ustring serial_number = parse_vpd_page_80( page, len );
+	if ( ! serial_number.validate() )
+		return "";
+	return serial_number;
 }
 
 void GParted_Core::set_device_serial_number( Device & device )
+{
+	device.wwid = read_sysfs_wwid( device.get_path() );
+
+	// Read the serial number without running a command when possible, as hdparm -I
+	// can take seconds on some USB bridges.
+	Glib::ustring serial_number = read_sysfs_serial_number( device.get_path() );
+	if ( serial_number.empty() )
+		serial_number = read_udev_serial_number( device.get_path() );
+	if ( serial_number.empty() )
+		serial_number = inquire_serial_number( device.get_path() );
+	if ( ! serial_number.empty() )
+	{
+		device.serial_number = serial_number;
+		return;
+	}
+
+	set_device_serial_number_hdparm( device );
+}
+
+void GParted_Core::set_device_serial_number_hdparm( Device & device )
 {
 	if ( ! hdparm_found )
 		// Serial number left blank when the hdparm command is not installed.
@@ -1015,7 +1309,7 @@ void GParted_Core::set_device_serial_number( Device & device )
 
 /**
  * Fills the device.partitions member of device by scanning
- * all partitions
+ * all partitions.  Called with libparted_mutex held.
  */
 void GParted_Core::set_device_partitions( Device & device, PedDevice* lp_device, PedDisk* lp_disk )
 {
@@ -1023,6 +1317,7 @@ void GParted_Core::set_device_partitions( Device & device, PedDevice* lp_device,
 #ifndef USE_LIBPARTED_DMRAID
 	DMRaid dmraid ;    //Use cache of dmraid device information
 #endif
+	std::vector<PartitionProbe> probes;
 
 	//clear partitions
 	device .partitions .clear() ;
@@ -1032,9 +1327,9 @@ void GParted_Core::set_device_partitions( Device & device, PedDevice* lp_device,
 	{
 		libparted_messages .clear() ;
 		Partition * partition_temp = NULL;
-		bool partition_is_busy = false ;
 		FSType filesystem;
 		std::vector<Glib::ustring> detect_messages;
+		PartitionProbe probe;
 
 		//Retrieve partition path
 		Glib::ustring partition_path = get_partition_path( lp_partition );
@@ -1064,17 +1359,15 @@ void GParted_Core::set_device_partitions( Device & device, PedDevice* lp_device,
 				if ( dmraid .is_dmraid_device( device .get_path() ) )
 				{
 					//Try device_name + partition_number
-					Glib::ustring dmraid_path = device .get_path() + Utils::num_to_str( lp_partition ->num ) ;
-					partition_is_busy = is_busy( filesystem, dmraid_path ) ;
+					probe.busy_paths.push_back( device.get_path() + Utils::num_to_str( lp_partition->num ) );
 
 					//Try device_name + p + partition_number
-					dmraid_path = device .get_path() + "p" + Utils::num_to_str( lp_partition ->num ) ;
-					partition_is_busy |= is_busy( filesystem, dmraid_path ) ;
+					probe.busy_paths.push_back( device.get_path() + "p" + Utils::num_to_str( lp_partition->num ) );
 				}
 				else
 #endif
 				{
-					partition_is_busy = is_busy( filesystem, partition_path ) ;
+					probe.busy_paths.push_back( partition_path );
 				}
 
 				if ( filesystem == FS_LUKS )
@@ -1091,16 +1384,10 @@ void GParted_Core::set_device_partitions( Device & device, PedDevice* lp_device,
 				                     lp_partition->geom.end,
 				                     device.sector_size,
 				                     ( lp_partition->type == PED_PARTITION_LOGICAL ),
-				                     partition_is_busy );
+				                     false );  // Busy status is set when probed below
 				partition_temp->append_messages( detect_messages );
 
 				set_flags( *partition_temp, lp_partition );
-
-				if ( filesystem == FS_LUKS )
-					set_luks_partition( *dynamic_cast<PartitionLUKS *>( partition_temp ) );
-
-				if ( partition_temp->busy && partition_temp->partition_number > device.highest_busy )
-					device.highest_busy = partition_temp->partition_number;
 				break ;
 			
 			case PED_PARTITION_EXTENDED:
@@ -1131,16 +1418,15 @@ void GParted_Core::set_device_partitions( Device & device, PedDevice* lp_device,
 		// LOGICAL, EXTENDED
 		if ( partition_temp != NULL )
 		{
-			set_partition_label_and_uuid( *partition_temp );
-			set_mountpoints( *partition_temp );
-			set_used_sectors( *partition_temp, lp_disk );
-
 			// Retrieve partition name
 			if ( device.partition_naming_supported() )
 				partition_temp->name = Glib::ustring( ped_partition_get_name( lp_partition ) );
 
 			partition_temp->append_messages( libparted_messages );
 
+			probe.partition = partition_temp;
+			probes.push_back( probe );
+
 			if ( ! partition_temp->inside_extended )
 				device.partitions.push_back_adopt( partition_temp );
 			else
@@ -1151,6 +1437,21 @@ void GParted_Core::set_device_partitions( Device & device, PedDevice* lp_device,
 		lp_partition = ped_disk_next_partition( lp_disk, lp_partition ) ;
 	}
 
+	// Probe the partitions concurrently.  Libparted isn't used while doing so, except
+	// where libparted_mutex is taken again, so let other devices use it meanwhile.
+	libparted_mutex.unlock();
+	WorkerPool pool( PROBE_PARTITION_THREADS );
+	pool.run( probes.size(),
+	          sigc::bind( sigc::mem_fun( *this, &GParted_Core::probe_partition ), &probes, lp_disk ) );
+	libparted_mutex.lock();
+
+	for ( unsigned int t = 0 ; t < probes.size() ; t ++ )
+	{
+		const Partition & partition = *probes[t].partition;
+		if ( partition.busy && partition.partition_number > device.highest_busy )
+			device.highest_busy = partition.partition_number;
+	}
+
 	if ( EXT_INDEX > -1 )
 	{
 		insert_unallocated( device .get_path(),
@@ -1175,14 +1476,34 @@ void GParted_Core::set_device_partitions( Device & device, PedDevice* lp_device,
 	insert_unallocated( device .get_path(), device .partitions, 0, device .length -1, device .sector_size, false ) ; 
 }
 
+// Read the details of one partition which need commands to be run or the file system to
+// be read.  Run concurrently for the partitions of a device by set_device_partitions().
+void GParted_Core::probe_partition( unsigned int index, std::vector<PartitionProbe> * probes, PedDisk * lp_disk )
+{
+	const PartitionProbe & probe = (*probes)[index];
+	Partition & partition = *probe.partition;
+
+	for ( unsigned int t = 0 ; t < probe.busy_paths.size() ; t ++ )
+		partition.busy |= is_busy( partition.filesystem, probe.busy_paths[t] );
+
+	if ( partition.filesystem == FS_LUKS )
+		set_luks_partition( *dynamic_cast<PartitionLUKS *>( &partition ) );
+
+	set_partition_label_and_uuid( partition );
+	set_mountpoints( partition );
+	set_used_sectors( partition, lp_disk );
+}
+
 // Create one Partition object spanning the Device after identifying the file system
 // on the whole disk device.  Much simplified equivalent of set_device_partitions().
+// Called with libparted_mutex held.
 void GParted_Core::set_device_one_partition( Device & device, PedDevice * lp_device, FSType fstype,
                                              std::vector<Glib::ustring> & messages )
 {
 	device.partitions.clear();
 
 	Glib::ustring path = lp_device->path;
+	libparted_mutex.unlock();
 	bool partition_is_busy = is_busy( fstype, path );
 
 	Partition * partition_temp = NULL;
@@ -1210,6 +1531,7 @@ void GParted_Core::set_device_one_partition( Device & device, PedDevice * lp_dev
 	set_used_sectors( *partition_temp, NULL );
 
 	device.partitions.push_back_adopt( partition_temp );
+	libparted_mutex.lock();
 }
 
 void GParted_Core::set_luks_partition( PartitionLUKS & partition )
@@ -1222,14 +1544,17 @@ void GParted_Core::set_luks_partition( PartitionLUKS & partition )
 		return;
 
 	Glib::ustring mapping_path = DEV_MAPPER_PATH + mapping.name;
-	PedDevice* lp_device = NULL;
 	std::vector<Glib::ustring> detect_messages;
 	FSType fstype = FS_UNKNOWN;
-	if ( get_device( mapping_path, lp_device ) )
 	{
-		fstype = detect_filesystem( lp_device, NULL, detect_messages );
-		PedDisk* lp_disk = NULL;
-		destroy_device_and_disk( lp_device, lp_disk );
+		Glib::RecMutex::Lock lock( libparted_mutex );
+		PedDevice* lp_device = NULL;
+		if ( get_device( mapping_path, lp_device ) )
+		{
+			fstype = detect_filesystem( lp_device, NULL, detect_messages );
+			PedDisk* lp_disk = NULL;
+			destroy_device_and_disk( lp_device, lp_disk );
+		}
 	}
 	bool fs_busy = is_busy( fstype, mapping_path );
 
@@ -1822,6 +2147,7 @@ void GParted_Core::mounted_set_used_sectors( Partition & partition )
 #ifdef HAVE_LIBPARTED_FS_RESIZE
 void GParted_Core::LP_set_used_sectors( Partition & partition, PedDisk* lp_disk )
 {
+	Glib::RecMutex::Lock lock( libparted_mutex );
 	PedFileSystem *fs = NULL;
 	PedConstraint *constraint = NULL;
 
@@ -2323,11 +2649,13 @@ bool GParted_Core::move( const Partition & partition_old,
 	// Make old partition all encompassing and if move file system fails then return
 	// partition table to original state
 	bool success = false;
+	MoveJournal journal;
+	bool journalled = false;
 	if ( resize_move_partition( partition_old, *partition_all_space, operationdetail, true ) )
 	{
 		// Note move of file system is from old values to new values, not from the
 		// all encompassing values.
-		if ( ! move_filesystem( partition_old, partition_new, operationdetail ) )
+		if ( ! move_filesystem( partition_old, partition_new, operationdetail, journal, journalled ) )
 		{
 			operationdetail.add_child( OperationDetail( _("rollback last change to the partition") ) );
 
@@ -2356,8 +2684,12 @@ bool GParted_Core::move( const Partition & partition_old,
 	// Make new partition from all encompassing partition
 	if ( success )
 	{
-		success =    resize_move_partition( *partition_all_space, partition_new, operationdetail, false )
-		          && update_bootsector( partition_new, operationdetail );
+		success = resize_move_partition( *partition_all_space, partition_new, operationdetail, false );
+		// Only once the partition table records the new location is there nothing
+		// left to resume.  Until then resuming finishes by doing this instead.
+		if ( success && journalled )
+			journal.remove();
+		success = success && update_bootsector( partition_new, operationdetail );
 	}
 
 	delete partition_all_space;
@@ -2373,10 +2705,16 @@ bool GParted_Core::move( const Partition & partition_old,
 	return true;
 }
 
+// Move the file system.  Overlapping moves are journalled, setting journalled, and the
+// caller must remove the journal once the partition table has been updated.  After a
+// failure the move has been rolled back and there is no journal.
 bool GParted_Core::move_filesystem( const Partition & partition_old,
 		   		    const Partition & partition_new,
-				    OperationDetail & operationdetail ) 
+				    OperationDetail & operationdetail,
+				    MoveJournal & journal,
+				    bool & journalled )
 {
+	journalled = false;
 	if ( partition_new .sector_start < partition_old .sector_start )
 		operationdetail .add_child( OperationDetail( _("move file system to the left") ) ) ;
 	else if ( partition_new .sector_start > partition_old .sector_start )
@@ -2401,17 +2739,47 @@ bool GParted_Core::move_filesystem( const Partition & partition_old,
 		case GParted::FS::NONE:
 			break ;
 		case GParted::FS::GPARTED:
+		{
 			succes = false ;
+			std::vector<Extent> used_extents;
+			bool have_extents = get_used_extents( partition_old, used_extents );
 			if ( partition_new .test_overlap( partition_old ) )
 			{
+				// Journal the progress of the move so that if it is
+				// interrupted by a crash it can be resumed forwards.
+				if ( llabs( partition_new.sector_start - partition_old.sector_start )
+				     * partition_old.sector_size >= MOVE_JOURNAL_MIN_DISTANCE        )
+				{
+					std::map<Glib::ustring, Glib::ustring>::const_iterator identity =
+						device_identities.find( partition_old.device_path );
+					journal.device_path = partition_old.device_path;
+					if ( identity != device_identities.end() )
+						journal.device_identity = identity->second;
+					journal.filesystem  = partition_old.filesystem;
+					journal.sector_size = partition_old.sector_size;
+					journal.old_start   = partition_old.sector_start;
+					journal.old_end     = partition_old.sector_end;
+					journal.new_start   = partition_new.sector_start;
+					journal.new_end     = partition_new.sector_end;
+					journalled = journal.start();
+				}
+
 				succes = copy_filesystem_internal( partition_old,
 				                                   partition_new,
 				                                   operationdetail.get_last_child(),
 				                                   total_done,
-				                                   true );
+				                                   true,
+				                                   have_extents ? &used_extents : NULL,
+				                                   journalled ? &journal : NULL );
 
 				operationdetail.get_last_child().get_last_child()
 					.set_success_and_capture_errors( succes );
+				// About to be rolled back, so there is nothing left to resume.
+				if ( ! succes && journalled )
+				{
+					journal.remove();
+					journalled = false;
+				}
 				if ( ! succes )
 				{
 					rollback_move_filesystem( partition_old,
@@ -2425,9 +2793,11 @@ bool GParted_Core::move_filesystem( const Partition & partition_old,
 				                                   partition_new,
 				                                   operationdetail.get_last_child(),
 				                                   total_done,
-				                                   true );
+				                                   true,
+				                                   have_extents ? &used_extents : NULL );
 
 			break ;
+		}
 		case GParted::FS::LIBPARTED:
 			break ;
 		case GParted::FS::EXTERNAL:
@@ -2446,6 +2816,86 @@ bool GParted_Core::move_filesystem( const Partition & partition_old,
 	return succes ;
 }
 
+// Finish a move of a file system interrupted by a crash, resuming from the last
+// checkpoint in the journal.  The partition was left encompassing both the old and new
+// locations of the file system so, like move(), shrink it to the new location afterwards.
+bool GParted_Core::resume_move( const Partition & partition_all_space,
+                                const Partition & partition_new,
+                                OperationDetail & operationdetail )
+{
+	MoveJournal journal;
+	if ( ! find_interrupted_move( journal )                                             ||
+	     journal.device_path != partition_all_space.device_path                        ||
+	     std::min( journal.old_start, journal.new_start ) != partition_all_space.sector_start ||
+	     std::max( journal.old_end, journal.new_end ) != partition_all_space.sector_end       ||
+	     journal.new_start != partition_new.sector_start                                ||
+	     journal.new_end != partition_new.sector_end                                       )
+	{
+		operationdetail.add_child( OperationDetail(
+			_("interrupted move of the file system not found"), STATUS_ERROR, FONT_ITALIC ) );
+		return false;
+	}
+
+	if ( journal.moving_left() )
+		operationdetail.add_child( OperationDetail( _("resume moving file system to the left") ) );
+	else
+		operationdetail.add_child( OperationDetail( _("resume moving file system to the right") ) );
+	operationdetail.get_last_child().add_child( OperationDetail(
+		/*TO TRANSLATORS: looks like   1.00 GiB of 10.00 GiB already moved */
+		String::ucompose( _("%1 of %2 already moved"),
+		                  Utils::format_size( journal.done, 1 ),
+		                  Utils::format_size( journal.get_byte_length(), 1 ) ),
+		STATUS_NONE, FONT_ITALIC ) );
+
+	// Copy the remainder of the file system.  For a move to the left that is the end,
+	// copied forwards.  For a move to the right that is the start, copied backwards.
+	Sector done_sectors = journal.done / journal.sector_size;
+	Sector src_start = journal.old_start;
+	Sector dst_start = journal.new_start;
+	if ( journal.moving_left() )
+	{
+		src_start += done_sectors;
+		dst_start += done_sectors;
+	}
+	journal.resumed = journal.done;
+
+	bool success = true;
+	Byte_Value remaining = journal.get_byte_length() - journal.done;
+	if ( remaining > 0 )
+	{
+		Byte_Value total_done = 0;
+		success = copy_blocks( journal.device_path,
+		                       journal.device_path,
+		                       src_start,
+		                       dst_start,
+		                       journal.sector_size,
+		                       journal.sector_size,
+		                       remaining,
+		                       operationdetail.get_last_child(),
+		                       total_done,
+		                       true,
+		                       NULL,
+		                       &journal );
+		operationdetail.get_last_child().get_last_child().set_success_and_capture_errors( success );
+	}
+	operationdetail.get_last_child().set_success_and_capture_errors( success );
+	// Leave the journal in place after a failure so that the move can be resumed again.
+	if ( ! success )
+		return false;
+
+	if ( ! resize_move_partition( partition_all_space, partition_new, operationdetail, false ) )
+		return false;
+	journal.remove();
+	if ( ! update_bootsector( partition_new, operationdetail ) )
+		return false;
+
+	if ( partition_new.filesystem == FS_LINUX_SWAP )
+		// linux-swap is recreated, not moved
+		return recreate_linux_swap_filesystem( partition_new, operationdetail );
+
+	return true;
+}
+
 #ifdef HAVE_LIBPARTED_FS_RESIZE
 bool GParted_Core::resize_move_filesystem_using_libparted( const Partition & partition_old,
 		  	      		            	   const Partition & partition_new,
@@ -3162,11 +3612,16 @@ bool GParted_Core::copy_filesystem( const Partition & partition_src,
 	switch ( get_fs( partition_dst.filesystem ).copy )
 	{
 		case FS::GPARTED:
+		{
+			std::vector<Extent> used_extents;
+			bool have_extents = get_used_extents( partition_src, used_extents );
 			success = copy_filesystem_internal( partition_src,
 			                                    partition_dst,
 			                                    operationdetail.get_last_child(),
-			                                    true );
+			                                    true,
+			                                    have_extents ? &used_extents : NULL );
 			break;
+		}
 
 		case FS::LIBPARTED:
 			// FIXME: see if copying through libparted has any advantages
@@ -3187,10 +3642,20 @@ bool GParted_Core::copy_filesystem( const Partition & partition_src,
 	return success;
 }
 
+// Get the ranges of a file system in use so that the internal copy can pass over free
+// space.  Returns false when they aren't known and the whole file system must be copied.
+bool GParted_Core::get_used_extents( const Partition & partition, std::vector<Extent> & extents )
+{
+	extents.clear();
+	FileSystem * p_filesystem = get_filesystem_object( partition.filesystem );
+	return p_filesystem && p_filesystem->get_used_extents( partition, extents );
+}
+
 bool GParted_Core::copy_filesystem_internal( const Partition & partition_src,
                                              const Partition & partition_dst,
                                              OperationDetail & operationdetail,
-                                             bool cancel_safe )
+                                             bool cancel_safe,
+                                             const std::vector<Extent> * used_extents )
 {
 	Sector dummy ;
 	return copy_blocks( partition_src.device_path,
@@ -3202,14 +3667,17 @@ bool GParted_Core::copy_filesystem_internal( const Partition & partition_src,
 	                    partition_src.get_byte_length(),
 	                    operationdetail,
 	                    dummy,
-	                    cancel_safe );
+	                    cancel_safe,
+	                    used_extents );
 }
 
 bool GParted_Core::copy_filesystem_internal( const Partition & partition_src,
                                              const Partition & partition_dst,
                                              OperationDetail & operationdetail,
                                              Byte_Value & total_done,
-                                             bool cancel_safe )
+                                             bool cancel_safe,
+                                             const std::vector<Extent> * used_extents,
+                                             MoveJournal * journal )
 {
 	return copy_blocks( partition_src.device_path,
 	                    partition_dst.device_path,
@@ -3220,9 +3688,26 @@ bool GParted_Core::copy_filesystem_internal( const Partition & partition_src,
 	                    partition_src.get_byte_length(),
 	                    operationdetail,
 	                    total_done,
-	                    cancel_safe );
+	                    cancel_safe,
+	                    used_extents,
+	                    journal );
 }
-	
+
+// Identify a pair of devices by model and serial number for their copy performance
+// profile.  Returns an empty key, so no profile is used, when either device doesn't have
+// a serial number as the model alone doesn't distinguish between devices.
+Glib::ustring GParted_Core::get_copy_profile_key( const Glib::ustring & src_device,
+                                                  const Glib::ustring & dst_device ) const
+{
+	std::map<Glib::ustring, Glib::ustring>::const_iterator src = device_identities.find( src_device );
+	std::map<Glib::ustring, Glib::ustring>::const_iterator dst = device_identities.find( dst_device );
+	if ( src == device_identities.end() || dst == device_identities.end() )
+		return "";
+	if ( src_device == dst_device )
+		return src->second;
+	return src->second + " to " + dst->second;
+}
+
 bool GParted_Core::copy_blocks( const Glib::ustring & src_device,
                                 const Glib::ustring & dst_device,
                                 Sector src_start,
@@ -3232,7 +3717,9 @@ bool GParted_Core::copy_blocks( const Glib::ustring & src_device,
                                 Byte_Value src_length,
                                 OperationDetail & operationdetail,
                                 Byte_Value & total_done,
-                                bool cancel_safe )
+                                bool cancel_safe,
+                                const std::vector<Extent> * used_extents,
+                                MoveJournal * journal )
 {
 	operationdetail .add_child( OperationDetail( _("using internal algorithm"), STATUS_NONE ) ) ;
 	operationdetail .add_child( OperationDetail(
@@ -3240,97 +3727,66 @@ bool GParted_Core::copy_blocks( const Glib::ustring & src_device,
 		                  _("copy %1"), Utils::format_size( src_length, 1 ) ),
 		STATUS_NONE ) ) ;
 
-	operationdetail .add_child( OperationDetail( _("finding optimal block size"), STATUS_NONE ) ) ;
-
-	Byte_Value benchmark_blocksize = (1 * MEBIBYTE) ;
-	Byte_Value N = (16 * MEBIBYTE) ;
-	Byte_Value optimal_blocksize = benchmark_blocksize ;
-	Sector offset_read = src_start ;
-	Sector offset_write = dst_start ;
-
-	//Handle situation where we need to perform the copy beginning
-	//  with the end of the partition and finishing with the start.
-	if ( dst_start > src_start )
+	if ( used_extents )
 	{
-		offset_read  += (src_length/src_sector_size) - (N/src_sector_size) ;
-		/* Handle situation where src sector size is smaller than dst sector size and an additional partial dst sector is required. */
-		offset_write += ((src_length + (dst_sector_size - 1))/dst_sector_size) - (N/dst_sector_size) ;
-	}
+		Byte_Value used_length = 0;
+		for ( unsigned int i = 0 ; i < used_extents->size() ; i ++ )
+			used_length += (*used_extents)[i].length;
+		operationdetail.add_child( OperationDetail(
+			/*TO TRANSLATORS: looks like   skip 1.00 GiB not used by the file system */
+			String::ucompose( _("skip %1 not used by the file system"),
+			                  Utils::format_size( src_length - used_length, 1 ) ),
+			STATUS_NONE ) );
+	}
+
+	// Buffered I/O unless direct I/O was opted into when configured, in which case
+	// io_uring is used too when available.
+#ifdef ENABLE_DIRECT_IO_COPY
+	CopyMethod copy_method = COPY_METHOD_DIRECT;
+	if ( CopyBlocks::io_uring_supported() )
+		copy_method = COPY_METHOD_IO_URING;
+#else
+	CopyMethod copy_method = COPY_METHOD_LIBPARTED;
+#endif
 
+	// Rather than benchmarking block sizes before copying, the block size is tuned
+	// while copying starting from the best found by earlier copies between the same
+	// devices.
+	CopyTuner tuner( get_copy_profile_key( src_device, dst_device ) );
 	total_done = 0 ;
-	Byte_Value done = 0 ;
-	Glib::Timer timer ;
-	double smallest_time = 1000000 ;
-	bool succes = true ;
-	OperationDetail & benchmark_od = operationdetail.get_last_child();
-
-	//Benchmark copy times using different block sizes to determine optimal size
-	while ( succes &&
-		llabs( done ) + N <= src_length && 
-		benchmark_blocksize <= N )
-	{
-		benchmark_od.add_child( OperationDetail(
-				/*TO TRANSLATORS: looks like   copy 16.00 MiB using a block size of 1.00 MiB */
-				String::ucompose( _("copy %1 using a block size of %2"),
-				                  Utils::format_size( N, 1 ),
-				                  Utils::format_size( benchmark_blocksize, 1 ) ) ) );
-
-		timer .reset() ;
-		succes = CopyBlocks( src_device,
-		                     dst_device,
-		                     offset_read  + (done / src_sector_size),
-		                     offset_write + (done / dst_sector_size),
-		                     N,
-		                     benchmark_blocksize,
-		                     benchmark_od,
-		                     total_done,
-		                     src_length,
-		                     cancel_safe ).copy();
-		timer.stop() ;
-
-		benchmark_od.get_last_child().add_child( OperationDetail(
-			String::ucompose( _("%1 seconds"), timer .elapsed() ), STATUS_NONE, FONT_ITALIC ) ) ;
-		benchmark_od.get_last_child().set_success_and_capture_errors( succes );
-
-		if ( timer .elapsed() <= smallest_time )
-		{
-			smallest_time = timer .elapsed() ;
-			optimal_blocksize = benchmark_blocksize ; 
-		}
-		benchmark_blocksize *= 2 ;
+	operationdetail.add_child( OperationDetail(
+			/*TO TRANSLATORS: looks like   copy 16.00 MiB using a block size of 1.00 MiB */
+			String::ucompose( _("copy %1 using a block size of %2"),
+			                  Utils::format_size( src_length, 1 ),
+			                  Utils::format_size( tuner.get_blocksize(), 1 ) ) ) );
+	bool succes = CopyBlocks( src_device,
+	                          dst_device,
+	                          src_start,
+	                          dst_start,
+	                          src_length,
+	                          tuner.get_blocksize(),
+	                          operationdetail,
+	                          total_done,
+	                          src_length,
+	                          cancel_safe,
+	                          copy_method,
+	                          used_extents,
+	                          &tuner,
+	                          journal ).copy();
+	operationdetail.get_last_child().set_success_and_capture_errors( succes );
 
-		if ( ( dst_start > src_start ) )
-			done -= N ;
-		else
-			done += N ;
-	}
-	
-	if ( succes )
-		operationdetail .get_last_child() .add_child( OperationDetail( String::ucompose( 
+	// The tuner doesn't run for copies too short to measure or when copying in
+	// windows within one rotating disk.
+	if ( succes && tuner.measured() )
+	{
+		operationdetail .add_child( OperationDetail( String::ucompose(
 				/*TO TRANSLATORS: looks like  optimal block size is 1.00 MiB */
 				_("optimal block size is %1"),
-				Utils::format_size( optimal_blocksize, 1 ) ),
+				Utils::format_size( tuner.get_best_blocksize(), 1 ) ),
 				STATUS_NONE ) ) ;
-
-	if ( succes && llabs( done ) < src_length )
-	{
-		Byte_Value remaining_length = src_length - llabs( done );
-		operationdetail.add_child( OperationDetail(
-				/*TO TRANSLATORS: looks like   copy 16.00 MiB using a block size of 1.00 MiB */
-				String::ucompose( _("copy %1 using a block size of %2"),
-				                  Utils::format_size( remaining_length, 1 ),
-				                  Utils::format_size( optimal_blocksize, 1 ) ) ) );
-		succes = CopyBlocks( src_device,
-		                     dst_device,
-		                     src_start + ((done > 0 ? done : 0) / src_sector_size),
-		                     dst_start + ((done > 0 ? done : 0) / dst_sector_size),
-		                     remaining_length,
-		                     optimal_blocksize,
-		                     operationdetail,
-		                     total_done,
-		                     src_length,
-		                     cancel_safe ).copy();
-		operationdetail.get_last_child().set_success_and_capture_errors( succes );
+		Glib::ustring error;
+		if ( ! tuner.save_profile( error ) )
+			operationdetail.add_child( OperationDetail( error, STATUS_NONE, FONT_ITALIC ) );
 	}
 
 	operationdetail .add_child( OperationDetail( 
@@ -3581,6 +4037,7 @@ bool GParted_Core::calibrate_partition( Partition & partition, OperationDetail &
 		bool success = false;
 		PedDevice* lp_device = NULL ;
 		PedDisk* lp_disk = NULL ;
+		struct timespec since = udev_events_start_time();
 		if ( get_device( partition.device_path, lp_device ) )
 		{	
 			if ( partition.type == TYPE_UNPARTITIONED )
@@ -3667,7 +4124,7 @@ bool GParted_Core::calibrate_partition( Partition & partition, OperationDetail &
 		// remove and re-add all the partition specific /dev/ entries.  Wait for
 		// this to complete to avoid FS specific commands failing because they
 		// happen to run just when the needed /dev/PTN entry doesn't exist.
-		settle_device( SETTLE_DEVICE_APPLY_MAX_WAIT_SECONDS );
+		settle_device( partition.device_path, since, SETTLE_DEVICE_APPLY_MAX_WAIT_SECONDS );
 
 		operationdetail.get_last_child().set_success_and_capture_errors( success );
 		return success;
@@ -4316,10 +4773,11 @@ bool GParted_Core::commit( PedDisk* lp_disk )
 
 	if ( opened )
 	{
+		struct timespec since = udev_events_start_time();
 		ped_device_close( lp_disk->dev );
 		// Wait for udev rules to complete and partition device nodes to settle
 		// from this ped_device_close().
-		settle_device( SETTLE_DEVICE_APPLY_MAX_WAIT_SECONDS );
+		settle_device( lp_disk->dev->path, since, SETTLE_DEVICE_APPLY_MAX_WAIT_SECONDS );
 	}
 
 	return succes ;
@@ -4328,6 +4786,7 @@ bool GParted_Core::commit( PedDisk* lp_disk )
 bool GParted_Core::commit_to_os( PedDisk* lp_disk, std::time_t timeout )
 {
 	bool succes ;
+	struct timespec since = udev_events_start_time();
 #ifndef USE_LIBPARTED_DMRAID
 	DMRaid dmraid ;
 	if ( dmraid .is_dmraid_device( lp_disk ->dev ->path ) )
@@ -4352,13 +4811,159 @@ bool GParted_Core::commit_to_os( PedDisk* lp_disk, std::time_t timeout )
 
 	// Wait for udev rules to complete and partition device nodes to settle from above
 	// ped_disk_commit_to_os() initiated kernel update of the partitions.
-	settle_device( timeout ) ;
+	settle_device( lp_disk->dev->path, since, timeout );
 
 	return succes ;
 }
 
-void GParted_Core::settle_device( std::time_t timeout )
+// Time from which udev events caused by a following operation on a device are waited
+// for.  Stepped back by the timestamp granularity so that a udev database write made
+// after this time never has an earlier mtime.
+static struct timespec udev_events_start_time()
+{
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	struct timespec since;
+	since.tv_sec  = tv.tv_sec;
+	since.tv_nsec = tv.tv_usec * 1000L - UDEV_DB_MTIME_GRANULARITY_NS;
+	if ( since.tv_nsec < 0 )
+	{
+		since.tv_sec  -= 1;
+		since.tv_nsec += 1000L * 1000 * 1000;
+	}
+	return since;
+}
+
+// Append the udev state of one block device to state.  Returns false when udev hasn't
+// finished with the device yet: the /dev node doesn't exist with the device numbers, or
+// udev is busy and hasn't yet written its database entry for the device, which it does
+// for each add and change event processed.  Sets updated when the database entry has
+// been written since the given time.
+static bool append_udev_device_state( const Glib::ustring & sysfs_dir, const struct timespec & since,
+                                      std::string & state, bool & updated )
+{
+	Glib::ustring dev = Utils::trim( read_sysfs_file( sysfs_dir + "/dev" ) );
+	unsigned long maj = 0;
+	unsigned long min = 0;
+	if ( sscanf( dev.c_str(), "%lu:%lu", &maj, &min ) != 2 )
+		// Removed since listed.  The change of state is seen next time.
+		return true;
+
+	bool ready = true;
+	struct stat sb;
+	state += dev + " ";
+	Glib::ustring db_file = Glib::ustring( UDEV_DATA_DIR ) + "/b" + dev;
+	if ( stat( db_file.c_str(), &sb ) == 0 )
+	{
+		state += Utils::num_to_str( sb.st_mtim.tv_sec ) + "." + Utils::num_to_str( sb.st_mtim.tv_nsec ) + " ";
+		if ( sb.st_mtim.tv_sec > since.tv_sec                                          ||
+		     ( sb.st_mtim.tv_sec == since.tv_sec && sb.st_mtim.tv_nsec >= since.tv_nsec )    )
+			updated = true;
+	}
+	else if ( file_test( UDEV_QUEUE_FLAG, Glib::FILE_TEST_EXISTS ) )
+		ready = false;
+
+	Glib::ustring devname = Utils::regexp_label( read_sysfs_file( sysfs_dir + "/uevent" ),
+	                                             "^DEVNAME=(.*)$" );
+	if ( devname.empty()                                        ||
+	     stat( ( "/dev/" + devname ).c_str(), &sb ) != 0        ||
+	     ! S_ISBLK( sb.st_mode )                                ||
+	     sb.st_rdev != makedev( maj, min )                         )
+		ready = false;
+	state += devname + "\n";
+
+	return ready;
+}
+
+// Get the udev state of the device, its partitions and the devices directly using it,
+// such as dmraid partition mappings.  Returns false when udev hasn't finished with any
+// of them.  Sets updated when udev has processed an event for the device itself, or for
+// one of the devices using it, since the given time.  Partitions don't count as they can
+// be re-added before udev gets to the change event of the whole device.
+static bool get_udev_devices_state( const Glib::ustring & sysfs_dir, const struct timespec & since,
+                                    std::string & state, bool & updated )
+{
+	bool ready = append_udev_device_state( sysfs_dir, since, state, updated );
+	bool partition_updated = false;
+	try
+	{
+		Glib::Dir dir( sysfs_dir );
+		Glib::ustring filename;
+		while ( ( filename = dir.read_name() ) != "" )
+		{
+			if ( file_test( sysfs_dir + "/" + filename + "/partition", Glib::FILE_TEST_EXISTS ) )
+				ready = append_udev_device_state( sysfs_dir + "/" + filename, since,
+				                                  state, partition_updated ) && ready;
+		}
+	}
+	catch ( Glib::FileError & e )
+	{
+	}
+	try
+	{
+		Glib::Dir dir( sysfs_dir + "/holders" );
+		Glib::ustring filename;
+		while ( ( filename = dir.read_name() ) != "" )
+			ready = append_udev_device_state( sysfs_dir + "/holders/" + filename, since,
+			                                  state, updated ) && ready;
+	}
+	catch ( Glib::FileError & e )
+	{
+	}
+	return ready;
+}
+
+// Wait for udev to finish with just this device, its partitions and the devices directly
+// using it.  The /dev nodes and udev database entries typically already exist from
+// before the operation, so first wait for udev to record processing an event for the
+// device after the operation started.  Then they are settled once all are ready and
+// their state hasn't changed for SETTLE_DEVICE_QUIET_MS, which allows for further queued
+// events.  Returns false when udev state can't be watched or doesn't settle within the
+// timeout so the caller must settle another way.
+static bool settle_udev_devices( const Glib::ustring & device_path, const struct timespec & since,
+                                 std::time_t timeout )
+{
+	if ( ! file_test( UDEV_DATA_DIR, Glib::FILE_TEST_IS_DIR ) )
+		return false;
+	BlockSpecial bs( device_path );
+	if ( bs.m_major == 0 && bs.m_minor == 0 )
+		return false;
+	Glib::ustring sysfs_dir = "/sys/dev/block/" + Utils::num_to_str( bs.m_major ) +
+	                          ":" + Utils::num_to_str( bs.m_minor );
+	if ( ! file_test( sysfs_dir, Glib::FILE_TEST_IS_DIR ) )
+		return false;
+
+	Glib::Timer timer;
+	std::string last_state;
+	double unchanged_since = 0.0;
+	for ( bool first = true ; ; first = false )
+	{
+		std::string state;
+		bool updated = false;
+		bool ready = get_udev_devices_state( sysfs_dir, since, state, updated );
+		double elapsed = timer.elapsed();
+		if ( first || state != last_state )
+		{
+			last_state = state;
+			unchanged_since = elapsed;
+		}
+		else if ( ready && updated && ( elapsed - unchanged_since ) * 1000.0 >= SETTLE_DEVICE_QUIET_MS )
+			return true;
+		if ( elapsed >= timeout )
+			return false;
+		usleep( SETTLE_DEVICE_POLL_MS * 1000 );
+	}
+}
+
+// Wait for udev rules to complete for the device and its partitions following an
+// operation started at time since.  Only the events of this device are waited for,
+// falling back to waiting for all pending udev events.
+void GParted_Core::settle_device( const Glib::ustring & device_path, const struct timespec & since,
+                                  std::time_t timeout )
 {
+	if ( settle_udev_devices( device_path, since, timeout ) )
+		return;
+
 	if ( udevsettle_found )
 		Utils::execute_command( "udevsettle --timeout=" + Utils::num_to_str( timeout ) ) ;
 	else if ( udevadm_found )
@@ -4479,6 +5084,9 @@ GParted_Core::~GParted_Core()
 {
 	// Delete file system map entries
 	fini_filesystems();
+
+	// Close the files watched for mount changes
+	Mount_Info::clear_cache();
 }
 
 Glib::Thread *GParted_Core::mainthread;
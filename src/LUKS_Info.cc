@@ -16,8 +16,10 @@
 
 #include "LUKS_Info.h"
 #include "BlockSpecial.h"
+#include "DM_Info.h"
 #include "Utils.h"
 
+#include <glibmm/thread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -32,16 +34,27 @@ namespace GParted
 //     {name="sdb6_crypt", container=BlockSpecial{"/dev/sdb6", 8, 22}, offset=2097152, length=534773760}
 std::vector<LUKS_Mapping> LUKS_Info::luks_mapping_cache;
 
+// Index of the containers in luks_mapping_cache.
+BlockSpecialIndex LUKS_Info::luks_mapping_index;
+
 bool LUKS_Info::cache_initialised = false;
 
+// Protects the above when devices are probed concurrently.
+static Glib::Mutex luks_mapping_cache_mutex;
+
 void LUKS_Info::clear_cache()
 {
+	Glib::Mutex::Lock lock( luks_mapping_cache_mutex );
 	luks_mapping_cache.clear();
+	luks_mapping_index.clear();
 	cache_initialised = false;
 }
 
-const LUKS_Mapping & LUKS_Info::get_cache_entry( const Glib::ustring & path )
+// Return a copy of the cache entry as it may be reloaded by another thread once the
+// lock is released.
+LUKS_Mapping LUKS_Info::get_cache_entry( const Glib::ustring & path )
 {
+	Glib::Mutex::Lock lock( luks_mapping_cache_mutex );
 	initialise_if_required();
 	return get_cache_entry_internal( path );
 }
@@ -60,6 +73,35 @@ void LUKS_Info::initialise_if_required()
 void LUKS_Info::load_cache()
 {
 	luks_mapping_cache.clear();
+	luks_mapping_index.clear();
+
+	// Read the dm-crypt mappings directly from the kernel when possible.  The
+	// parameters of a crypt target are documented in the kernel source:
+	//     https://git.kernel.org/cgit/linux/kernel/git/torvalds/linux.git/tree/Documentation/device-mapper/dm-crypt.txt?id=v4.0
+	//     CIPHER KEY IVOFFSET DEVPATH OFFSET ...
+	const unsigned DMCRYPT_PARAM_devpath = 3;
+	const unsigned DMCRYPT_PARAM_offset  = 4;
+	if ( DM_Info::is_available() )
+	{
+		std::vector<DM_Mapping> mappings = DM_Info::get_mappings();
+		for ( unsigned int i = 0 ; i < mappings.size() ; i ++ )
+		{
+			for ( unsigned int j = 0 ; j < mappings[i].targets.size() ; j ++ )
+			{
+				const DM_Target & target = mappings[i].targets[j];
+				if ( target.target_type != "crypt" )
+					continue;
+				std::vector<Glib::ustring> params;
+				Utils::tokenize( target.params, params, " " );
+				if ( params.size() <= DMCRYPT_PARAM_offset )
+					continue;
+				add_mapping( mappings[i].name, target.length,
+				             params[DMCRYPT_PARAM_devpath],
+				             atoll( params[DMCRYPT_PARAM_offset].c_str() ) );
+			}
+		}
+		return;
+	}
 
 	Glib::ustring output;
 	Glib::ustring error;
@@ -71,20 +113,18 @@ void LUKS_Info::load_cache()
 	// First 4 fields are defined by the dmsetup program by the print call in the
 	// _status() function:
 	//     https://git.fedorahosted.org/cgit/lvm2.git/tree/tools/dmsetup.c?id=v2_02_118#n1715
-	// Field 5 onwards are called parameters and documented in the kernel source:
-	//     https://git.kernel.org/cgit/linux/kernel/git/torvalds/linux.git/tree/Documentation/device-mapper/dm-crypt.txt?id=v4.0
+	// Field 5 onwards are the parameters, as above.
 
 	std::vector<Glib::ustring> lines;
 	Utils::tokenize( output, lines, "\n" );
 	for ( unsigned int i = 0 ; i < lines.size() ; i ++ )
 	{
-		LUKS_Mapping luks_map;
 		std::vector<Glib::ustring> fields;
 		Utils::tokenize( lines[i], fields, " " );
 		const unsigned DMCRYPT_FIELD_Name    = 0;
 		const unsigned DMCRYPT_FIELD_length  = 2;
-		const unsigned DMCRYPT_FIELD_devpath = 7;
-		const unsigned DMCRYPT_FIELD_offset  = 8;
+		const unsigned DMCRYPT_FIELD_devpath = 4 + DMCRYPT_PARAM_devpath;
+		const unsigned DMCRYPT_FIELD_offset  = 4 + DMCRYPT_PARAM_offset;
 
 		if ( fields.size() <= DMCRYPT_FIELD_offset )
 			continue;
@@ -94,58 +134,59 @@ void LUKS_Info::load_cache()
 		size_t len = name.length();
 		if ( len <= 1 || name[len-1] != ':' )
 			continue;
-		luks_map.name = name.substr( 0, len-1 );
-
-		// Extract LUKS underlying device containing the encrypted data.  May be
-		// either a device name (/dev/sda1) or major, minor pair (8:1).
-		luks_map.container = BlockSpecial();
-		Glib::ustring devpath = fields[DMCRYPT_FIELD_devpath];
-		unsigned long maj = 0UL;
-		unsigned long min = 0UL;
-		if ( devpath.length() > 0 && devpath[0] == '/' )
-			luks_map.container = BlockSpecial( devpath );
-		else if ( sscanf( devpath.c_str(), "%lu:%lu", &maj, &min ) == 2 )
-		{
-			luks_map.container.m_major = maj;
-			luks_map.container.m_minor = min;
-		}
-		else
-			continue;
 
-		// Extract LUKS offset and length.  Dm-crypt reports all sizes in units of
-		// 512 byte sectors.
-		luks_map.offset = -1LL;
-		luks_map.length = -1LL;
-		Byte_Value offset = atoll( fields[DMCRYPT_FIELD_offset].c_str() );
-		Byte_Value length = atoll( fields[DMCRYPT_FIELD_length].c_str() );
-		if ( offset > 0LL && length > 0LL )
-		{
-			luks_map.offset = offset * 512LL;
-			luks_map.length = length * 512LL;
-		}
-		else
-			continue;
+		add_mapping( name.substr( 0, len-1 ),
+		             atoll( fields[DMCRYPT_FIELD_length].c_str() ),
+		             fields[DMCRYPT_FIELD_devpath],
+		             atoll( fields[DMCRYPT_FIELD_offset].c_str() ) );
+	}
+}
 
-		luks_mapping_cache.push_back( luks_map );
+// Add a dm-crypt mapping to the cache.  Dm-crypt reports all sizes in units of 512 byte
+// sectors.
+void LUKS_Info::add_mapping( const Glib::ustring & name, Sector length,
+                             const Glib::ustring & devpath, Sector offset )
+{
+	LUKS_Mapping luks_map;
+	luks_map.name = name;
+
+	// Extract LUKS underlying device containing the encrypted data.  May be either a
+	// device name (/dev/sda1) or major, minor pair (8:1).
+	luks_map.container = BlockSpecial();
+	unsigned long maj = 0UL;
+	unsigned long min = 0UL;
+	if ( devpath.length() > 0 && devpath[0] == '/' )
+		luks_map.container = BlockSpecial( devpath );
+	else if ( sscanf( devpath.c_str(), "%lu:%lu", &maj, &min ) == 2 )
+	{
+		luks_map.container.m_major = maj;
+		luks_map.container.m_minor = min;
 	}
+	else
+		return;
+
+	if ( offset <= 0LL || length <= 0LL )
+		return;
+	luks_map.offset = offset * 512LL;
+	luks_map.length = length * 512LL;
+
+	luks_mapping_cache.push_back( luks_map );
+	luks_mapping_index.push_back( luks_map.container );
 }
 
 // Return LUKS cache entry for the named underlying block device path,
 // or not found substitute when no entry exists.
 const LUKS_Mapping & LUKS_Info::get_cache_entry_internal( const Glib::ustring & path )
 {
-	BlockSpecial bs = BlockSpecial( path );
-	for ( unsigned int i = 0 ; i < luks_mapping_cache.size() ; i ++ )
+	unsigned int i;
+	if ( luks_mapping_index.find( BlockSpecial( path ), i ) )
 	{
-		if ( bs == luks_mapping_cache[i].container )
-		{
-			// Store underlying block device path in the BlockSpecial object
-			// if not already known.  Not required, just for completeness.
-			if ( ! luks_mapping_cache[i].container.m_name.length() )
-				luks_mapping_cache[i].container.m_name = path;
+		// Store underlying block device path in the BlockSpecial object if not
+		// already known.  Not required, just for completeness.
+		if ( ! luks_mapping_cache[i].container.m_name.length() )
+			luks_mapping_cache[i].container.m_name = path;
 
-			return luks_mapping_cache[i];
-		}
+		return luks_mapping_cache[i];
 	}
 
 	static LUKS_Mapping not_found = {"", BlockSpecial(), -1LL, -1LL};
@@ -16,6 +16,11 @@
 
 #include "LVM2_PV_Info.h"
 #include "BlockSpecial.h"
+#include "TextTokenizer.h"
+
+#include <glibmm/thread.h>
+#include <glib.h>
+#include <string>
 
 namespace GParted
 {
@@ -46,21 +51,19 @@ enum LV_BIT
 //                         {BlockSpecial("/dev/sda14"), 1069547520,  566231040, "Test_VG3"},
 //                         {BlockSpecial("/dev/sda15"), 1069547520,  545259520, "Test-VG4"}
 //                        ]
-//  lvm2_vg_cache       - Vector storing VG fields: vg_name, vg_attr, lv_name, lv_attr.
+//  lvm2_vg_cache       - Vector of VG fields: vg_name, vg_attr and the LVs in the VG with
+//                        fields: lv_name, lv_attr.
 //                        See vgs(8) and lvs(8) for details of vg_attr and lv_attr respectively.
 //                        E.g.
-//                        //vg_name   , vg_attr , lv_name, lv_attr
-//                        [{""        , "r-----", ""     , ""      },  // (from empty PV)
-//                         {"Test-VG1", "wz--n-", ""     , ""      },  // Empty VG
-//                         {"Test_VG2", "wz--n-", "lvol0", "-wi---"},  // Inactive VG
-//                         {"Test_VG2", "wz--n-", "lvol1", "-wi---"},
-//                         {"Test_VG2", "wz--n-", ""     , ""      },
-//                         {"Test_VG3", "wz--n-", "lvol0", "-wi-a-"},  // Active VG
-//                         {"Test_VG3", "wz--n-", "lvol0", "-wi-a-"},
-//                         {"Test_VG3", "wz--n-", ""     , ""      },
-//                         {"Test-VG4", "wzx-n-", "lvol0", "-wi---"},  // Exported VG
-//                         {"Test-VG4", "wzx-n-", ""     , ""      }
+//                        //vg_name   , vg_attr , lvs
+//                        [{"Test-VG1", "wz--n-", []                                     },  // Empty VG
+//                         {"Test_VG2", "wz--n-", [{"lvol0", "-wi---"}, {"lvol1", "-wi---"}]},  // Inactive VG
+//                         {"Test_VG3", "wz--n-", [{"lvol0", "-wi-a-"}]                  },  // Active VG
+//                         {"Test-VG4", "wzx-n-", [{"lvol0", "-wi---"}]                  }   // Exported VG
 //                        ]
+//  lvm2_pv_index       - Map from PV name to index of the PV in lvm2_pv_cache.
+//  lvm2_vg_index       - Map from VG name to index of the VG in lvm2_vg_cache.
+//  vgscan_requested    - Run "lvm vgscan" before next loading the cache?
 //  error_messages      - String vector storing whole cache error messages.
 
 
@@ -69,23 +72,43 @@ bool LVM2_PV_Info::lvm2_pv_info_cache_initialized = false ;
 bool LVM2_PV_Info::lvm_found = false ;
 std::vector<LVM2_PV> LVM2_PV_Info::lvm2_pv_cache;
 std::vector<LVM2_VG> LVM2_PV_Info::lvm2_vg_cache;
+BlockSpecialIndex LVM2_PV_Info::lvm2_pv_index;
+std::map<Glib::ustring, unsigned int> LVM2_PV_Info::lvm2_vg_index;
+bool LVM2_PV_Info::vgscan_requested = false;
 std::vector<Glib::ustring> LVM2_PV_Info::error_messages ;
 
+// Protects the above when devices are probed concurrently.
+static Glib::Mutex lvm2_pv_info_mutex;
+
 bool LVM2_PV_Info::is_lvm2_pv_supported()
 {
+	Glib::Mutex::Lock lock( lvm2_pv_info_mutex );
 	set_command_found() ;
 	return ( lvm_found ) ;
 }
 
 void LVM2_PV_Info::clear_cache()
 {
+	Glib::Mutex::Lock lock( lvm2_pv_info_mutex );
 	lvm2_pv_cache.clear();
 	lvm2_vg_cache.clear();
+	lvm2_pv_index.clear();
+	lvm2_vg_index.clear();
 	lvm2_pv_info_cache_initialized = false;
 }
 
+// Run "lvm vgscan" before the cache is next loaded.  Scanning every block device again
+// is slow so it is only requested for the first load and when the user refreshes the
+// devices, not for the refreshes after applying operations.
+void LVM2_PV_Info::request_vgscan()
+{
+	Glib::Mutex::Lock lock( lvm2_pv_info_mutex );
+	vgscan_requested = true;
+}
+
 Glib::ustring LVM2_PV_Info::get_vg_name( const Glib::ustring & path )
 {
+	Glib::Mutex::Lock lock( lvm2_pv_info_mutex );
 	initialize_if_required() ;
 	LVM2_PV pv = get_pv_cache_entry_by_name( path );
 	return pv.vg_name;
@@ -94,6 +117,7 @@ Glib::ustring LVM2_PV_Info::get_vg_name( const Glib::ustring & path )
 //Return PV size in bytes, or -1 for error.
 Byte_Value LVM2_PV_Info::get_size_bytes( const Glib::ustring & path )
 {
+	Glib::Mutex::Lock lock( lvm2_pv_info_mutex );
 	initialize_if_required() ;
 	LVM2_PV pv = get_pv_cache_entry_by_name( path );
 	return pv.pv_size;
@@ -102,6 +126,7 @@ Byte_Value LVM2_PV_Info::get_size_bytes( const Glib::ustring & path )
 //Return number of free bytes in the PV, or -1 for error.
 Byte_Value LVM2_PV_Info::get_free_bytes( const Glib::ustring & path )
 {
+	Glib::Mutex::Lock lock( lvm2_pv_info_mutex );
 	initialize_if_required() ;
 	LVM2_PV pv = get_pv_cache_entry_by_name( path );
 	return pv.pv_free;
@@ -110,20 +135,19 @@ Byte_Value LVM2_PV_Info::get_free_bytes( const Glib::ustring & path )
 //Report if any LVs are active in the VG stored in the PV.
 bool LVM2_PV_Info::has_active_lvs( const Glib::ustring & path )
 {
+	Glib::Mutex::Lock lock( lvm2_pv_info_mutex );
 	initialize_if_required() ;
 	LVM2_PV pv = get_pv_cache_entry_by_name( path );
 	if ( pv.vg_name == "" )
 		// PV not yet included in any VG or PV not found in cache
 		return false ;
 
-	for ( unsigned int i = 0 ; i < lvm2_vg_cache .size() ; i ++ )
+	const LVM2_VG & vg = get_vg_cache_entry_by_name( pv.vg_name );
+	for ( unsigned int i = 0 ; i < vg.lvs.size() ; i ++ )
 	{
-		if ( pv.vg_name == lvm2_vg_cache[i].vg_name )
-		{
-			if ( bit_set( lvm2_vg_cache[i].lv_attr, LVBIT_STATE ) )
-				//LV in VG is active
-				return true ;
-		}
+		if ( bit_set( vg.lvs[i].lv_attr, LVBIT_STATE ) )
+			//LV in VG is active
+			return true ;
 	}
 	return false ;
 }
@@ -131,6 +155,7 @@ bool LVM2_PV_Info::has_active_lvs( const Glib::ustring & path )
 //Report if the VG is exported.
 bool LVM2_PV_Info::is_vg_exported( const Glib::ustring & vgname )
 {
+	Glib::Mutex::Lock lock( lvm2_pv_info_mutex );
 	initialize_if_required() ;
 	LVM2_VG vg = get_vg_cache_entry_by_name( vgname );
 	return bit_set( vg.vg_attr, VGBIT_EXPORTED );
@@ -139,6 +164,7 @@ bool LVM2_PV_Info::is_vg_exported( const Glib::ustring & vgname )
 //Return vector of PVs which are members of the VG.  Passing "" returns all empty PVs.
 std::vector<Glib::ustring> LVM2_PV_Info::get_vg_members( const Glib::ustring & vgname )
 {
+	Glib::Mutex::Lock lock( lvm2_pv_info_mutex );
 	initialize_if_required() ;
 	std::vector<Glib::ustring> members ;
 
@@ -156,27 +182,23 @@ std::vector<Glib::ustring> LVM2_PV_Info::get_vg_members( const Glib::ustring & v
 // Return vector of LVs in the VG.
 std::vector<Glib::ustring> LVM2_PV_Info::get_vg_lvs( const Glib::ustring & vgname )
 {
+	Glib::Mutex::Lock lock( lvm2_pv_info_mutex );
 	initialize_if_required();
 	std::vector<Glib::ustring> lvs;
 
 	if ( vgname == "" )
 		return lvs;
 
-	for ( unsigned int i = 0 ; i < lvm2_vg_cache.size() ; i ++ )
-	{
-		if ( vgname == lvm2_vg_cache[i].vg_name && lvm2_vg_cache[i].lv_name != "" )
-		{
-			// Only append lv_name if not already in lvs
-			if ( std::find( lvs.begin(), lvs.end(), lvm2_vg_cache[i].lv_name ) == lvs.end() )
-				lvs.push_back( lvm2_vg_cache[i].lv_name );
-		}
-	}
+	const LVM2_VG & vg = get_vg_cache_entry_by_name( vgname );
+	for ( unsigned int i = 0 ; i < vg.lvs.size() ; i ++ )
+		lvs.push_back( vg.lvs[i].lv_name );
 
 	return lvs;
 }
 
 std::vector<Glib::ustring> LVM2_PV_Info::get_error_messages( const Glib::ustring & path )
 {
+	Glib::Mutex::Lock lock( lvm2_pv_info_mutex );
 	initialize_if_required() ;
 	if ( ! error_messages .empty() )
 		//Return whole cache error messages as first choice
@@ -217,141 +239,418 @@ void LVM2_PV_Info::set_command_found()
 
 void LVM2_PV_Info::load_lvm2_pv_info_cache()
 {
-	Glib::ustring output, error ;
-	unsigned int i ;
-
 	lvm2_pv_cache .clear() ;
 	lvm2_vg_cache .clear() ;
+	lvm2_pv_index.clear();
+	lvm2_vg_index.clear();
 	error_messages .clear() ;
 	if ( lvm_found )
 	{
-		//The OS is expected to fully enable LVM, this scan does
-		//  not do the full job.  It is included incase anything
-		//  is changed not using lvm commands.
-		Utils::execute_command( "lvm vgscan", output, error, true ) ;
-
-		// Load LVM2 PV cache.  Output PV values in PV_FIELD order.
-		Glib::ustring cmd = "lvm pvs --config \"log{command_names=0}\" --nosuffix "
-		                    "--noheadings --separator , --units b -o pv_name,pv_size,pv_free,vg_name" ;
-		enum PV_FIELD
+		if ( vgscan_requested )
 		{
-			PVFIELD_PV_NAME = 0,
-			PVFIELD_PV_SIZE = 1,
-			PVFIELD_PV_FREE = 2,
-			PVFIELD_VG_NAME = 3,
-			PVFIELD_COUNT   = 4
-		};
-		if ( ! Utils::execute_command( cmd, output, error, true ) )
+			//The OS is expected to fully enable LVM, this scan does
+			//  not do the full job.  It is included incase anything
+			//  is changed not using lvm commands.
+			Glib::ustring output, error;
+			Utils::execute_command( "lvm vgscan", output, error, true );
+			vgscan_requested = false;
+		}
+
+		// Report everything with a single scan of the block devices when lvm supports
+		// it, otherwise fall back to the older pvs report.
+		if ( ! load_from_fullreport() && ! load_from_pvs() )
 		{
-			if ( output != "" )
+			Glib::ustring temp ;
+			temp = _("An error occurred reading LVM2 configuration!") ;
+			temp += "\n" ;
+			temp += _("Some or all of the details might be missing or incorrect.") ;
+			temp += "\n" ;
+			temp += _("You should NOT modify any LVM2 PV partitions.") ;
+			error_messages .push_back( temp ) ;
+		}
+	}
+}
+
+// Reader of the JSON output of the lvm report commands.  The rows of each report are
+// passed to LVM2_PV_Info::add_report_row() as they are read, named after the report
+// they are in, without building a document tree.  E.g. the output of lvm fullreport:
+//     {
+//         "report": [
+//             {
+//                 "vg": [
+//                     {"vg_name":"Test_VG3", "vg_attr":"wz--n-"}
+//                 ]
+//                 ,
+//                 "pv": [
+//                     {"pv_name":"/dev/sda13", "pv_size":"1069547520", ...},
+//                     ...
+//                 ]
+//                 ,
+//                 "lv": [ ... ]
+//                 ...
+//             }
+//             ...
+//         ]
+//     }
+class LVM2_JSON_Reader
+{
+public:
+	LVM2_JSON_Reader( const std::string & json, void (*handler)( const Glib::ustring &,
+	                                                               const LVM2_Report_Row & ) )
+		: p( json.data() ), end( json.data() + json.size() ), row_handler( handler )  {};
+
+	bool read()
+	{
+		std::string scalar;
+		bool is_scalar;
+		if ( ! read_value( "", 0, scalar, is_scalar ) )
+			return false;
+		skip_space();
+		return p == end;
+	}
+
+private:
+	// Objects nest no deeper than this in the lvm reports
+	static const unsigned int MAX_DEPTH = 16;
+
+	void skip_space()
+	{
+		while ( p < end && ( *p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' ) )
+			p ++;
+	}
+
+	bool expect( char c )
+	{
+		skip_space();
+		if ( p >= end || *p != c )
+			return false;
+		p ++;
+		return true;
+	}
+
+	// Read an object, array, string or other scalar value.  Objects with string
+	// members are passed to the row handler as a row of the named report.
+	bool read_value( const Glib::ustring & report, unsigned int depth, std::string & scalar, bool & is_scalar )
+	{
+		is_scalar = false;
+		skip_space();
+		if ( p >= end || depth > MAX_DEPTH )
+			return false;
+
+		if ( *p == '{' )
+		{
+			p ++;
+			LVM2_Report_Row row;
+			skip_space();
+			if ( p < end && *p == '}' )
 			{
-				std::vector<Glib::ustring> lines;
-				Utils::tokenize( output, lines, "\n" );
-				for ( i = 0 ; i < lines.size() ; i ++ )
-				{
-					std::vector<Glib::ustring> fields;
-					Utils::split( Utils::trim( lines[i] ), fields, "," );
-					if ( fields.size() < PVFIELD_COUNT )
-						continue;  // Not enough fields
-					if ( fields[PVFIELD_PV_NAME] == "" )
-						continue;  // Empty PV name
-					LVM2_PV pv;
-					pv.pv_name = BlockSpecial( fields[PVFIELD_PV_NAME] );
-					pv.pv_size = lvm2_pv_size_to_num( fields[PVFIELD_PV_SIZE] );
-					pv.pv_free = lvm2_pv_size_to_num( fields[PVFIELD_PV_FREE] );
-					pv.vg_name = fields[PVFIELD_VG_NAME];
-					lvm2_pv_cache.push_back( pv );
-				}
+				p ++;
+				return true;
 			}
+			do
+			{
+				std::string key;
+				std::string value;
+				bool value_is_scalar;
+				skip_space();
+				if ( ! read_string( key ) || ! expect( ':' ) )
+					return false;
+				// Nested arrays and objects are rows of the report named by key
+				if ( ! read_value( key, depth + 1, value, value_is_scalar ) )
+					return false;
+				if ( value_is_scalar )
+					row[key] = value;
+			} while ( expect( ',' ) );
+			if ( p >= end || *p != '}' )
+				return false;
+			p ++;
+			if ( ! row.empty() )
+				row_handler( report, row );
+			return true;
 		}
-		else
+		else if ( *p == '[' )
 		{
-			error_messages .push_back( cmd ) ;
-			if ( ! output .empty() )
-				error_messages .push_back ( output ) ;
-			if ( ! error .empty() )
-				error_messages .push_back ( error ) ;
+			p ++;
+			skip_space();
+			if ( p < end && *p == ']' )
+			{
+				p ++;
+				return true;
+			}
+			do
+			{
+				std::string value;
+				bool value_is_scalar;
+				if ( ! read_value( report, depth + 1, value, value_is_scalar ) )
+					return false;
+			} while ( expect( ',' ) );
+			if ( p >= end || *p != ']' )
+				return false;
+			p ++;
+			return true;
 		}
-
-		// Load LVM2 VG cache.  Output VG and LV values in VG_FIELD order.
-		cmd = "lvm pvs --config \"log{command_names=0}\" --nosuffix "
-		      "--noheadings --separator , --units b -o vg_name,vg_attr,lv_name,lv_attr" ;
-		enum VG_FIELD
+		else if ( *p == '"' )
 		{
-			VGFIELD_VG_NAME = 0,
-			VGFIELD_VG_ATTR = 1,
-			VGFIELD_LV_NAME = 2,
-			VGFIELD_LV_ATTR = 3,
-			VGFIELD_COUNT   = 4
-		};
-		if ( ! Utils::execute_command( cmd, output, error, true ) )
+			is_scalar = true;
+			return read_string( scalar );
+		}
+
+		// Number, true, false or null.  Kept as text.
+		const char * start = p;
+		while ( p < end && ( g_ascii_isalnum( *p ) || *p == '-' || *p == '+' || *p == '.' ) )
+			p ++;
+		if ( p == start )
+			return false;
+		scalar.assign( start, p );
+		is_scalar = true;
+		return true;
+	}
+
+	bool read_string( std::string & str )
+	{
+		if ( p >= end || *p != '"' )
+			return false;
+		p ++;
+		str.clear();
+		while ( p < end && *p != '"' )
 		{
-			if ( output != "" )
+			if ( *p != '\\' )
+			{
+				str += *p ++;
+				continue;
+			}
+			if ( ++ p >= end )
+				return false;
+			switch ( *p ++ )
 			{
-				std::vector<Glib::ustring> lines;
-				Utils::tokenize( output, lines, "\n" );
-				for ( i = 0 ; i < lines.size() ; i ++ )
+				case '"':  str += '"';  break;
+				case '\\': str += '\\'; break;
+				case '/':  str += '/';  break;
+				case 'b':  str += '\b'; break;
+				case 'f':  str += '\f'; break;
+				case 'n':  str += '\n'; break;
+				case 'r':  str += '\r'; break;
+				case 't':  str += '\t'; break;
+				case 'u':
 				{
-					std::vector<Glib::ustring> fields;
-					Utils::split( Utils::trim( lines[i] ), fields, "," );
-					if ( fields.size() < VGFIELD_COUNT )
-						continue;  // Not enough fields
-					LVM2_VG vg;
-					// VG name may be empty.  See data model example above.
-					vg.vg_name = fields[VGFIELD_VG_NAME];
-					vg.vg_attr = fields[VGFIELD_VG_ATTR];
-					vg.lv_name = fields[VGFIELD_LV_NAME];
-					vg.lv_attr = fields[VGFIELD_LV_ATTR];
-					lvm2_vg_cache.push_back( vg );
+					gunichar c;
+					if ( ! read_hex4( c ) )
+						return false;
+					// Characters outside the Basic Multilingual Plane are
+					// escaped as a UTF-16 surrogate pair.  Reject unpaired
+					// halves.
+					if ( c >= 0xDC00 && c <= 0xDFFF )
+						return false;
+					if ( c >= 0xD800 && c <= 0xDBFF )
+					{
+						gunichar low;
+						if ( end - p < 2 || p[0] != '\\' || p[1] != 'u' )
+							return false;
+						p += 2;
+						if ( ! read_hex4( low ) || low < 0xDC00 || low > 0xDFFF )
+							return false;
+						c = 0x10000 + ( ( c - 0xD800 ) << 10 ) + ( low - 0xDC00 );
+					}
+					char utf8[6];
+					str.append( utf8, g_unichar_to_utf8( c, utf8 ) );
+					break;
 				}
+				default:
+					return false;
 			}
 		}
-		else
+		if ( p >= end )
+			return false;
+		p ++;
+		return true;
+	}
+
+	// Read the 4 hex digits of a \u escape.
+	bool read_hex4( gunichar & c )
+	{
+		if ( end - p < 4 )
+			return false;
+		c = 0;
+		for ( unsigned int i = 0 ; i < 4 ; i ++ )
 		{
-			error_messages .push_back( cmd ) ;
-			if ( ! output .empty() )
-				error_messages .push_back ( output ) ;
-			if ( ! error .empty() )
-				error_messages .push_back ( error ) ;
+			int digit = g_ascii_xdigit_value( *p ++ );
+			if ( digit < 0 )
+				return false;
+			c = c << 4 | digit;
 		}
+		return true;
+	}
+
+	const char * p;
+	const char * end;
+	void (*row_handler)( const Glib::ustring & report, const LVM2_Report_Row & row );
+};
 
-		if ( ! error_messages .empty() )
+// Load the caches from one lvm fullreport command, which reports on all the PVs, VGs and
+// LVs with a single scan of the block devices.  Returns false when lvm fails or is too
+// old to produce this report, so that the older report is tried.
+bool LVM2_PV_Info::load_from_fullreport()
+{
+	Glib::ustring output, error;
+	Glib::ustring cmd = "lvm fullreport --reportformat json --nosuffix --units b "
+	                    "--configreport vg -o vg_name,vg_attr "
+	                    "--configreport pv -o pv_name,pv_size,pv_free,vg_name "
+	                    "--configreport lv -o vg_name,lv_name,lv_attr "
+	                    "--configreport pvseg -o pvseg_start "
+	                    "--configreport seg -o seg_start";
+	if ( Utils::execute_command( cmd, output, error, true ) != 0 )
+		return false;
+
+	LVM2_JSON_Reader reader( output.raw(), add_report_row );
+	if ( ! reader.read() )
+	{
+		lvm2_pv_cache.clear();
+		lvm2_vg_cache.clear();
+		lvm2_pv_index.clear();
+		lvm2_vg_index.clear();
+		return false;
+	}
+	return true;
+}
+
+// Load the caches from the pvs report, with one row for each segment of each PV.
+// Returns false and records the error messages when lvm fails.
+bool LVM2_PV_Info::load_from_pvs()
+{
+	Glib::ustring output, error;
+	// Output values in FIELD order.
+	Glib::ustring cmd = "lvm pvs --config \"log{command_names=0}\" --nosuffix "
+	                    "--noheadings --separator , --units b "
+	                    "-o pv_name,pv_size,pv_free,vg_name,vg_attr,lv_name,lv_attr";
+	enum FIELD
+	{
+		FIELD_PV_NAME = 0,
+		FIELD_PV_SIZE = 1,
+		FIELD_PV_FREE = 2,
+		FIELD_VG_NAME = 3,
+		FIELD_VG_ATTR = 4,
+		FIELD_LV_NAME = 5,
+		FIELD_LV_ATTR = 6,
+		FIELD_COUNT   = 7
+	};
+	if ( Utils::execute_command( cmd, output, error, true ) != 0 )
+	{
+		error_messages .push_back( cmd ) ;
+		if ( ! output .empty() )
+			error_messages .push_back ( output ) ;
+		if ( ! error .empty() )
+			error_messages .push_back ( error ) ;
+		return false;
+	}
+
+	TextTokenizer lines( output.raw(), "\n", true );
+	StringView line;
+	while ( lines.next( line ) )
+	{
+		StringView fields[FIELD_COUNT];
+		unsigned int num_fields = 0;
+		TextTokenizer line_fields( line.trim(), ",", false );
+		while ( num_fields < FIELD_COUNT && line_fields.next( fields[num_fields] ) )
+			num_fields ++;
+		if ( num_fields < FIELD_COUNT )
+			continue;  // Not enough fields
+
+		LVM2_Report_Row row;
+		row["pv_name"] = fields[FIELD_PV_NAME].str();
+		row["pv_size"] = fields[FIELD_PV_SIZE].str();
+		row["pv_free"] = fields[FIELD_PV_FREE].str();
+		row["vg_name"] = fields[FIELD_VG_NAME].str();
+		row["vg_attr"] = fields[FIELD_VG_ATTR].str();
+		row["lv_name"] = fields[FIELD_LV_NAME].str();
+		row["lv_attr"] = fields[FIELD_LV_ATTR].str();
+		add_report_row( "pv", row );
+		add_report_row( "vg", row );
+		add_report_row( "lv", row );
+	}
+	return true;
+}
+
+// Add a row of the pv, vg or lv report to the caches.  Rows of the other reports are
+// ignored, as are repeats of PVs, VGs and LVs already added.
+void LVM2_PV_Info::add_report_row( const Glib::ustring & report, const LVM2_Report_Row & row )
+{
+	LVM2_Report_Row::const_iterator pv_name = row.find( "pv_name" );
+	LVM2_Report_Row::const_iterator pv_size = row.find( "pv_size" );
+	LVM2_Report_Row::const_iterator pv_free = row.find( "pv_free" );
+	LVM2_Report_Row::const_iterator vg_name = row.find( "vg_name" );
+	LVM2_Report_Row::const_iterator vg_attr = row.find( "vg_attr" );
+	LVM2_Report_Row::const_iterator lv_name = row.find( "lv_name" );
+	LVM2_Report_Row::const_iterator lv_attr = row.find( "lv_attr" );
+
+	if ( report == "pv" )
+	{
+		if ( pv_name == row.end() || pv_name->second == "" )
+			return;  // Empty PV name
+		LVM2_PV pv;
+		pv.pv_name = BlockSpecial( pv_name->second );
+		unsigned int index;
+		if ( lvm2_pv_index.find( pv.pv_name, index ) )
+			return;
+		pv.pv_size = ( pv_size != row.end() ) ? lvm2_pv_size_to_num( pv_size->second ) : -1;
+		pv.pv_free = ( pv_free != row.end() ) ? lvm2_pv_size_to_num( pv_free->second ) : -1;
+		pv.vg_name = ( vg_name != row.end() ) ? vg_name->second : "";
+		lvm2_pv_cache.push_back( pv );
+		lvm2_pv_index.push_back( pv.pv_name );
+	}
+	else if ( report == "vg" || report == "lv" )
+	{
+		if ( vg_name == row.end() || vg_name->second == "" )
+			return;  // Empty VG name of a PV not in a VG
+		std::map<Glib::ustring, unsigned int>::const_iterator index = lvm2_vg_index.find( vg_name->second );
+		if ( index == lvm2_vg_index.end() )
 		{
-			Glib::ustring temp ;
-			temp = _("An error occurred reading LVM2 configuration!") ;
-			temp += "\n" ;
-			temp += _("Some or all of the details might be missing or incorrect.") ;
-			temp += "\n" ;
-			temp += _("You should NOT modify any LVM2 PV partitions.") ;
-			error_messages .push_back( temp ) ;
+			LVM2_VG vg;
+			vg.vg_name = vg_name->second;
+			index = lvm2_vg_index.insert( std::make_pair( vg.vg_name, lvm2_vg_cache.size() ) ).first;
+			lvm2_vg_cache.push_back( vg );
+		}
+		LVM2_VG & vg = lvm2_vg_cache[index->second];
+
+		if ( report == "vg" )
+		{
+			if ( vg_attr != row.end() )
+				vg.vg_attr = vg_attr->second;
+			return;
 		}
+
+		if ( lv_name == row.end() || lv_name->second == "" )
+			return;  // Free space segment not in any LV
+		for ( unsigned int i = 0 ; i < vg.lvs.size() ; i ++ )
+		{
+			if ( vg.lvs[i].lv_name == lv_name->second )
+				return;
+		}
+		LVM2_LV lv;
+		lv.lv_name = lv_name->second;
+		lv.lv_attr = ( lv_attr != row.end() ) ? lv_attr->second : "";
+		vg.lvs.push_back( lv );
 	}
 }
 
-// Performs linear search of the PV cache to find the first matching pv_name.
+// Finds the PV in the cache by name.
 // Returns found cache entry or not found substitute.
 const LVM2_PV & LVM2_PV_Info::get_pv_cache_entry_by_name( const Glib::ustring & pvname )
 {
-	BlockSpecial bs_pvname( pvname );
-	for ( unsigned int i = 0 ; i < lvm2_pv_cache.size() ; i ++ )
-	{
-		if ( bs_pvname == lvm2_pv_cache[i].pv_name )
-			return lvm2_pv_cache[i];
-	}
+	unsigned int index;
+	if ( lvm2_pv_index.find( BlockSpecial( pvname ), index ) )
+		return lvm2_pv_cache[index];
 	static LVM2_PV pv = {BlockSpecial(), -1, -1, ""};
 	return pv;
 }
 
-// Performs linear search of the VG cache to find the first matching vg_name.
+// Finds the VG in the cache by name.
 // Returns found cache entry or not found substitute.
 const LVM2_VG & LVM2_PV_Info::get_vg_cache_entry_by_name( const Glib::ustring & vgname )
 {
-	for ( unsigned int i = 0 ; i < lvm2_vg_cache.size() ; i ++ )
-	{
-		if ( vgname == lvm2_vg_cache[i].vg_name )
-			return lvm2_vg_cache[i];
-	}
-	static LVM2_VG vg = {"", "", "", ""};
+	std::map<Glib::ustring, unsigned int>::const_iterator index = lvm2_vg_index.find( vgname );
+	if ( index != lvm2_vg_index.end() )
+		return lvm2_vg_cache[index->second];
+	static LVM2_VG vg;
 	return vg;
 }
 
@@ -15,16 +15,24 @@
  */
 
 #include "Mount_Info.h"
+#include "BlockSpecial.h"
 #include "FS_Info.h"
+#include "TextTokenizer.h"
 #include "Utils.h"
 
 #include <glibmm/ustring.h>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <mntent.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
 #include <string>
-#include <fstream>
 
 namespace GParted
 {
@@ -42,28 +50,68 @@ static Mount_Info::MountMapping mount_info;
 //     fstab_info[BlockSpecial("/dev/sda3")] -> ["/"]
 static Mount_Info::MountMapping fstab_info;
 
+// Mounted file systems and active swap space as last read, merged into mount_info.
+// Those identified by device number are kept in mounted_fs_info.  Those only known by
+// name, such as btrfs with its anonymous device number and all swap space, are kept
+// unresolved and looked up again on each load as the name to device number cache is
+// cleared on every rescan, after which the names may refer to other devices.
+static Mount_Info::MountMapping mounted_fs_info;
+static Mount_Info::MountEntries mounted_fs_entries;
+static Mount_Info::MountEntries swaps_entries;
+
+// Node and mount point pairs as last read from /etc/fstab.  UUID= and LABEL= nodes are
+// looked up again each time the cache is loaded as the file systems may have changed
+// even when /etc/fstab hasn't.
+static Mount_Info::MountEntries fstab_entries;
+
+// Open files watched for changes, or -1 when not open.  The kernel reports changes to
+// the mount table and to the active swap space by polling /proc/self/mountinfo and
+// /proc/swaps for POLLPRI.  Proc files don't support inotify so it is only used to
+// watch /etc for editors writing or replacing fstab.
+static int mountinfo_fd = -1;
+static int swaps_fd = -1;
+static int etc_inotify_fd = -1;
+
 void Mount_Info::load_cache()
 {
-	mount_info.clear();
-	fstab_info.clear();
+	std::string contents;
 
-	read_mountpoints_from_file( "/proc/mounts", mount_info );
-	read_mountpoints_from_file_swaps( "/proc/swaps", mount_info );
+	if ( watched_file_changed( mountinfo_fd, "/proc/self/mountinfo" ) )
+	{
+		mounted_fs_info.clear();
+		mounted_fs_entries.clear();
+		if ( read_from_start( mountinfo_fd, contents ) )
+			read_mountpoints_from_mountinfo( contents, mounted_fs_info, mounted_fs_entries );
+		else
+		{
+			// Kernels before 2.6.26 don't provide /proc/self/mountinfo.
+			read_mount_entries( "/proc/mounts", mounted_fs_entries );
+
+			if ( ! have_rootfs_dev( mounted_fs_entries ) )
+				// Old distributions only contain 'rootfs' and '/dev/root' device names
+				// for the / (root) file system in /proc/mounts with '/dev/root' being a
+				// block device rather than a symlink to the true device.  This prevents
+				// identification, and therefore busy detection, of the device containing
+				// the / (root) file system.  Used to read /etc/mtab to get the root file
+				// system device name, but this contains an out of date device name after
+				// the mounting device has been dynamically removed from a multi-device
+				// btrfs, thus identifying the wrong device as busy.  Instead fall back
+				// to reading mounted file systems from the output of the mount command,
+				// but only when required.
+				read_mountpoints_from_mount_command( mounted_fs_entries );
+		}
+	}
 
-	if ( ! have_rootfs_dev( mount_info ) )
-		// Old distributions only contain 'rootfs' and '/dev/root' device names
-		// for the / (root) file system in /proc/mounts with '/dev/root' being a
-		// block device rather than a symlink to the true device.  This prevents
-		// identification, and therefore busy detection, of the device containing
-		// the / (root) file system.  Used to read /etc/mtab to get the root file
-		// system device name, but this contains an out of date device name after
-		// the mounting device has been dynamically removed from a multi-device
-		// btrfs, thus identifying the wrong device as busy.  Instead fall back
-		// to reading mounted file systems from the output of the mount command,
-		// but only when required.
-		read_mountpoints_from_mount_command( mount_info );
+	if ( watched_file_changed( swaps_fd, "/proc/swaps" ) )
+	{
+		swaps_entries.clear();
+		if ( read_from_start( swaps_fd, contents ) )
+			read_mountpoints_from_swaps( contents, swaps_entries );
+	}
 
-	read_mountpoints_from_file( "/etc/fstab", fstab_info );
+	mount_info = mounted_fs_info;
+	add_named_entries( mounted_fs_entries, mount_info );
+	add_named_entries( swaps_entries, mount_info );
 
 	// Sort the mount points and remove duplicates ... (no need to do this for fstab_info)
 	MountMapping::iterator iter_mp;
@@ -75,6 +123,36 @@ void Mount_Info::load_cache()
 				std::unique( iter_mp->second.begin(), iter_mp->second.end() ),
 				iter_mp->second.end() );
 	}
+
+	if ( fstab_changed() )
+	{
+		fstab_entries.clear();
+		read_mount_entries( "/etc/fstab", fstab_entries );
+	}
+	fstab_info.clear();
+	add_mount_entries( fstab_entries, fstab_info );
+}
+
+// Close the watched files and empty the caches so that everything is read again by the
+// next load.
+void Mount_Info::clear_cache()
+{
+	if ( mountinfo_fd >= 0 )
+		close( mountinfo_fd );
+	mountinfo_fd = -1;
+	if ( swaps_fd >= 0 )
+		close( swaps_fd );
+	swaps_fd = -1;
+	if ( etc_inotify_fd >= 0 )
+		close( etc_inotify_fd );
+	etc_inotify_fd = -1;
+
+	mount_info.clear();
+	fstab_info.clear();
+	mounted_fs_info.clear();
+	mounted_fs_entries.clear();
+	swaps_entries.clear();
+	fstab_entries.clear();
 }
 
 // Return whether the device path, such as /dev/sda3, is mounted or not
@@ -113,7 +191,199 @@ const std::vector<Glib::ustring> & Mount_Info::get_fstab_mountpoints( const Glib
 
 // Private methods
 
-void Mount_Info::read_mountpoints_from_file( const Glib::ustring & filename, MountMapping & map )
+// Decode the octal escapes, such as "\040" for space, used for special characters in
+// the names in /proc/self/mountinfo and /proc/swaps.
+static Glib::ustring unescape_octal( const StringView & field )
+{
+	std::string result;
+	result.reserve( field.size() );
+	for ( size_t i = 0 ; i < field.size() ; i ++ )
+	{
+		if ( field[i] == '\\'                          &&
+		     i + 3 < field.size()                      &&
+		     field[i+1] >= '0' && field[i+1] <= '3'    &&
+		     field[i+2] >= '0' && field[i+2] <= '7'    &&
+		     field[i+3] >= '0' && field[i+3] <= '7'       )
+		{
+			result += (char)( ( field[i+1] - '0' ) * 64 + ( field[i+2] - '0' ) * 8 + ( field[i+3] - '0' ) );
+			i += 3;
+		}
+		else
+			result += field[i];
+	}
+	return result;
+}
+
+// Return whether the watched file has changed since it was last read, or is not yet open
+// so must be read for the first time.
+bool Mount_Info::watched_file_changed( int & fd, const char * filename )
+{
+	if ( fd < 0 )
+	{
+		fd = open( filename, O_RDONLY );
+		if ( fd >= 0 )
+			fcntl( fd, F_SETFD, FD_CLOEXEC );
+		return true;
+	}
+
+	struct pollfd pfd;
+	pfd.fd      = fd;
+	pfd.events  = POLLPRI;
+	pfd.revents = 0;
+	if ( poll( &pfd, 1, 0 ) < 0 )
+		return true;
+	return ( pfd.revents & ( POLLPRI | POLLERR ) ) != 0;
+}
+
+// Return whether /etc/fstab may have changed since last called.  Always true when /etc
+// can't be watched.
+bool Mount_Info::fstab_changed()
+{
+	if ( etc_inotify_fd < 0 )
+	{
+		etc_inotify_fd = inotify_init();
+		if ( etc_inotify_fd < 0 )
+			return true;
+		fcntl( etc_inotify_fd, F_SETFD, FD_CLOEXEC );
+		fcntl( etc_inotify_fd, F_SETFL, O_NONBLOCK );
+		if ( inotify_add_watch( etc_inotify_fd, "/etc",
+		                        IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO ) < 0 )
+		{
+			close( etc_inotify_fd );
+			etc_inotify_fd = -1;
+		}
+		return true;
+	}
+
+	// Read all the queued events.  A buffer of longs so that the events are aligned.
+	bool changed = false;
+	bool watch_removed = false;
+	long buf[4096 / sizeof( long )];
+	ssize_t len;
+	while ( ( len = read( etc_inotify_fd, buf, sizeof( buf ) ) ) > 0 )
+	{
+		const char * ptr = reinterpret_cast<const char *>( buf );
+		const char * end = ptr + len;
+		while ( ptr < end )
+		{
+			const struct inotify_event * event = reinterpret_cast<const struct inotify_event *>( ptr );
+			if ( event->mask & IN_Q_OVERFLOW )
+				changed = true;
+			else if ( event->mask & IN_IGNORED )
+				watch_removed = true;
+			else if ( event->len > 0 && strcmp( event->name, "fstab" ) == 0 )
+				changed = true;
+			ptr += sizeof( struct inotify_event ) + event->len;
+		}
+	}
+	if ( len < 0 && errno != EAGAIN && errno != EINTR )
+		watch_removed = true;
+
+	if ( watch_removed )
+	{
+		// Start watching again next time
+		close( etc_inotify_fd );
+		etc_inotify_fd = -1;
+		return true;
+	}
+	return changed;
+}
+
+// Read the whole of an open file from the start.  On failure the file is closed so that
+// it is opened again next time.
+bool Mount_Info::read_from_start( int & fd, std::string & contents )
+{
+	contents.clear();
+	if ( fd < 0 )
+		return false;
+
+	if ( lseek( fd, 0, SEEK_SET ) == 0 )
+	{
+		char buf[4096];
+		ssize_t len;
+		while ( ( len = read( fd, buf, sizeof( buf ) ) ) != 0 )
+		{
+			if ( len < 0 && errno == EINTR )
+				continue;
+			if ( len < 0 )
+				break;
+			contents.append( buf, len );
+		}
+		if ( len == 0 )
+			return true;
+	}
+
+	close( fd );
+	fd = -1;
+	return false;
+}
+
+// Read the mounted file systems.  The major, minor device numbers are those of the
+// mounted block device so no lookup by name is required.  Example lines:
+//     22 1 8:3 / / rw,relatime shared:1 - ext4 /dev/sda3 rw,seclabel
+//     40 22 8:1 / /boot rw,relatime shared:25 - xfs /dev/sda1 rw,attr2,inode64,noquota
+//     45 22 0:38 / /mnt/btrfs rw,relatime shared:27 - btrfs /dev/sdb1 rw,space_cache,subvol=/
+//     46 22 0:39 / /mnt/my\040files rw,relatime - tmpfs tmpfs rw
+// Reference:
+//     proc(5), /proc/[pid]/mountinfo
+void Mount_Info::read_mountpoints_from_mountinfo( const std::string & contents, MountMapping & map,
+                                                  MountEntries & entries )
+{
+	TextTokenizer lines( contents, "\n", true );
+	StringView line;
+	while ( lines.next( line ) )
+	{
+		// Fixed fields: mount ID, parent ID, major:minor, root, mount point and
+		// mount options, followed by optional fields up to a "-" separator, then
+		// file system type and mount source.
+		TextTokenizer fields( line, " ", true );
+		StringView field;
+		StringView dev_numbers;
+		StringView mountpoint;
+		unsigned int num_fields = 0;
+		while ( num_fields < 6 && fields.next( field ) )
+		{
+			if ( num_fields == 2 )
+				dev_numbers = field;
+			else if ( num_fields == 4 )
+				mountpoint = field;
+			num_fields ++;
+		}
+		bool found_separator = false;
+		while ( ! found_separator && fields.next( field ) )
+			found_separator = ( field == "-" );
+		StringView fstype;
+		StringView source;
+		if ( num_fields < 6 || ! found_separator || ! fields.next( fstype ) || ! fields.next( source ) )
+			continue;
+
+		size_t colon = dev_numbers.find( ":" );
+		unsigned long long maj;
+		unsigned long long min;
+		if ( colon == StringView::npos                          ||
+		     ! dev_numbers.substr( 0, colon ).to_number( maj )  ||
+		     ! dev_numbers.substr( colon + 1 ).to_number( min )    )
+			continue;
+
+		if ( maj > 0 )
+		{
+			BlockSpecial bs;
+			bs.m_name  = unescape_octal( source );
+			bs.m_major = maj;
+			bs.m_minor = min;
+			map[bs].push_back( unescape_octal( mountpoint ) );
+		}
+		else
+		{
+			// File systems which aren't on a single block device, such as btrfs,
+			// and virtual file systems have anonymous device numbers with major 0
+			// so identify the device by name instead.
+			entries.push_back( std::make_pair( unescape_octal( source ), unescape_octal( mountpoint ) ) );
+		}
+	}
+}
+
+void Mount_Info::read_mount_entries( const Glib::ustring & filename, MountEntries & entries )
 {
 	FILE* fp = setmntent( filename .c_str(), "r" );
 	if ( fp == NULL )
@@ -121,9 +391,17 @@ void Mount_Info::read_mountpoints_from_file( const Glib::ustring & filename, Mou
 
 	struct mntent* p = NULL;
 	while ( ( p = getmntent( fp ) ) != NULL )
+		entries.push_back( std::make_pair( Glib::ustring( p->mnt_fsname ), Glib::ustring( p->mnt_dir ) ) );
+
+	endmntent( fp );
+}
+
+void Mount_Info::add_mount_entries( const MountEntries & entries, MountMapping & map )
+{
+	for ( unsigned int i = 0 ; i < entries.size() ; i ++ )
 	{
-		Glib::ustring node = p->mnt_fsname;
-		Glib::ustring mountpoint = p->mnt_dir;
+		Glib::ustring node = entries[i].first;
+		Glib::ustring mountpoint = entries[i].second;
 
 		Glib::ustring uuid = Utils::regexp_label( node, "^UUID=(.*)" );
 		if ( ! uuid.empty() )
@@ -136,8 +414,13 @@ void Mount_Info::read_mountpoints_from_file( const Glib::ustring & filename, Mou
 		if ( ! node.empty() )
 			add_node_and_mountpoint( map, node, mountpoint );
 	}
+}
 
-	endmntent( fp );
+// Add entries whose nodes are device names, looking up the device numbers now.
+void Mount_Info::add_named_entries( const MountEntries & entries, MountMapping & map )
+{
+	for ( unsigned int i = 0 ; i < entries.size() ; i ++ )
+		map[BlockSpecial( entries[i].first )].push_back( entries[i].second );
 }
 
 void Mount_Info::add_node_and_mountpoint( MountMapping & map,
@@ -149,41 +432,41 @@ void Mount_Info::add_node_and_mountpoint( MountMapping & map,
 		map[BlockSpecial( node )].push_back( mountpoint );
 }
 
-void Mount_Info::read_mountpoints_from_file_swaps( const Glib::ustring & filename, MountMapping & map )
+// Read the active swap space.  Example /proc/swaps:
+//     Filename				Type		Size	Used	Priority
+//     /dev/sda2                               partition	2097148	0	-2
+void Mount_Info::read_mountpoints_from_swaps( const std::string & contents, MountEntries & entries )
 {
-	std::string line;
-	std::string node;
-
-	std::ifstream file( filename.c_str() );
-	if ( file )
+	TextTokenizer lines( contents, "\n", true );
+	StringView line;
+	while ( lines.next( line ) )
 	{
-		while ( getline( file, line ) )
-		{
-			node = Utils::regexp_label( line, "^(/[^ ]+)" );
-			if ( node.size() > 0 )
-				map[BlockSpecial( node )].push_back( "" /* no mountpoint for swap */ );
-		}
-		file.close();
+		if ( ! line.starts_with( "/" ) )
+			continue;
+		TextTokenizer fields( line, " \t", true );
+		StringView filename;
+		if ( fields.next( filename ) )
+			entries.push_back( std::make_pair( unescape_octal( filename ),
+			                                   Glib::ustring( "" ) /* no mountpoint for swap */ ) );
 	}
 }
 
-// Return true only if the map contains a device name for the / (root) file system other
-// than 'rootfs' and '/dev/root'.
-bool Mount_Info::have_rootfs_dev( MountMapping & map )
+// Return true only if the entries contain a device name for the / (root) file system
+// other than 'rootfs' and '/dev/root'.
+bool Mount_Info::have_rootfs_dev( const MountEntries & entries )
 {
-	MountMapping::const_iterator iter_mp;
-	for ( iter_mp = mount_info.begin() ; iter_mp != mount_info.end() ; iter_mp ++ )
+	for ( unsigned int i = 0 ; i < entries.size() ; i ++ )
 	{
-		if ( ! iter_mp->second.empty() && iter_mp->second[0] == "/" )
+		if ( entries[i].second == "/" )
 		{
-			if ( iter_mp->first.m_name != "rootfs" && iter_mp->first.m_name != "/dev/root" )
+			if ( entries[i].first != "rootfs" && entries[i].first != "/dev/root" )
 				return true;
 		}
 	}
 	return false;
 }
 
-void Mount_Info::read_mountpoints_from_mount_command( MountMapping & map )
+void Mount_Info::read_mountpoints_from_mount_command( MountEntries & entries )
 {
 	Glib::ustring output;
 	Glib::ustring error;
@@ -196,8 +479,8 @@ void Mount_Info::read_mountpoints_from_mount_command( MountMapping & map )
 			// Process line like "/dev/sda3 on / type ext4 (rw)"
 			Glib::ustring node = Utils::regexp_label( lines[ i ], "^([^[:blank:]]+) on " );
 			Glib::ustring mountpoint = Utils::regexp_label( lines[ i ], "^[^[:blank:]]+ on ([^[:blank:]]+) " );
-			if ( ! node.empty() )
-				add_node_and_mountpoint( map, node, mountpoint );
+			if ( ! node.empty() && file_test( mountpoint, Glib::FILE_TEST_EXISTS ) )
+				entries.push_back( std::make_pair( node, mountpoint ) );
 		}
 	}
 }
@@ -0,0 +1,173 @@
+/* Copyright (C) 2018 Mike Fleetwood
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MoveJournal.h"
+#include "Utils.h"
+
+#include <glibmm/ustring.h>
+#include <glibmm/keyfile.h>
+#include <glibmm/miscutils.h>
+#include <glib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace GParted
+{
+
+const char * const JOURNAL_GROUP = "move";
+
+MoveJournal::MoveJournal() :
+	filesystem( FS_UNKNOWN ),
+	sector_size( 0 ),
+	old_start( 0 ),
+	old_end( -1 ),
+	new_start( 0 ),
+	new_end( -1 ),
+	done( 0 ),
+	resumed( 0 )
+{
+}
+
+// Record a new move, with nothing moved yet, before starting to copy.
+bool MoveJournal::start()
+{
+	done = 0;
+	resumed = 0;
+	return save();
+}
+
+// Record that the current copy has moved and flushed copied bytes.
+bool MoveJournal::checkpoint( Byte_Value copied )
+{
+	done = resumed + copied;
+	return save();
+}
+
+void MoveJournal::remove()
+{
+	unlink( get_filename().c_str() );
+}
+
+Byte_Value MoveJournal::get_byte_length() const
+{
+	return ( old_end - old_start + 1 ) * sector_size;
+}
+
+bool MoveJournal::moving_left() const
+{
+	return new_start < old_start;
+}
+
+// Load the journal of a move which didn't finish.  Returns false when there isn't one.
+bool MoveJournal::load( MoveJournal & journal )
+{
+	try
+	{
+		Glib::KeyFile key_file;
+		key_file.load_from_file( get_filename() );
+		journal.device_path     = key_file.get_string( JOURNAL_GROUP, "device" );
+		journal.device_identity = key_file.get_string( JOURNAL_GROUP, "identity" );
+		journal.filesystem      = (FSType)key_file.get_integer( JOURNAL_GROUP, "filesystem" );
+		journal.sector_size     = key_file.get_integer( JOURNAL_GROUP, "sector_size" );
+		journal.old_start       = atoll( key_file.get_string( JOURNAL_GROUP, "old_start" ).c_str() );
+		journal.old_end         = atoll( key_file.get_string( JOURNAL_GROUP, "old_end" ).c_str() );
+		journal.new_start       = atoll( key_file.get_string( JOURNAL_GROUP, "new_start" ).c_str() );
+		journal.new_end         = atoll( key_file.get_string( JOURNAL_GROUP, "new_end" ).c_str() );
+		journal.done            = atoll( key_file.get_string( JOURNAL_GROUP, "done" ).c_str() );
+		journal.resumed         = 0;
+	}
+	catch ( Glib::Exception & e )
+	{
+		return false;
+	}
+
+	return    journal.sector_size > 0
+	       && journal.old_end >= journal.old_start
+	       && journal.new_end - journal.new_start == journal.old_end - journal.old_start
+	       && journal.done >= 0
+	       && journal.done % journal.sector_size == 0
+	       && journal.done <= journal.get_byte_length();
+}
+
+// Write the journal so that it survives a crash.  Written to a temporary file which is
+// flushed and renamed over the previous journal, so that either the previous or new
+// checkpoint is always readable.
+bool MoveJournal::save() const
+{
+	Glib::KeyFile key_file;
+	key_file.set_string( JOURNAL_GROUP, "device", device_path );
+	key_file.set_string( JOURNAL_GROUP, "identity", device_identity );
+	key_file.set_integer( JOURNAL_GROUP, "filesystem", filesystem );
+	key_file.set_integer( JOURNAL_GROUP, "sector_size", sector_size );
+	key_file.set_string( JOURNAL_GROUP, "old_start", Utils::num_to_str( old_start ) );
+	key_file.set_string( JOURNAL_GROUP, "old_end", Utils::num_to_str( old_end ) );
+	key_file.set_string( JOURNAL_GROUP, "new_start", Utils::num_to_str( new_start ) );
+	key_file.set_string( JOURNAL_GROUP, "new_end", Utils::num_to_str( new_end ) );
+	key_file.set_string( JOURNAL_GROUP, "done", Utils::num_to_str( done ) );
+	Glib::ustring data = key_file.to_data();
+
+	Glib::ustring filename = get_filename();
+	Glib::ustring dirname = Glib::path_get_dirname( filename );
+	Glib::ustring tmpname = filename + ".tmp";
+	g_mkdir_with_parents( dirname.c_str(), 0700 );
+
+	int fd = open( tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600 );
+	if ( fd < 0 )
+		return false;
+	const char * buf = data.c_str();
+	size_t remaining = data.bytes();
+	while ( remaining > 0 )
+	{
+		ssize_t ret = write( fd, buf, remaining );
+		if ( ret < 0 && errno == EINTR )
+			continue;
+		if ( ret <= 0 )
+		{
+			close( fd );
+			return false;
+		}
+		buf += ret;
+		remaining -= ret;
+	}
+	if ( fsync( fd ) != 0 )
+	{
+		close( fd );
+		return false;
+	}
+	close( fd );
+
+	if ( rename( tmpname.c_str(), filename.c_str() ) != 0 )
+		return false;
+
+	// Flush the directory entry too
+	fd = open( dirname.c_str(), O_RDONLY | O_DIRECTORY );
+	if ( fd >= 0 )
+	{
+		fsync( fd );
+		close( fd );
+	}
+	return true;
+}
+
+Glib::ustring MoveJournal::get_filename()
+{
+	return Glib::build_filename( Glib::get_user_data_dir(), "gparted", "move-journal.ini" );
+}
+
+}//GParted
@@ -0,0 +1,46 @@
+/* Copyright (C) 2018 Mike Fleetwood
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "OperationResumeMove.h"
+#include "Partition.h"
+
+namespace GParted
+{
+
+OperationResumeMove::OperationResumeMove( const Device & device,
+                                          const Partition & partition_all_space,
+                                          const Partition & partition_new )
+	: OperationResizeMove( device, partition_all_space, partition_new )
+{
+	type = OPERATION_RESUME_MOVE;
+}
+
+void OperationResumeMove::create_description()
+{
+	g_assert( partition_original != NULL );  // Bug: Not initialised by constructor or reset later
+
+	/*TO TRANSLATORS: looks like  Resume interrupted move of /dev/hda4 */
+	description = String::ucompose( _("Resume interrupted move of %1"),
+	                                partition_original->get_path() );
+}
+
+bool OperationResumeMove::merge_operations( const Operation & candidate )
+{
+	// Never merged.  The move must be finished exactly as journalled.
+	return false;
+}
+
+} //GParted
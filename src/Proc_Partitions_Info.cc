@@ -16,12 +16,12 @@
 
 #include "Proc_Partitions_Info.h"
 #include "BlockSpecial.h"
+#include "TextTokenizer.h"
 #include "Utils.h"
 
 #include <glibmm/ustring.h>
 #include <vector>
 #include <fstream>
-#include <stdio.h>
 
 namespace GParted
 {
@@ -67,51 +67,52 @@ void Proc_Partitions_Info::load_proc_partitions_info_cache()
 		{
 			// Pre-populate BlockSpecial cache with major, minor numbers of
 			// all names found from /proc/partitions.
-			Glib::ustring name = Utils::regexp_label( line,
-			        "^[[:blank:]]*[[:digit:]]+[[:blank:]]+[[:digit:]]+[[:blank:]]+[[:digit:]]+[[:blank:]]+([[:graph:]]+)$" );
-			if ( name == "" )
-				continue;
-			unsigned long maj;
-			unsigned long min;
-			if ( sscanf( line.c_str(), "%lu %lu", &maj, &min ) != 2 )
+			// Example line:
+			//        8        1     524288 sda1
+			StringView fields[4];
+			unsigned int num_fields = 0;
+			TextTokenizer line_fields( line, " \t", true );
+			while ( num_fields < 4 && line_fields.next( fields[num_fields] ) )
+				num_fields ++;
+			unsigned long long maj;
+			unsigned long long min;
+			unsigned long long blocks;
+			if ( num_fields < 4                       ||
+			     ! line_fields.rest().trim().empty()  ||
+			     ! fields[0].to_number( maj )         ||
+			     ! fields[1].to_number( min )         ||
+			     ! fields[2].to_number( blocks )         )
 				continue;
+			Glib::ustring name = fields[3].str();
 			BlockSpecial::register_block_special( "/dev/" + name, maj, min );
 
 			// Recognise only whole disk device names, excluding partitions,
-			// from /proc/partitions and save in this cache.
-
-			//Whole disk devices are the ones we want.
-			//Device names without a trailing digit refer to the whole disk.
-			device = Utils::regexp_label( name, "^([^0-9]+)$" );
-
-			//Recognize /dev/md* devices (Linux software RAID - mdadm).
-			//E.g., device = /dev/md127, partition = /dev/md127p1
-			if ( device == "" )
-				device = Utils::regexp_label( name, "^(md[0-9]+)$" );
-
-			//Recognize /dev/mmcblk* devices.
-			//E.g., device = /dev/mmcblk0, partition = /dev/mmcblk0p1
-			if ( device == "" )
-				device = Utils::regexp_label( name, "^(mmcblk[0-9]+)$" );
-
-			// Recognise /dev/nvme*n* devices
-			// (Non-Volatile Memory Express devices.  SSD type devices which
-			// plug directly into PCIe sockets).
-			// E.g., device = /dev/nvme0n1, partition = /dev/nvme0n1p1
-			if ( device == "" )
-				device = Utils::regexp_label( name, "^(nvme[0-9]+n[0-9]+)$" );
-
-			//Device names that end with a #[^p]# are HP Smart Array Devices (disks)
-			//  E.g., device = /dev/cciss/c0d0, partition = /dev/cciss/c0d0p1
-			//  (linux-x.y.z/Documentation/blockdev/cciss.txt)
-			//Device names for Compaq SMART2 Intelligent Disk Array
-			//  E.g., device = /dev/ida/c0d0, partition = /dev/ida/c0d0p1
-			//  (linux-x.y.z/Documentation/blockdev/cpqarray.txt)
-			//Device names for Mylex DAC960/AcceleRAID/eXtremeRAID PCI RAID
-			//  E.g., device = /dev/rd/c0d0, partition = /dev/rd/c0d0p1
-			//  (linux-x.y.z/Documentation/blockdev/README.DAC960)
-			if ( device == "" )
-				device = Utils::regexp_label( name, "^([a-z]+/c[0-9]+d[0-9]+)$" );
+			// from /proc/partitions and save in this cache.  Whole disk
+			// devices are the ones we want:
+			// *   Device names without a trailing digit refer to the whole
+			//     disk.
+			// *   /dev/md* devices (Linux software RAID - mdadm).
+			//     E.g., device = /dev/md127, partition = /dev/md127p1
+			// *   /dev/mmcblk* devices.
+			//     E.g., device = /dev/mmcblk0, partition = /dev/mmcblk0p1
+			// *   /dev/nvme*n* devices (Non-Volatile Memory Express devices.
+			//     SSD type devices which plug directly into PCIe sockets).
+			//     E.g., device = /dev/nvme0n1, partition = /dev/nvme0n1p1
+			// *   Device names that end with a #[^p]# are HP Smart Array
+			//     Devices (disks)
+			//       E.g., device = /dev/cciss/c0d0, partition = /dev/cciss/c0d0p1
+			//       (linux-x.y.z/Documentation/blockdev/cciss.txt)
+			//     Device names for Compaq SMART2 Intelligent Disk Array
+			//       E.g., device = /dev/ida/c0d0, partition = /dev/ida/c0d0p1
+			//       (linux-x.y.z/Documentation/blockdev/cpqarray.txt)
+			//     Device names for Mylex DAC960/AcceleRAID/eXtremeRAID PCI RAID
+			//       E.g., device = /dev/rd/c0d0, partition = /dev/rd/c0d0p1
+			//       (linux-x.y.z/Documentation/blockdev/README.DAC960)
+			device = Utils::regexp_label( name, "^([^0-9]+"
+			                                    "|md[0-9]+"
+			                                    "|mmcblk[0-9]+"
+			                                    "|nvme[0-9]+n[0-9]+"
+			                                    "|[a-z]+/c[0-9]+d[0-9]+)$" );
 
 			if ( device != "" )
 			{
@@ -16,17 +16,29 @@
 
 #include "SWRaid_Info.h"
 #include "BlockSpecial.h"
+#include "FS_Info.h"
+#include "SuperblockReader.h"
+#include "TextTokenizer.h"
 #include "Utils.h"
 
 #include <glibmm/ustring.h>
+#include <glibmm/fileutils.h>
+#include <glibmm/thread.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
 #include <fstream>
 
 namespace GParted
 {
 
+const unsigned long long MD_SB_MAGIC = 0xa92b4efc;
+const Byte_Value MD_SB_0_90_RESERVED = 64 * KIBIBYTE;  // Reserved at the end for 0.90 metadata
+const size_t MD_SB_READ_SIZE = 4096;
+
 // Data model:
 // cache_initialised - Has the cache been loaded?
-// mdadm_found       - Is the "mdadm" command available?
 // swraid_info_cache - Vector of member information in Linux Software RAID arrays.
 //                     Only active arrays have /dev entries.
 //                     Notes:
@@ -40,14 +52,20 @@ namespace GParted
 //                      {BS("/dev/sda6"), ""        , "8dc7483c-d74e-e0a8-b6a8-dc3ca57e43f8", ""         , false},
 //                      {BS("/dev/sdb6"), ""        , "8dc7483c-d74e-e0a8-b6a8-dc3ca57e43f8", ""         , false}
 //                     ]
+// swraid_info_index - Index of the members in swraid_info_cache.
 
 // Initialise static data elements
-bool SWRaid_Info::cache_initialised = false;
 bool SWRaid_Info::mdadm_found = false;
+bool SWRaid_Info::cache_initialised = false;
 std::vector<SWRaid_Member> SWRaid_Info::swraid_info_cache;
+BlockSpecialIndex SWRaid_Info::swraid_info_index;
+
+// Protects the above when devices are probed concurrently.
+static Glib::Mutex swraid_info_mutex;
 
 void SWRaid_Info::load_cache()
 {
+	Glib::Mutex::Lock lock( swraid_info_mutex );
 	set_command_found();
 	load_swraid_info_cache();
 	cache_initialised = true;
@@ -55,6 +73,7 @@ void SWRaid_Info::load_cache()
 
 bool SWRaid_Info::is_member( const Glib::ustring & member_path )
 {
+	Glib::Mutex::Lock lock( swraid_info_mutex );
 	initialise_if_required();
 	const SWRaid_Member & memb = get_cache_entry_by_member( member_path );
 	if ( memb.member.m_name.length() > 0 )
@@ -66,6 +85,7 @@ bool SWRaid_Info::is_member( const Glib::ustring & member_path )
 // Return member/array active status, or false when there is no such member.
 bool SWRaid_Info::is_member_active( const Glib::ustring & member_path )
 {
+	Glib::Mutex::Lock lock( swraid_info_mutex );
 	initialise_if_required();
 	const SWRaid_Member & memb = get_cache_entry_by_member( member_path );
 	return memb.active;
@@ -75,6 +95,7 @@ bool SWRaid_Info::is_member_active( const Glib::ustring & member_path )
 // array is not running or there is no such member.
 Glib::ustring SWRaid_Info::get_array( const Glib::ustring & member_path )
 {
+	Glib::Mutex::Lock lock( swraid_info_mutex );
 	initialise_if_required();
 	const SWRaid_Member & memb = get_cache_entry_by_member( member_path );
 	return memb.array;
@@ -84,6 +105,7 @@ Glib::ustring SWRaid_Info::get_array( const Glib::ustring & member_path )
 // there is no such member.
 Glib::ustring SWRaid_Info::get_uuid( const Glib::ustring & member_path )
 {
+	Glib::Mutex::Lock lock( swraid_info_mutex );
 	initialise_if_required();
 	const SWRaid_Member & memb = get_cache_entry_by_member( member_path );
 	return memb.uuid;
@@ -95,6 +117,7 @@ Glib::ustring SWRaid_Info::get_uuid( const Glib::ustring & member_path )
 // default of hostname ":" array number when not otherwise specified).
 Glib::ustring SWRaid_Info::get_label( const Glib::ustring & member_path )
 {
+	Glib::Mutex::Lock lock( swraid_info_mutex );
 	initialise_if_required();
 	const SWRaid_Member & memb = get_cache_entry_by_member( member_path );
 	return memb.label;
@@ -119,95 +142,41 @@ void SWRaid_Info::set_command_found()
 
 void SWRaid_Info::load_swraid_info_cache()
 {
-	Glib::ustring output, error;
-
 	swraid_info_cache.clear();
+	swraid_info_index.clear();
 
-	// Load SWRaid members into the cache.  Load member device, array UUID and array
-	// label (array name in mdadm terminology).
-	if ( mdadm_found                                                                         &&
-	     ! Utils::execute_command( "mdadm --examine --scan --verbose", output, error, true )    )
+	// Load SWRaid members into the cache.  Only the devices which blkid identified
+	// as Linux Software RAID members have their member superblocks read for the
+	// array UUID and label (array name in mdadm terminology), rather than having
+	// mdadm read every block device.  IMSM and DDF members have other blkid types
+	// so are excluded.  Without blkid members of inactive arrays can only be found
+	// by mdadm, so fall back to it then.
+	if ( FS_Info::can_identify_fs_types() )
 	{
-		// Extract information from Linux Software RAID arrays only, excluding
-		// IMSM and DDF arrays.  Example output:
-		//     ARRAY metadata=imsm UUID=9a5e3477:e1e668ea:12066a1b:d3708608
-		//        devices=/dev/sdd,/dev/sdc,/dev/md/imsm0
-		//     ARRAY /dev/md/MyRaid container=9a5e3477:e1e668ea:12066a1b:d3708608 member=0 UUID=47518beb:cc6ef9e7:c80cd1c7:5f6ecb28
-		//
-		//     ARRAY /dev/md/1  level=raid1 metadata=1.0 num-devices=2 UUID=15224a42:c25bbcd9:15db6000:4e5fe53a name=chimney:1
-		//        devices=/dev/sda1,/dev/sdb1
-		//     ARRAY /dev/md5 level=raid1 num-devices=2 UUID=8dc7483c:d74ee0a8:b6a8dc3c:a57e43f8
-		//        devices=/dev/sda6,/dev/sdb6
-		std::vector<Glib::ustring> lines;
-		Utils::split( output, lines, "\n" );
-		enum MDADM_LINE_TYPE
-		{
-			MDADM_LT_OTHER   = 0,
-			MDADM_LT_ARRAY   = 1,
-			MDADM_LT_DEVICES = 2
-		};
-		MDADM_LINE_TYPE mdadm_line_type = MDADM_LT_OTHER;
-		Glib::ustring uuid;
-		Glib::ustring label;
-		for ( unsigned int i = 0 ; i < lines.size() ; i ++ )
+		std::vector<Glib::ustring> paths = FS_Info::get_paths_by_fs_type( "linux_raid_member" );
+		for ( unsigned int i = 0 ; i < paths.size() ; i ++ )
 		{
-			Glib::ustring metadata_type;
-			if ( lines[i].substr( 0, 6 ) == "ARRAY " )
-			{
-				mdadm_line_type = MDADM_LT_ARRAY;
-				Glib::ustring metadata_type = Utils::regexp_label( lines[i],
-				                                                   "metadata=([[:graph:]]+)" );
-				// Mdadm with these flags doesn't seem to print the
-				// metadata tag for 0.90 version arrays.  Accept no tag
-				// (or empty version) as well as "0.90".
-				if ( metadata_type != ""    && metadata_type != "0.90" &&
-				     metadata_type != "1.0" && metadata_type != "1.1"  &&
-				     metadata_type != "1.2"                               )
-				{
-					// Skip mdadm reported non-Linux Software RAID arrays
-					mdadm_line_type = MDADM_LT_OTHER;
-					continue;
-				}
-
-				uuid = mdadm_to_canonical_uuid(
-						Utils::regexp_label( lines[i], "UUID=([[:graph:]]+)" ) );
-				label = Utils::regexp_label( lines[i], "name=(.*)$" );
-			}
-			else if ( mdadm_line_type == MDADM_LT_ARRAY                  &&
-			          lines[i].find( "devices=" ) != Glib::ustring::npos    )
-			{
-				mdadm_line_type = MDADM_LT_DEVICES;
-				Glib::ustring devices_str = Utils::regexp_label( lines[i],
-				                                                 "devices=([[:graph:]]+)" );
-				std::vector<Glib::ustring> devices;
-				Utils::split( devices_str, devices, "," );
-				for ( unsigned int j = 0 ; j < devices.size() ; j ++ )
-				{
-					SWRaid_Member memb;
-					memb.member = BlockSpecial( devices[j] );
-					memb.array = "";
-					memb.uuid = uuid;
-					memb.label = label;
-					memb.active = false;
-					swraid_info_cache.push_back( memb );
-				}
-				uuid.clear();
-				label.clear();
-			}
-			else
-			{
-				mdadm_line_type = MDADM_LT_OTHER;
-			}
+			SWRaid_Member memb;
+			memb.member = BlockSpecial( paths[i] );
+			memb.array = "";
+			memb.active = false;
+			read_member_superblock( paths[i], memb.uuid, memb.label );
+			swraid_info_cache.push_back( memb );
+			swraid_info_index.push_back( memb.member );
 		}
 	}
+	else if ( mdadm_found )
+	{
+		load_members_from_mdadm();
+	}
 
 	// For active SWRaid members, set array and active flag.
 	std::string line;
 	std::ifstream input( "/proc/mdstat" );
 	if ( input )
 	{
-		// Read /proc/mdstat extracting information for Linux Software RAID arrays
-		// only, excluding external IMSM and DDF arrays.  Example /proc/mdstat:
+		// Read /proc/mdstat for the names of the active arrays.  Example
+		// /proc/mdstat:
 		//     Personalities : [raid1]
 		//     md127 : inactive sdd[1](S) sdc[0](S)
 		//           6306 blocks super external:imsm
@@ -222,122 +191,295 @@ void SWRaid_Info::load_swraid_info_cache()
 		//           524224 blocks [2/2] [UU]
 		//
 		//     unused devices: <none>
-		enum MDSTAT_LINE_TYPE
-		{
-			MDSTAT_LT_OTHER  = 0,
-			MDSTAT_LT_ACTIVE = 1,
-			MDSTAT_LT_BLOCKS = 2
-		};
-		MDSTAT_LINE_TYPE mdstat_line_type = MDSTAT_LT_OTHER;
-		Glib::ustring array;
-		std::vector<Glib::ustring> members;
 		while ( getline( input, line ) )
 		{
-			if ( line.find( " : active " ) != std::string::npos )
+			if ( line.find( " : active " ) == std::string::npos )
+				continue;
+
+			StringView name;
+			TextTokenizer fields( line, " ", true );
+			if ( ! fields.next( name ) )
+				continue;
+			Glib::ustring array = "/dev/" + name.str();
+			Glib::ustring md_dir = "/sys/block/" + name.str() + "/md";
+
+			// Skip non-Linux Software RAID arrays, those with external IMSM and
+			// DDF metadata.  The kernel reports "0.90", "1.0", "1.1" or "1.2"
+			// for Linux Software RAID arrays.
+			Glib::ustring metadata_version;
+			std::ifstream metadata_input( ( md_dir + "/metadata_version" ).c_str() );
+			if ( metadata_input )
+				metadata_input >> metadata_version;
+			if ( metadata_version != "0.90" && metadata_version != "1.0" &&
+			     metadata_version != "1.1"  && metadata_version != "1.2"    )
+				continue;
+
+			std::vector<Glib::ustring> members = get_array_members( md_dir );
+			for ( unsigned int i = 0 ; i < members.size() ; i ++ )
 			{
-				mdstat_line_type = MDSTAT_LT_ACTIVE;
-				// Found a line for an active array.  Split into space
-				// separated fields.
-				std::vector<Glib::ustring> fields;
-				Utils::tokenize( line, fields, " " );
-				array = "/dev/" + fields[0];
-				members.clear();
-				for ( unsigned int i = 0 ; i < fields.size() ; i ++ )
+				SWRaid_Member & memb = get_cache_entry_by_member( members[i] );
+				if ( memb.member.m_name.length() > 0 )
 				{
-					Glib::ustring::size_type index = fields[i].find( "[" );
-					if ( index != Glib::ustring::npos )
-					{
-						// Field contains an "[" so got a short
-						// kernel device name of a member.
-						members.push_back( "/dev/" + fields[i].substr( 0, index ) );
-					}
+					// Update existing cache entry, setting array and
+					// active flag.
+					memb.array = array;
+					memb.active = true;
 				}
-			}
-			else if ( mdstat_line_type == MDSTAT_LT_ACTIVE         &&
-			          line.find( " blocks " ) != std::string::npos    )
-			{
-				mdstat_line_type = MDSTAT_LT_BLOCKS;
-				// Found a blocks line for an array.
-				Glib::ustring super_type = Utils::regexp_label( line, "super ([[:graph:]]+)" );
-
-				// Kernel doesn't seem to print the super block type for
-				// 0.90 version arrays.  Accept no tag (or empty version)
-				// as well as "0.90".
-				if ( super_type != ""    && super_type != "0.90" &&
-				     super_type != "1.0" && super_type != "1.1"  &&
-				     super_type != "1.2"                            )
+				else
 				{
-					// Skip /proc/mdstat reported non-Linux Software RAID arrays
-					mdstat_line_type = MDSTAT_LT_OTHER;
-					continue;
+					// Member not already found in the cache.  (Blkid
+					// possibly missing).  Insert cache entry.
+					SWRaid_Member new_memb;
+					new_memb.member = BlockSpecial( members[i] );
+					new_memb.array = array;
+					new_memb.active = true;
+					read_member_superblock( members[i], new_memb.uuid, new_memb.label );
+					swraid_info_cache.push_back( new_memb );
+					swraid_info_index.push_back( new_memb.member );
 				}
+			}
+		}
+		input.close();
+	}
+}
 
-				for ( unsigned int i = 0 ; i < members.size() ; i ++ )
+// Load members by running mdadm, which reads every block device.  Only used when blkid
+// isn't available to identify the members.
+void SWRaid_Info::load_members_from_mdadm()
+{
+	Glib::ustring output, error;
+	if ( Utils::execute_command( "mdadm --examine --scan --verbose", output, error, true ) )
+		return;
+
+	// Extract information from Linux Software RAID arrays only, excluding IMSM and
+	// DDF arrays.  Example output:
+	//     ARRAY metadata=imsm UUID=9a5e3477:e1e668ea:12066a1b:d3708608
+	//        devices=/dev/sdd,/dev/sdc,/dev/md/imsm0
+	//     ARRAY /dev/md/MyRaid container=9a5e3477:e1e668ea:12066a1b:d3708608 member=0 UUID=47518beb:cc6ef9e7:c80cd1c7:5f6ecb28
+	//
+	//     ARRAY /dev/md/1  level=raid1 metadata=1.0 num-devices=2 UUID=15224a42:c25bbcd9:15db6000:4e5fe53a name=chimney:1
+	//        devices=/dev/sda1,/dev/sdb1
+	//     ARRAY /dev/md5 level=raid1 num-devices=2 UUID=8dc7483c:d74ee0a8:b6a8dc3c:a57e43f8
+	//        devices=/dev/sda6,/dev/sdb6
+	TextTokenizer lines( output.raw(), "\n", true );
+	StringView line;
+	bool in_array = false;
+	Glib::ustring uuid;
+	Glib::ustring label;
+	while ( lines.next( line ) )
+	{
+		TextTokenizer fields( line, " \t", true );
+		StringView field;
+		if ( ! fields.next( field ) )
+		{
+			in_array = false;
+		}
+		else if ( field == "ARRAY" )
+		{
+			// Mdadm with these flags doesn't print the metadata tag for 0.90
+			// version arrays.  Accept no tag as well as "0.90".  Arrays inside
+			// IMSM and DDF containers have no metadata tag either so skip those
+			// too.
+			StringView metadata_type;
+			StringView hex;
+			bool in_container = false;
+			uuid.clear();
+			label.clear();
+			while ( fields.next( field ) )
+			{
+				if ( field.starts_with( "metadata=" ) )
+					metadata_type = field.substr( 9 );
+				else if ( field.starts_with( "container=" ) )
+					in_container = true;
+				else if ( field.starts_with( "UUID=" ) )
+					hex = field.substr( 5 );
+				else if ( field.starts_with( "name=" ) )
 				{
-					SWRaid_Member & memb = get_cache_entry_by_member( members[i] );
-					if ( memb.member.m_name.length() > 0 )
-					{
-						// Update existing cache entry, setting
-						// array and active flag.
-						memb.array = array;
-						memb.active = true;
-					}
-					else
-					{
-						// Member not already found in the cache.
-						// (Mdadm command possibly missing).
-						// Insert cache entry.
-						SWRaid_Member new_memb;
-						new_memb.member = BlockSpecial( members[i] );
-						new_memb.array = array;
-						new_memb.uuid = "";
-						new_memb.label = "";
-						new_memb.active = true;
-						swraid_info_cache.push_back( new_memb );
-					}
+					// The name is the rest of the line
+					label = StringView( field.data() + 5,
+					                    line.data() + line.size() - field.data() - 5 ).trim().str();
+					break;
 				}
-				array.clear();
-				members.clear();
 			}
-			else
+			in_array = ( metadata_type.empty() || metadata_type == "0.90" ||
+			             metadata_type == "1.0"  || metadata_type == "1.1"  ||
+			             metadata_type == "1.2"                                ) &&
+			           ! in_container;
+			// Reformat the UUID from mdadm's "15224a42:c25bbcd9:15db6000:4e5fe53a"
+			if ( is_mdadm_uuid( hex ) )
+				uuid = format_uuid( hex.substr( 0, 8 ).str() + hex.substr( 9, 8 ).str() +
+				                    hex.substr( 18, 8 ).str() + hex.substr( 27, 8 ).str() );
+		}
+		else if ( in_array && field.starts_with( "devices=" ) )
+		{
+			TextTokenizer devices( field.substr( 8 ), ",", true );
+			StringView device;
+			while ( devices.next( device ) )
 			{
-				mdstat_line_type = MDSTAT_LT_OTHER;
+				SWRaid_Member memb;
+				memb.member = BlockSpecial( device.str() );
+				memb.array = "";
+				memb.uuid = uuid;
+				memb.label = label;
+				memb.active = false;
+				swraid_info_cache.push_back( memb );
+				swraid_info_index.push_back( memb.member );
 			}
+			in_array = false;
+		}
+		else
+		{
+			in_array = false;
 		}
-		input.close();
 	}
 }
 
-// Perform linear search of the cache to find the matching member.
-// Returns found cache entry or not found substitute.
-SWRaid_Member & SWRaid_Info::get_cache_entry_by_member( const Glib::ustring & member_path )
+// Return the /dev entries of the members of an array from its md directory in sysfs.
+// Each member has a directory named "dev-" followed by the kernel device name, with any
+// "/" replaced by "!".  E.g. "/sys/block/md1/md/dev-sda1" or
+// "/sys/block/md0/md/dev-cciss!c0d0p1".
+std::vector<Glib::ustring> SWRaid_Info::get_array_members( const Glib::ustring & md_dir )
 {
-	BlockSpecial bs = BlockSpecial( member_path );
-	for ( unsigned int i = 0 ; i < swraid_info_cache.size() ; i ++ )
+	std::vector<Glib::ustring> members;
+	try
 	{
-		if ( bs == swraid_info_cache[i].member )
-			return swraid_info_cache[i];
+		Glib::Dir dir( md_dir );
+		Glib::ustring filename;
+		while ( ( filename = dir.read_name() ) != "" )
+		{
+			if ( filename.substr( 0, 4 ) != "dev-" )
+				continue;
+			Glib::ustring name = filename.substr( 4 );
+			for ( Glib::ustring::size_type i = name.find( '!' ) ;
+			      i != Glib::ustring::npos ;
+			      i = name.find( '!', i ) )
+				name.replace( i, 1, "/" );
+			members.push_back( "/dev/" + name );
+		}
 	}
-	static SWRaid_Member memb = {BlockSpecial(), "", "", "", false};
-	return memb;
+	catch ( Glib::Exception & e )
+	{
+		// Array not in sysfs
+	}
+	return members;
+}
+
+// Read the array UUID and label from the md superblock of a member.  Metadata 1.1 and
+// 1.2 superblocks are at 0 and 4 KiB from the start of the member, 1.0 superblocks are 8
+// to 12 KiB from the end and 0.90 superblocks are 64 to 128 KiB from the end.  Returns
+// false, with the UUID and label empty, when no superblock is found.
+bool SWRaid_Info::read_member_superblock( const Glib::ustring & member_path,
+                                          Glib::ustring & uuid, Glib::ustring & label )
+{
+	uuid.clear();
+	label.clear();
+
+	int fd = open( member_path.c_str(), O_RDONLY );
+	if ( fd < 0 )
+		return false;
+	Byte_Value size = lseek( fd, 0, SEEK_END );
+	close( fd );
+	if ( size <= 0 )
+		return false;
+
+	// Metadata 1.x superblocks are always little endian.  The superblock offset in
+	// sectors is recorded in the superblock itself.
+	Byte_Value offsets_1_x[3] = { 0, 4 * KIBIBYTE, ( ( size / 512 - 16 ) & ~7LL ) * 512 };
+	SuperblockReader reader( SB_LITTLE_ENDIAN );
+	for ( unsigned int i = 0 ; i < 3 ; i ++ )
+	{
+		unsigned long long magic;
+		unsigned long long major_version;
+		unsigned long long super_offset;
+		if ( offsets_1_x[i] < 0                                          ||
+		     ! reader.read( member_path, offsets_1_x[i], MD_SB_READ_SIZE ) ||
+		     ! reader.get_uint( 0, 4, magic )                            ||
+		     ! reader.get_uint( 4, 4, major_version )                    ||
+		     ! reader.get_uint( 144, 8, super_offset )                   ||
+		     magic != MD_SB_MAGIC                                        ||
+		     major_version != 1                                          ||
+		     (Byte_Value)super_offset * 512 != offsets_1_x[i]               )
+			continue;
+
+		SuperblockField uuid_field = { 16, 16 };
+		SuperblockField name_field = { 32, 32 };
+		for ( unsigned int j = 0 ; j < 16 ; j ++ )
+		{
+			unsigned long long byte;
+			reader.get_uint( uuid_field.offset + j, 1, byte );
+			char hex[3];
+			snprintf( hex, sizeof( hex ), "%02llx", byte );
+			uuid += hex;
+		}
+		uuid = format_uuid( uuid );
+		if ( ! reader.get_string( name_field, label ) )
+			label.clear();
+		return true;
+	}
+
+	// Metadata 0.90 superblocks are in the byte order of the machine which created
+	// them.  They don't have a name.
+	Byte_Value offset_0_90 = ( size & ~( MD_SB_0_90_RESERVED - 1 ) ) - MD_SB_0_90_RESERVED;
+	SuperblockByteOrder byte_orders[2] = { SB_LITTLE_ENDIAN, SB_BIG_ENDIAN };
+	for ( unsigned int i = 0 ; i < 2 && offset_0_90 >= 0 ; i ++ )
+	{
+		SuperblockReader reader_0_90( byte_orders[i] );
+		unsigned long long magic;
+		unsigned long long major_version;
+		if ( ! reader_0_90.read( member_path, offset_0_90, MD_SB_READ_SIZE ) ||
+		     ! reader_0_90.get_uint( 0, 4, magic )                           ||
+		     ! reader_0_90.get_uint( 4, 4, major_version )                   ||
+		     magic != MD_SB_MAGIC                                            ||
+		     major_version != 0                                                 )
+			continue;
+
+		// UUID words set_uuid0 to set_uuid3, printed as numbers like mdadm does
+		const size_t uuid_word_offsets[4] = { 5 * 4, 13 * 4, 14 * 4, 15 * 4 };
+		for ( unsigned int j = 0 ; j < 4 ; j ++ )
+		{
+			unsigned long long word;
+			reader_0_90.get_uint( uuid_word_offsets[j], 4, word );
+			char hex[9];
+			snprintf( hex, sizeof( hex ), "%08llx", word );
+			uuid += hex;
+		}
+		uuid = format_uuid( uuid );
+		return true;
+	}
+
+	return false;
 }
 
-// Reformat mdadm printed UUID into canonical format.  Returns "" if source not correctly
-// formatted.
-// E.g. "15224a42:c25bbcd9:15db6000:4e5fe53a" -> "15224a42-c25b-bcd9-15db-60004e5fe53a"
-Glib::ustring SWRaid_Info::mdadm_to_canonical_uuid( const Glib::ustring & mdadm_uuid )
+// Format 32 hex digits as a canonical UUID.
+// E.g. "15224a42c25bbcd915db60004e5fe53a" -> "15224a42-c25b-bcd9-15db-60004e5fe53a"
+// Return true for a UUID as printed by mdadm, like "15224a42:c25bbcd9:15db6000:4e5fe53a".
+bool SWRaid_Info::is_mdadm_uuid( const StringView & str )
 {
-	Glib::ustring verified_uuid = Utils::regexp_label( mdadm_uuid,
-			"^([[:xdigit:]]{8}:[[:xdigit:]]{8}:[[:xdigit:]]{8}:[[:xdigit:]]{8})$" );
-	if ( verified_uuid.empty() )
-		return verified_uuid;
-
-	Glib::ustring canonical_uuid = verified_uuid.substr( 0, 8) + "-" +
-	                               verified_uuid.substr( 9, 4) + "-" +
-	                               verified_uuid.substr(13, 4) + "-" +
-	                               verified_uuid.substr(18, 4) + "-" +
-	                               verified_uuid.substr(22, 4) + verified_uuid.substr(27, 8);
-	return canonical_uuid;
+	if ( str.size() != 35 )
+		return false;
+	for ( size_t i = 0 ; i < str.size() ; i ++ )
+	{
+		if ( i % 9 == 8 ? str[i] != ':' : ! isxdigit( (unsigned char)str[i] ) )
+			return false;
+	}
+	return true;
+}
+
+Glib::ustring SWRaid_Info::format_uuid( const Glib::ustring & hex )
+{
+	return hex.substr( 0, 8 ) + "-" + hex.substr( 8, 4 ) + "-" + hex.substr( 12, 4 ) + "-" +
+	       hex.substr( 16, 4 ) + "-" + hex.substr( 20, 12 );
+}
+
+// Look up the member in the index of the cache.
+// Returns found cache entry or not found substitute.
+SWRaid_Member & SWRaid_Info::get_cache_entry_by_member( const Glib::ustring & member_path )
+{
+	unsigned int i;
+	if ( swraid_info_index.find( BlockSpecial( member_path ), i ) )
+		return swraid_info_cache[i];
+	static SWRaid_Member memb = {BlockSpecial(), "", "", "", false};
+	return memb;
 }
 
 } //GParted
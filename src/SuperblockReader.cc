@@ -0,0 +1,210 @@
+/* Copyright (C) 2018 Mike Fleetwood
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SuperblockReader.h"
+#include "Utils.h"
+
+#include <glibmm/ustring.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <uuid/uuid.h>
+#include <vector>
+
+namespace GParted
+{
+
+SuperblockReader::SuperblockReader( SuperblockByteOrder byte_order ) : m_byte_order( byte_order )
+{
+}
+
+// Read size bytes from offset in path, replacing anything read before.
+bool SuperblockReader::read( const Glib::ustring & path, Byte_Value offset, size_t size )
+{
+	m_buf.clear();
+	int fd = open( path.c_str(), O_RDONLY );
+	if ( fd < 0 )
+		return false;
+	std::vector<unsigned char> buf( size );
+	bool success = size > 0 && pread( fd, &buf[0], size, offset ) == (ssize_t)size;
+	close( fd );
+	if ( success )
+		m_buf.swap( buf );
+	return success;
+}
+
+// Decode the fields described by layout from the superblock already read.  Returns false
+// when the magic doesn't match or a field is out of bounds.
+bool SuperblockReader::decode( const SuperblockLayout & layout, SuperblockInfo & info ) const
+{
+	if ( ! matches( layout.magic, layout.magic_value ) )
+		return false;
+
+	info.block_count = -1;
+	info.free_blocks = -1;
+	info.block_size = -1;
+	info.label.clear();
+	info.uuid.clear();
+	unsigned long long value;
+	if ( layout.block_count.size > 0 )
+	{
+		if ( ! get_uint( layout.block_count, value ) || (Sector)value <= 0 )
+			return false;
+		info.block_count = value;
+	}
+	if ( layout.free_blocks.size > 0 )
+	{
+		if ( ! get_uint( layout.free_blocks, value ) || (Sector)value < 0 )
+			return false;
+		info.free_blocks = value;
+	}
+	if ( info.block_count > -1 && info.free_blocks > info.block_count )
+		return false;
+	if ( layout.block_size.size > 0 )
+	{
+		if ( ! get_uint( layout.block_size, value ) )
+			return false;
+		if ( layout.block_size_encoding == SB_BLOCK_SIZE_LOG2_KIB )
+		{
+			if ( value > 6 )
+				// Larger than 64 KiB
+				return false;
+			value = 1024ULL << value;
+		}
+		if ( value < 512 || value > 64 * KIBIBYTE || ( value & ( value - 1 ) ) != 0 )
+			return false;
+		info.block_size = value;
+	}
+	if ( layout.label.size > 0 && ! get_string( layout.label, info.label ) )
+		return false;
+	if ( layout.uuid.size > 0 && ! get_uuid( layout.uuid, info.uuid ) )
+		return false;
+	return true;
+}
+
+// Read and decode the superblock described by layout from path.
+bool SuperblockReader::read_superblock( const Glib::ustring & path, const SuperblockLayout & layout,
+                                        SuperblockInfo & info )
+{
+	SuperblockReader reader( layout.byte_order );
+	return reader.read( path, layout.offset, layout.size ) && reader.decode( layout, info );
+}
+
+// Get an unsigned integer field of 1, 2, 4 or 8 bytes.
+bool SuperblockReader::get_uint( size_t offset, size_t size, unsigned long long & value ) const
+{
+	if ( ( size != 1 && size != 2 && size != 4 && size != 8 ) || offset + size > m_buf.size() )
+		return false;
+
+	const unsigned char * p = &m_buf[offset];
+	bool le = m_byte_order == SB_LITTLE_ENDIAN;
+	switch ( size )
+	{
+		case 1:  value = p[0];                          break;
+		case 2:  value = le ? le16( p ) : be16( p );    break;
+		case 4:  value = le ? le32( p ) : be32( p );    break;
+		default: value = le ? le64( p ) : be64( p );    break;
+	}
+	return true;
+}
+
+bool SuperblockReader::get_uint( const SuperblockField & field, unsigned long long & value ) const
+{
+	return get_uint( field.offset, field.size, value );
+}
+
+// Get a NUL padded string field.  Returns false when it isn't valid UTF-8, so that the
+// tools are used to convert it.
+bool SuperblockReader::get_string( const SuperblockField & field, Glib::ustring & value ) const
+{
+	if ( field.offset + field.size > m_buf.size() )
+		return false;
+
+	const char * str = reinterpret_cast<const char *>( &m_buf[field.offset] );
+	size_t len = strnlen( str, field.size );
+	value = Glib::ustring( str, len );
+	return value.validate();
+}
+
+// Get a 16 byte UUID field formatted in lower case.  As when matching the tools' output,
+// the Nil UUID and others with a zero version number are returned as empty.
+bool SuperblockReader::get_uuid( const SuperblockField & field, Glib::ustring & uuid ) const
+{
+	if ( field.size != 16 || field.offset + field.size > m_buf.size() )
+		return false;
+
+	uuid.clear();
+	if ( m_buf[field.offset+6] >> 4 != 0 )
+	{
+		char uuid_str[UUID_STRING_LENGTH+1];
+		uuid_unparse_lower( &m_buf[field.offset], uuid_str );
+		uuid = uuid_str;
+	}
+	return true;
+}
+
+unsigned int SuperblockReader::le16( const unsigned char * p )
+{
+	return p[0] | p[1] << 8;
+}
+
+unsigned long SuperblockReader::le32( const unsigned char * p )
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (unsigned long)p[3] << 24;
+}
+
+unsigned long long SuperblockReader::le64( const unsigned char * p )
+{
+	return le32( p ) | (unsigned long long)le32( p + 4 ) << 32;
+}
+
+unsigned int SuperblockReader::be16( const unsigned char * p )
+{
+	return p[0] << 8 | p[1];
+}
+
+unsigned long SuperblockReader::be32( const unsigned char * p )
+{
+	return (unsigned long)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+unsigned long long SuperblockReader::be64( const unsigned char * p )
+{
+	return (unsigned long long)be32( p ) << 32 | be32( p + 4 );
+}
+
+// CRC-32C (Castagnoli), as used by the ext4 and btrfs metadata checksums.  Continues from
+// crc without the initial or final inversion, which are left to the caller.
+unsigned long SuperblockReader::crc32c( unsigned long crc, const unsigned char * buf, size_t len )
+{
+	for ( size_t i = 0 ; i < len ; i ++ )
+	{
+		crc ^= buf[i];
+		for ( unsigned int bit = 0 ; bit < 8 ; bit ++ )
+			crc = ( crc >> 1 ) ^ ( 0x82F63B78UL & ( 0UL - ( crc & 1 ) ) );
+	}
+	return crc & 0xFFFFFFFFUL;
+}
+
+// Compare the bytes of a field with value.
+bool SuperblockReader::matches( const SuperblockField & field, const char * value ) const
+{
+	return    field.size > 0
+	       && field.offset + field.size <= m_buf.size()
+	       && memcmp( &m_buf[field.offset], value, field.size ) == 0;
+}
+
+}//GParted
@@ -0,0 +1,172 @@
+/* Copyright (C) 2018 Mike Fleetwood
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TextTokenizer.h"
+
+#include <string.h>
+#include <string>
+
+namespace GParted
+{
+
+const size_t StringView::npos;
+
+StringView::StringView() : m_data( "" ), m_size( 0 )
+{
+}
+
+StringView::StringView( const char * data, size_t size ) : m_data( data ), m_size( size )
+{
+}
+
+StringView::StringView( const char * str ) : m_data( str ), m_size( strlen( str ) )
+{
+}
+
+StringView::StringView( const std::string & str ) : m_data( str.data() ), m_size( str.size() )
+{
+}
+
+std::string StringView::str() const
+{
+	return std::string( m_data, m_size );
+}
+
+// Part of the view, limited to the bytes available.
+StringView StringView::substr( size_t pos, size_t n ) const
+{
+	if ( pos > m_size )
+		pos = m_size;
+	if ( n > m_size - pos )
+		n = m_size - pos;
+	return StringView( m_data + pos, n );
+}
+
+// The view without any leading or trailing chars.
+StringView StringView::trim( const char * chars ) const
+{
+	size_t start = 0;
+	size_t end = m_size;
+	while ( start < end && strchr( chars, m_data[start] ) != NULL && m_data[start] != '\0' )
+		start ++;
+	while ( end > start && strchr( chars, m_data[end-1] ) != NULL && m_data[end-1] != '\0' )
+		end --;
+	return StringView( m_data + start, end - start );
+}
+
+// Byte offset of the first occurrence of sought from pos, or npos when not found.
+size_t StringView::find( const StringView & sought, size_t pos ) const
+{
+	if ( sought.m_size > m_size )
+		return npos;
+	for ( size_t i = pos ; i + sought.m_size <= m_size ; i ++ )
+	{
+		if ( memcmp( m_data + i, sought.m_data, sought.m_size ) == 0 )
+			return i;
+	}
+	return npos;
+}
+
+bool StringView::starts_with( const StringView & prefix ) const
+{
+	return prefix.m_size <= m_size && memcmp( m_data, prefix.m_data, prefix.m_size ) == 0;
+}
+
+// Convert a view consisting only of decimal digits to a number.  Returns false when
+// there are other characters or it overflows.
+bool StringView::to_number( unsigned long long & value ) const
+{
+	if ( m_size == 0 )
+		return false;
+	unsigned long long num = 0;
+	for ( size_t i = 0 ; i < m_size ; i ++ )
+	{
+		if ( m_data[i] < '0' || m_data[i] > '9' )
+			return false;
+		unsigned long long digit = m_data[i] - '0';
+		if ( num > ( (unsigned long long)-1 - digit ) / 10 )
+			return false;
+		num = num * 10 + digit;
+	}
+	value = num;
+	return true;
+}
+
+bool operator==( const StringView & lhs, const StringView & rhs )
+{
+	return lhs.size() == rhs.size() && memcmp( lhs.data(), rhs.data(), lhs.size() ) == 0;
+}
+
+bool operator!=( const StringView & lhs, const StringView & rhs )
+{
+	return ! ( lhs == rhs );
+}
+
+// Tokens are separated by any one of the delimiters.  When skip_empty is true runs of
+// delimiters separate tokens and leading and trailing delimiters are ignored, like
+// Utils::tokenize(), otherwise every delimiter separates a token, like Utils::split().
+//  E.g. with delimiters ":"
+//      text      skip_empty=false    skip_empty=true
+//      ""        []                  []
+//      "a"       ["a"]               ["a"]
+//      "::"      ["","",""]          []
+//      ":a::bb"  ["","a","","bb"]    ["a","bb"]
+TextTokenizer::TextTokenizer( const StringView & text, const char * delimiters, bool skip_empty )
+ : m_text( text ), m_delimiters( delimiters ), m_skip_empty( skip_empty ), m_pos( 0 ),
+   m_done( text.empty() )
+{
+}
+
+// Get the next token.  Returns false when there are no more.
+bool TextTokenizer::next( StringView & token )
+{
+	if ( m_skip_empty )
+	{
+		while ( m_pos < m_text.size() && is_delimiter( m_text[m_pos] ) )
+			m_pos ++;
+		if ( m_pos >= m_text.size() )
+			m_done = true;
+	}
+	if ( m_done )
+		return false;
+
+	size_t start = m_pos;
+	while ( m_pos < m_text.size() && ! is_delimiter( m_text[m_pos] ) )
+		m_pos ++;
+	token = m_text.substr( start, m_pos - start );
+	if ( m_pos < m_text.size() )
+		// Step over the delimiter.  A delimiter at the end separates a final
+		// empty token, unless skipping empty tokens.
+		m_pos ++;
+	else
+		m_done = true;
+	return true;
+}
+
+// The text not yet tokenized.
+StringView TextTokenizer::rest() const
+{
+	if ( m_done )
+		return StringView();
+	return m_text.substr( m_pos );
+}
+
+bool TextTokenizer::is_delimiter( char c ) const
+{
+	return c != '\0' && strchr( m_delimiters, c ) != NULL;
+}
+
+}//GParted
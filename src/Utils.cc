@@ -22,7 +22,11 @@
 #include <sstream>
 #include <fstream>
 #include <iomanip>
+#include <list>
+#include <map>
 #include <glibmm/regex.h>
+#include <glibmm/thread.h>
+#include <glib.h>
 #include <locale.h>
 #include <uuid/uuid.h>
 #include <cerrno>
@@ -655,6 +659,46 @@ int Utils::decode_wait_status( int wait_status )
 	return 255;
 }
 
+// Registry of compiled regular expressions by pattern, so that each pattern is compiled
+// once rather than every time it is matched.  GRegex objects are immutable once compiled
+// so can be shared between the probe threads; only the registry needs locking.
+struct RegexEntry
+{
+	Glib::RefPtr<Glib::Regex> regex;
+	std::list<Glib::ustring>::iterator lru_pos;
+};
+static std::map<Glib::ustring, RegexEntry> regex_registry;
+static std::list<Glib::ustring> regex_lru;  // Patterns, most recently used first
+static Glib::Mutex regex_registry_mutex;     // Protects regex_registry and regex_lru
+
+// Patterns built from device names make the registry grow.  Once it reaches this size
+// the least recently used pattern is dropped for each new one, so the fixed patterns
+// matched on every refresh stay compiled.
+const unsigned int REGEX_REGISTRY_MAX_SIZE = 256;
+
+static Glib::RefPtr<Glib::Regex> get_regex( const Glib::ustring & pattern )
+{
+	Glib::Mutex::Lock lock( regex_registry_mutex );
+	std::map<Glib::ustring, RegexEntry>::iterator iter = regex_registry.find( pattern );
+	if ( iter != regex_registry.end() )
+	{
+		regex_lru.splice( regex_lru.begin(), regex_lru, iter->second.lru_pos );
+		return iter->second.regex;
+	}
+
+	if ( regex_registry.size() >= REGEX_REGISTRY_MAX_SIZE )
+	{
+		regex_registry.erase( regex_lru.back() );
+		regex_lru.pop_back();
+	}
+	RegexEntry entry;
+	entry.regex = Glib::Regex::create( pattern, Glib::REGEX_CASELESS | Glib::REGEX_MULTILINE );
+	regex_lru.push_front( pattern );
+	entry.lru_pos = regex_lru.begin();
+	regex_registry[pattern] = entry;
+	return entry.regex;
+}
+
 Glib::ustring Utils::regexp_label( const Glib::ustring & text
                                  , const Glib::ustring & pattern
                                  )
@@ -662,10 +706,7 @@ Glib::ustring Utils::regexp_label( const Glib::ustring & text
 	//Extract text from a regular sub-expression or pattern.
 	//  E.g., "text we don't want (text we want)"
 	std::vector<Glib::ustring> results;
-	Glib::RefPtr<Glib::Regex> myregexp =
-		Glib::Regex::create( pattern
-		                   , Glib::REGEX_CASELESS | Glib::REGEX_MULTILINE
-		                   );
+	Glib::RefPtr<Glib::Regex> myregexp = get_regex( pattern );
 
 	results = myregexp ->split( text );
 
@@ -675,6 +716,35 @@ Glib::ustring Utils::regexp_label( const Glib::ustring & text
 		return "" ;
 }
 
+// Match text against pattern, returning the text of every sub-expression of the first
+// match in captures.  Sub-expressions which took no part in the match are returned as
+// "".  Returns false when there is no match.
+//  E.g., regexp_match( "   8        1    1048576 sda1", "^ *([0-9]+) +([0-9]+) +[0-9]+ +(.*)$", captures )
+//        -> true, captures=["8","1","sda1"]
+bool Utils::regexp_match( const Glib::ustring & text,
+                          const Glib::ustring & pattern,
+                          std::vector<Glib::ustring> & captures )
+{
+	captures.clear();
+	Glib::RefPtr<Glib::Regex> regex = get_regex( pattern );
+
+	// Glibmm only provides Glib::MatchInfo from 2.28 so use the GRegex API.
+	GMatchInfo * match_info = NULL;
+	bool matched = g_regex_match( regex->gobj(), text.c_str(), (GRegexMatchFlags)0, &match_info );
+	if ( matched )
+	{
+		gint count = g_regex_get_capture_count( regex->gobj() );
+		for ( gint i = 1 ; i <= count ; i ++ )
+		{
+			gchar * capture = g_match_info_fetch( match_info, i );
+			captures.push_back( capture ? capture : "" );
+			g_free( capture );
+		}
+	}
+	g_match_info_free( match_info );
+	return matched;
+}
+
 Glib::ustring Utils::trim( const Glib::ustring & src, const Glib::ustring & c /* = " \t\r\n" */ )
 {
 	//Trim leading and trailing whitespace from string
@@ -29,12 +29,14 @@
 #include "DialogManageFlags.h"
 #include "GParted_Core.h"
 #include "Mount_Info.h"
+#include "MoveJournal.h"
 #include "OperationCopy.h"
 #include "OperationCheck.h"
 #include "OperationCreate.h"
 #include "OperationDelete.h"
 #include "OperationFormat.h"
 #include "OperationResizeMove.h"
+#include "OperationResumeMove.h"
 #include "OperationChangeUUID.h"
 #include "OperationLabelFileSystem.h"
 #include "OperationNamePartition.h"
@@ -44,6 +46,7 @@
 #include "Utils.h"
 #include "../config.h"
 
+#include <algorithm>
 #include <gtkmm/aboutdialog.h>
 #include <gtkmm/messagedialog.h>
 #include <gtkmm/radiobuttongroup.h>
@@ -156,7 +159,7 @@ void Win_GParted::init_menubar()
 		_("_Refresh Devices"),
 		Gtk::AccelKey("<control>r"),
 		*image, 
-		sigc::mem_fun(*this, &Win_GParted::menu_gparted_refresh_devices) ) );
+		sigc::mem_fun(*this, &Win_GParted::menu_gparted_rescan_devices) ) );
 	
 	image = manage( new Gtk::Image( Gtk::Stock::HARDDISK, Gtk::ICON_SIZE_MENU ) );
 	menu ->items() .push_back( Gtk::Menu_Helpers::ImageMenuElem( _("_Devices"), *image ) ) ; 
@@ -723,6 +726,7 @@ void Win_GParted::Add_Operation( const Device & device, Operation * operation )
 		     operation ->type == OPERATION_CHANGE_UUID ||
 		     operation ->type == OPERATION_LABEL_FILESYSTEM ||
 		     operation ->type == OPERATION_NAME_PARTITION ||
+		     operation ->type == OPERATION_RESUME_MOVE ||
 		     gparted_core.snap_to_alignment( device, operation->get_partition_new(), error )
 		   )
 		{
@@ -1444,10 +1448,19 @@ void Win_GParted::on_show()
 gboolean Win_GParted::initial_device_refresh( gpointer data )
 {
 	Win_GParted *win_gparted = static_cast<Win_GParted *>( data );
-	win_gparted->menu_gparted_refresh_devices();
+	win_gparted->menu_gparted_rescan_devices();
+	win_gparted->offer_resume_interrupted_move();
 	return false;  // one shot g_idle_add() callback
 }
 
+// Refresh Devices menu item.  Unlike the refreshes after applying operations also asks
+// LVM to rescan for volume groups changed by other tools.
+void Win_GParted::menu_gparted_rescan_devices()
+{
+	LVM2_PV_Info::request_vgscan();
+	menu_gparted_refresh_devices();
+}
+
 void Win_GParted::menu_gparted_refresh_devices()
 {
 	show_pulsebar( _("Scanning all devices...") ) ;
@@ -1517,6 +1530,84 @@ void Win_GParted::menu_gparted_refresh_devices()
 	}
 }
 
+// Find the primary or logical partition with exactly the given boundaries.
+static const Partition * find_partition_with_bounds( const PartitionVector & partitions,
+                                                     Sector start, Sector end )
+{
+	for ( unsigned int i = 0 ; i < partitions.size() ; i ++ )
+	{
+		if ( partitions[i].type == TYPE_EXTENDED )
+		{
+			const Partition * logical = find_partition_with_bounds( partitions[i].logicals, start, end );
+			if ( logical )
+				return logical;
+		}
+		else if ( ( partitions[i].type == TYPE_PRIMARY || partitions[i].type == TYPE_LOGICAL ) &&
+		          partitions[i].sector_start == start && partitions[i].sector_end == end          )
+			return &partitions[i];
+	}
+	return NULL;
+}
+
+// Offer to resume a move of a file system which was interrupted by a crash.  The
+// partition was left encompassing both the old and new locations of the half moved file
+// system.  Resuming queues an operation to finish the move, which the user then applies.
+void Win_GParted::offer_resume_interrupted_move()
+{
+	MoveJournal journal;
+	if ( ! gparted_core.find_interrupted_move( journal ) )
+		return;
+
+	for ( unsigned int i = 0 ; i < devices.size() ; i ++ )
+	{
+		if ( devices[i].get_path() != journal.device_path )
+			continue;
+
+		const Partition * partition_ptr = find_partition_with_bounds(
+				devices[i].partitions,
+				std::min( journal.old_start, journal.new_start ),
+				std::max( journal.old_end, journal.new_end ) );
+		if ( ! partition_ptr )
+			return;
+
+		Gtk::MessageDialog dialog( *this,
+		                           /*TO TRANSLATORS: looks like   Resume interrupted move of /dev/sda3? */
+		                           String::ucompose( _("Resume interrupted move of %1?"),
+		                                             partition_ptr->get_path() ),
+		                           false,
+		                           Gtk::MESSAGE_QUESTION,
+		                           Gtk::BUTTONS_YES_NO,
+		                           true );
+		Glib::ustring tmp_msg =
+				/*TO TRANSLATORS: looks like   Moving the file system was interrupted after 1.00 GiB of 10.00 GiB had been moved. */
+				String::ucompose( _("Moving the file system was interrupted after %1 of %2 had been moved."),
+				                  Utils::format_size( journal.done, 1 ),
+				                  Utils::format_size( journal.get_byte_length(), 1 ) );
+		tmp_msg += _("  The file system can't be used until the move is finished.");
+		tmp_msg += "\n";
+		tmp_msg += _("Resuming queues an operation to finish the move, continuing from where it was interrupted.");
+		dialog.set_secondary_text( tmp_msg );
+		if ( dialog.run() != Gtk::RESPONSE_YES )
+			return;
+		dialog.hide();
+
+		Partition * partition_new = partition_ptr->clone();
+		partition_new->sector_start = journal.new_start;
+		partition_new->sector_end   = journal.new_end;
+		partition_new->filesystem   = journal.filesystem;
+		partition_new->alignment    = ALIGN_STRICT;
+		Operation * operation = new OperationResumeMove( devices[i], *partition_ptr, *partition_new );
+		operation->icon = render_icon( Gtk::Stock::GOTO_LAST, Gtk::ICON_SIZE_MENU );
+		delete partition_new;
+		partition_new = NULL;
+
+		Add_Operation( devices[i], operation );
+		combo_devices.set_active( i );
+		show_operationslist();
+		return;
+	}
+}
+
 void Win_GParted::menu_gparted_features()
 {
 	DialogFeatures dialog ;
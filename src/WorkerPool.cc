@@ -0,0 +1,105 @@
+/* Copyright (C) 2018 Mike Fleetwood
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WorkerPool.h"
+
+#include <glibmm/thread.h>
+#include <algorithm>
+#include <vector>
+
+namespace GParted
+{
+
+Glib::Mutex WorkerPool::limit_mutex;
+unsigned int WorkerPool::thread_limit = 0;
+unsigned int WorkerPool::threads_created = 0;
+
+WorkerPool::WorkerPool( unsigned int in_max_threads ) :
+	max_threads( std::max( in_max_threads, 1U ) ),
+	count( 0 ),
+	next( 0 )
+{
+}
+
+void WorkerPool::run( unsigned int in_count, const WorkSlot & in_work )
+{
+	count = in_count;
+	next = 0;
+	work = in_work;
+
+	std::vector<Glib::Thread *> threads;
+	unsigned int num_threads = std::min( max_threads, count );
+	for ( unsigned int i = 1 ; i < num_threads && reserve_thread() ; i ++ )
+	{
+		try
+		{
+			threads.push_back( Glib::Thread::create( sigc::mem_fun( *this, &WorkerPool::worker ),
+			                                         true ) );
+		}
+		catch ( Glib::ThreadError & e )
+		{
+			// Carry on with the threads already created.
+			release_threads( 1 );
+			break;
+		}
+	}
+
+	worker();
+
+	for ( unsigned int i = 0 ; i < threads.size() ; i ++ )
+		threads[i]->join();
+	release_threads( threads.size() );
+}
+
+// Limit the number of threads all pools together may have created at once.
+void WorkerPool::set_thread_limit( unsigned int limit )
+{
+	Glib::Mutex::Lock lock( limit_mutex );
+	thread_limit = limit;
+}
+
+void WorkerPool::worker()
+{
+	while ( true )
+	{
+		unsigned int index;
+		{
+			Glib::Mutex::Lock lock( mutex );
+			if ( next >= count )
+				return;
+			index = next ++;
+		}
+		work( index );
+	}
+}
+
+// Count another thread as created, unless the limit has been reached.
+bool WorkerPool::reserve_thread()
+{
+	Glib::Mutex::Lock lock( limit_mutex );
+	if ( thread_limit > 0 && threads_created >= thread_limit )
+		return false;
+	threads_created ++;
+	return true;
+}
+
+void WorkerPool::release_threads( unsigned int num )
+{
+	Glib::Mutex::Lock lock( limit_mutex );
+	threads_created -= num;
+}
+
+}//GParted
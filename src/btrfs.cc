@@ -18,17 +18,55 @@
 #include "btrfs.h"
 #include "BlockSpecial.h"
 #include "FileSystem.h"
+#include "FS_Info.h"
 #include "Mount_Info.h"
 #include "Partition.h"
+#include "SuperblockReader.h"
+#include "TextTokenizer.h"
 
+#include <glibmm/thread.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <map>
+#include <string.h>
+#include <unistd.h>
+#include <uuid/uuid.h>
 
 namespace GParted
 {
 
 bool btrfs_found = false ;
+bool btrfs_show_found = false;
 bool resize_to_same_size_fails = true ;
 
+// Superblock copies, the fields used and the embedded device item fields used, all
+// little endian.
+// Reference:
+//     Btrfs documentation, On-disk Format, Superblock
+//     https://btrfs.readthedocs.io/en/latest/dev/On-disk-format.html
+const Byte_Value BTRFS_SUPER_MIRRORS[] = { 64 * KIBIBYTE, 64 * MEBIBYTE, 256 * GIBIBYTE };
+const unsigned int BTRFS_SUPER_MIRROR_MAX = sizeof( BTRFS_SUPER_MIRRORS ) / sizeof( BTRFS_SUPER_MIRRORS[0] );
+const size_t BTRFS_SUPER_INFO_SIZE = 4096;
+const char BTRFS_MAGIC[] = "_BHRfS_M";
+
+const size_t BTRFS_CSUM_SIZE        = 0x20;
+const unsigned int BTRFS_CSUM_TYPE_CRC32 = 0;
+
+const size_t BTRFS_SB_FSID          = 0x20;
+const size_t BTRFS_SB_BYTENR        = 0x30;
+const size_t BTRFS_SB_MAGIC         = 0x40;
+const size_t BTRFS_SB_GENERATION    = 0x48;
+const size_t BTRFS_SB_BYTES_USED    = 0x78;
+const size_t BTRFS_SB_NUM_DEVICES   = 0x88;
+const size_t BTRFS_SB_CSUM_TYPE     = 0xC4;
+const size_t BTRFS_SB_DEV_ITEM      = 0xC9;
+const size_t BTRFS_SB_LABEL         = 0x12B;
+const size_t BTRFS_LABEL_SIZE       = 256;
+
+const size_t BTRFS_DEV_ITEM_DEVID       = 0;
+const size_t BTRFS_DEV_ITEM_TOTAL_BYTES = 8;
+const size_t BTRFS_DEV_ITEM_BYTES_USED  = 16;
+
 // Cache of required btrfs file system device information by device
 // E.g. For a single device btrfs on /dev/sda2 and a three device btrfs
 //      on /dev/sd[bcd]1 the cache would be as follows.  (Note that
@@ -37,7 +75,58 @@ bool resize_to_same_size_fails = true ;
 //  btrfs_device_cache[BS("/dev/sdb1")] = {devid=1, members=[BS("/dev/sdd1"), BS("/dev/sdc1"), BS("/dev/sdb1")]}
 //  btrfs_device_cache[BS("/dev/sdc1")] = {devid=2, members=[BS("/dev/sdd1"), BS("/dev/sdc1"), BS("/dev/sdb1")]}
 //  btrfs_device_cache[BS("/dev/sdd1")] = {devid=3, members=[BS("/dev/sdd1"), BS("/dev/sdc1"), BS("/dev/sdb1")]}
+// The cache is first loaded from the superblocks of all the btrfs devices found by blkid
+// in one pass, with the btrfs tools used for any device which that doesn't cover.
 std::map<BlockSpecial, BTRFS_Device> btrfs_device_cache;
+bool btrfs_device_cache_scanned = false;
+
+// Protects btrfs_device_cache when devices are probed concurrently.
+static Glib::Mutex btrfs_device_cache_mutex;
+
+// Fields of a device line from btrfs filesystem show or btrfs-show output.
+struct BTRFS_Devid_Line
+{
+	int           devid;
+	Glib::ustring size;
+	Glib::ustring used;
+	Glib::ustring path;
+};
+
+// Parse a device line like these, returning false for any other line.  Some versions
+// print a space between the figure and the units so the size and used figures are all
+// the words up to the next keyword.
+//          devid    2 size 2.00GB used 512.00MB path /dev/sdb2
+//          devid    1 size 2.00 GiB used 240.75 MiB path /dev/sdb1
+static bool parse_devid_line( const StringView & line, BTRFS_Devid_Line & devid_line )
+{
+	TextTokenizer words( line, " \t", true );
+	StringView word;
+	unsigned long long devid;
+	if ( ! words.next( word ) || word != "devid" || ! words.next( word ) || ! word.to_number( devid ) )
+		return false;
+
+	devid_line.devid = devid;
+	devid_line.size.clear();
+	devid_line.used.clear();
+	devid_line.path.clear();
+	Glib::ustring * field = NULL;
+	while ( words.next( word ) )
+	{
+		if ( word == "size" )
+			field = &devid_line.size;
+		else if ( word == "used" )
+			field = &devid_line.used;
+		else if ( word == "path" )
+			field = &devid_line.path;
+		else if ( field != NULL )
+		{
+			if ( ! field->empty() )
+				*field += " ";
+			*field += word.str();
+		}
+	}
+	return devid_line.path.compare( 0, 5, "/dev/" ) == 0;
+}
 
 FS btrfs::get_filesystem_support()
 {
@@ -45,6 +134,12 @@ FS btrfs::get_filesystem_support()
 
 	fs .busy = FS::EXTERNAL ;
 
+	// Usage, label and UUID are read from the superblocks directly, falling back on
+	// btrfs filesystem show or btrfs-show.
+	fs .read = GParted::FS::EXTERNAL ;
+	fs .read_label = FS::EXTERNAL ;
+	fs .read_uuid = FS::EXTERNAL ;
+
 	if ( ! Glib::find_program_in_path( "mkfs.btrfs" ) .empty() )
 	{
 		fs .create = GParted::FS::EXTERNAL ;
@@ -61,10 +156,6 @@ FS btrfs::get_filesystem_support()
 		//  to test for filesystem show and filesystem resize
 		//  sub-commands as they were always included.
 
-		fs .read = GParted::FS::EXTERNAL ;
-		fs .read_label = FS::EXTERNAL ;
-		fs .read_uuid = FS::EXTERNAL ;
-
 		//Resizing of btrfs requires mount, umount and kernel
 		//  support as well as btrfs filesystem resize
 		if (    ! Glib::find_program_in_path( "mount" ) .empty()
@@ -79,6 +170,7 @@ FS btrfs::get_filesystem_support()
 		}
 
 		//Test for labelling capability in btrfs command
+		Glib::ustring output, error;
 		if ( ! Utils::execute_command( "btrfs filesystem label --help", output, error, true ) )
 			fs .write_label = FS::EXTERNAL;
 	}
@@ -87,12 +179,7 @@ FS btrfs::get_filesystem_support()
 		//Fall back to using btrfs-show and btrfsctl, which
 		//  were depreciated October 2011
 
-		if ( ! Glib::find_program_in_path( "btrfs-show" ) .empty() )
-		{
-			fs .read = GParted::FS::EXTERNAL ;
-			fs .read_label = FS::EXTERNAL ;
-			fs .read_uuid = FS::EXTERNAL ;
-		}
+		btrfs_show_found = ! Glib::find_program_in_path( "btrfs-show" ).empty();
 
 		//Resizing of btrfs requires btrfsctl, mount, umount
 		//  and kernel support
@@ -111,6 +198,7 @@ FS btrfs::get_filesystem_support()
 
 	if ( ! Glib::find_program_in_path( "btrfstune" ).empty() )
 	{
+		Glib::ustring output, error;
 		Utils::execute_command( "btrfstune --help", output, error, true );
 		if ( Utils::regexp_label( output + error, "^[[:blank:]]*(-u)[[:blank:]]" ) == "-u" )
 			fs.write_uuid = FS::EXTERNAL;
@@ -168,6 +256,9 @@ bool btrfs::check_repair( const Partition & partition, OperationDetail & operati
 
 void btrfs::set_used_sectors( Partition & partition )
 {
+	Glib::ustring output, error;
+	Sector T = -1, N = -1;
+
 	//Called when the file system is unmounted *and* when mounted.
 	//
 	//  Btrfs has a volume manager layer within the file system which allows it to
@@ -218,6 +309,22 @@ void btrfs::set_used_sectors( Partition & partition )
 	//     devices.
 	//  4) Extents can be and are relocated to other devices within the file system
 	//     when shrinking a device.
+	//
+	//  The same figures are read from the superblock of each member device, where
+	//  btrfs filesystem show reads them from, without running the command.
+	BTRFS_Device btrfs_dev = get_cache_entry( partition.get_path() );
+	if ( btrfs_dev.total_bytes > -1 && btrfs_dev.members_bytes_used > 0 )
+	{
+		T = Utils::round( btrfs_dev.total_bytes / double(partition.sector_size) );
+		double ptn_fs_used = btrfs_dev.fs_bytes_used *
+		                     ( btrfs_dev.bytes_used / double(btrfs_dev.members_bytes_used) );
+		N = T - Utils::round( ptn_fs_used / double(partition.sector_size) );
+		partition.set_sector_usage( T, N );
+		return;
+	}
+	if ( ! btrfs_found && ! btrfs_show_found )
+		return;
+
 	if ( btrfs_found )
 		Utils::execute_command( "btrfs filesystem show " + Glib::shell_quote( partition.get_path() ),
 		                        output, error, true );
@@ -250,34 +357,26 @@ void btrfs::set_used_sectors( Partition & partition )
 	if ( ! ( str = Utils::regexp_label( output, "FS bytes used ([0-9\\.]+( ?[KMGTPE]?i?B)?)" ) ) .empty() )
 		total_fs_used = Utils::round( btrfs_size_to_gdouble( str ) ) ;
 
-	Glib::ustring::size_type offset = 0 ;
-	Glib::ustring::size_type index ;
-	while ( ( index = output .find( "devid ", offset ) ) != Glib::ustring::npos )
+	TextTokenizer lines( output.raw(), "\n", true );
+	StringView line;
+	BTRFS_Devid_Line devid_line;
+	while ( lines.next( line ) )
 	{
-		Glib::ustring devid_path = Utils::regexp_label( output .substr( index ),
-		                                                "devid .* path (/dev/[[:graph:]]+)" ) ;
-		if ( ! devid_path .empty() )
-		{
-			//Btrfs per devid used bytes (chunks)
-			Byte_Value used = -1 ;
-			if ( ! ( str = Utils::regexp_label( output .substr( index ),
-			                                    "devid .* used ([0-9\\.]+( ?[KMGTPE]?i?B)?) path" ) ) .empty() )
-			{
-				used = btrfs_size_to_num( str, ptn_size, false ) ;
-				sum_devid_used += used ;
-				if ( devid_path == partition .get_path() )
-					devid_used = used ;
-			}
+		if ( ! parse_devid_line( line, devid_line ) )
+			continue;
 
-			if ( devid_path == partition .get_path() )
-			{
-				//Btrfs per device size bytes (chunks)
-				if ( ! ( str = Utils::regexp_label( output .substr( index ),
-				                                    "devid .* size ([0-9\\.]+( ?[KMGTPE]?i?B)?) used " ) ) .empty() )
-					devid_size = btrfs_size_to_num( str, ptn_size, true ) ;
-			}
+		//Btrfs per devid used bytes (chunks)
+		if ( ! devid_line.used.empty() )
+		{
+			Byte_Value used = btrfs_size_to_num( devid_line.used, ptn_size, false );
+			sum_devid_used += used ;
+			if ( devid_line.path == partition .get_path() )
+				devid_used = used ;
 		}
-		offset = index + 5 ;  //Next find starts immediately after current "devid"
+
+		//Btrfs per device size bytes (chunks)
+		if ( devid_line.path == partition .get_path() && ! devid_line.size.empty() )
+			devid_size = btrfs_size_to_num( devid_line.size, ptn_size, true );
 	}
 
 	if ( total_fs_used > -1 && devid_size > -1 && devid_used > -1 && sum_devid_used > 0 )
@@ -344,7 +443,7 @@ bool btrfs::resize( const Partition & partition_new, OperationDetail & operation
 			cmd = "btrfs filesystem resize " + devid_str + ":" + size + " " + Glib::shell_quote( mount_point );
 		else
 			cmd = "btrfsctl -r " + devid_str + ":" + size + " " + Glib::shell_quote( mount_point );
-		exit_status = execute_command( cmd, operationdetail );
+		int exit_status = execute_command( cmd, operationdetail );
 		bool resize_succeeded = ( exit_status == 0 ) ;
 		if ( resize_to_same_size_fails )
 		{
@@ -382,6 +481,16 @@ bool btrfs::resize( const Partition & partition_new, OperationDetail & operation
 
 void btrfs::read_label( Partition & partition )
 {
+	Glib::ustring output, error;
+	BTRFS_Device btrfs_dev = get_cache_entry( partition.get_path() );
+	if ( btrfs_dev.total_bytes > -1 && btrfs_dev.label_valid )
+	{
+		partition.set_filesystem_label( btrfs_dev.label );
+		return;
+	}
+	if ( ! btrfs_found && ! btrfs_show_found )
+		return;
+
 	if ( btrfs_found )
 		Utils::execute_command( "btrfs filesystem show " + Glib::shell_quote( partition.get_path() ),
 		                        output, error, true );
@@ -420,6 +529,16 @@ void btrfs::read_label( Partition & partition )
 
 void btrfs::read_uuid( Partition & partition )
 {
+	Glib::ustring output, error;
+	BTRFS_Device btrfs_dev = get_cache_entry( partition.get_path() );
+	if ( btrfs_dev.total_bytes > -1 )
+	{
+		partition.uuid = btrfs_dev.uuid;
+		return;
+	}
+	if ( ! btrfs_found && ! btrfs_show_found )
+		return;
+
 	if ( btrfs_found )
 		Utils::execute_command( "btrfs filesystem show " + Glib::shell_quote( partition.get_path() ),
 		                        output, error, true );
@@ -450,7 +569,9 @@ bool btrfs::write_uuid( const Partition & partition, OperationDetail & operation
 
 void btrfs::clear_cache()
 {
+	Glib::Mutex::Lock lock( btrfs_device_cache_mutex );
 	btrfs_device_cache .clear() ;
+	btrfs_device_cache_scanned = false;
 }
 
 //Return the device which is mounting the btrfs in this partition.
@@ -488,12 +609,34 @@ std::vector<Glib::ustring> btrfs::get_members( const Glib::ustring & path )
 //Private methods
 
 //Return btrfs device cache entry, incrementally loading cache as required
-const BTRFS_Device & btrfs::get_cache_entry( const Glib::ustring & path )
+BTRFS_Device btrfs::get_cache_entry( const Glib::ustring & path )
 {
-	std::map<BlockSpecial, BTRFS_Device>::const_iterator bd_iter = btrfs_device_cache.find( BlockSpecial( path ) );
-	if ( bd_iter != btrfs_device_cache .end() )
-		return bd_iter ->second ;
+	std::map<BlockSpecial, BTRFS_Device>::const_iterator bd_iter;
+	{
+		Glib::Mutex::Lock lock( btrfs_device_cache_mutex );
+		bd_iter = btrfs_device_cache.find( BlockSpecial( path ) );
+		if ( bd_iter != btrfs_device_cache .end() )
+			return bd_iter ->second ;
+
+		// Read the superblocks of all btrfs devices the first time, and just this
+		// path after that.
+		std::vector<Glib::ustring> paths;
+		if ( ! btrfs_device_cache_scanned )
+		{
+			paths = FS_Info::get_paths_by_fs_type( "btrfs" );
+			btrfs_device_cache_scanned = true;
+		}
+		paths.push_back( path );
+		load_cache_from_superblocks( paths );
+		bd_iter = btrfs_device_cache.find( BlockSpecial( path ) );
+		if ( bd_iter != btrfs_device_cache .end() )
+			return bd_iter ->second ;
+	}
+	if ( ! btrfs_found && ! btrfs_show_found )
+		return BTRFS_Device();
 
+	// Run the btrfs tools without holding the cache lock so that other threads
+	// probing other devices aren't held up waiting for them.
 	Glib::ustring output, error ;
 	std::vector<int> devid_list ;
 	std::vector<Glib::ustring> path_list ;
@@ -509,31 +652,29 @@ const BTRFS_Device & btrfs::get_cache_entry( const Glib::ustring & path )
 	//          Total devices 2 FS bytes used 156.00KB
 	//          devid    2 size 2.00GB used 512.00MB path /dev/sdb2
 	//          devid    1 size 2.00GB used 240.75MB path /dev/sdb1
-	Glib::ustring::size_type offset = 0 ;
-	Glib::ustring::size_type index ;
-	while ( ( index = output .find( "devid ", offset ) ) != Glib::ustring::npos )
-	{
-		int devid = -1 ;
-		sscanf( output .substr( index ) .c_str(), "devid %d", &devid ) ;
-		Glib::ustring devid_path = Utils::regexp_label( output .substr( index ),
-		                                                "devid .* path (/dev/[[:graph:]]+)" ) ;
-		if ( devid > -1 && ! devid_path .empty() )
+	TextTokenizer lines( output.raw(), "\n", true );
+	StringView line;
+	BTRFS_Devid_Line devid_line;
+	while ( lines.next( line ) )
+	{
+		if ( parse_devid_line( line, devid_line ) )
 		{
-			devid_list .push_back( devid ) ;
-			path_list .push_back( devid_path ) ;
+			devid_list .push_back( devid_line.devid ) ;
+			path_list .push_back( devid_line.path ) ;
 		}
-		offset = index + 5 ;  //Next find starts immediately after current "devid"
 	}
-	//Add cache entries for all found devices
+	//Add cache entries for all found devices, keeping any added by another thread
+	//  in the meantime
 	std::vector<BlockSpecial> bs_list;
 	for ( unsigned int i = 0 ; i < path_list.size() ; i ++ )
 		bs_list.push_back( BlockSpecial( path_list[i] ) );
+	Glib::Mutex::Lock lock( btrfs_device_cache_mutex );
 	for ( unsigned int i = 0 ; i < devid_list .size() ; i ++ )
 	{
 		BTRFS_Device btrfs_dev ;
 		btrfs_dev .devid = devid_list[ i ] ;
 		btrfs_dev.members = bs_list;
-		btrfs_device_cache[ BlockSpecial( path_list[i] ) ] = btrfs_dev;
+		btrfs_device_cache.insert( std::make_pair( bs_list[i], btrfs_dev ) );
 	}
 
 	bd_iter = btrfs_device_cache.find( BlockSpecial( path ) );
@@ -541,8 +682,157 @@ const BTRFS_Device & btrfs::get_cache_entry( const Glib::ustring & path )
 		return bd_iter ->second ;
 
 	//If for any reason we fail to parse the information return an "unknown" record
-	static BTRFS_Device btrfs_dev = { -1, } ;
-	return btrfs_dev ;
+	return BTRFS_Device();
+}
+
+// Add cache entries for the btrfs devices in paths, grouped into file systems by fsid.
+// File systems with members missing from paths are left for the btrfs tools to find
+// all the members, unless the tools aren't available.
+void btrfs::load_cache_from_superblocks( const std::vector<Glib::ustring> & paths )
+{
+	std::map<std::string, std::vector<Superblock> > file_systems;
+	std::map<std::string, std::vector<BlockSpecial> > fs_members;
+	for ( unsigned int i = 0 ; i < paths.size() ; i ++ )
+	{
+		BlockSpecial bs( paths[i] );
+		Superblock sb;
+		if ( ! read_superblock( paths[i], sb ) )
+			continue;
+
+		// Skip the same device found again under another name
+		std::vector<BlockSpecial> & found = fs_members[sb.fsid];
+		bool duplicate = false;
+		for ( unsigned int j = 0 ; j < found.size() ; j ++ )
+			if ( found[j] == bs )
+				duplicate = true;
+		if ( duplicate )
+			continue;
+		found.push_back( bs );
+		file_systems[sb.fsid].push_back( sb );
+	}
+
+	std::map<std::string, std::vector<Superblock> >::const_iterator fs_iter;
+	for ( fs_iter = file_systems.begin() ; fs_iter != file_systems.end() ; ++ fs_iter )
+	{
+		const std::vector<Superblock> & sbs = fs_iter->second;
+		const std::vector<BlockSpecial> & members = fs_members[fs_iter->first];
+		if ( (Byte_Value)sbs.size() != sbs[0].num_devices && ( btrfs_found || btrfs_show_found ) )
+			continue;
+
+		Byte_Value members_bytes_used = 0;
+		for ( unsigned int i = 0 ; i < sbs.size() ; i ++ )
+			members_bytes_used += sbs[i].bytes_used;
+		for ( unsigned int i = 0 ; i < sbs.size() ; i ++ )
+		{
+			BTRFS_Device btrfs_dev;
+			btrfs_dev.devid              = sbs[i].devid;
+			btrfs_dev.members            = members;
+			btrfs_dev.total_bytes        = sbs[i].total_bytes;
+			btrfs_dev.bytes_used         = sbs[i].bytes_used;
+			btrfs_dev.fs_bytes_used      = sbs[i].fs_bytes_used;
+			btrfs_dev.members_bytes_used = members_bytes_used;
+			btrfs_dev.label              = sbs[i].label;
+			btrfs_dev.label_valid        = sbs[i].label_valid;
+			btrfs_dev.uuid               = sbs[i].uuid;
+			btrfs_device_cache[members[i]] = btrfs_dev;
+		}
+	}
+}
+
+// Read the superblock.  The primary copy is used when its checksum is good.  Only when it
+// isn't are the mirror copies of the same file system tried, using the newest good one,
+// as btrfs rescue super-recover does.
+bool btrfs::read_superblock( const Glib::ustring & path, Superblock & sb )
+{
+	int fd = open( path.c_str(), O_RDONLY );
+	if ( fd < 0 )
+		return false;
+
+	unsigned char primary[BTRFS_SUPER_INFO_SIZE];
+	unsigned char buf[BTRFS_SUPER_INFO_SIZE];
+	unsigned char best[BTRFS_SUPER_INFO_SIZE];
+	bool found = false;
+	memset( primary, 0, sizeof( primary ) );
+	if ( read_super_copy( fd, 0, primary ) && super_checksum_ok( primary ) )
+	{
+		memcpy( best, primary, sizeof( best ) );
+		found = true;
+	}
+	else if ( memcmp( primary + BTRFS_SB_MAGIC, BTRFS_MAGIC, 8 ) == 0 )
+	{
+		for ( unsigned int i = 1 ; i < BTRFS_SUPER_MIRROR_MAX ; i ++ )
+		{
+			if (    ! read_super_copy( fd, i, buf )
+			     || ! super_checksum_ok( buf )
+			     || memcmp( buf + BTRFS_SB_FSID, primary + BTRFS_SB_FSID, 16 ) != 0 )
+				continue;
+			if (    ! found
+			     || SuperblockReader::le64( buf + BTRFS_SB_GENERATION ) > SuperblockReader::le64( best + BTRFS_SB_GENERATION ) )
+			{
+				memcpy( best, buf, sizeof( best ) );
+				found = true;
+			}
+		}
+	}
+	close( fd );
+	if ( ! found )
+		return false;
+
+	const unsigned char * dev_item = best + BTRFS_SB_DEV_ITEM;
+	sb.fsid          = std::string( reinterpret_cast<const char *>( best + BTRFS_SB_FSID ), 16 );
+	sb.generation    = SuperblockReader::le64( best + BTRFS_SB_GENERATION );
+	sb.devid         = SuperblockReader::le64( dev_item + BTRFS_DEV_ITEM_DEVID );
+	sb.num_devices   = SuperblockReader::le64( best + BTRFS_SB_NUM_DEVICES );
+	sb.total_bytes   = SuperblockReader::le64( dev_item + BTRFS_DEV_ITEM_TOTAL_BYTES );
+	sb.bytes_used    = SuperblockReader::le64( dev_item + BTRFS_DEV_ITEM_BYTES_USED );
+	sb.fs_bytes_used = SuperblockReader::le64( best + BTRFS_SB_BYTES_USED );
+	if (    sb.devid <= 0 || sb.num_devices <= 0 || sb.total_bytes <= 0
+	     || sb.bytes_used < 0 || sb.bytes_used > sb.total_bytes || sb.fs_bytes_used < 0 )
+		return false;
+
+	// The label is whatever bytes were set so may not be valid UTF-8.  Leave it to the
+	// btrfs tools to report when it isn't.
+	const char * label = reinterpret_cast<const char *>( best + BTRFS_SB_LABEL );
+	sb.label = Glib::ustring( label, strnlen( label, BTRFS_LABEL_SIZE ) );
+	sb.label_valid = sb.label.validate();
+	if ( ! sb.label_valid )
+		sb.label.clear();
+
+	// As when matching btrfs filesystem show output, exclude the Nil UUID and others
+	// with a zero version number.
+	sb.uuid.clear();
+	if ( best[BTRFS_SB_FSID + 6] >> 4 != 0 )
+	{
+		char uuid_str[UUID_STRING_LENGTH+1];
+		uuid_unparse_lower( best + BTRFS_SB_FSID, uuid_str );
+		sb.uuid = uuid_str;
+	}
+
+	return true;
+}
+
+// Read copy mirror of the superblock into buf.  Returns false when it doesn't have the
+// btrfs magic or isn't at the offset it records.
+bool btrfs::read_super_copy( int fd, unsigned int mirror, unsigned char * buf )
+{
+	if ( pread( fd, buf, BTRFS_SUPER_INFO_SIZE, BTRFS_SUPER_MIRRORS[mirror] ) != (ssize_t)BTRFS_SUPER_INFO_SIZE )
+		return false;
+	return    memcmp( buf + BTRFS_SB_MAGIC, BTRFS_MAGIC, 8 ) == 0
+	       && (Byte_Value)SuperblockReader::le64( buf + BTRFS_SB_BYTENR ) == BTRFS_SUPER_MIRRORS[mirror];
+}
+
+// Verify the checksum of a superblock copy, stored in the first bytes and covering the
+// rest of the block.  Only CRC-32C is checked; copies using the other checksum types are
+// accepted as they are.
+bool btrfs::super_checksum_ok( const unsigned char * buf )
+{
+	if ( SuperblockReader::le16( buf + BTRFS_SB_CSUM_TYPE ) != BTRFS_CSUM_TYPE_CRC32 )
+		return true;
+
+	unsigned long crc = SuperblockReader::crc32c( 0xFFFFFFFFUL, buf + BTRFS_CSUM_SIZE,
+	                                              BTRFS_SUPER_INFO_SIZE - BTRFS_CSUM_SIZE );
+	crc = ~crc & 0xFFFFFFFFUL;
+	return crc == SuperblockReader::le32( buf );
 }
 
 //Return the value of a btrfs tool formatted size, including reversing
@@ -16,6 +16,15 @@
 
 #include "exfat.h"
 #include "FileSystem.h"
+#include "Partition.h"
+#include "SuperblockReader.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
 
 namespace GParted
 {
@@ -25,6 +34,7 @@ FS exfat::get_filesystem_support()
 	FS fs( FS_EXFAT );
 
 	fs .busy = FS::GPARTED ;
+	fs .read = FS::EXTERNAL ;
 	fs .copy = FS::GPARTED ;
 	fs .move = FS::GPARTED ;
 	fs .online_read = FS::GPARTED ;
@@ -32,4 +42,166 @@ FS exfat::get_filesystem_support()
 	return fs ;
 }
 
+void exfat::set_used_sectors( Partition & partition )
+{
+	Byte_Value T = -1, N = -1, S = -1;
+	if ( read_usage( partition.get_path(), T, N, S ) )
+	{
+		partition.set_sector_usage( T / partition.sector_size, N / partition.sector_size );
+		partition.fs_block_size = S;
+	}
+}
+
+// Private methods
+
+// Read the size and free space of the file system.  Sets T to the file system size, N to
+// the free space and S to the cluster size, all in bytes.  exFAT doesn't keep a count of
+// free clusters so they are counted from the allocation bitmap.
+bool exfat::read_usage( const Glib::ustring & path, Byte_Value & T, Byte_Value & N, Byte_Value & S )
+{
+	int fd = open( path.c_str(), O_RDONLY );
+	if ( fd < 0 )
+		return false;
+
+	BootSector bs;
+	unsigned long bitmap_cluster = 0;
+	unsigned long used_clusters = 0;
+	bool success =    read_boot_sector( fd, bs )
+	               && find_allocation_bitmap( fd, bs, bitmap_cluster )
+	               && count_used_clusters( fd, bs, bitmap_cluster, used_clusters );
+	close( fd );
+	if ( ! success )
+		return false;
+
+	S = cluster_size( bs );
+	T = bs.volume_length << bs.sector_shift;
+	N = (Byte_Value)( bs.cluster_count - used_clusters ) * S;
+	return true;
+}
+
+// Reference:
+//     Microsoft exFAT file system specification, 3.1 Main Boot Sector
+bool exfat::read_boot_sector( int fd, BootSector & bs )
+{
+	unsigned char sector[512];
+	if ( pread( fd, sector, sizeof( sector ), 0 ) != sizeof( sector ) )
+		return false;
+	if ( memcmp( sector + 3, "EXFAT   ", 8 ) != 0 || sector[510] != 0x55 || sector[511] != 0xAA )
+		return false;
+
+	unsigned long long volume_length = SuperblockReader::le64( sector + 72 );
+	bs.fat_offset          = SuperblockReader::le32( sector + 80 );
+	bs.cluster_heap_offset = SuperblockReader::le32( sector + 88 );
+	bs.cluster_count       = SuperblockReader::le32( sector + 92 );
+	bs.root_cluster        = SuperblockReader::le32( sector + 96 );
+	bs.sector_shift        = sector[108];
+	bs.cluster_shift       = sector[109];
+
+	if (    bs.sector_shift < 9 || bs.sector_shift > 12
+	     || bs.cluster_shift > 25 - bs.sector_shift
+	     || bs.cluster_count == 0 || bs.cluster_count > 0xFFFFFFF5UL
+	     || bs.root_cluster < 2 || bs.root_cluster >= bs.cluster_count + 2
+	     || bs.fat_offset < 24
+	     || bs.cluster_heap_offset <= bs.fat_offset                          )
+		return false;
+	// Check the volume length still fits in bytes.
+	if ( volume_length >= 1ULL << ( 63 - bs.sector_shift ) )
+		return false;
+	bs.volume_length = volume_length;
+	if ( bs.cluster_heap_offset + ( (Byte_Value)bs.cluster_count << bs.cluster_shift ) > bs.volume_length )
+		return false;
+
+	return true;
+}
+
+Byte_Value exfat::cluster_size( const BootSector & bs )
+{
+	return 1LL << ( bs.sector_shift + bs.cluster_shift );
+}
+
+Byte_Value exfat::cluster_offset( const BootSector & bs, unsigned long cluster )
+{
+	return ( bs.cluster_heap_offset + ( (Byte_Value)( cluster - 2 ) << bs.cluster_shift ) ) << bs.sector_shift;
+}
+
+// Follow the FAT chain from cluster.  Returns false at the end of the chain or when the
+// entry isn't a valid cluster.
+bool exfat::next_cluster( int fd, const BootSector & bs, unsigned long & cluster )
+{
+	unsigned char entry[4];
+	if ( pread( fd, entry, sizeof( entry ), ( bs.fat_offset << bs.sector_shift ) + (Byte_Value)cluster * 4 )
+	     != sizeof( entry ) )
+		return false;
+	unsigned long next = SuperblockReader::le32( entry );
+	if ( next < 2 || next >= bs.cluster_count + 2 )
+		return false;
+	cluster = next;
+	return true;
+}
+
+// Find the first cluster of the allocation bitmap from its entry in the root directory.
+// When there are two bitmaps, for TexFAT, the first is the active one.
+// Reference:
+//     Microsoft exFAT file system specification,
+//     7.1 Allocation Bitmap Directory Entry
+bool exfat::find_allocation_bitmap( int fd, const BootSector & bs, unsigned long & bitmap_cluster )
+{
+	std::vector<unsigned char> buf( cluster_size( bs ) );
+	unsigned long cluster = bs.root_cluster;
+	// Bound the walk by the number of clusters in case the chain loops.
+	for ( unsigned long i = 0 ; i < bs.cluster_count ; i ++ )
+	{
+		if ( pread( fd, &buf[0], buf.size(), cluster_offset( bs, cluster ) ) != (ssize_t)buf.size() )
+			return false;
+		for ( size_t entry = 0 ; entry < buf.size() ; entry += 32 )
+		{
+			unsigned char type = buf[entry];
+			if ( type == 0x00 )
+				// End of directory
+				return false;
+			if ( type == 0x81 )
+			{
+				bitmap_cluster = SuperblockReader::le32( &buf[entry+20] );
+				return bitmap_cluster >= 2 && bitmap_cluster < bs.cluster_count + 2 &&
+				       SuperblockReader::le64( &buf[entry+24] ) >= ( bs.cluster_count + 7ULL ) / 8;
+			}
+		}
+		if ( ! next_cluster( fd, bs, cluster ) )
+			return false;
+	}
+	return false;
+}
+
+// Count the bits set in the allocation bitmap, one per cluster.
+bool exfat::count_used_clusters( int fd, const BootSector & bs, unsigned long bitmap_cluster,
+                                 unsigned long & used_clusters )
+{
+	static const unsigned char nibble_bits[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+	std::vector<unsigned char> buf( cluster_size( bs ) );
+	Byte_Value bitmap_bytes = ( bs.cluster_count + 7ULL ) / 8;
+	Byte_Value done = 0;
+	unsigned long cluster = bitmap_cluster;
+	used_clusters = 0;
+	while ( true )
+	{
+		if ( pread( fd, &buf[0], buf.size(), cluster_offset( bs, cluster ) ) != (ssize_t)buf.size() )
+			return false;
+		Byte_Value len = std::min( (Byte_Value)buf.size(), bitmap_bytes - done );
+		for ( Byte_Value i = 0 ; i < len ; i ++ )
+		{
+			unsigned char bits = buf[i];
+			if ( done + i == bitmap_bytes - 1 && bs.cluster_count % 8 != 0 )
+				// Ignore the bits past the last cluster
+				bits &= ( 1 << ( bs.cluster_count % 8 ) ) - 1;
+			used_clusters += nibble_bits[bits & 0x0F] + nibble_bits[bits >> 4];
+		}
+		done += len;
+		if ( done >= bitmap_bytes )
+			return used_clusters <= bs.cluster_count;
+		if ( ! next_cluster( fd, bs, cluster ) )
+			return false;
+	}
+}
+
 } //GParted
@@ -19,13 +19,46 @@
 #include "FileSystem.h"
 #include "OperationDetail.h"
 #include "Partition.h"
+#include "SuperblockReader.h"
 #include "Utils.h"
 
 #include <glibmm/ustring.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <uuid/uuid.h>
 
 namespace GParted
 {
 
+// Superblock location, size and the fields used.
+// Reference:
+//     The Linux Kernel, ext4 Data Structures and Algorithms, Super Block
+//     https://www.kernel.org/doc/html/latest/filesystems/ext4/super.html
+const Byte_Value EXT_SUPERBLOCK_OFFSET = 1024;
+const size_t EXT_SUPERBLOCK_SIZE = 1024;
+const unsigned int EXT_SUPER_MAGIC = 0xEF53;
+
+const size_t EXT_SB_BLOCKS_COUNT_LO      = 0x04;
+const size_t EXT_SB_FREE_BLOCKS_COUNT_LO = 0x0C;
+const size_t EXT_SB_LOG_BLOCK_SIZE       = 0x18;
+const size_t EXT_SB_MAGIC                = 0x38;
+const size_t EXT_SB_FEATURE_INCOMPAT     = 0x60;
+const size_t EXT_SB_FEATURE_RO_COMPAT    = 0x64;
+const size_t EXT_SB_UUID                 = 0x68;
+const size_t EXT_SB_VOLUME_NAME          = 0x78;
+const size_t EXT_SB_BLOCKS_COUNT_HI      = 0x150;
+const size_t EXT_SB_FREE_BLOCKS_COUNT_HI = 0x158;
+const size_t EXT_SB_CHECKSUM_TYPE        = 0x175;
+const size_t EXT_SB_CHECKSUM             = 0x3FC;
+
+const unsigned long EXT_INCOMPAT_JOURNAL_DEV     = 0x0008;
+const unsigned long EXT_INCOMPAT_64BIT           = 0x0080;
+// Incompatible features up to casefold, all of which leave the fields used alone
+const unsigned long EXT_INCOMPAT_KNOWN           = 0x3F7DF;
+const unsigned long EXT_RO_COMPAT_METADATA_CSUM  = 0x0400;
+const unsigned int  EXT_CHECKSUM_TYPE_CRC32C     = 1;
+
 FS ext2::get_filesystem_support()
 {
 	FS fs( specific_type );
@@ -43,6 +76,7 @@ FS ext2::get_filesystem_support()
 		force_auto_64bit = false;
 		if ( specific_type == FS_EXT4 )
 		{
+			Glib::ustring output, error;
 			Utils::execute_command( mkfs_cmd + " -V", output, error, true );
 			int mke4fs_major_ver = 0;
 			int mke4fs_minor_ver = 0;
@@ -113,6 +147,7 @@ FS ext2::get_filesystem_support()
 		// than copying all blocks used by GParted's internal method.
 		if ( ! Glib::find_program_in_path( "e2image" ).empty() )
 		{
+			Glib::ustring output, error;
 			Utils::execute_command( "e2image", output, error, true );
 			if ( Utils::regexp_label( error, "(-o src_offset)" ) == "-o src_offset" )
 				fs.copy = fs.move = FS::EXTERNAL;
@@ -142,13 +177,22 @@ FS ext2::get_filesystem_support()
 
 void ext2::set_used_sectors( Partition & partition ) 
 {
+	Glib::ustring output, error;
+	Sector T = -1, N = -1, S = -1;
 	//Called when file system is unmounted *and* when mounted.  Always read
-	//  the file system size from the on disk superblock using dumpe2fs to
-	//  avoid overhead subtraction.  Read the free space from the kernel via
-	//  the statvfs() system call when mounted and from the superblock when
-	//  unmounted.
-	if ( ! Utils::execute_command( "dumpe2fs -h " + Glib::shell_quote( partition.get_path() ),
-	                               output, error, true )                                       )
+	//  the file system size from the on disk superblock, directly or using
+	//  dumpe2fs, to avoid overhead subtraction.  Read the free space from the
+	//  kernel via the statvfs() system call when mounted and from the
+	//  superblock when unmounted.
+	Superblock sb;
+	if ( read_superblock( partition.get_path(), sb ) )
+	{
+		T = sb.block_count;
+		N = sb.free_blocks;
+		S = sb.block_size;
+	}
+	else if ( ! Utils::execute_command( "dumpe2fs -h " + Glib::shell_quote( partition.get_path() ),
+	                                    output, error, true )                                       )
 	{
 		Glib::ustring::size_type index = output.find( "Block count:" );
 		if ( index >= output .length() ||
@@ -160,38 +204,10 @@ void ext2::set_used_sectors( Partition & partition )
 		     sscanf( output.substr( index ).c_str(), "Block size: %lld", &S ) != 1 )
 			S = -1 ;
 
-		if ( T > -1 && S > -1 )
-			T = Utils::round( T * ( S / double(partition .sector_size) ) ) ;
-
-		if ( partition .busy )
-		{
-			Byte_Value ignored ;
-			Byte_Value fs_free ;
-			if ( Utils::get_mounted_filesystem_usage( partition .get_mountpoint(),
-			                                          ignored, fs_free, error ) == 0 )
-				N = Utils::round( fs_free / double(partition .sector_size) ) ;
-			else
-			{
-				N = -1 ;
-				partition.push_back_message( error );
-			}
-		}
-		else
-		{
-			index = output .find( "Free blocks:" ) ;
-			if ( index >= output .length() ||
-			     sscanf( output.substr( index ).c_str(), "Free blocks: %lld", &N ) != 1 )
-				N = -1 ;
-
-			if ( N > -1 && S > -1 )
-				N = Utils::round( N * ( S / double(partition .sector_size) ) ) ;
-		}
-
-		if ( T > -1 && N > -1 && S > -1 )
-		{
-			partition .set_sector_usage( T, N ) ;
-			partition.fs_block_size = S;
-		}
+		index = output .find( "Free blocks:" ) ;
+		if ( index >= output .length() ||
+		     sscanf( output.substr( index ).c_str(), "Free blocks: %lld", &N ) != 1 )
+			N = -1 ;
 	}
 	else
 	{
@@ -200,11 +216,45 @@ void ext2::set_used_sectors( Partition & partition )
 		
 		if ( ! error .empty() )
 			partition.push_back_message( error );
+		return;
+	}
+
+	if ( T > -1 && S > -1 )
+		T = Utils::round( T * ( S / double(partition .sector_size) ) ) ;
+
+	if ( partition .busy )
+	{
+		Byte_Value ignored ;
+		Byte_Value fs_free ;
+		if ( Utils::get_mounted_filesystem_usage( partition .get_mountpoint(),
+		                                          ignored, fs_free, error ) == 0 )
+			N = Utils::round( fs_free / double(partition .sector_size) ) ;
+		else
+		{
+			N = -1 ;
+			partition.push_back_message( error );
+		}
+	}
+	else if ( N > -1 && S > -1 )
+		N = Utils::round( N * ( S / double(partition .sector_size) ) ) ;
+
+	if ( T > -1 && N > -1 && S > -1 )
+	{
+		partition .set_sector_usage( T, N ) ;
+		partition.fs_block_size = S;
 	}
 }
-	
+
 void ext2::read_label( Partition & partition )
 {
+	Glib::ustring output, error;
+	Superblock sb;
+	if ( read_superblock( partition.get_path(), sb ) )
+	{
+		partition.set_filesystem_label( Utils::trim( sb.label ) );
+		return;
+	}
+
 	if ( ! Utils::execute_command( "e2label " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                   )
 	{
@@ -229,6 +279,14 @@ bool ext2::write_label( const Partition & partition, OperationDetail & operation
 
 void ext2::read_uuid( Partition & partition )
 {
+	Glib::ustring output, error;
+	Superblock sb;
+	if ( read_superblock( partition.get_path(), sb ) )
+	{
+		partition.uuid = sb.uuid;
+		return;
+	}
+
 	if ( ! Utils::execute_command( "tune2fs -l " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                      )
 	{
@@ -284,9 +342,9 @@ bool ext2::resize( const Partition & partition_new, OperationDetail & operationd
 
 bool ext2::check_repair( const Partition & partition, OperationDetail & operationdetail )
 {
-	exit_status = execute_command( "e2fsck -f -y -v -C 0 " + Glib::shell_quote( partition.get_path() ),
-	                               operationdetail, EXEC_CANCEL_SAFE|EXEC_PROGRESS_STDOUT,
-	                               static_cast<StreamSlot>( sigc::mem_fun( *this, &ext2::check_repair_progress ) ) );
+	int exit_status = execute_command( "e2fsck -f -y -v -C 0 " + Glib::shell_quote( partition.get_path() ),
+	                                   operationdetail, EXEC_CANCEL_SAFE|EXEC_PROGRESS_STDOUT,
+	                                   static_cast<StreamSlot>( sigc::mem_fun( *this, &ext2::check_repair_progress ) ) );
 	bool success = ( exit_status == 0 || exit_status == 1 || exit_status == 2 );
 	set_status( operationdetail, success );
 	return success;
@@ -322,9 +380,67 @@ bool ext2::copy( const Partition & src_part,
 
 //Private methods
 
+// Read the superblock directly, rather than running dumpe2fs, e2label and tune2fs for
+// each file system.  Handles the 64bit and metadata_csum features.  Returns false for
+// external journal devices, unknown incompatible features or a bad checksum so that the
+// tools are used instead.
+bool ext2::read_superblock( const Glib::ustring & path, Superblock & sb )
+{
+	int fd = open( path.c_str(), O_RDONLY );
+	if ( fd < 0 )
+		return false;
+	unsigned char buf[EXT_SUPERBLOCK_SIZE];
+	bool success = pread( fd, buf, sizeof( buf ), EXT_SUPERBLOCK_OFFSET ) == (ssize_t)sizeof( buf );
+	close( fd );
+	if ( ! success || SuperblockReader::le16( buf + EXT_SB_MAGIC ) != EXT_SUPER_MAGIC )
+		return false;
+
+	unsigned long incompat = SuperblockReader::le32( buf + EXT_SB_FEATURE_INCOMPAT );
+	unsigned long ro_compat = SuperblockReader::le32( buf + EXT_SB_FEATURE_RO_COMPAT );
+	if ( ( incompat & ~EXT_INCOMPAT_KNOWN ) || ( incompat & EXT_INCOMPAT_JOURNAL_DEV ) )
+		return false;
+	if ( ro_compat & EXT_RO_COMPAT_METADATA_CSUM )
+	{
+		if (    buf[EXT_SB_CHECKSUM_TYPE] != EXT_CHECKSUM_TYPE_CRC32C
+		     || SuperblockReader::crc32c( 0xFFFFFFFFUL, buf, EXT_SB_CHECKSUM ) != SuperblockReader::le32( buf + EXT_SB_CHECKSUM ) )
+			return false;
+	}
+
+	unsigned long log_block_size = SuperblockReader::le32( buf + EXT_SB_LOG_BLOCK_SIZE );
+	if ( log_block_size > 6 )
+		// Larger than the 64 KiB maximum block size
+		return false;
+	sb.block_size = 1024 << log_block_size;
+
+	sb.block_count = SuperblockReader::le32( buf + EXT_SB_BLOCKS_COUNT_LO );
+	sb.free_blocks = SuperblockReader::le32( buf + EXT_SB_FREE_BLOCKS_COUNT_LO );
+	if ( incompat & EXT_INCOMPAT_64BIT )
+	{
+		sb.block_count |= (Sector)SuperblockReader::le32( buf + EXT_SB_BLOCKS_COUNT_HI ) << 32;
+		sb.free_blocks |= (Sector)SuperblockReader::le32( buf + EXT_SB_FREE_BLOCKS_COUNT_HI ) << 32;
+	}
+	if ( sb.block_count == 0 || sb.free_blocks > sb.block_count )
+		return false;
+
+	const char * volume_name = reinterpret_cast<const char *>( buf + EXT_SB_VOLUME_NAME );
+	sb.label = Glib::ustring( volume_name, strnlen( volume_name, 16 ) );
+
+	// As when matching tune2fs output, exclude the Nil UUID and others with a zero
+	// version number.
+	sb.uuid.clear();
+	if ( buf[EXT_SB_UUID + 6] >> 4 != 0 )
+	{
+		char uuid_str[UUID_STRING_LENGTH+1];
+		uuid_unparse_lower( buf + EXT_SB_UUID, uuid_str );
+		sb.uuid = uuid_str;
+	}
+
+	return true;
+}
+
 void ext2::resize_progress( OperationDetail *operationdetail )
 {
-	Glib::ustring line = Utils::last_line( output );
+	Glib::ustring line = Utils::last_line( get_command_output() );
 	size_t llen = line.length();
 	// There may be multiple text progress bars on subsequent last lines which look
 	// like: "Scanning inode table          XXXXXXXXXXXXXXXXXXXXXXXXXXXX------------"
@@ -348,7 +464,7 @@ void ext2::resize_progress( OperationDetail *operationdetail )
 	}
 	// Ending summary line looks like:
 	// "The filesystem on /dev/sdb3 is now 256000 block long."
-	else if ( output.find( " is now " ) != output.npos )
+	else if ( get_command_output().find( " is now " ) != Glib::ustring::npos )
 	{
 		operationdetail->stop_progressbar();
 	}
@@ -356,7 +472,7 @@ void ext2::resize_progress( OperationDetail *operationdetail )
 
 void ext2::create_progress( OperationDetail *operationdetail )
 {
-	Glib::ustring line = Utils::last_line( output );
+	Glib::ustring line = Utils::last_line( get_command_output() );
 	// Text progress on the LAST LINE looks like "Writing inode tables:  105/1600"
 	long long progress, target;
 	if ( sscanf( line.c_str(), "Writing inode tables: %lld/%lld", &progress, &target ) == 2 )
@@ -364,7 +480,7 @@ void ext2::create_progress( OperationDetail *operationdetail )
 		operationdetail->run_progressbar( (double)progress, (double)target );
 	}
 	// Or when finished, on any line, ...
-	else if ( output.find( "Writing inode tables: done" ) != output.npos )
+	else if ( get_command_output().find( "Writing inode tables: done" ) != Glib::ustring::npos )
 	{
 		operationdetail->stop_progressbar();
 	}
@@ -372,7 +488,7 @@ void ext2::create_progress( OperationDetail *operationdetail )
 
 void ext2::check_repair_progress( OperationDetail *operationdetail )
 {
-	Glib::ustring line = Utils::last_line( output );
+	Glib::ustring line = Utils::last_line( get_command_output() );
 	// Text progress on the LAST LINE looks like
 	// "/dev/sdd3: |=====================================================   \ 95.1%   "
 	size_t p = line.rfind( "%" );
@@ -388,7 +504,7 @@ void ext2::check_repair_progress( OperationDetail *operationdetail )
 	// summary at the end to prevent the GUI progress bar flashing back to pulsing
 	// mode when the text progress bar is temporarily missing/incomplete before fsck
 	// output is fully updated when switching from one pass to the next.
-	else if ( output.find( "non-contiguous" ) != output.npos )
+	else if ( get_command_output().find( "non-contiguous" ) != Glib::ustring::npos )
 	{
 		operationdetail->stop_progressbar();
 	}
@@ -396,7 +512,7 @@ void ext2::check_repair_progress( OperationDetail *operationdetail )
 
 void ext2::copy_progress( OperationDetail *operationdetail )
 {
-	Glib::ustring line = Utils::last_line( error );
+	Glib::ustring line = Utils::last_line( get_command_error() );
 	// Text progress on the LAST LINE of STDERR looks like "Copying 146483 / 258033 blocks ..."
 	long long progress, target;
 	if ( sscanf( line.c_str(), "Copying %lld / %lld blocks", &progress, &target ) == 2 )
@@ -406,7 +522,7 @@ void ext2::copy_progress( OperationDetail *operationdetail )
 		                                  PROGRESSBAR_TEXT_COPY_BYTES );
 	}
 	// Or when finished, on any line of STDERR, looks like "Copied 258033 / 258033 blocks ..."
-	else if ( error.find( "\nCopied " ) != error.npos )
+	else if ( get_command_error().find( "\nCopied " ) != Glib::ustring::npos )
 	{
 		operationdetail->stop_progressbar();
 	}
@@ -17,15 +17,31 @@
 #include "f2fs.h"
 #include "FileSystem.h"
 #include "Partition.h"
+#include "SuperblockReader.h"
+#include "Utils.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
 
 namespace GParted
 {
 
+const unsigned long F2FS_SUPER_MAGIC          = 0xF2F52010UL;
+const Byte_Value    F2FS_SUPER_OFFSET         = 1024;
+const unsigned int  F2FS_LOG_BLOCK_SIZE       = 12;
+const unsigned int  F2FS_BLOCK_SIZE           = 1 << F2FS_LOG_BLOCK_SIZE;
+const unsigned int  F2FS_LOG_BLOCKS_PER_SEG   = 9;
+// Checksum offset range, from the end of the fixed checkpoint fields to the end of the block
+const unsigned long F2FS_CP_MIN_CHKSUM_OFFSET = 192;
+const unsigned long F2FS_CP_CHKSUM_OFFSET     = F2FS_BLOCK_SIZE - 4;
+
 FS f2fs::get_filesystem_support()
 {
 	FS fs( FS_F2FS );
 
 	fs .busy = FS::GPARTED ;
+	fs .read = FS::EXTERNAL ;
 
 	if ( ! Glib::find_program_in_path( "mkfs.f2fs" ) .empty() )
 	{
@@ -40,6 +56,133 @@ FS f2fs::get_filesystem_support()
 	return fs ;
 }
 
+void f2fs::set_used_sectors( Partition & partition )
+{
+	int fd = open( partition.get_path().c_str(), O_RDONLY );
+	if ( fd < 0 )
+		return;
+
+	Byte_Value T = -1, N = -1;
+	Superblock sb;
+	unsigned long long user_blocks = 0;
+	unsigned long long valid_blocks = 0;
+	bool success =    ( read_superblock( fd, 0, sb ) || read_superblock( fd, F2FS_BLOCK_SIZE, sb ) )
+	               && read_checkpoint( fd, sb, user_blocks, valid_blocks );
+	close( fd );
+	if ( ! success )
+		return;
+
+	T = (Byte_Value)sb.block_count * F2FS_BLOCK_SIZE;
+	N = (Byte_Value)( user_blocks - valid_blocks ) * F2FS_BLOCK_SIZE;
+	partition.set_sector_usage( T / partition.sector_size, N / partition.sector_size );
+	partition.fs_block_size = F2FS_BLOCK_SIZE;
+}
+
+// Private methods
+
+// Read one of the two copies of the superblock, in the first and second blocks.
+// Reference:
+//     Linux kernel, include/linux/f2fs_fs.h, struct f2fs_super_block
+bool f2fs::read_superblock( int fd, Byte_Value block_offset, Superblock & sb )
+{
+	unsigned char buf[512];
+	if ( pread( fd, buf, sizeof( buf ), block_offset + F2FS_SUPER_OFFSET ) != sizeof( buf ) )
+		return false;
+	if ( SuperblockReader::le32( buf ) != F2FS_SUPER_MAGIC )
+		return false;
+
+	unsigned long log_blocksize = SuperblockReader::le32( buf + 16 );
+	sb.log_blocks_per_seg       = SuperblockReader::le32( buf + 20 );
+	sb.block_count              = SuperblockReader::le64( buf + 36 );
+	sb.cp_blkaddr               = SuperblockReader::le32( buf + 76 );
+
+	if (    log_blocksize != F2FS_LOG_BLOCK_SIZE
+	     || sb.log_blocks_per_seg != F2FS_LOG_BLOCKS_PER_SEG
+	     || sb.block_count == 0 || sb.block_count >= 1ULL << 40
+	     || sb.cp_blkaddr == 0 || sb.cp_blkaddr >= sb.block_count )
+		return false;
+
+	return true;
+}
+
+// Read the block counts from the newest valid checkpoint pack.  There are two packs, in
+// the first two segments of the checkpoint area, written alternately.
+// Reference:
+//     Linux kernel, fs/f2fs/checkpoint.c, f2fs_get_valid_checkpoint()
+bool f2fs::read_checkpoint( int fd, const Superblock & sb,
+                            unsigned long long & user_blocks, unsigned long long & valid_blocks )
+{
+	bool found = false;
+	unsigned long long newest_version = 0;
+	for ( unsigned int i = 0 ; i < 2 ; i ++ )
+	{
+		unsigned long long blkaddr = sb.cp_blkaddr + ( (unsigned long long)i << sb.log_blocks_per_seg );
+		unsigned long long version;
+		unsigned long long user;
+		unsigned long long valid;
+		if ( ! read_checkpoint_pack( fd, blkaddr, sb.block_count, version, user, valid ) )
+			continue;
+		if ( ! found || version > newest_version )
+		{
+			found          = true;
+			newest_version = version;
+			user_blocks    = user;
+			valid_blocks   = valid;
+		}
+	}
+	return found;
+}
+
+// A checkpoint pack is valid when its first and last blocks both have good checksums and
+// the same version.
+bool f2fs::read_checkpoint_pack( int fd, unsigned long long blkaddr, unsigned long long block_count,
+                                 unsigned long long & version,
+                                 unsigned long long & user_blocks, unsigned long long & valid_blocks )
+{
+	std::vector<unsigned char> head;
+	if ( ! read_checkpoint_block( fd, blkaddr, head ) )
+		return false;
+
+	version      = SuperblockReader::le64( &head[0] );
+	user_blocks  = SuperblockReader::le64( &head[8] );
+	valid_blocks = SuperblockReader::le64( &head[16] );
+	unsigned long pack_blocks = SuperblockReader::le32( &head[136] );
+	if ( pack_blocks < 2 || blkaddr + pack_blocks > block_count || valid_blocks > user_blocks )
+		return false;
+
+	std::vector<unsigned char> tail;
+	if ( ! read_checkpoint_block( fd, blkaddr + pack_blocks - 1, tail ) )
+		return false;
+	return SuperblockReader::le64( &tail[0] ) == version;
+}
+
+// Read a checkpoint block and verify its checksum, stored at checksum_offset.
+bool f2fs::read_checkpoint_block( int fd, unsigned long long blkaddr, std::vector<unsigned char> & buf )
+{
+	buf.resize( F2FS_BLOCK_SIZE );
+	if ( pread( fd, &buf[0], buf.size(), (Byte_Value)blkaddr * F2FS_BLOCK_SIZE ) != (ssize_t)buf.size() )
+		return false;
+
+	unsigned long checksum_offset = SuperblockReader::le32( &buf[164] );
+	if ( checksum_offset < F2FS_CP_MIN_CHKSUM_OFFSET || checksum_offset > F2FS_CP_CHKSUM_OFFSET )
+		return false;
+	return crc32( &buf[0], checksum_offset ) == SuperblockReader::le32( &buf[checksum_offset] );
+}
+
+// The CRC-32 f2fs uses for checkpoints: the reflected IEEE 802.3 polynomial seeded with
+// the superblock magic and without the final inversion.
+unsigned long f2fs::crc32( const unsigned char * p, size_t len )
+{
+	unsigned long crc = F2FS_SUPER_MAGIC;
+	for ( size_t i = 0 ; i < len ; i ++ )
+	{
+		crc ^= p[i];
+		for ( unsigned int bit = 0 ; bit < 8 ; bit ++ )
+			crc = ( crc >> 1 ) ^ ( ( crc & 1 ) ? 0xEDB88320UL : 0 );
+	}
+	return crc & 0xFFFFFFFFUL;
+}
+
 bool f2fs::create( const Partition & new_partition, OperationDetail & operationdetail )
 {
 	return ! execute_command( "mkfs.f2fs -l " + Glib::shell_quote( new_partition.get_filesystem_label() ) +
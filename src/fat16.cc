@@ -18,6 +18,14 @@
 #include "fat16.h"
 #include "FileSystem.h"
 #include "Partition.h"
+#include "SuperblockReader.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
 
 /*****
 //For some reason unknown, this works without these include statements.
@@ -29,6 +37,10 @@
 namespace GParted
 {
 
+// Number of bytes of the FAT read at a time.  A multiple of both 3 bytes, a pair of
+// FAT12 entries, and 4 bytes, one FAT32 entry, so that no entry spans two reads.
+const Byte_Value FAT_READ_SIZE = 3 * MEBIBYTE;
+
 const Glib::ustring fat16::Change_UUID_Warning [] =
 	{ _( "Changing the UUID might invalidate the Windows Product Activation (WPA) key"
 	   )
@@ -67,6 +79,12 @@ FS fat16::get_filesystem_support()
 
 	fs .busy = FS::GPARTED ;
 
+	// Usage, label and UUID are read directly from the file system, falling back on
+	// fsck.fat and mtools.
+	fs .read = FS::EXTERNAL ;
+	fs .read_label = FS::EXTERNAL ;
+	fs .read_uuid = FS::EXTERNAL ;
+
 	//find out if we can create fat file systems
 	if ( ! Glib::find_program_in_path( "mkfs.fat" ) .empty() )
 	{
@@ -84,21 +102,19 @@ FS fat16::get_filesystem_support()
 	if ( ! Glib::find_program_in_path( "fsck.fat" ) .empty() )
 	{
 		fs .check = GParted::FS::EXTERNAL ;
-		fs .read = GParted::FS::EXTERNAL ;
 		check_cmd = "fsck.fat" ;
 	}
 	else if ( ! Glib::find_program_in_path( "dosfsck" ) .empty() )
 	{
 		fs .check = GParted::FS::EXTERNAL ;
-		fs .read = GParted::FS::EXTERNAL ;
 		check_cmd = "dosfsck" ;
 	}
 
-	if ( ! Glib::find_program_in_path( "mdir" ) .empty() )
-		fs .read_uuid = FS::EXTERNAL ;
+	mdir_found = ! Glib::find_program_in_path( "mdir" ).empty();
 
-	if ( ! Glib::find_program_in_path( "mlabel" ) .empty() ) {
-		fs .read_label = FS::EXTERNAL ;
+	mlabel_found = ! Glib::find_program_in_path( "mlabel" ).empty();
+	if ( mlabel_found )
+	{
 		fs .write_label = FS::EXTERNAL ;
 		fs .write_uuid = FS::EXTERNAL ;
 	}
@@ -132,6 +148,18 @@ FS fat16::get_filesystem_support()
 
 void fat16::set_used_sectors( Partition & partition ) 
 {
+	Glib::ustring output, error;
+	Sector T = -1, N = -1, S = -1;
+	int exit_status;
+	if ( read_usage( partition.get_path(), T, N, S ) )
+	{
+		partition.set_sector_usage( T / partition.sector_size, N / partition.sector_size );
+		partition.fs_block_size = S;
+		return;
+	}
+	if ( check_cmd.empty() )
+		return;
+
 	exit_status = Utils::execute_command( check_cmd + " -n -v " + Glib::shell_quote( partition.get_path() ),
 	                                      output, error, true );
 	if ( exit_status == 0 || exit_status == 1 )
@@ -180,8 +208,78 @@ void fat16::set_used_sectors( Partition & partition )
 	}
 }
 
+// Get the ranges in use from the first FAT.  The reserved sectors, FATs and FAT12/16 root
+// directory are always in use, followed by the allocated data clusters.
+bool fat16::get_used_extents( const Partition & partition, std::vector<Extent> & extents )
+{
+	int fd = open( partition.device_path.c_str(), O_RDONLY );
+	if ( fd < 0 )
+		return false;
+
+	Byte_Value partition_offset = partition.sector_start * partition.sector_size;
+	BootSector bs;
+	bool success = read_boot_sector( fd, partition_offset, bs );
+	if ( success )
+	{
+		Byte_Value cluster_size = (Byte_Value)bs.sectors_per_cluster * bs.bytes_per_sector;
+		Byte_Value data_offset = bs.first_data_sector * bs.bytes_per_sector;
+		extents.push_back( Extent( 0, data_offset ) );
+
+		Byte_Value fat_offset = partition_offset + (Byte_Value)bs.reserved_sectors * bs.bytes_per_sector;
+		Byte_Value fat_bytes = ( ( (Byte_Value)bs.clusters + 2 ) * bs.fat_bits + 7 ) / 8;
+		unsigned long entries_per_read = FAT_READ_SIZE * 8 / bs.fat_bits;
+		unsigned long bad = bs.fat_bits == 12 ? 0xFF7UL : bs.fat_bits == 16 ? 0xFFF7UL : 0x0FFFFFF7UL;
+		std::vector<unsigned char> buf( FAT_READ_SIZE );
+		for ( unsigned long first = 0 ; success && first < bs.clusters + 2 ; first += entries_per_read )
+		{
+			Byte_Value pos = (Byte_Value)first * bs.fat_bits / 8;
+			Byte_Value count = std::min( FAT_READ_SIZE, fat_bytes - pos );
+			if ( pread( fd, &buf[0], count, fat_offset + pos ) != count )
+			{
+				success = false;
+				break;
+			}
+
+			unsigned long last = std::min( first + entries_per_read, bs.clusters + 2 );
+			for ( unsigned long cluster = std::max( first, 2UL ) ; cluster < last ; cluster ++ )
+			{
+				unsigned long entry = fat_entry( &buf[0], bs.fat_bits, cluster - first );
+				if ( entry == 0 || entry == bad )
+					continue;
+
+				Byte_Value offset = data_offset + ( cluster - 2 ) * cluster_size;
+				Extent & prev = extents.back();
+				if ( prev.offset + prev.length == offset )
+					prev.length += cluster_size;
+				else
+					extents.push_back( Extent( offset, cluster_size ) );
+			}
+		}
+	}
+
+	close( fd );
+	return success;
+}
+
 void fat16::read_label( Partition & partition )
 {
+	Glib::ustring output, error;
+	int fd = open( partition.get_path().c_str(), O_RDONLY );
+	if ( fd >= 0 )
+	{
+		BootSector bs;
+		Glib::ustring label;
+		bool success = read_boot_sector( fd, 0, bs ) && read_volume_label( fd, bs, label );
+		close( fd );
+		if ( success )
+		{
+			partition.set_filesystem_label( label );
+			return;
+		}
+	}
+	if ( ! mlabel_found )
+		return;
+
 	if ( ! Utils::execute_command( "mlabel -s :: -i " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                           )
 	{
@@ -211,6 +309,30 @@ bool fat16::write_label( const Partition & partition, OperationDetail & operatio
 
 void fat16::read_uuid( Partition & partition )
 {
+	Glib::ustring output, error;
+	int fd = open( partition.get_path().c_str(), O_RDONLY );
+	if ( fd >= 0 )
+	{
+		BootSector bs;
+		bool success = read_boot_sector( fd, 0, bs );
+		close( fd );
+		if ( success )
+		{
+			// Formatted as mdir reports the Volume Serial Number
+			partition.uuid.clear();
+			if ( bs.have_serial && bs.serial != 0 )
+			{
+				char serial_str[10];
+				snprintf( serial_str, sizeof( serial_str ), "%04lX-%04lX",
+				          bs.serial >> 16, bs.serial & 0xFFFFUL );
+				partition.uuid = serial_str;
+			}
+			return;
+		}
+	}
+	if ( ! mdir_found )
+		return;
+
 	Glib::ustring cmd = "mdir -f :: -i " + Glib::shell_quote( partition.get_path() );
 
 	if ( ! Utils::execute_command( cmd, output, error, true ) )
@@ -249,9 +371,9 @@ bool fat16::create( const Partition & new_partition, OperationDetail & operation
 
 bool fat16::check_repair( const Partition & partition, OperationDetail & operationdetail )
 {
-	exit_status = execute_command( check_cmd + " -a -w -v " + Glib::shell_quote( partition .get_path() ),
-	                               operationdetail,
-	                               EXEC_CANCEL_SAFE );
+	int exit_status = execute_command( check_cmd + " -a -w -v " + Glib::shell_quote( partition .get_path() ),
+	                                   operationdetail,
+	                                   EXEC_CANCEL_SAFE );
 	bool success = ( exit_status == 0 || exit_status == 1 );
 	set_status( operationdetail, success );
 	return success;
@@ -259,6 +381,278 @@ bool fat16::check_repair( const Partition & partition, OperationDetail & operati
 
 //Private methods
 
+// Read and sanity check the BIOS Parameter Block from the boot sector of the file
+// system starting at byte offset in fd.
+// Reference:
+//     Microsoft Extensible Firmware Initiative FAT32 File System Specification,
+//     FAT: General Overview of On-Disk Format, Version 1.03
+bool fat16::read_boot_sector( int fd, Byte_Value offset, BootSector & bs )
+{
+	unsigned char sector[512];
+	if ( pread( fd, sector, sizeof( sector ), offset ) != sizeof( sector ) )
+		return false;
+	if ( sector[510] != 0x55 || sector[511] != 0xAA )
+		return false;
+
+	bs.bytes_per_sector    = SuperblockReader::le16( sector + 11 );
+	bs.sectors_per_cluster = sector[13];
+	bs.reserved_sectors    = SuperblockReader::le16( sector + 14 );
+	bs.num_fats            = sector[16];
+	unsigned int root_entries = SuperblockReader::le16( sector + 17 );
+	bs.total_sectors       = SuperblockReader::le16( sector + 19 );
+	if ( bs.total_sectors == 0 )
+		bs.total_sectors = SuperblockReader::le32( sector + 32 );
+	bs.fat_sectors         = SuperblockReader::le16( sector + 22 );
+	// FAT32 BPB, with the extended fields from offset 64 rather than 36
+	bool fat32_bpb = ( bs.fat_sectors == 0 );
+	if ( fat32_bpb )
+		bs.fat_sectors = SuperblockReader::le32( sector + 36 );
+	bs.root_entries  = root_entries;
+	bs.root_cluster  = fat32_bpb ? SuperblockReader::le32( sector + 44 ) : 0;
+	bs.fsinfo_sector = fat32_bpb ? SuperblockReader::le16( sector + 48 ) : 0;
+	unsigned int ext_bpb = fat32_bpb ? 64 : 36;
+	bs.have_serial   = ( sector[ext_bpb+2] == 0x29 || sector[ext_bpb+2] == 0x28 );
+	bs.serial        = SuperblockReader::le32( sector + ext_bpb + 3 );
+
+	if (    bs.bytes_per_sector < 512 || bs.bytes_per_sector > 4096
+	     || ( bs.bytes_per_sector & ( bs.bytes_per_sector - 1 ) ) != 0
+	     || bs.sectors_per_cluster == 0
+	     || ( bs.sectors_per_cluster & ( bs.sectors_per_cluster - 1 ) ) != 0
+	     || bs.reserved_sectors == 0
+	     || bs.num_fats == 0
+	     || bs.fat_sectors == 0                                               )
+		return false;
+
+	Byte_Value root_dir_sectors = ( root_entries * 32 + bs.bytes_per_sector - 1 ) / bs.bytes_per_sector;
+	bs.first_data_sector = bs.reserved_sectors + bs.num_fats * bs.fat_sectors + root_dir_sectors;
+	if ( bs.first_data_sector >= bs.total_sectors )
+		return false;
+	bs.clusters = ( bs.total_sectors - bs.first_data_sector ) / bs.sectors_per_cluster;
+
+	// The FAT type is determined solely by the number of clusters.
+	if ( bs.clusters < 4085 )
+		bs.fat_bits = 12;
+	else if ( bs.clusters < 65525 )
+		bs.fat_bits = 16;
+	else
+		bs.fat_bits = 32;
+
+	// The FAT must be big enough for all the clusters.
+	if ( ( ( (Byte_Value)bs.clusters + 2 ) * bs.fat_bits + 7 ) / 8 > bs.fat_sectors * bs.bytes_per_sector )
+		return false;
+
+	return true;
+}
+
+// Return FAT entry index from a buffer holding part of the FAT.  FAT12 entries are
+// packed two into three bytes.
+unsigned long fat16::fat_entry( const unsigned char * fat, unsigned int fat_bits, unsigned long index )
+{
+	if ( fat_bits == 12 )
+	{
+		unsigned int pair = SuperblockReader::le16( fat + index * 3 / 2 );
+		return index & 1 ? pair >> 4 : pair & 0xFFF;
+	}
+	if ( fat_bits == 16 )
+		return SuperblockReader::le16( fat + index * 2 );
+	return SuperblockReader::le32( fat + index * 4 ) & 0x0FFFFFFFUL;
+}
+
+// Read the size and free space of the file system.  Sets T to the file system size, N to
+// the free space and S to the cluster size, all in bytes.  The size is exact rather than
+// rounded to clusters as the data area rarely ends on a cluster boundary.
+bool fat16::read_usage( const Glib::ustring & path, Byte_Value & T, Byte_Value & N, Byte_Value & S )
+{
+	int fd = open( path.c_str(), O_RDONLY );
+	if ( fd < 0 )
+		return false;
+
+	BootSector bs;
+	unsigned long free_clusters = 0;
+	bool success = read_boot_sector( fd, 0, bs ) &&
+	               ( read_fsinfo_free_clusters( fd, bs, free_clusters ) ||
+	                 count_free_clusters( fd, bs, free_clusters )            );
+	close( fd );
+	if ( ! success )
+		return false;
+
+	S = (Byte_Value)bs.sectors_per_cluster * bs.bytes_per_sector;
+	T = bs.total_sectors * bs.bytes_per_sector;
+	N = (Byte_Value)free_clusters * S;
+	return true;
+}
+
+// Read the free cluster count kept in the FAT32 FSInfo sector.  Returns false when there
+// is no FSInfo sector or the count isn't known.
+// Reference:
+//     Microsoft Extensible Firmware Initiative FAT32 File System Specification,
+//     FAT32 FSInfo Sector Structure and Backup Boot Sector
+bool fat16::read_fsinfo_free_clusters( int fd, const BootSector & bs, unsigned long & free_clusters )
+{
+	if ( bs.fat_bits != 32 || bs.fsinfo_sector == 0 || bs.fsinfo_sector >= bs.reserved_sectors )
+		return false;
+
+	unsigned char sector[512];
+	if ( pread( fd, sector, sizeof( sector ), (Byte_Value)bs.fsinfo_sector * bs.bytes_per_sector )
+	     != sizeof( sector ) )
+		return false;
+	if (    SuperblockReader::le32( sector )       != 0x41615252UL
+	     || SuperblockReader::le32( sector + 484 ) != 0x61417272UL
+	     || SuperblockReader::le32( sector + 508 ) != 0xAA550000UL )
+		return false;
+
+	// 0xFFFFFFFF means the count is not known
+	free_clusters = SuperblockReader::le32( sector + 488 );
+	return free_clusters <= bs.clusters;
+}
+
+// Count the zero entries in a run of FAT16 or FAT32 entries, a 64-bit word at a time.
+// The top bit of each entry is set when any other bit is, without carrying into the next
+// entry, then the top bits which are still clear are counted.  The top 4 bits of FAT32
+// entries are reserved so are masked off first.  Works with either host byte order as
+// each entry is tested for zero as a whole.
+static unsigned long count_zero_entries( const unsigned char * fat, unsigned long words, unsigned int fat_bits )
+{
+	static const unsigned char fat32_mask_bytes[8] = { 0xFF, 0xFF, 0xFF, 0x0F, 0xFF, 0xFF, 0xFF, 0x0F };
+	unsigned long long mask;
+	unsigned long long low;
+	unsigned long long high;
+	unsigned long long sum;
+	unsigned int shift;
+	if ( fat_bits == 16 )
+	{
+		mask  = ~0ULL;
+		low   = 0x7FFF7FFF7FFF7FFFULL;
+		high  = 0x8000800080008000ULL;
+		sum   = 0x0001000100010001ULL;
+		shift = 48;
+	}
+	else
+	{
+		memcpy( &mask, fat32_mask_bytes, sizeof( mask ) );
+		low   = 0x7FFFFFFF7FFFFFFFULL;
+		high  = 0x8000000080000000ULL;
+		sum   = 0x0000000100000001ULL;
+		shift = 32;
+	}
+
+	unsigned long zeros = 0;
+	for ( unsigned long i = 0 ; i < words ; i ++ )
+	{
+		unsigned long long word;
+		memcpy( &word, fat + i * sizeof( word ), sizeof( word ) );
+		word &= mask;
+		unsigned long long nonzero = ( ( word & low ) + low ) | word;
+		// Multiplying sums the zero flags, one per entry, into the top entry.
+		zeros += ( ( ( ~nonzero & high ) >> ( fat_bits - 1 ) ) * sum ) >> shift;
+	}
+	return zeros;
+}
+
+// Count the free clusters by scanning the first FAT.
+bool fat16::count_free_clusters( int fd, const BootSector & bs, unsigned long & free_clusters )
+{
+	Byte_Value fat_offset = (Byte_Value)bs.reserved_sectors * bs.bytes_per_sector;
+	Byte_Value fat_bytes = ( ( (Byte_Value)bs.clusters + 2 ) * bs.fat_bits + 7 ) / 8;
+	unsigned long entries_per_read = FAT_READ_SIZE * 8 / bs.fat_bits;
+	unsigned long end = bs.clusters + 2;
+	std::vector<unsigned char> buf( FAT_READ_SIZE );
+	free_clusters = 0;
+	for ( unsigned long first = 0 ; first < end ; first += entries_per_read )
+	{
+		Byte_Value pos = (Byte_Value)first * bs.fat_bits / 8;
+		Byte_Value count = std::min( FAT_READ_SIZE, fat_bytes - pos );
+		if ( pread( fd, &buf[0], count, fat_offset + pos ) != count )
+			return false;
+
+		unsigned long last = std::min( first + entries_per_read, end );
+		unsigned long index = first;
+		if ( bs.fat_bits != 12 )
+		{
+			unsigned long entries_per_word = 64 / bs.fat_bits;
+			unsigned long words = ( last - first ) / entries_per_word;
+			free_clusters += count_zero_entries( &buf[0], words, bs.fat_bits );
+			index += words * entries_per_word;
+		}
+		for ( ; index < last ; index ++ )
+			if ( fat_entry( &buf[0], bs.fat_bits, index - first ) == 0 )
+				free_clusters ++;
+
+		// Entries 0 and 1 are reserved rather than clusters
+		if ( first == 0 )
+		{
+			for ( index = 0 ; index < 2 ; index ++ )
+				if ( fat_entry( &buf[0], bs.fat_bits, index ) == 0 )
+					free_clusters --;
+		}
+	}
+	return true;
+}
+
+// Read the volume label from the root directory, which is where mlabel reads it from.
+// An empty label is returned when there is no volume label entry.  Returns false when the
+// directory can't be read or the label isn't plain ASCII, which mlabel would convert
+// from the DOS code page.
+bool fat16::read_volume_label( int fd, const BootSector & bs, Glib::ustring & label )
+{
+	label.clear();
+	Byte_Value cluster_size = (Byte_Value)bs.sectors_per_cluster * bs.bytes_per_sector;
+	Byte_Value fat_offset = (Byte_Value)bs.reserved_sectors * bs.bytes_per_sector;
+	unsigned long cluster = bs.root_cluster;
+	std::vector<unsigned char> dir;
+	// Limit the clusters followed in case the chain loops
+	for ( unsigned long n = 0 ; n < bs.clusters ; n ++ )
+	{
+		Byte_Value dir_offset;
+		Byte_Value dir_size;
+		if ( bs.root_cluster == 0 )
+		{
+			// FAT12/16 root directory follows the FATs
+			dir_offset = fat_offset + (Byte_Value)bs.num_fats * bs.fat_sectors * bs.bytes_per_sector;
+			dir_size = (Byte_Value)bs.root_entries * 32;
+		}
+		else
+		{
+			if ( bs.fat_bits != 32 || cluster < 2 || cluster >= bs.clusters + 2 )
+				return false;
+			dir_offset = bs.first_data_sector * bs.bytes_per_sector + ( cluster - 2 ) * cluster_size;
+			dir_size = cluster_size;
+		}
+
+		dir.resize( dir_size );
+		if ( dir_size > 0 && pread( fd, &dir[0], dir_size, dir_offset ) != dir_size )
+			return false;
+		for ( Byte_Value pos = 0 ; pos + 32 <= dir_size ; pos += 32 )
+		{
+			const unsigned char * entry = &dir[pos];
+			if ( entry[0] == 0x00 )
+				// End of directory
+				return true;
+			unsigned char attr = entry[11];
+			if ( entry[0] == 0xE5 || attr == 0x0F || ! ( attr & 0x08 ) )
+				// Deleted, long file name or not the volume label
+				continue;
+
+			for ( unsigned int i = 0 ; i < 11 ; i ++ )
+				if ( entry[i] < 0x20 || entry[i] >= 0x80 )
+					return false;
+			label = Utils::trim( Glib::ustring( reinterpret_cast<const char *>( entry ), 11 ) );
+			return true;
+		}
+
+		if ( bs.root_cluster == 0 )
+			return true;
+		unsigned char next[4];
+		if ( pread( fd, next, sizeof( next ), fat_offset + (Byte_Value)cluster * 4 ) != sizeof( next ) )
+			return false;
+		cluster = SuperblockReader::le32( next ) & 0x0FFFFFFFUL;
+		if ( cluster >= 0x0FFFFFF8UL )
+			// End of the root directory cluster chain
+			return true;
+	}
+	return false;
+}
+
 const Glib::ustring fat16::sanitize_label( const Glib::ustring &label ) const
 {
 	Glib::ustring uppercase_label = label.uppercase();
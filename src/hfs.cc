@@ -18,6 +18,11 @@
 #include "hfs.h"
 #include "FileSystem.h"
 #include "Partition.h"
+#include "SuperblockReader.h"
+#include "Utils.h"
+
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace GParted
 {
@@ -27,9 +32,9 @@ FS hfs::get_filesystem_support()
 	FS fs( FS_HFS );
 
 	fs .busy = FS::GPARTED ;
+	fs .read = FS::EXTERNAL ;
 
 #ifdef HAVE_LIBPARTED_FS_RESIZE
-	fs .read = GParted::FS::LIBPARTED ;
 	fs .shrink = GParted::FS::LIBPARTED ;
 #endif
 
@@ -51,6 +56,60 @@ FS hfs::get_filesystem_support()
 	return fs ;
 }
 
+void hfs::set_used_sectors( Partition & partition )
+{
+	int fd = open( partition.get_path().c_str(), O_RDONLY );
+	if ( fd < 0 )
+		return;
+	MasterDirectoryBlock mdb;
+	bool success = read_mdb( fd, 0, mdb );
+	close( fd );
+	if ( ! success )
+		return;
+
+	partition.set_sector_usage( volume_size( mdb ) / partition.sector_size,
+	                            (Byte_Value)mdb.free_blocks * mdb.block_size / partition.sector_size );
+	partition.fs_block_size = mdb.block_size;
+}
+
+// Read the HFS Master Directory Block of the volume starting at offset.  Also used to
+// find the HFS+ volume embedded in an HFS wrapper.
+// Reference:
+//     Inside Macintosh: Files, 2-61 Master Directory Blocks
+bool hfs::read_mdb( int fd, Byte_Value offset, MasterDirectoryBlock & mdb )
+{
+	unsigned char buf[512];
+	if ( pread( fd, buf, sizeof( buf ), offset + 1024 ) != sizeof( buf ) )
+		return false;
+	if ( buf[0] != 'B' || buf[1] != 'D' )
+		return false;
+
+	mdb.total_blocks   = SuperblockReader::be16( buf + 18 );
+	mdb.block_size     = SuperblockReader::be32( buf + 20 );
+	mdb.first_block    = SuperblockReader::be16( buf + 28 );
+	mdb.free_blocks    = SuperblockReader::be16( buf + 34 );
+	mdb.embedded       = ( buf[124] == 'H' && buf[125] == '+' );
+	mdb.embed_start    = SuperblockReader::be16( buf + 126 );
+	mdb.embed_count    = SuperblockReader::be16( buf + 128 );
+
+	// The allocation block size is a multiple of 512 bytes but not necessarily a
+	// power of two.
+	if (    mdb.block_size == 0 || mdb.block_size % 512 != 0
+	     || mdb.total_blocks == 0 || mdb.free_blocks > mdb.total_blocks )
+		return false;
+	if ( mdb.embedded && (unsigned long)mdb.embed_start + mdb.embed_count > mdb.total_blocks )
+		return false;
+
+	return true;
+}
+
+// Size of the volume from the start of the first allocation block, in 512 byte
+// sectors, to the end of the last plus the alternate MDB and the reserved sector after.
+Byte_Value hfs::volume_size( const MasterDirectoryBlock & mdb )
+{
+	return (Byte_Value)mdb.first_block * 512 + (Byte_Value)mdb.total_blocks * mdb.block_size + 1024;
+}
+
 bool hfs::create( const Partition & new_partition, OperationDetail & operationdetail )
 {
 	Glib::ustring cmd = "";
@@ -16,8 +16,14 @@
  */
 
 #include "hfsplus.h"
+#include "hfs.h"
 #include "FileSystem.h"
 #include "Partition.h"
+#include "SuperblockReader.h"
+#include "Utils.h"
+
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace GParted
 {
@@ -27,9 +33,9 @@ FS hfsplus::get_filesystem_support()
 	FS fs( FS_HFSPLUS );
 
 	fs .busy = FS::GPARTED ;
+	fs .read = FS::EXTERNAL ;
 
 #ifdef HAVE_LIBPARTED_FS_RESIZE
-	fs .read = GParted::FS::LIBPARTED ;
 	fs .shrink = GParted::FS::LIBPARTED ;
 #endif
 
@@ -49,6 +55,64 @@ FS hfsplus::get_filesystem_support()
 	return fs ;
 }
 
+void hfsplus::set_used_sectors( Partition & partition )
+{
+	Byte_Value T = -1, N = -1, S = -1;
+	if ( read_usage( partition.get_path(), T, N, S ) )
+	{
+		partition.set_sector_usage( T / partition.sector_size, N / partition.sector_size );
+		partition.fs_block_size = S;
+	}
+}
+
+// Private methods
+
+// Read the size and free space of the volume.  Sets T to the volume size, N to the free
+// space and S to the allocation block size, all in bytes.  For an HFS+ volume embedded in
+// an HFS wrapper the size is that of the wrapper, which the embedded volume fills.
+// Reference:
+//     Apple Technical Note TN1150, HFS Plus Volumes, Volume Header and HFS Wrapper
+bool hfsplus::read_usage( const Glib::ustring & path, Byte_Value & T, Byte_Value & N, Byte_Value & S )
+{
+	int fd = open( path.c_str(), O_RDONLY );
+	if ( fd < 0 )
+		return false;
+
+	Byte_Value offset = 0;
+	Byte_Value wrapper_size = -1;
+	hfs::MasterDirectoryBlock mdb;
+	if ( hfs::read_mdb( fd, 0, mdb ) )
+	{
+		if ( ! mdb.embedded )
+		{
+			close( fd );
+			return false;
+		}
+		offset = (Byte_Value)mdb.first_block * 512 + (Byte_Value)mdb.embed_start * mdb.block_size;
+		wrapper_size = hfs::volume_size( mdb );
+	}
+
+	unsigned char buf[512];
+	bool success = ( pread( fd, buf, sizeof( buf ), offset + 1024 ) == sizeof( buf ) );
+	close( fd );
+	if ( ! success )
+		return false;
+	if ( buf[0] != 'H' || ( buf[1] != '+' && buf[1] != 'X' ) )
+		return false;
+
+	unsigned long block_size   = SuperblockReader::be32( buf + 40 );
+	unsigned long total_blocks = SuperblockReader::be32( buf + 44 );
+	unsigned long free_blocks  = SuperblockReader::be32( buf + 48 );
+	if (    block_size < 512 || ( block_size & ( block_size - 1 ) ) != 0
+	     || total_blocks == 0 || free_blocks > total_blocks               )
+		return false;
+
+	S = block_size;
+	T = wrapper_size > -1 ? wrapper_size : (Byte_Value)total_blocks * block_size;
+	N = (Byte_Value)free_blocks * block_size;
+	return N <= T;
+}
+
 bool hfsplus::create( const Partition & new_partition, OperationDetail & operationdetail )
 {
 	Glib::ustring cmd = "";
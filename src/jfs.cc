@@ -18,24 +18,61 @@
 #include "jfs.h"
 #include "FileSystem.h"
 #include "Partition.h"
+#include "SuperblockReader.h"
 
 namespace GParted
 {
 
+// Reference:
+//     linux/fs/jfs/jfs_superblock.h, struct jfs_superblock
+const SuperblockLayout JFS_LAYOUT =
+{
+	32 * KIBIBYTE, 184, SB_LITTLE_ENDIAN,
+	{ 0, 4 }, "JFS1",                      // s_magic
+	{ 0, 0 },                              // Size and free space are in the block map
+	{ 0, 0 },
+	{ 16, 4 }, SB_BLOCK_SIZE_BYTES,        // s_bsize
+	{ 152, 16 },                           // s_label
+	{ 136, 16 }                            // s_uuid
+};
+const SuperblockField JFS_SB_VERSION = { 4, 4 };
+const SuperblockField JFS_SB_FPACK   = { 101, 11 };  // Label in version 1
+
+// The block map is described by the third inode in the aggregate inode table, which is
+// at a fixed location.  Its data starts with the block map control page.
+// Reference:
+//     linux/fs/jfs/jfs_filsys.h, jfs_dinode.h, jfs_xtree.h, jfs_types.h and jfs_dmap.h
+const Byte_Value   JFS_AITBL_OFFSET    = 44 * KIBIBYTE;
+const unsigned int JFS_INODE_SIZE      = 512;
+const unsigned int JFS_BMAP_INODE      = 2;
+const size_t       JFS_DI_NUMBER       = 8;
+const size_t       JFS_DI_XTROOT       = 224;
+const size_t       JFS_XT_FLAG         = 16;
+const size_t       JFS_XT_NEXTINDEX    = 18;
+const unsigned int JFS_XT_ENTRY_START  = 2;
+const size_t       JFS_XAD_SIZE        = 16;
+const unsigned int JFS_BT_LEAF         = 0x02;
+const size_t       JFS_DN_MAPSIZE      = 0;
+const size_t       JFS_DN_NFREE        = 8;
+
 FS jfs::get_filesystem_support()
 {
 	FS fs( FS_JFS );
 
 	fs .busy = FS::GPARTED ;
 
-	if ( ! Glib::find_program_in_path( "jfs_debugfs" ) .empty() ) {
-		fs .read = GParted::FS::EXTERNAL ;
-	}
-	
-	if ( ! Glib::find_program_in_path( "jfs_tune" ) .empty() ) {
-		fs .read_label = FS::EXTERNAL ;
+	// Usage, label and UUID are read from the superblock and block map directly,
+	// falling back on jfs_debugfs and jfs_tune.
+	fs .read = GParted::FS::EXTERNAL ;
+	fs .read_label = FS::EXTERNAL ;
+	fs .read_uuid = FS::EXTERNAL ;
+
+	jfs_debugfs_found = ! Glib::find_program_in_path( "jfs_debugfs" ).empty();
+
+	jfs_tune_found = ! Glib::find_program_in_path( "jfs_tune" ).empty();
+	if ( jfs_tune_found )
+	{
 		fs .write_label = FS::EXTERNAL ;
-		fs .read_uuid = FS::EXTERNAL ;
 		fs .write_uuid = FS::EXTERNAL ;
 	}
 
@@ -76,6 +113,23 @@ FS jfs::get_filesystem_support()
 
 void jfs::set_used_sectors( Partition & partition ) 
 {
+	Glib::ustring output, error;
+	Sector T = -1, N = -1, S = -1;
+	SuperblockInfo info;
+	Sector map_size;
+	Sector free_blocks;
+	if (    read_superblock( partition.get_path(), info )
+	     && read_block_map( partition.get_path(), info.block_size, map_size, free_blocks ) )
+	{
+		T = Utils::round( map_size * ( info.block_size / double(partition.sector_size) ) );
+		N = Utils::round( free_blocks * ( info.block_size / double(partition.sector_size) ) );
+		partition.set_sector_usage( T, N );
+		partition.fs_block_size = info.block_size;
+		return;
+	}
+	if ( ! jfs_debugfs_found )
+		return;
+
 	const Glib::ustring jfs_debug_cmd = "echo dm | jfs_debugfs " + Glib::shell_quote( partition.get_path() );
 	if ( ! Utils::execute_command( "sh -c " + Glib::shell_quote( jfs_debug_cmd ), output, error, true ) )
 	{
@@ -117,6 +171,16 @@ void jfs::set_used_sectors( Partition & partition )
 
 void jfs::read_label( Partition & partition )
 {
+	Glib::ustring output, error;
+	SuperblockInfo info;
+	if ( read_superblock( partition.get_path(), info ) )
+	{
+		partition.set_filesystem_label( info.label );
+		return;
+	}
+	if ( ! jfs_tune_found )
+		return;
+
 	if ( ! Utils::execute_command( "jfs_tune -l " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                       )
 	{
@@ -141,6 +205,16 @@ bool jfs::write_label( const Partition & partition, OperationDetail & operationd
 
 void jfs::read_uuid( Partition & partition )
 {
+	Glib::ustring output, error;
+	SuperblockInfo info;
+	if ( read_superblock( partition.get_path(), info ) )
+	{
+		partition.uuid = info.uuid;
+		return;
+	}
+	if ( ! jfs_tune_found )
+		return;
+
 	if ( ! Utils::execute_command( "jfs_tune -l " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                       )
 	{
@@ -206,11 +280,76 @@ bool jfs::resize( const Partition & partition_new, OperationDetail & operationde
 
 bool jfs::check_repair( const Partition & partition, OperationDetail & operationdetail )
 {
-	exit_status = execute_command( "jfs_fsck -f " + Glib::shell_quote( partition.get_path() ),
-	                               operationdetail, EXEC_CANCEL_SAFE );
+	int exit_status = execute_command( "jfs_fsck -f " + Glib::shell_quote( partition.get_path() ),
+	                                   operationdetail, EXEC_CANCEL_SAFE );
 	bool success = ( exit_status == 0 || exit_status == 1 );
 	set_status( operationdetail, success );
 	return success;
 }
 
+//Private methods
+
+bool jfs::read_superblock( const Glib::ustring & path, SuperblockInfo & info )
+{
+	SuperblockReader reader( JFS_LAYOUT.byte_order );
+	unsigned long long version;
+	if (    ! reader.read( path, JFS_LAYOUT.offset, JFS_LAYOUT.size )
+	     || ! reader.decode( JFS_LAYOUT, info )
+	     || ! reader.get_uint( JFS_SB_VERSION, version )            )
+		return false;
+
+	// As jfs_tune reports, version 1 file systems keep the label in s_fpack
+	if ( version == 1 && ! reader.get_string( JFS_SB_FPACK, info.label ) )
+		return false;
+	return true;
+}
+
+// Read the size of the file system and number of free blocks from the block map control
+// page, as jfs_debugfs dm reports them.  Only a block map inode with the control page
+// in its xtree root is handled.
+bool jfs::read_block_map( const Glib::ustring & path, Byte_Value block_size,
+                          Sector & map_size, Sector & free_blocks )
+{
+	SuperblockReader reader( SB_LITTLE_ENDIAN );
+	unsigned long long number;
+	unsigned long long flag;
+	unsigned long long next_index;
+	if (    ! reader.read( path, JFS_AITBL_OFFSET + JFS_BMAP_INODE * JFS_INODE_SIZE, JFS_INODE_SIZE )
+	     || ! reader.get_uint( JFS_DI_NUMBER, 4, number )
+	     || ! reader.get_uint( JFS_DI_XTROOT + JFS_XT_FLAG, 1, flag )
+	     || ! reader.get_uint( JFS_DI_XTROOT + JFS_XT_NEXTINDEX, 2, next_index ) )
+		return false;
+	if ( number != JFS_BMAP_INODE || ! ( flag & JFS_BT_LEAF ) )
+		return false;
+
+	// Find the extent at offset 0 of the block map
+	for ( unsigned int i = JFS_XT_ENTRY_START ; i < next_index ; i ++ )
+	{
+		size_t xad = JFS_DI_XTROOT + i * JFS_XAD_SIZE;
+		unsigned long long off1;
+		unsigned long long off2;
+		unsigned long long len_addr;
+		unsigned long long addr2;
+		if (    ! reader.get_uint( xad + 3, 1, off1 )
+		     || ! reader.get_uint( xad + 4, 4, off2 )
+		     || ! reader.get_uint( xad + 8, 4, len_addr )
+		     || ! reader.get_uint( xad + 12, 4, addr2 )   )
+			return false;
+		if ( off1 != 0 || off2 != 0 )
+			continue;
+
+		Byte_Value control_page = (Byte_Value)( ( len_addr >> 24 ) << 32 | addr2 ) * block_size;
+		unsigned long long mapsize;
+		unsigned long long nfree;
+		if (    ! reader.read( path, control_page, JFS_DN_NFREE + 8 )
+		     || ! reader.get_uint( JFS_DN_MAPSIZE, 8, mapsize )
+		     || ! reader.get_uint( JFS_DN_NFREE, 8, nfree )           )
+			return false;
+		map_size = mapsize;
+		free_blocks = nfree;
+		return map_size > 0 && free_blocks >= 0 && free_blocks <= map_size;
+	}
+	return false;
+}
+
 } //GParted
@@ -19,12 +19,29 @@
 #include "BlockSpecial.h"
 #include "FileSystem.h"
 #include "Partition.h"
+#include "SuperblockReader.h"
 
 #include <cerrno>
 
 namespace GParted
 {
 
+// The swap header fills the first page, with the signature at the end of the page, so
+// try each page size Linux uses.
+// Reference:
+//     linux/include/linux/swap.h, union swap_header
+const SuperblockLayout SWAP_LAYOUTS[] =
+{
+	{ 0,  4096, SB_LITTLE_ENDIAN, {  4096 - 10, 10 }, "SWAPSPACE2", { 0, 0 }, { 0, 0 }, { 0, 0 }, SB_BLOCK_SIZE_BYTES,
+	  { 1052, 16 }, { 1036, 16 } },
+	{ 0,  8192, SB_LITTLE_ENDIAN, {  8192 - 10, 10 }, "SWAPSPACE2", { 0, 0 }, { 0, 0 }, { 0, 0 }, SB_BLOCK_SIZE_BYTES,
+	  { 1052, 16 }, { 1036, 16 } },
+	{ 0, 16384, SB_LITTLE_ENDIAN, { 16384 - 10, 10 }, "SWAPSPACE2", { 0, 0 }, { 0, 0 }, { 0, 0 }, SB_BLOCK_SIZE_BYTES,
+	  { 1052, 16 }, { 1036, 16 } },
+	{ 0, 65536, SB_LITTLE_ENDIAN, { 65536 - 10, 10 }, "SWAPSPACE2", { 0, 0 }, { 0, 0 }, { 0, 0 }, SB_BLOCK_SIZE_BYTES,
+	  { 1052, 16 }, { 1036, 16 } }
+};
+
 const Glib::ustring linux_swap::get_custom_text( CUSTOM_TEXT ttype, int index ) const
 {
 	/*TO TRANSLATORS: these labels will be used in the partition menu */
@@ -59,11 +76,15 @@ FS linux_swap::get_filesystem_support()
 		fs.move = FS::EXTERNAL;
 	}
 
-	if ( ! Glib::find_program_in_path( "swaplabel" ) .empty() )
+	// Label and UUID are read from the swap header directly, falling back on
+	// swaplabel.
+	fs .read_label = FS::EXTERNAL ;
+	fs .read_uuid = FS::EXTERNAL ;
+
+	swaplabel_found = ! Glib::find_program_in_path( "swaplabel" ).empty();
+	if ( swaplabel_found )
 	{
-		fs .read_label = FS::EXTERNAL ;
 		fs .write_label = FS::EXTERNAL ;
-		fs .read_uuid = FS::EXTERNAL ;
 		fs .write_uuid = FS::EXTERNAL ;
 	}
 
@@ -72,6 +93,7 @@ FS linux_swap::get_filesystem_support()
 
 void linux_swap::set_used_sectors( Partition & partition )
 {
+	Sector T = -1, N = -1;
 	if ( partition .busy )
 	{
 		N = -1;
@@ -116,6 +138,16 @@ void linux_swap::set_used_sectors( Partition & partition )
 
 void linux_swap::read_label( Partition & partition )
 {
+	Glib::ustring output, error;
+	SuperblockInfo info;
+	if ( read_swap_header( partition.get_path(), info ) )
+	{
+		partition.set_filesystem_label( info.label );
+		return;
+	}
+	if ( ! swaplabel_found )
+		return;
+
 	if ( ! Utils::execute_command( "swaplabel " + Glib::shell_quote( partition.get_path() ), output, error, true ) )
 	{
 		partition.set_filesystem_label( Utils::regexp_label( output, "^LABEL:[[:blank:]]*(.*)$" ) );
@@ -139,6 +171,16 @@ bool linux_swap::write_label( const Partition & partition, OperationDetail & ope
 
 void linux_swap::read_uuid( Partition & partition )
 {
+	Glib::ustring output, error;
+	SuperblockInfo info;
+	if ( read_swap_header( partition.get_path(), info ) )
+	{
+		partition.uuid = info.uuid;
+		return;
+	}
+	if ( ! swaplabel_found )
+		return;
+
 	if ( ! Utils::execute_command( "swaplabel " + Glib::shell_quote( partition.get_path() ), output, error, true ) )
 	{
 		partition .uuid = Utils::regexp_label( output, "^UUID:[[:blank:]]*(" RFC4122_NONE_NIL_UUID_REGEXP ")" ) ;
@@ -217,4 +259,14 @@ bool linux_swap::copy( const Partition & src_part,
 	return true ;
 }
 
+//Private methods
+
+bool linux_swap::read_swap_header( const Glib::ustring & path, SuperblockInfo & info )
+{
+	for ( unsigned int i = 0 ; i < sizeof( SWAP_LAYOUTS ) / sizeof( SWAP_LAYOUTS[0] ) ; i ++ )
+		if ( SuperblockReader::read_superblock( path, SWAP_LAYOUTS[i], info ) )
+			return true;
+	return false;
+}
+
 } //GParted
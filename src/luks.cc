@@ -65,6 +65,8 @@ bool luks::is_busy( const Glib::ustring & path )
 
 void luks::set_used_sectors( Partition & partition )
 {
+	Sector T = -1;
+
 	// Rational for how used, unused and unallocated are set for LUKS partitions
 	//
 	// A LUKS formatted partition has metadata at the start, followed by the encrypted
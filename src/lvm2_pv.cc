@@ -79,6 +79,7 @@ bool lvm2_pv::is_busy( const Glib::ustring & path )
 
 void lvm2_pv::set_used_sectors( Partition & partition )
 {
+	Sector T = -1, N = -1;
 	T = (Sector) LVM2_PV_Info::get_size_bytes( partition.get_path() );
 	N = (Sector) LVM2_PV_Info::get_free_bytes( partition.get_path() );
 	if ( T > -1 && N > -1 )
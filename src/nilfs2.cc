@@ -17,10 +17,25 @@
 #include "nilfs2.h"
 #include "FileSystem.h"
 #include "Partition.h"
+#include "SuperblockReader.h"
 
 namespace GParted
 {
 
+// Reference:
+//     linux/include/uapi/linux/nilfs2_ondisk.h, struct nilfs_super_block
+const SuperblockLayout NILFS2_LAYOUT =
+{
+	1024, 248, SB_LITTLE_ENDIAN,
+	{ 6, 2 }, "\x34\x34",                  // s_magic 0x3434
+	{ 0, 0 },                              // Size is s_dev_size in bytes instead
+	{ 80, 8 },                             // s_free_blocks_count
+	{ 20, 4 }, SB_BLOCK_SIZE_LOG2_KIB,     // s_log_block_size
+	{ 168, 80 },                           // s_volume_name
+	{ 152, 16 }                            // s_uuid
+};
+const SuperblockField NILFS2_SB_DEV_SIZE = { 32, 8 };
+
 FS nilfs2::get_filesystem_support()
 {
 	FS fs( FS_NILFS2 );
@@ -33,12 +48,16 @@ FS nilfs2::get_filesystem_support()
 		fs .create_with_label = GParted::FS::EXTERNAL ;
 	}
 
-	if ( ! Glib::find_program_in_path( "nilfs-tune" ) .empty() )
+	// Usage, label and UUID are read from the superblock directly, falling back on
+	// nilfs-tune.
+	fs .read = GParted::FS::EXTERNAL ;
+	fs .read_label = GParted::FS::EXTERNAL ;
+	fs .read_uuid = GParted::FS::EXTERNAL ;
+
+	nilfs_tune_found = ! Glib::find_program_in_path( "nilfs-tune" ).empty();
+	if ( nilfs_tune_found )
 	{
-		fs .read = GParted::FS::EXTERNAL ;
-		fs .read_label = GParted::FS::EXTERNAL ;
 		fs .write_label = GParted::FS::EXTERNAL ;
-		fs .read_uuid = GParted::FS::EXTERNAL ;
 		fs .write_uuid = GParted::FS::EXTERNAL ;
 	}
 
@@ -74,6 +93,21 @@ FS nilfs2::get_filesystem_support()
 
 void nilfs2::set_used_sectors( Partition & partition )
 {
+	Glib::ustring output, error;
+	Sector T = -1, N = -1, S = -1;
+	SuperblockInfo info;
+	Byte_Value dev_size;
+	if ( read_superblock( partition.get_path(), info, dev_size ) )
+	{
+		T = Utils::round( dev_size / double(partition.sector_size) );
+		N = Utils::round( info.free_blocks * ( info.block_size / double(partition.sector_size) ) );
+		partition.set_sector_usage( T, N );
+		partition.fs_block_size = info.block_size;
+		return;
+	}
+	if ( ! nilfs_tune_found )
+		return;
+
 	if ( ! Utils::execute_command( "nilfs-tune -l " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                         )
 	{
@@ -117,6 +151,17 @@ void nilfs2::set_used_sectors( Partition & partition )
 
 void nilfs2::read_label( Partition & partition )
 {
+	Glib::ustring output, error;
+	SuperblockInfo info;
+	Byte_Value dev_size;
+	if ( read_superblock( partition.get_path(), info, dev_size ) )
+	{
+		partition.set_filesystem_label( info.label );
+		return;
+	}
+	if ( ! nilfs_tune_found )
+		return;
+
 	if ( ! Utils::execute_command( "nilfs-tune -l " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                         )
 	{
@@ -145,6 +190,17 @@ bool nilfs2::write_label( const Partition & partition, OperationDetail & operati
 
 void nilfs2::read_uuid( Partition & partition )
 {
+	Glib::ustring output, error;
+	SuperblockInfo info;
+	Byte_Value dev_size;
+	if ( read_superblock( partition.get_path(), info, dev_size ) )
+	{
+		partition.uuid = info.uuid;
+		return;
+	}
+	if ( ! nilfs_tune_found )
+		return;
+
 	if ( ! Utils::execute_command( "nilfs-tune -l " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                         )
 	{
@@ -212,4 +268,19 @@ bool nilfs2::resize( const Partition & partition_new, OperationDetail & operatio
 	return success ;
 }
 
+//Private methods
+
+bool nilfs2::read_superblock( const Glib::ustring & path, SuperblockInfo & info, Byte_Value & dev_size )
+{
+	SuperblockReader reader( NILFS2_LAYOUT.byte_order );
+	unsigned long long value;
+	if (    ! reader.read( path, NILFS2_LAYOUT.offset, NILFS2_LAYOUT.size )
+	     || ! reader.decode( NILFS2_LAYOUT, info )
+	     || ! reader.get_uint( NILFS2_SB_DEV_SIZE, value )                  )
+		return false;
+
+	dev_size = value;
+	return dev_size > 0 && info.free_blocks * info.block_size <= dev_size;
+}
+
 } //GParted
@@ -19,13 +19,25 @@
 #include "FileSystem.h"
 #include "OperationDetail.h"
 #include "Partition.h"
+#include "SuperblockReader.h"
 #include "Utils.h"
 
 #include <glibmm/ustring.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
 
 namespace GParted
 {
 
+// Number of bytes of $Bitmap read at a time, covering 64 Gi clusters.
+const Byte_Value BITMAP_READ_SIZE = 8 * MEBIBYTE;
+
+// MFT record number of $Bitmap
+const unsigned int MFT_RECORD_BITMAP = 6;
+
 const Glib::ustring ntfs::Change_UUID_Warning [] =
 	{ _( "Changing the UUID might invalidate the Windows Product Activation (WPA) key"
 	   )
@@ -65,14 +77,17 @@ FS ntfs::get_filesystem_support()
 
 	fs .busy = FS::GPARTED ;
 
-	if ( ! Glib::find_program_in_path( "ntfsresize" ) .empty() )
-	{
-		fs .read = GParted::FS::EXTERNAL ;
+	// Usage is read from $Bitmap directly.  ntfsresize provides the minimum size
+	// when a resize or copy is prepared.
+	fs .read = GParted::FS::EXTERNAL ;
+
+	ntfsresize_found = ! Glib::find_program_in_path( "ntfsresize" ).empty();
+	if ( ntfsresize_found )
 		fs .check = GParted::FS::EXTERNAL ;
-	}
 
 	if ( ! Glib::find_program_in_path( "ntfslabel" ) .empty() ) {
 		Glib::ustring version ;
+		Glib::ustring output, error;
 
 		fs .read_label = FS::EXTERNAL ;
 		fs .write_label = FS::EXTERNAL ;
@@ -121,41 +136,62 @@ FS ntfs::get_filesystem_support()
 	return fs ;
 }
 
+// The minimum size comes from "ntfsresize --info" as, unlike the clusters allocated in
+// $Bitmap, it also accounts for the clusters it can't move, such as those of the MFT and
+// other metadata files.  It reads the whole of the MFT so is only run for an existing file
+// system when a resize or copy is being prepared, rather than every time it is probed.
+FS_Limits ntfs::get_filesystem_limits( const Partition & partition ) const
+{
+	FS_Limits limits = fs_limits;
+	if ( partition.filesystem != FS_NTFS || partition.fs_block_size <= 0 || partition.busy ||
+	     ! ntfsresize_found                                                                   )
+		return limits;
+
+	Glib::ustring output, error;
+	Byte_Value volume_size, min_size, cluster_size;
+	if ( read_ntfsresize_info( partition.get_path(), volume_size, min_size, cluster_size, output, error ) &&
+	     min_size > limits.min_size                                                                      )
+		limits.min_size = min_size;
+	return limits;
+}
+
+// File system usage is counted from $Bitmap, which is much quicker than ntfsresize
+// reading the whole of the MFT.  ntfsresize is only used when $Bitmap can't be read.
 void ntfs::set_used_sectors( Partition & partition ) 
 {
-	exit_status = Utils::execute_command( "ntfsresize --info --force --no-progress-bar " +
-	                                      Glib::shell_quote( partition.get_path() ),
-	                                      output, error, true );
-	if ( exit_status == 0 || exit_status == 1 )
+	int fd = open( partition.get_path().c_str(), O_RDONLY );
+	if ( fd >= 0 )
+	{
+		Volume vol;
+		Sector used_clusters = 0;
+		bool success = read_volume( fd, 0, vol ) && count_used_clusters( fd, 0, vol, used_clusters );
+		close( fd );
+		if ( success )
+		{
+			Sector T = vol.clusters;
+			Sector N = vol.clusters - used_clusters;
+			Byte_Value S = vol.cluster_size;
+			partition.set_sector_usage( Utils::round( T * ( S / double(partition.sector_size) ) ),
+			                            Utils::round( N * ( S / double(partition.sector_size) ) ) );
+			partition.fs_block_size = S;
+			return;
+		}
+	}
+	if ( ! ntfsresize_found )
+		return;
+
+	Glib::ustring output, error;
+	Byte_Value volume_size, min_size, cluster_size;
+	if ( read_ntfsresize_info( partition.get_path(), volume_size, min_size, cluster_size, output, error ) )
 	{
-		Glib::ustring::size_type index = output.find( "Current volume size:" );
-		if ( index >= output .length() ||
-		     sscanf( output.substr( index ).c_str(), "Current volume size: %lld", &T ) != 1 )
-			T = -1 ;
-
-		index = output .find( "resize at" ) ;
-		if ( index >= output .length() ||
-		     sscanf( output.substr( index ).c_str(), "resize at %lld", &N ) != 1 )
-			N = -1 ;
-		//For an absolutely full NTFS, "ntfsresize --info" exits
-		//  with status 1 and reports this message instead
-		index = output .find( "ERROR: Volume is full" ) ;
-		if ( index < output .length() )
-			N = T ;
-
-		index = output.find( "Cluster size" );
-		if ( index >= output.length() ||
-		     sscanf( output.substr( index ).c_str(), "Cluster size       : %lld", &S ) != 1 )
-			S = -1;
-
-		if ( T > -1 && N > -1 )
+		if ( volume_size > -1 && min_size > -1 )
 		{
-			T = Utils::round( T / double(partition .sector_size) ) ;
-			N = Utils::round( N / double(partition .sector_size) ) ;
+			Sector T = Utils::round( volume_size / double(partition.sector_size) );
+			Sector N = Utils::round( min_size / double(partition.sector_size) );
 			partition .set_sector_usage( T, T - N );
 		}
-		if ( S > -1 )
-			partition.fs_block_size = S;
+		if ( cluster_size > -1 )
+			partition.fs_block_size = cluster_size;
 	}
 	else
 	{
@@ -167,8 +203,56 @@ void ntfs::set_used_sectors( Partition & partition )
 	}
 }
 
+bool ntfs::get_used_extents( const Partition & partition, std::vector<Extent> & extents )
+{
+	int fd = open( partition.device_path.c_str(), O_RDONLY );
+	if ( fd < 0 )
+		return false;
+
+	Byte_Value partition_offset = partition.sector_start * partition.sector_size;
+	Volume vol;
+	bool success = read_volume( fd, partition_offset, vol );
+	if ( success )
+	{
+		Byte_Value bitmap_bytes = ( vol.clusters + 7 ) / 8;
+		std::vector<unsigned char> buf( std::min( BITMAP_READ_SIZE, bitmap_bytes ) );
+		for ( Byte_Value pos = 0 ; pos < bitmap_bytes ; pos += BITMAP_READ_SIZE )
+		{
+			Byte_Value count = std::min( BITMAP_READ_SIZE, bitmap_bytes - pos );
+			if ( ! read_bitmap( fd, partition_offset, vol, pos, &buf[0], count ) )
+			{
+				success = false;
+				break;
+			}
+
+			Sector last = std::min( ( pos + count ) * 8, vol.clusters );
+			for ( Sector cluster = pos * 8 ; cluster < last ; cluster ++ )
+			{
+				if ( ! ( buf[cluster / 8 - pos] & ( 1 << ( cluster % 8 ) ) ) )
+					continue;
+
+				Byte_Value offset = cluster * vol.cluster_size;
+				if ( ! extents.empty() && extents.back().offset + extents.back().length == offset )
+					extents.back().length += vol.cluster_size;
+				else
+					extents.push_back( Extent( offset, vol.cluster_size ) );
+			}
+		}
+
+		// The backup boot sector follows the last cluster
+		Byte_Value clusters_end = vol.clusters * vol.cluster_size;
+		Byte_Value volume_end = ( vol.total_sectors + 1 ) * vol.bytes_per_sector;
+		if ( volume_end > clusters_end )
+			extents.push_back( Extent( clusters_end, volume_end - clusters_end ) );
+	}
+
+	close( fd );
+	return success;
+}
+
 void ntfs::read_label( Partition & partition )
 {
+	Glib::ustring output, error;
 	if ( ! Utils::execute_command( "ntfslabel --force " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, false )                                            )
 	{
@@ -261,9 +345,302 @@ bool ntfs::check_repair( const Partition & partition, OperationDetail & operatio
 
 //Private methods
 
+// Run "ntfsresize --info" and return the volume size, minimum resize size and cluster size
+// in bytes, or -1 for those not reported.  Returns false when ntfsresize fails.
+bool ntfs::read_ntfsresize_info( const Glib::ustring & path, Byte_Value & volume_size,
+                                 Byte_Value & min_size, Byte_Value & cluster_size,
+                                 Glib::ustring & output, Glib::ustring & error )
+{
+	volume_size = min_size = cluster_size = -1;
+	int exit_status = Utils::execute_command( "ntfsresize --info --force --no-progress-bar " +
+	                                          Glib::shell_quote( path ), output, error, true );
+	if ( exit_status != 0 && exit_status != 1 )
+		return false;
+
+	Glib::ustring::size_type index = output.find( "Current volume size:" );
+	if ( index >= output .length() ||
+	     sscanf( output.substr( index ).c_str(), "Current volume size: %lld", &volume_size ) != 1 )
+		volume_size = -1;
+
+	index = output .find( "resize at" ) ;
+	if ( index >= output .length() ||
+	     sscanf( output.substr( index ).c_str(), "resize at %lld", &min_size ) != 1 )
+		min_size = -1;
+	//For an absolutely full NTFS, "ntfsresize --info" exits
+	//  with status 1 and reports this message instead
+	index = output .find( "ERROR: Volume is full" ) ;
+	if ( index < output .length() )
+		min_size = volume_size;
+
+	index = output.find( "Cluster size" );
+	if ( index >= output.length() ||
+	     sscanf( output.substr( index ).c_str(), "Cluster size       : %lld", &cluster_size ) != 1 )
+		cluster_size = -1;
+
+	return true;
+}
+
+// Read the boot sector and locate $Bitmap from its MFT record, for the file system
+// starting at byte offset in fd.  Returns false for anything unexpected so that the
+// caller can fall back on ntfsresize.
+// Reference:
+//     NTFS Documentation, Richard Russon and Yuval Fledel,
+//     Files - $Boot, $MFT, $Bitmap; Attributes - $DATA
+bool ntfs::read_volume( int fd, Byte_Value offset, Volume & vol )
+{
+	unsigned char sector[512];
+	if ( pread( fd, sector, sizeof( sector ), offset ) != sizeof( sector ) )
+		return false;
+	if ( memcmp( sector + 3, "NTFS    ", 8 ) != 0 || sector[510] != 0x55 || sector[511] != 0xAA )
+		return false;
+
+	vol.bytes_per_sector = SuperblockReader::le16( sector + 11 );
+	if (    vol.bytes_per_sector < 256 || vol.bytes_per_sector > 4096
+	     || ( vol.bytes_per_sector & ( vol.bytes_per_sector - 1 ) ) != 0 )
+		return false;
+	// Sectors per cluster above 128 is a negative power of two, for clusters over 64 KiB
+	unsigned int spc = sector[13];
+	if ( spc > 0x80 )
+	{
+		if ( 256 - spc > 31 )
+			return false;
+		vol.cluster_size = (Byte_Value)1 << ( 256 - spc );
+	}
+	else
+	{
+		if ( spc == 0 || ( spc & ( spc - 1 ) ) != 0 )
+			return false;
+		vol.cluster_size = spc * vol.bytes_per_sector;
+	}
+	if ( vol.cluster_size < vol.bytes_per_sector )
+		return false;
+	vol.total_sectors = SuperblockReader::le64( sector + 40 );
+	vol.mft_lcn = SuperblockReader::le64( sector + 48 );
+	vol.clusters = vol.total_sectors * vol.bytes_per_sector / vol.cluster_size;
+	// Clusters per MFT record, or when negative a power of two in bytes
+	signed char cpr = (signed char)sector[64];
+	if ( cpr < 0 )
+	{
+		if ( -cpr < 9 || -cpr > 16 )
+			return false;
+		vol.mft_record_size = (Byte_Value)1 << -cpr;
+	}
+	else
+		vol.mft_record_size = cpr * vol.cluster_size;
+	if (    vol.total_sectors <= 0 || vol.clusters <= 0
+	     || vol.mft_lcn <= 0 || vol.mft_lcn >= vol.clusters
+	     || vol.mft_record_size < 512 || vol.mft_record_size > 64 * KIBIBYTE )
+		return false;
+
+	// The first MFT records are always contiguous at the start of the MFT.
+	std::vector<unsigned char> record( vol.mft_record_size );
+	Byte_Value record_offset = offset + vol.mft_lcn * vol.cluster_size
+	                           + MFT_RECORD_BITMAP * vol.mft_record_size;
+	if ( pread( fd, &record[0], vol.mft_record_size, record_offset ) != vol.mft_record_size )
+		return false;
+	if ( memcmp( &record[0], "FILE", 4 ) != 0 || ! ( SuperblockReader::le16( &record[22] ) & 0x0001 ) )
+		return false;
+	if ( ! apply_fixups( &record[0], vol.mft_record_size ) )
+		return false;
+
+	// Find the unnamed $DATA attribute
+	vol.resident_bitmap.clear();
+	vol.bitmap_runs.clear();
+	const unsigned char * end = &record[0] + vol.mft_record_size;
+	unsigned int attr_offset = SuperblockReader::le16( &record[20] );
+	while ( attr_offset + 24 <= vol.mft_record_size )
+	{
+		const unsigned char * attr = &record[attr_offset];
+		unsigned long type = SuperblockReader::le32( attr );
+		unsigned long length = SuperblockReader::le32( attr + 4 );
+		if ( type == 0xFFFFFFFFUL || length < 24 || (Byte_Value)( attr_offset + length ) > vol.mft_record_size )
+			break;
+		if ( type != 0x80 || attr[9] != 0 )
+		{
+			attr_offset += length;
+			continue;
+		}
+
+		if ( attr[8] == 0 )
+		{
+			// Resident
+			unsigned long value_length = SuperblockReader::le32( attr + 16 );
+			unsigned int value_offset = SuperblockReader::le16( attr + 20 );
+			if ( value_offset + value_length > length )
+				return false;
+			vol.resident_bitmap.assign( attr + value_offset, attr + value_offset + value_length );
+			return (Byte_Value)vol.resident_bitmap.size() * 8 >= vol.clusters;
+		}
+
+		// Non-resident.  Only a $Bitmap described entirely by this record is handled.
+		if ( length < 64 || SuperblockReader::le64( attr + 16 ) != 0 )
+			return false;
+		Byte_Value data_size = SuperblockReader::le64( attr + 48 );
+		if ( data_size * 8 < vol.clusters )
+			return false;
+		if ( ! decode_runs( attr + SuperblockReader::le16( attr + 32 ), std::min( attr + length, end ), vol.bitmap_runs ) )
+			return false;
+		Sector run_clusters = 0;
+		for ( unsigned int i = 0 ; i < vol.bitmap_runs.size() ; i ++ )
+		{
+			if ( vol.bitmap_runs[i].lcn >= 0 && vol.bitmap_runs[i].lcn + vol.bitmap_runs[i].length > vol.clusters )
+				return false;
+			run_clusters += vol.bitmap_runs[i].length;
+		}
+		return run_clusters * vol.cluster_size >= ( vol.clusters + 7 ) / 8;
+	}
+	// $DATA is in an extension record listed in $ATTRIBUTE_LIST
+	return false;
+}
+
+// Undo the update sequence protection of an MFT record.  The last two bytes of every 512
+// byte block were replaced by the update sequence number when the record was written.
+bool ntfs::apply_fixups( unsigned char * record, Byte_Value record_size )
+{
+	unsigned int usa_offset = SuperblockReader::le16( record + 4 );
+	unsigned int usa_count = SuperblockReader::le16( record + 6 );
+	if ( usa_count != record_size / 512 + 1 || usa_offset + usa_count * 2 > record_size )
+		return false;
+
+	const unsigned char * usa = record + usa_offset;
+	for ( unsigned int i = 1 ; i < usa_count ; i ++ )
+	{
+		unsigned char * block_end = record + i * 512 - 2;
+		if ( block_end[0] != usa[0] || block_end[1] != usa[1] )
+			// Torn write
+			return false;
+		block_end[0] = usa[i*2];
+		block_end[1] = usa[i*2+1];
+	}
+	return true;
+}
+
+// Decode a mapping pairs array into cluster runs.  Each run has a header byte giving the
+// sizes of the length and the signed offset from the previous run's LCN which follow.
+// Reference:
+//     NTFS Documentation, Richard Russon and Yuval Fledel,
+//     Concepts - Data Runs
+bool ntfs::decode_runs( const unsigned char * p, const unsigned char * end, std::vector<Run> & runs )
+{
+	Sector lcn = 0;
+	while ( p < end && *p != 0 )
+	{
+		unsigned int length_size = *p & 0x0F;
+		unsigned int offset_size = *p >> 4;
+		p ++;
+		if ( length_size == 0 || length_size > 8 || offset_size > 8 || p + length_size + offset_size > end )
+			return false;
+
+		Sector length = 0;
+		for ( unsigned int i = 0 ; i < length_size ; i ++ )
+			length |= (Sector)p[i] << ( i * 8 );
+		p += length_size;
+		if ( length <= 0 )
+			return false;
+
+		Run run;
+		run.length = length;
+		if ( offset_size == 0 )
+		{
+			run.lcn = -1;
+		}
+		else
+		{
+			// Sign extend the offset from its most significant byte
+			Sector delta = (signed char)p[offset_size-1];
+			for ( int i = offset_size - 2 ; i >= 0 ; i -- )
+				delta = delta * 256 + p[i];
+			p += offset_size;
+			lcn += delta;
+			if ( lcn < 0 )
+				return false;
+			run.lcn = lcn;
+		}
+		runs.push_back( run );
+	}
+	return p < end;
+}
+
+// Read count bytes of $Bitmap from byte pos in the bitmap.  Sparse runs read as zeros.
+bool ntfs::read_bitmap( int fd, Byte_Value offset, const Volume & vol,
+                        Byte_Value pos, unsigned char * buf, Byte_Value count )
+{
+	if ( vol.bitmap_runs.empty() )
+	{
+		if ( pos + count > (Byte_Value)vol.resident_bitmap.size() )
+			return false;
+		memcpy( buf, &vol.resident_bitmap[pos], count );
+		return true;
+	}
+
+	Byte_Value run_pos = 0;
+	for ( unsigned int i = 0 ; i < vol.bitmap_runs.size() && count > 0 ; i ++ )
+	{
+		const Run & run = vol.bitmap_runs[i];
+		Byte_Value run_bytes = run.length * vol.cluster_size;
+		if ( pos < run_pos + run_bytes )
+		{
+			Byte_Value skip = pos - run_pos;
+			Byte_Value n = std::min( count, run_bytes - skip );
+			if ( run.lcn < 0 )
+				memset( buf, 0, n );
+			else if ( pread( fd, buf, n, offset + run.lcn * vol.cluster_size + skip ) != n )
+				return false;
+			buf += n;
+			pos += n;
+			count -= n;
+		}
+		run_pos += run_bytes;
+	}
+	return count == 0;
+}
+
+// Count the set bits in a run of 64-bit words, summing the bits of each word in parallel
+// within its bytes.
+static Sector count_bits( const unsigned char * buf, Byte_Value words )
+{
+	Sector bits = 0;
+	for ( Byte_Value i = 0 ; i < words ; i ++ )
+	{
+		unsigned long long word;
+		memcpy( &word, buf + i * sizeof( word ), sizeof( word ) );
+		word = word - ( ( word >> 1 ) & 0x5555555555555555ULL );
+		word = ( word & 0x3333333333333333ULL ) + ( ( word >> 2 ) & 0x3333333333333333ULL );
+		word = ( word + ( word >> 4 ) ) & 0x0F0F0F0F0F0F0F0FULL;
+		bits += ( word * 0x0101010101010101ULL ) >> 56;
+	}
+	return bits;
+}
+
+// Count the allocated clusters in $Bitmap, ignoring the padding after the last cluster.
+bool ntfs::count_used_clusters( int fd, Byte_Value offset, const Volume & vol, Sector & used_clusters )
+{
+	Byte_Value bitmap_bytes = ( vol.clusters + 7 ) / 8;
+	std::vector<unsigned char> buf( std::min( BITMAP_READ_SIZE, bitmap_bytes ) );
+	used_clusters = 0;
+	for ( Byte_Value pos = 0 ; pos < bitmap_bytes ; pos += BITMAP_READ_SIZE )
+	{
+		Byte_Value count = std::min( BITMAP_READ_SIZE, bitmap_bytes - pos );
+		if ( ! read_bitmap( fd, offset, vol, pos, &buf[0], count ) )
+			return false;
+
+		if ( pos + count == bitmap_bytes && vol.clusters % 8 != 0 )
+			buf[count-1] &= ( 1 << ( vol.clusters % 8 ) ) - 1;
+		Byte_Value words = count / 8;
+		used_clusters += count_bits( &buf[0], words );
+		if ( count % 8 != 0 )
+		{
+			unsigned char tail[8] = { 0 };
+			memcpy( tail, &buf[words*8], count % 8 );
+			used_clusters += count_bits( tail, 1 );
+		}
+	}
+	return true;
+}
+
 void ntfs::resize_progress( OperationDetail *operationdetail )
 {
-	Glib::ustring line = Utils::last_line( output );
+	Glib::ustring line = Utils::last_line( get_command_output() );
 	// Text progress on the LAST LINE looks like " 15.24 percent completed"
 	// NOTE:
 	// Specifying text to match following the last converted variable in *scanf() is
@@ -280,7 +657,7 @@ void ntfs::resize_progress( OperationDetail *operationdetail )
 		operationdetail->run_progressbar( percent, 100.0 );
 	}
 	// Or when finished, on any line, ...
-	else if ( output.find( "Successfully resized NTFS on device" ) != output.npos )
+	else if ( get_command_output().find( "Successfully resized NTFS on device" ) != Glib::ustring::npos )
 	{
 		operationdetail->stop_progressbar();
 	}
@@ -288,7 +665,7 @@ void ntfs::resize_progress( OperationDetail *operationdetail )
 
 void ntfs::clone_progress( OperationDetail *operationdetail )
 {
-	Glib::ustring line = Utils::last_line( output );
+	Glib::ustring line = Utils::last_line( get_command_output() );
 	// Text progress on the LAST LINE looks like " 15.24 progress completed"
 	float percent;
 	if ( line.find( "percent completed" ) != line.npos && sscanf( line.c_str(), "%f", &percent ) == 1 )
@@ -62,6 +62,8 @@ FS reiser4::get_filesystem_support()
 
 void reiser4::set_used_sectors( Partition & partition ) 
 {
+	Glib::ustring output, error;
+	Sector T = -1, N = -1, S = -1;
 	if ( ! Utils::execute_command( "debugfs.reiser4 " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                           )
 	{
@@ -100,6 +102,7 @@ void reiser4::set_used_sectors( Partition & partition )
 
 void reiser4::read_label( Partition & partition )
 {
+	Glib::ustring output, error;
 	if ( ! Utils::execute_command( "debugfs.reiser4 " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                           )
 	{
@@ -125,6 +128,7 @@ void reiser4::read_label( Partition & partition )
 
 void reiser4::read_uuid( Partition & partition )
 {
+	Glib::ustring output, error;
 	if ( ! Utils::execute_command( "debugfs.reiser4 " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                           )
 	{
@@ -18,26 +18,43 @@
 #include "reiserfs.h"
 #include "FileSystem.h"
 #include "Partition.h"
+#include "SuperblockReader.h"
 
 namespace GParted
 {
 
+// Reference:
+//     linux/fs/reiserfs/reiserfs.h, struct reiserfs_super_block
+const SuperblockLayout REISERFS_LAYOUT =
+{
+	64 * KIBIBYTE, 116, SB_LITTLE_ENDIAN,
+	{ 52, 6 }, "ReIsEr",                   // s_magic: ReIsErFs, ReIsEr2Fs or ReIsEr3Fs
+	{ 0, 4 },                              // s_block_count
+	{ 4, 4 },                              // s_free_blocks
+	{ 44, 2 }, SB_BLOCK_SIZE_BYTES,        // s_blocksize
+	{ 100, 16 },                           // s_label
+	{ 84, 16 }                             // s_uuid
+};
+// Magic of the 3.5 format, which has no label or UUID
+const SuperblockField REISERFS_MAGIC_3_5 = { 52, 9 };
+
 FS reiserfs::get_filesystem_support()
 {
 	FS fs( FS_REISERFS );
 
 	fs .busy = FS::GPARTED ;
 
-	if ( ! Glib::find_program_in_path( "debugreiserfs" ) .empty() )
-	{
-		fs .read = GParted::FS::EXTERNAL ;
-		fs .read_label = FS::EXTERNAL ;
-	}
+	// Usage, label and UUID are read from the superblock directly, falling back on
+	// debugreiserfs.
+	fs .read = GParted::FS::EXTERNAL ;
+	fs .read_label = FS::EXTERNAL ;
+	fs .read_uuid = FS::EXTERNAL ;
+
+	debugreiserfs_found = ! Glib::find_program_in_path( "debugreiserfs" ).empty();
 
 	if ( ! Glib::find_program_in_path( "reiserfstune" ) .empty() )
 	{
 		fs .write_label = FS::EXTERNAL ;
-		fs .read_uuid = FS::EXTERNAL ;
 		fs .write_uuid = FS::EXTERNAL ;
 	}
 
@@ -79,6 +96,20 @@ FS reiserfs::get_filesystem_support()
 
 void reiserfs::set_used_sectors( Partition & partition ) 
 {
+	Glib::ustring output, error;
+	Sector T = -1, N = -1, S = -1;
+	SuperblockInfo info;
+	if ( read_superblock( partition.get_path(), info ) )
+	{
+		T = Utils::round( info.block_count * ( info.block_size / double(partition.sector_size) ) );
+		N = Utils::round( info.free_blocks * ( info.block_size / double(partition.sector_size) ) );
+		partition.set_sector_usage( T, N );
+		partition.fs_block_size = info.block_size;
+		return;
+	}
+	if ( ! debugreiserfs_found )
+		return;
+
 	if ( ! Utils::execute_command( "debugreiserfs " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                         )
 	{
@@ -117,6 +148,16 @@ void reiserfs::set_used_sectors( Partition & partition )
 
 void reiserfs::read_label( Partition & partition )
 {
+	Glib::ustring output, error;
+	SuperblockInfo info;
+	if ( read_superblock( partition.get_path(), info ) )
+	{
+		partition.set_filesystem_label( info.label );
+		return;
+	}
+	if ( ! debugreiserfs_found )
+		return;
+
 	if ( ! Utils::execute_command( "debugreiserfs " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                         )
 	{
@@ -141,6 +182,16 @@ bool reiserfs::write_label( const Partition & partition, OperationDetail & opera
 
 void reiserfs::read_uuid( Partition & partition )
 {
+	Glib::ustring output, error;
+	SuperblockInfo info;
+	if ( read_superblock( partition.get_path(), info ) )
+	{
+		partition.uuid = info.uuid;
+		return;
+	}
+	if ( ! debugreiserfs_found )
+		return;
+
 	if ( ! Utils::execute_command( "debugreiserfs " + Glib::shell_quote( partition .get_path() ), output, error, true ) )
 	{
 		partition .uuid = Utils::regexp_label( output, "^UUID:[[:blank:]]*(" RFC4122_NONE_NIL_UUID_REGEXP ")" ) ;
@@ -179,7 +230,7 @@ bool reiserfs::resize( const Partition & partition_new, OperationDetail & operat
 	}
 	const Glib::ustring resize_cmd = "echo y | resize_reiserfs" + size +
 	                                 " " + Glib::shell_quote( partition_new.get_path() );
-	exit_status = execute_command( "sh -c " + Glib::shell_quote( resize_cmd ), operationdetail );
+	int exit_status = execute_command( "sh -c " + Glib::shell_quote( resize_cmd ), operationdetail );
 	// NOTE: Neither resize_reiserfs manual page nor the following commit, which first
 	// added this check, indicate why exit status 1 also indicates success.  Commit
 	// from 2006-05-23:
@@ -192,12 +243,29 @@ bool reiserfs::resize( const Partition & partition_new, OperationDetail & operat
 
 bool reiserfs::check_repair( const Partition & partition, OperationDetail & operationdetail )
 {
-	exit_status = execute_command( "reiserfsck --yes --fix-fixable --quiet " +
-	                               Glib::shell_quote( partition.get_path() ),
-	                               operationdetail, EXEC_CANCEL_SAFE );
+	int exit_status = execute_command( "reiserfsck --yes --fix-fixable --quiet " +
+	                                   Glib::shell_quote( partition.get_path() ),
+	                                   operationdetail, EXEC_CANCEL_SAFE );
 	bool success = ( exit_status == 0 || exit_status == 1 );
 	set_status( operationdetail, success );
 	return success;
 }
 
+//Private methods
+
+bool reiserfs::read_superblock( const Glib::ustring & path, SuperblockInfo & info )
+{
+	SuperblockReader reader( REISERFS_LAYOUT.byte_order );
+	if (    ! reader.read( path, REISERFS_LAYOUT.offset, REISERFS_LAYOUT.size )
+	     || ! reader.decode( REISERFS_LAYOUT, info )                          )
+		return false;
+
+	if ( reader.matches( REISERFS_MAGIC_3_5, "ReIsErFs" ) )
+	{
+		info.label.clear();
+		info.uuid.clear();
+	}
+	return true;
+}
+
 } //GParted
@@ -45,6 +45,7 @@ FS udf::get_filesystem_support()
 		fs.create_with_label = FS::EXTERNAL;
 
 		// Detect old mkudffs prior to version 1.1 by lack of --label option.
+		Glib::ustring output, error;
 		Utils::execute_command( "mkudffs --help", output, error, true );
 		old_mkudffs = Utils::regexp_label( output + error, "--label" ).empty();
 	}
@@ -75,8 +76,14 @@ FS_Limits udf::get_filesystem_limits( const Partition & partition ) const
 		return FS_Limits( MIN_UDF_BLOCKS * partition.sector_size  , MAX_UDF_BLOCKS * partition.sector_size );
 }
 
+// Usage is read with udfinfo rather than natively.  The free space count in the Logical
+// Volume Integrity Descriptor is only correct when the volume was closed cleanly,
+// otherwise the space bitmaps or tables, and for UDF 2.50+ the metadata partition, have
+// to be walked, which would duplicate most of udfinfo.
 void udf::set_used_sectors( Partition & partition )
 {
+	Glib::ustring output, error;
+	int exit_status;
 	exit_status = Utils::execute_command( "udfinfo --utf8 " + Glib::shell_quote( partition.get_path() ),
 	                                      output, error, true );
 	if ( exit_status != 0 )
@@ -128,6 +135,7 @@ void udf::set_used_sectors( Partition & partition )
 
 void udf::read_label( Partition & partition )
 {
+	Glib::ustring output, error;
 	if ( ! Utils::execute_command( "udflabel --utf8 " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                           )
 	{
@@ -152,6 +160,7 @@ bool udf::write_label( const Partition & partition, OperationDetail & operationd
 
 void udf::read_uuid( Partition & partition )
 {
+	Glib::ustring output, error;
 	if ( ! Utils::execute_command( "udfinfo --utf8 " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                          )
 	{
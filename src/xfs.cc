@@ -19,29 +19,68 @@
 #include "FileSystem.h"
 #include "OperationDetail.h"
 #include "Partition.h"
+#include "SuperblockReader.h"
 #include "Utils.h"
 
 #include <glibmm/ustring.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <uuid/uuid.h>
 
 namespace GParted
 {
 
+// Superblock and AG free space header fields used, all big endian.
+// Reference:
+//     XFS Algorithms & Data Structures, 3rd Edition,
+//     Allocation Groups - Superblocks and AG Free Space Management
+const size_t XFS_SB_SIZE = 512;
+const unsigned long XFS_SB_MAGIC = 0x58465342;  // "XFSB"
+
+const size_t XFS_SB_MAGICNUM      = 0;
+const size_t XFS_SB_BLOCKSIZE     = 4;
+const size_t XFS_SB_DBLOCKS       = 8;
+const size_t XFS_SB_UUID          = 32;
+const size_t XFS_SB_AGBLOCKS      = 84;
+const size_t XFS_SB_AGCOUNT       = 88;
+const size_t XFS_SB_VERSIONNUM    = 100;
+const size_t XFS_SB_SECTSIZE      = 102;
+const size_t XFS_SB_FNAME         = 108;
+const size_t XFS_SB_INPROGRESS    = 126;
+const size_t XFS_SB_FDBLOCKS      = 144;
+const size_t XFS_SB_FEATURES2     = 200;
+
+const unsigned int  XFS_SB_VERSION_NUMBITS     = 0x000F;
+const unsigned int  XFS_SB_VERSION_MOREBITSBIT = 0x8000;
+const unsigned long XFS_SB_VERSION2_LAZYSBCOUNTBIT = 0x00000002;
+
+const unsigned long XFS_AGF_MAGIC = 0x58414746;  // "XAGF"
+
+const size_t XFS_AGF_MAGICNUM     = 0;
+const size_t XFS_AGF_SEQNO        = 8;
+const size_t XFS_AGF_FLCOUNT      = 48;
+const size_t XFS_AGF_FREEBLKS     = 52;
+const size_t XFS_AGF_BTREEBLKS    = 60;
+
 FS xfs::get_filesystem_support()
 {
 	FS fs( FS_XFS );
 
 	fs .busy = FS::GPARTED ;
 
-	if ( ! Glib::find_program_in_path( "xfs_db" ) .empty() ) 	
-	{
-		fs .read = GParted::FS::EXTERNAL ;
-		fs .read_label = FS::EXTERNAL ;
-	}
+	// Usage, label and UUID are read from the superblock directly, falling back on
+	// xfs_db and xfs_admin.
+	fs .read = GParted::FS::EXTERNAL ;
+	fs .read_label = FS::EXTERNAL ;
+	fs .read_uuid = FS::EXTERNAL ;
 
-	if ( ! Glib::find_program_in_path( "xfs_admin" ) .empty() ) 	
+	xfs_db_found = ! Glib::find_program_in_path( "xfs_db" ).empty();
+
+	xfs_admin_found = ! Glib::find_program_in_path( "xfs_admin" ).empty();
+	if ( xfs_admin_found )
 	{
 		fs .write_label = FS::EXTERNAL ;
-		fs .read_uuid = FS::EXTERNAL ;
 		fs .write_uuid = FS::EXTERNAL ;
 	}
 
@@ -88,6 +127,22 @@ FS xfs::get_filesystem_support()
 
 void xfs::set_used_sectors( Partition & partition ) 
 {
+	Glib::ustring output, error;
+	Sector T = -1, N = -1, S = -1;
+	Superblock sb;
+	if ( read_superblock( partition.get_path(), sb ) )
+	{
+		T = sb.block_count;
+		N = sb.free_blocks;
+		S = sb.block_size;
+		partition.set_sector_usage( Utils::round( T * ( S / double(partition.sector_size) ) ),
+		                            Utils::round( N * ( S / double(partition.sector_size) ) ) );
+		partition.fs_block_size = S;
+		return;
+	}
+	if ( ! xfs_db_found )
+		return;
+
 	if ( ! Utils::execute_command( "xfs_db -c 'sb 0' -c 'print blocksize' -c 'print dblocks'"
 	                               " -c 'print fdblocks' -r " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                                   )
@@ -129,6 +184,16 @@ void xfs::set_used_sectors( Partition & partition )
 
 void xfs::read_label( Partition & partition )
 {
+	Glib::ustring output, error;
+	Superblock sb;
+	if ( read_superblock( partition.get_path(), sb ) )
+	{
+		partition.set_filesystem_label( sb.label );
+		return;
+	}
+	if ( ! xfs_db_found )
+		return;
+
 	if ( ! Utils::execute_command( "xfs_db -r -c 'label' " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                                )
 	{
@@ -157,6 +222,16 @@ bool xfs::write_label( const Partition & partition, OperationDetail & operationd
 
 void xfs::read_uuid( Partition & partition )
 {
+	Glib::ustring output, error;
+	Superblock sb;
+	if ( read_superblock( partition.get_path(), sb ) )
+	{
+		partition.uuid = sb.uuid;
+		return;
+	}
+	if ( ! xfs_admin_found )
+		return;
+
 	if ( ! Utils::execute_command( "xfs_admin -u " + Glib::shell_quote( partition.get_path() ),
 	                               output, error, true )                                        )
 	{
@@ -248,6 +323,7 @@ bool xfs::copy( const Partition & src_part,
 	// Get source FS used bytes, needed in progress update calculation
 	Byte_Value fs_size;
 	Byte_Value fs_free;
+	Glib::ustring error;
 	if ( Utils::get_mounted_filesystem_usage( src_mount_point, fs_size, fs_free, error ) == 0 )
 		src_used = fs_size - fs_free;
 	else
@@ -291,6 +367,92 @@ bool xfs::check_repair( const Partition & partition, OperationDetail & operation
 
 //Private methods
 
+// Read the primary superblock, as xfs_db 'sb 0' does.  Returns false when it isn't a
+// sane XFS superblock so that the tools are used instead.
+bool xfs::read_superblock( const Glib::ustring & path, Superblock & sb )
+{
+	int fd = open( path.c_str(), O_RDONLY );
+	if ( fd < 0 )
+		return false;
+	unsigned char buf[XFS_SB_SIZE];
+	bool success = pread( fd, buf, sizeof( buf ), 0 ) == (ssize_t)sizeof( buf );
+	if ( ! success || SuperblockReader::be32( buf + XFS_SB_MAGICNUM ) != XFS_SB_MAGIC )
+	{
+		close( fd );
+		return false;
+	}
+
+	unsigned int version = SuperblockReader::be16( buf + XFS_SB_VERSIONNUM ) & XFS_SB_VERSION_NUMBITS;
+	unsigned long block_size = SuperblockReader::be32( buf + XFS_SB_BLOCKSIZE );
+	if (    ( version != 4 && version != 5 )
+	     || buf[XFS_SB_INPROGRESS] != 0
+	     || block_size < 512 || block_size > 65536 || ( block_size & ( block_size - 1 ) ) != 0 )
+	{
+		close( fd );
+		return false;
+	}
+	sb.block_size = block_size;
+	sb.block_count = SuperblockReader::be64( buf + XFS_SB_DBLOCKS );
+	sb.free_blocks = SuperblockReader::be64( buf + XFS_SB_FDBLOCKS );
+
+	// With lazy superblock counters the free block count in the superblock is only
+	// brought up to date when the file system is cleanly unmounted.  Sum the counts
+	// in the AG headers instead, which are always current on disk, as the kernel
+	// does at mount.
+	bool lazy_count = version == 5 ||
+	                  ( ( SuperblockReader::be16( buf + XFS_SB_VERSIONNUM ) & XFS_SB_VERSION_MOREBITSBIT ) &&
+	                    ( SuperblockReader::be32( buf + XFS_SB_FEATURES2 ) & XFS_SB_VERSION2_LAZYSBCOUNTBIT ) );
+	Sector ag_free_blocks;
+	if ( lazy_count && sum_ag_free_blocks( fd, buf, ag_free_blocks ) )
+		sb.free_blocks = ag_free_blocks;
+	close( fd );
+	if ( sb.block_count <= 0 || sb.free_blocks < 0 || sb.free_blocks > sb.block_count )
+		return false;
+
+	const char * fname = reinterpret_cast<const char *>( buf + XFS_SB_FNAME );
+	sb.label = Glib::ustring( fname, strnlen( fname, 12 ) );
+
+	// As when matching xfs_admin output, exclude the Nil UUID and others with a zero
+	// version number.
+	sb.uuid.clear();
+	if ( buf[XFS_SB_UUID + 6] >> 4 != 0 )
+	{
+		char uuid_str[UUID_STRING_LENGTH+1];
+		uuid_unparse_lower( buf + XFS_SB_UUID, uuid_str );
+		sb.uuid = uuid_str;
+	}
+
+	return true;
+}
+
+// Sum the free blocks recorded in the AGF header of every allocation group.  The AGF is
+// in the second sector of each allocation group.  Free list and free space btree
+// blocks are counted as free, matching the superblock counter.
+bool xfs::sum_ag_free_blocks( int fd, const unsigned char * sb_buf, Sector & free_blocks )
+{
+	Byte_Value block_size = SuperblockReader::be32( sb_buf + XFS_SB_BLOCKSIZE );
+	Sector ag_blocks = SuperblockReader::be32( sb_buf + XFS_SB_AGBLOCKS );
+	unsigned long ag_count = SuperblockReader::be32( sb_buf + XFS_SB_AGCOUNT );
+	unsigned int sector_size = SuperblockReader::be16( sb_buf + XFS_SB_SECTSIZE );
+	if ( ag_blocks == 0 || ag_count == 0 || sector_size < 512 || sector_size > block_size )
+		return false;
+
+	unsigned char agf[XFS_SB_SIZE];
+	free_blocks = 0;
+	for ( unsigned long agno = 0 ; agno < ag_count ; agno ++ )
+	{
+		Byte_Value offset = agno * ag_blocks * block_size + sector_size;
+		if ( pread( fd, agf, sizeof( agf ), offset ) != (ssize_t)sizeof( agf ) )
+			return false;
+		if ( SuperblockReader::be32( agf + XFS_AGF_MAGICNUM ) != XFS_AGF_MAGIC || SuperblockReader::be32( agf + XFS_AGF_SEQNO ) != agno )
+			return false;
+		free_blocks += (Sector)SuperblockReader::be32( agf + XFS_AGF_FREEBLKS )
+		             + SuperblockReader::be32( agf + XFS_AGF_FLCOUNT )
+		             + SuperblockReader::be32( agf + XFS_AGF_BTREEBLKS );
+	}
+	return true;
+}
+
 // Report progress of XFS copy.  Monitor destination FS used bytes and track against
 // recorded source FS used bytes.
 bool xfs::copy_progress( OperationDetail * operationdetail )
@@ -304,6 +466,7 @@ bool xfs::copy_progress( OperationDetail * operationdetail )
 	Byte_Value fs_size;
 	Byte_Value fs_free;
 	Byte_Value dst_used;
+	Glib::ustring error;
 	if ( Utils::get_mounted_filesystem_usage( dest_mount_point, fs_size, fs_free, error ) != 0 )
 	{
 		operationdetail->stop_progressbar();
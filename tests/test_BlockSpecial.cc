@@ -459,4 +459,93 @@ TEST( BlockSpecialTest, OperatorLessThanTwoDifferentBlockDevicesMinorNumbers )
 	EXPECT_TRUE( bs1 < bs2 ) << ON_FAILURE_WHERE( bs1, bs2 );
 }
 
+TEST( BlockSpecialIndexTest, FindBlockDevicesByNumbers )
+{
+	// Test block devices are found by major, minor numbers, including by another
+	// name for the same device, and the first of duplicates is found.
+	BlockSpecial::clear_cache();
+	BlockSpecial::register_block_special( "/dummy_block", 4, 1 );
+	BlockSpecial::register_block_special( "/dummy_link", 4, 1 );
+	BlockSpecial::register_block_special( "/dummy_other", 4, 2 );
+	BlockSpecial::register_block_special( "/dummy_missing", 4, 3 );
+	BlockSpecialIndex index;
+	index.push_back( BlockSpecial( "/dummy_other" ) );
+	index.push_back( BlockSpecial( "/dummy_block" ) );
+	index.push_back( BlockSpecial( "/dummy_link" ) );
+	EXPECT_EQ( 3U, index.size() );
+
+	unsigned int position = 99;
+	EXPECT_TRUE( index.find( BlockSpecial( "/dummy_link" ), position ) );
+	EXPECT_EQ( 1U, position );
+	EXPECT_TRUE( index.find( BlockSpecial( "/dummy_other" ), position ) );
+	EXPECT_EQ( 0U, position );
+	EXPECT_FALSE( index.find( BlockSpecial( "/dummy_missing" ), position ) );
+
+	index.clear();
+	EXPECT_EQ( 0U, index.size() );
+	EXPECT_FALSE( index.find( BlockSpecial( "/dummy_block" ), position ) );
+}
+
+TEST( BlockSpecialIndexTest, FindNonBlockSpecialByName )
+{
+	// Test non-block special files are found by name, including a block device
+	// entry of the same name, the same as operator==().
+	BlockSpecial::clear_cache();
+	BlockSpecial::register_block_special( "/dummy_file", 0, 0 );
+	BlockSpecial::register_block_special( "/dummy_block", 4, 1 );
+	BlockSpecialIndex index;
+	index.push_back( BlockSpecial( "/dummy_block" ) );
+	index.push_back( BlockSpecial( "/dummy_file" ) );
+
+	unsigned int position = 99;
+	EXPECT_TRUE( index.find( BlockSpecial( "/dummy_file" ), position ) );
+	EXPECT_EQ( 1U, position );
+
+	BlockSpecial bs;
+	bs.m_name = "/dummy_block";
+	EXPECT_TRUE( index.find( bs, position ) );
+	EXPECT_EQ( 0U, position );
+}
+
+// Return "/dummy_blockN" for number N.
+static std::string numbered_name( unsigned int number )
+{
+	char name[32];
+	snprintf( name, sizeof( name ), "/dummy_block%u", number );
+	return name;
+}
+
+TEST( BlockSpecialIndexTest, FindAfterGrowing )
+{
+	// Test every entry is still found after the index has grown past its initial
+	// number of buckets.
+	BlockSpecial::clear_cache();
+	BlockSpecialIndex index;
+	for ( unsigned int i = 0 ; i < 1000 ; i ++ )
+	{
+		BlockSpecial bs;
+		bs.m_name = numbered_name( i );
+		bs.m_major = 8 + i / 256;
+		bs.m_minor = i % 256;
+		index.push_back( bs );
+	}
+	EXPECT_EQ( 1000U, index.size() );
+
+	for ( unsigned int i = 0 ; i < 1000 ; i ++ )
+	{
+		BlockSpecial bs;
+		bs.m_major = 8 + i / 256;
+		bs.m_minor = i % 256;
+		unsigned int position = 9999;
+		EXPECT_TRUE( index.find( bs, position ) );
+		EXPECT_EQ( i, position );
+
+		BlockSpecial by_name;
+		by_name.m_name = numbered_name( i );
+		position = 9999;
+		EXPECT_TRUE( index.find( by_name, position ) );
+		EXPECT_EQ( i, position );
+	}
+}
+
 }  // namespace GParted
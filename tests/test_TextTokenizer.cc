@@ -0,0 +1,117 @@
+/* Copyright (C) 2018 Mike Fleetwood
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Test StringView and TextTokenizer
+ */
+
+#include "TextTokenizer.h"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+namespace GParted
+{
+
+// Tokenize the whole of text, returning the tokens as strings.
+static std::vector<std::string> all_tokens( const std::string & text, const char * delimiters,
+                                            bool skip_empty )
+{
+	std::vector<std::string> tokens;
+	TextTokenizer tokenizer( text, delimiters, skip_empty );
+	StringView token;
+	while ( tokenizer.next( token ) )
+		tokens.push_back( token.str() );
+	return tokens;
+}
+
+TEST( TextTokenizerTest, SplitKeepsEmptyTokens )
+{
+	// Same results as the Utils::split() examples.
+	EXPECT_EQ( 0U, all_tokens( "", ":", false ).size() );
+
+	std::vector<std::string> tokens = all_tokens( "a", ":", false );
+	ASSERT_EQ( 1U, tokens.size() );
+	EXPECT_EQ( "a", tokens[0] );
+
+	tokens = all_tokens( "::", ":", false );
+	ASSERT_EQ( 3U, tokens.size() );
+	EXPECT_EQ( "", tokens[0] );
+	EXPECT_EQ( "", tokens[1] );
+	EXPECT_EQ( "", tokens[2] );
+
+	tokens = all_tokens( ":a::bb", ":", false );
+	ASSERT_EQ( 4U, tokens.size() );
+	EXPECT_EQ( "", tokens[0] );
+	EXPECT_EQ( "a", tokens[1] );
+	EXPECT_EQ( "", tokens[2] );
+	EXPECT_EQ( "bb", tokens[3] );
+}
+
+TEST( TextTokenizerTest, TokenizeSkipsEmptyTokens )
+{
+	// Same results as the Utils::tokenize() examples.
+	EXPECT_EQ( 0U, all_tokens( "", ":", true ).size() );
+	EXPECT_EQ( 0U, all_tokens( "::", ":", true ).size() );
+
+	std::vector<std::string> tokens = all_tokens( ":a::bb", ":", true );
+	ASSERT_EQ( 2U, tokens.size() );
+	EXPECT_EQ( "a", tokens[0] );
+	EXPECT_EQ( "bb", tokens[1] );
+}
+
+TEST( TextTokenizerTest, RestIsUntokenizedText )
+{
+	std::string text = "   8        1     524288 sda1\n";
+	TextTokenizer tokenizer( text, " \t\n", true );
+	StringView token;
+	ASSERT_TRUE( tokenizer.next( token ) );
+	EXPECT_EQ( "8", token.str() );
+	EXPECT_EQ( "       1     524288 sda1\n", tokenizer.rest().str() );
+}
+
+TEST( StringViewTest, Trim )
+{
+	EXPECT_EQ( "a b", StringView( " \ta b \r\n" ).trim().str() );
+	EXPECT_TRUE( StringView( " \t\r\n" ).trim().empty() );
+	EXPECT_TRUE( StringView( "" ).trim().empty() );
+}
+
+TEST( StringViewTest, Find )
+{
+	StringView sv( "devid 1 size 2.00GiB used 1.00GiB path /dev/sdb1" );
+	EXPECT_EQ( 0U, sv.find( "devid" ) );
+	EXPECT_EQ( 34U, sv.find( "path" ) );
+	EXPECT_EQ( StringView::npos, sv.find( "path", 35 ) );
+	EXPECT_EQ( StringView::npos, sv.find( "missing" ) );
+	EXPECT_TRUE( sv.starts_with( "devid " ) );
+	EXPECT_FALSE( sv.starts_with( "size" ) );
+}
+
+TEST( StringViewTest, ToNumber )
+{
+	unsigned long long num = 0;
+	EXPECT_TRUE( StringView( "524288" ).to_number( num ) );
+	EXPECT_EQ( 524288ULL, num );
+	EXPECT_TRUE( StringView( "18446744073709551615" ).to_number( num ) );
+	EXPECT_EQ( 18446744073709551615ULL, num );
+	EXPECT_FALSE( StringView( "18446744073709551616" ).to_number( num ) );
+	EXPECT_FALSE( StringView( "" ).to_number( num ) );
+	EXPECT_FALSE( StringView( "12a" ).to_number( num ) );
+	EXPECT_FALSE( StringView( "-1" ).to_number( num ) );
+}
+
+}  // namespace GParted
@@ -0,0 +1,101 @@
+/* Copyright (C) 2018 Mike Fleetwood
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Test the regular expression matching in Utils
+ */
+
+#include "Utils.h"
+#include "GParted_Core.h"
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <vector>
+#include <glibmm.h>
+
+namespace GParted
+{
+
+// Utils refers to the main thread, but this test doesn't link the rest of GParted_Core.
+Glib::Thread * GParted_Core::mainthread = NULL;
+
+TEST( RegexpMatchTest, ReturnsEveryCapture )
+{
+	std::vector<Glib::ustring> captures;
+	EXPECT_TRUE( Utils::regexp_match( "   8        1    1048576 sda1",
+	                                  "^ *([0-9]+) +([0-9]+) +[0-9]+ +(.*)$", captures ) );
+	ASSERT_EQ( 3U, captures.size() );
+	EXPECT_EQ( "8", captures[0] );
+	EXPECT_EQ( "1", captures[1] );
+	EXPECT_EQ( "sda1", captures[2] );
+}
+
+TEST( RegexpMatchTest, UnmatchedCaptureIsEmpty )
+{
+	std::vector<Glib::ustring> captures;
+	EXPECT_TRUE( Utils::regexp_match( "size=100", "^size=([0-9]+)( used=([0-9]+))?", captures ) );
+	ASSERT_EQ( 3U, captures.size() );
+	EXPECT_EQ( "100", captures[0] );
+	EXPECT_EQ( "", captures[1] );
+	EXPECT_EQ( "", captures[2] );
+}
+
+TEST( RegexpMatchTest, FirstMatchOnly )
+{
+	// Patterns are multiline so ^ and $ match at each line.
+	std::vector<Glib::ustring> captures;
+	EXPECT_TRUE( Utils::regexp_match( "a=1 b=2\na=3 b=4\n", "^a=([0-9]) b=([0-9])$", captures ) );
+	ASSERT_EQ( 2U, captures.size() );
+	EXPECT_EQ( "1", captures[0] );
+	EXPECT_EQ( "2", captures[1] );
+}
+
+TEST( RegexpMatchTest, NoMatchClearsCaptures )
+{
+	std::vector<Glib::ustring> captures( 1, "stale" );
+	EXPECT_FALSE( Utils::regexp_match( "no numbers here", "([0-9]+) ([0-9]+)", captures ) );
+	EXPECT_EQ( 0U, captures.size() );
+}
+
+TEST( RegexpMatchTest, AgreesWithRegexpLabel )
+{
+	// More patterns than the registry holds, so some are compiled again after being
+	// dropped.
+	for ( unsigned int i = 0 ; i < 300 ; i ++ )
+	{
+		Glib::ustring text = "sd" + Utils::num_to_str( i ) + " " + Utils::num_to_str( i * 2 );
+		Glib::ustring pattern = "^(sd" + Utils::num_to_str( i ) + ") ([0-9]+)$";
+		std::vector<Glib::ustring> captures;
+		ASSERT_TRUE( Utils::regexp_match( text, pattern, captures ) );
+		ASSERT_EQ( 2U, captures.size() );
+		EXPECT_EQ( Utils::regexp_label( text, pattern ), captures[0] );
+		EXPECT_EQ( Utils::num_to_str( i * 2 ), captures[1] );
+	}
+}
+
+}  // namespace GParted
+
+// Custom Google Test main() which also initialises the Glib threading system for
+// distributions with glib/glibmm before version 2.32, as the regular expression
+// registry is protected by a mutex.
+int main( int argc, char **argv )
+{
+	printf("Running main() from %s\n", __FILE__ );
+	testing::InitGoogleTest( &argc, argv );
+
+	Glib::thread_init();
+
+	return RUN_ALL_TESTS();
+}